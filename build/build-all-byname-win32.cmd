@@ -26,6 +26,14 @@ if errorlevel 1 goto error
 %NMAKE_CMD% /f %MAKEFILE_NAME%.Release
 if errorlevel 1 goto error
 
+echo.
+echo.Building stdext benchmarks...
+cd ..\stdext-bench
+%NMAKE_CMD% /f %MAKEFILE_NAME%.Debug
+if errorlevel 1 goto error
+%NMAKE_CMD% /f %MAKEFILE_NAME%.Release
+if errorlevel 1 goto error
+
 popd
 exit /b 0
 
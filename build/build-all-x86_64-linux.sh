@@ -35,6 +35,14 @@ check_last $?
 make $mkargs -f Makefile-x86_64-linux.Release
 check_last $?
 
+echo
+echo "Building stdext benchmarks..."
+cd ../stdext-bench
+make $mkargs -f Makefile-x86_64-linux.Debug
+check_last $?
+make $mkargs -f Makefile-x86_64-linux.Release
+check_last $?
+
 popd > /dev/null
 echo "All builds done"
 
@@ -20,6 +20,14 @@ if errorlevel 1 goto error
 "%QMAKE_EXE%" stdext-test.pro -spec win32-msvc "CONFIG+=stdext_gen_makefile" -nocache -nodepend
 if errorlevel 1 goto error
 
+echo.
+echo.Generating stdext benchmarks makefiles...
+cd ..\stdext-bench
+"%QMAKE_EXE%" stdext-bench.pro -spec win32-msvc "CONFIG+=debug stdext_gen_makefile" -nocache -nodepend
+if errorlevel 1 goto error
+"%QMAKE_EXE%" stdext-bench.pro -spec win32-msvc "CONFIG+=stdext_gen_makefile" -nocache -nodepend
+if errorlevel 1 goto error
+
 popd
 exit /b 0
 
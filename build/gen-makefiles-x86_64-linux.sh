@@ -34,6 +34,15 @@ qmake stdext-test.pro -spec $compiler_spec "CONFIG+=stdext_gen_makefile" -nocach
 check_last $?
 echo "Done"
 
+echo
+echo "Generating stdext benchmarks makefiles..."
+cd ../stdext-bench
+qmake stdext-bench.pro -spec $compiler_spec "CONFIG+=debug stdext_gen_makefile" -nocache -nodepend
+check_last $?
+qmake stdext-bench.pro -spec $compiler_spec "CONFIG+=stdext_gen_makefile" -nocache -nodepend
+check_last $?
+echo "Done"
+
 echo "All makefiles done"
 
 popd > /dev/null
@@ -1,5 +1,7 @@
 TEMPLATE = subdirs
 SUBDIRS = stdext \
-        stdext-test
+        stdext-test \
+        stdext-bench
 
 stdext-test.depends = stdext
+stdext-bench.depends = stdext
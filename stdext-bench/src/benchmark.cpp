@@ -0,0 +1,137 @@
+/*
+ C++ standard library extensions
+ (c) 2001-2020 Serguei Tarassov (see license.txt)
+ */
+#include "benchmark.h"
+#include <iomanip>
+#include <sstream>
+#include "strutils.h"
+
+using namespace std;
+
+namespace stdext::bench
+{
+
+std::atomic<uint64_t> alloc_counter::m_count(0);
+std::atomic<uint64_t> alloc_counter::m_bytes(0);
+
+/*
+ * bench_result class
+ */
+double bench_result::mb_per_s() const noexcept
+{
+    if (total_mcs <= 0)
+        return 0;
+    // Bytes per microsecond equal to MB per second
+    return static_cast<double>(bytes) * iterations / total_mcs;
+}
+
+double bench_result::mcs_per_iteration() const noexcept
+{
+    return iterations > 0 ? static_cast<double>(total_mcs) / iterations : 0;
+}
+
+/*
+ * bench_runner class
+ */
+void bench_runner::context::start()
+{
+    m_start_allocs = alloc_counter::count();
+    m_start_alloc_bytes = alloc_counter::bytes();
+    m_timer.start("");
+}
+
+void bench_runner::context::stop()
+{
+    m_timer.stop();
+    m_allocs += alloc_counter::count() - m_start_allocs;
+    m_alloc_bytes += alloc_counter::bytes() - m_start_alloc_bytes;
+}
+
+bool bench_runner::is_enabled(const std::string& name) const
+{
+    return m_filter.empty() || name.find(m_filter) != string::npos;
+}
+
+void bench_runner::run(const std::string& name,
+                       const std::string& corpus,
+                       const std::string& policy,
+                       const uint64_t bytes,
+                       const uint64_t chars,
+                       bench_func_t func)
+{
+    string full_name = name + "/" + corpus + "/" + policy;
+    if (!is_enabled(full_name))
+        return;
+    // Warm up run is not measured
+    testutils::timer warm_up_timer(full_name);
+    context warm_up(warm_up_timer);
+    func(warm_up);
+    testutils::timer t(full_name);
+    context ctx(t);
+    for (int i = 0; i < m_iterations; i++)
+        func(ctx);
+    bench_result result;
+    result.name = name;
+    result.corpus = corpus;
+    result.policy = policy;
+    result.bytes = bytes;
+    result.chars = chars;
+    result.iterations = m_iterations;
+    result.total_mcs = t.total_duration_mcs();
+    result.allocs = ctx.m_allocs / m_iterations;
+    result.alloc_bytes = ctx.m_alloc_bytes / m_iterations;
+    m_results.push_back(result);
+    if (m_verbose)
+        cerr << full_name << ": " << fixed << setprecision(2) << result.mb_per_s() << " MB/s" << endl;
+}
+
+void bench_runner::write(std::ostream& stream, const output_format format) const
+{
+    switch (format)
+    {
+    case output_format::json:
+        write_json(stream);
+        break;
+    case output_format::csv:
+    default:
+        write_csv(stream);
+    }
+}
+
+void bench_runner::write_csv(std::ostream& stream) const
+{
+    stream << "name,corpus,policy,bytes,chars,iterations,total_mcs,mcs_per_iteration,mb_per_s,allocs,alloc_bytes" << endl;
+    for (const bench_result& r : m_results)
+    {
+        stream << r.name << ',' << r.corpus << ',' << r.policy << ','
+               << r.bytes << ',' << r.chars << ',' << r.iterations << ','
+               << r.total_mcs << ',' << fixed << setprecision(1) << r.mcs_per_iteration() << ','
+               << setprecision(3) << r.mb_per_s() << ','
+               << r.allocs << ',' << r.alloc_bytes << endl;
+    }
+}
+
+void bench_runner::write_json(std::ostream& stream) const
+{
+    stream << "[";
+    for (size_t i = 0; i < m_results.size(); i++)
+    {
+        const bench_result& r = m_results[i];
+        stream << (i > 0 ? ",\n" : "\n")
+               << "  {\"name\":\"" << r.name
+               << "\",\"corpus\":\"" << r.corpus
+               << "\",\"policy\":\"" << r.policy
+               << "\",\"bytes\":" << r.bytes
+               << ",\"chars\":" << r.chars
+               << ",\"iterations\":" << r.iterations
+               << ",\"total_mcs\":" << r.total_mcs
+               << ",\"mcs_per_iteration\":" << fixed << setprecision(1) << r.mcs_per_iteration()
+               << ",\"mb_per_s\":" << setprecision(3) << r.mb_per_s()
+               << ",\"allocs\":" << r.allocs
+               << ",\"alloc_bytes\":" << r.alloc_bytes << "}";
+    }
+    stream << "\n]" << endl;
+}
+
+}
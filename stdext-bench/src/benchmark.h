@@ -0,0 +1,113 @@
+#pragma once
+/*
+ C++ standard library extensions
+ (c) 2001-2020 Serguei Tarassov (see license.txt)
+
+ Benchmark runner
+ */
+#include <string>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include "testutils.h"
+
+namespace stdext::bench
+{
+    /*
+     * Global allocation counters, incremented by replaced operator new
+     */
+    class alloc_counter
+    {
+    public:
+        static void add(const std::size_t size) noexcept
+        {
+            m_count.fetch_add(1, std::memory_order_relaxed);
+            m_bytes.fetch_add(size, std::memory_order_relaxed);
+        }
+        static uint64_t count() noexcept { return m_count.load(std::memory_order_relaxed); }
+        static uint64_t bytes() noexcept { return m_bytes.load(std::memory_order_relaxed); }
+    private:
+        static std::atomic<uint64_t> m_count;
+        static std::atomic<uint64_t> m_bytes;
+    };
+
+
+    class bench_result
+    {
+    public:
+        std::string name;
+        std::string corpus;
+        std::string policy;
+        uint64_t bytes = 0;         // processed input or output size per iteration
+        uint64_t chars = 0;
+        int iterations = 0;
+        int64_t total_mcs = 0;
+        uint64_t allocs = 0;        // per iteration
+        uint64_t alloc_bytes = 0;   // per iteration
+    public:
+        double mb_per_s() const noexcept;
+        double mcs_per_iteration() const noexcept;
+    };
+
+
+    enum class output_format
+    {
+        csv,
+        json
+    };
+
+    class bench_runner
+    {
+    public:
+        // Runs once per iteration, only the time between start() and stop() calls is measured
+        class context
+        {
+            friend class bench_runner;
+        public:
+            void start();
+            void stop();
+        private:
+            context(testutils::timer& t) : m_timer(t) {}
+        private:
+            testutils::timer& m_timer;
+            uint64_t m_allocs = 0;
+            uint64_t m_alloc_bytes = 0;
+            uint64_t m_start_allocs = 0;
+            uint64_t m_start_alloc_bytes = 0;
+        };
+        typedef std::function<void(context&)> bench_func_t;
+    public:
+        bench_runner() {}
+        bench_runner(const bench_runner&) = delete;
+        bench_runner& operator=(const bench_runner&) = delete;
+        bench_runner(bench_runner&&) = delete;
+        bench_runner& operator=(bench_runner&&) = delete;
+    public:
+        int iterations() const noexcept { return m_iterations; }
+        void iterations(const int value) noexcept { m_iterations = value > 0 ? value : 1; }
+        const std::string& filter() const noexcept { return m_filter; }
+        void filter(const std::string& value) { m_filter = value; }
+        bool verbose() const noexcept { return m_verbose; }
+        void verbose(const bool value) noexcept { m_verbose = value; }
+        bool is_enabled(const std::string& name) const;
+        void run(const std::string& name,
+                 const std::string& corpus,
+                 const std::string& policy,
+                 const uint64_t bytes,
+                 const uint64_t chars,
+                 bench_func_t func);
+        const std::vector<bench_result>& results() const noexcept { return m_results; }
+        void write(std::ostream& stream, const output_format format) const;
+    private:
+        void write_csv(std::ostream& stream) const;
+        void write_json(std::ostream& stream) const;
+    private:
+        int m_iterations = 5;
+        std::string m_filter;
+        bool m_verbose = false;
+        std::vector<bench_result> m_results;
+    };
+
+}
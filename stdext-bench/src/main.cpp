@@ -0,0 +1,425 @@
+/*
+ C++ standard library extensions
+ (c) 2001-2020 Serguei Tarassov (see license.txt)
+
+ JSON parser and writer benchmarks
+ Usage: stdext-bench [--size=chars] [--iterations=N] [--seed=N] [--filter=text]
+                     [--format=csv|json] [--output=file] [--data-dir=dir] [--verbose]
+ */
+#include <new>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <algorithm>
+#include "benchmark.h"
+#include "json.h"
+#include "ioutils.h"
+#include "strutils.h"
+
+using namespace std;
+using namespace stdext;
+
+/*
+ * Allocation counting
+ */
+void* operator new(std::size_t size)
+{
+    bench::alloc_counter::add(size);
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+
+namespace
+{
+    class bench_config
+    {
+    public:
+        std::size_t size = 1000000;
+        int iterations = 5;
+        unsigned int seed = 20200101;
+        string filter;
+        bench::output_format format = bench::output_format::csv;
+        string output;
+        string data_dir = ".";
+        bool verbose = false;
+    };
+
+    class corpus
+    {
+    public:
+        string name;
+        wstring text;
+        bool is_ascii = true;
+    };
+
+    class policy_item
+    {
+    public:
+        string name;
+        // Plain policy uses wide streams
+        const ioutils::text_io_policy* policy = nullptr;
+    };
+
+    class null_handler : public json::sax_handler_intf
+    {
+    public:
+        void on_literal(const json::dom_literal_type, const std::wstring&) override { m_count++; }
+        void on_number(const json::dom_number_type, const std::wstring&) override { m_count++; }
+        void on_number(const json::dom_number_type, const std::wstring&, const parsers::numeric_value&) override { m_count++; }
+        void on_string(const std::wstring&) override { m_count++; }
+        void on_begin_object() override { m_count++; }
+        void on_member_name(const std::wstring&) override { m_count++; }
+        void on_end_object(const std::size_t) override { m_count++; }
+        void on_begin_array() override { m_count++; }
+        void on_end_array(const std::size_t) override { m_count++; }
+        void textpos_changed(const parsers::textpos&) override {}
+        std::size_t count() const noexcept { return m_count; }
+    private:
+        std::size_t m_count = 0;
+    };
+
+    bool is_ascii(const wstring& ws)
+    {
+        return std::all_of(ws.begin(), ws.end(), [](wchar_t c) { return c < 0x80; });
+    }
+
+    bool starts_with(const string& s, const string& prefix, string& value)
+    {
+        if (s.compare(0, prefix.length(), prefix) != 0)
+            return false;
+        value = s.substr(prefix.length());
+        return true;
+    }
+
+    bool parse_args(int argc, char* argv[], bench_config& conf)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            string arg = argv[i];
+            string value;
+            if (starts_with(arg, "--size=", value))
+                conf.size = std::stoull(value);
+            else if (starts_with(arg, "--iterations=", value))
+                conf.iterations = std::stoi(value);
+            else if (starts_with(arg, "--seed=", value))
+                conf.seed = static_cast<unsigned int>(std::stoul(value));
+            else if (starts_with(arg, "--filter=", value))
+                conf.filter = value;
+            else if (starts_with(arg, "--format=", value) && (value == "csv" || value == "json"))
+                conf.format = value == "json" ? bench::output_format::json : bench::output_format::csv;
+            else if (starts_with(arg, "--output=", value))
+                conf.output = value;
+            else if (starts_with(arg, "--data-dir=", value))
+                conf.data_dir = value;
+            else if (arg == "--verbose")
+                conf.verbose = true;
+            else
+            {
+                cerr << "Unknown argument: " << arg << endl
+                     << "Usage: stdext-bench [--size=chars] [--iterations=N] [--seed=N] [--filter=text]" << endl
+                     << "                    [--format=csv|json] [--output=file] [--data-dir=dir] [--verbose]" << endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void generate_corpora(const bench_config& conf, vector<corpus>& corpora)
+    {
+        for (json::dom_document_shape shape : {
+             json::dom_document_shape::wide_flat,
+             json::dom_document_shape::deep,
+             json::dom_document_shape::number_heavy,
+             json::dom_document_shape::string_heavy,
+             json::dom_document_shape::unicode_heavy })
+        {
+            json::dom_document_generator gen;
+            gen.conf().shape(shape);
+            if (shape != json::dom_document_shape::unicode_heavy)
+                gen.conf().value_char_range() = locutils::wchar_range(0x20, 0x7E);
+            gen.conf().seed(conf.seed);
+            gen.conf().target_size(conf.size);
+            wstringstream ss;
+            gen.write(ss);
+            corpus c;
+            c.name = json::to_string(shape);
+            c.text = ss.str();
+            c.is_ascii = is_ascii(c.text);
+            corpora.push_back(c);
+        }
+    }
+
+    void load_corpora(const bench_config& conf, vector<corpus>& corpora)
+    {
+        for (const char* file_name : { "bench-api-records.json", "bench-geo.json", "bench-config.json" })
+        {
+            string path = conf.data_dir + "/" + file_name;
+            ifstream test(path);
+            if (!test.good())
+            {
+                cerr << "File not found: " << path << endl;
+                continue;
+            }
+            test.close();
+            ioutils::text_io_policy_utf8 policy;
+            ioutils::text_reader r(str::to_wstring(path), policy);
+            corpus c;
+            c.name = file_name;
+            r.read_all(c.text);
+            c.is_ascii = is_ascii(c.text);
+            corpora.push_back(c);
+        }
+    }
+
+    string encode(const wstring& text, const ioutils::text_io_policy& policy)
+    {
+        ostringstream ss;
+        {
+            ioutils::text_writer w(ss, policy);
+            w.write(text);
+        }
+        return ss.str();
+    }
+
+    void collect_strings(json::dom_document& doc, vector<wstring>& strings)
+    {
+        for (json::dom_document::const_iterator it = doc.begin(); it != doc.end(); ++it)
+        {
+            if (it->type() == json::dom_value_type::vt_string)
+                strings.push_back(it->text());
+            if (it->member() != nullptr)
+                strings.push_back(it->member()->name());
+        }
+    }
+
+    bool parse(const wstring& text, json::dom_document& doc)
+    {
+        wistringstream ss(text);
+        json::dom_document_reader r(doc);
+        return r.read(ss);
+    }
+
+    // Same parser over the reader which decoder is known at compile time
+    template <class Decoder>
+    void run_static_reader_benchmark(bench::bench_runner& runner, const corpus& c, const policy_item& p, const string& input)
+    {
+        runner.run("sax_parser_static", c.name, p.name, input.length(), c.text.length(), [&](bench::bench_runner::context& ctx)
+        {
+            istringstream ss(input);
+            json::msg_collector_t mc;
+            null_handler h;
+            ctx.start();
+            ioutils::basic_text_reader<ioutils::stream_source<istream>, Decoder> r((ioutils::stream_source<istream>(ss)));
+            json::sax_parser parser(r, mc, h);
+            parser.run();
+            ctx.stop();
+        });
+    }
+
+    void run_text_benchmarks(bench::bench_runner& runner, const corpus& c, const policy_item& p)
+    {
+        const uint64_t chars = c.text.length();
+        json::dom_document doc;
+        parse(c.text, doc);
+        if (p.policy == nullptr)
+        {
+            const uint64_t bytes = chars * sizeof(wchar_t);
+            runner.run("dom_document_reader", c.name, p.name, bytes, chars, [&](bench::bench_runner::context& ctx)
+            {
+                wistringstream ss(c.text);
+                json::dom_document d;
+                json::dom_document_reader r(d);
+                ctx.start();
+                r.read(ss);
+                ctx.stop();
+            });
+            runner.run("sax_parser", c.name, p.name, bytes, chars, [&](bench::bench_runner::context& ctx)
+            {
+                wistringstream ss(c.text);
+                json::msg_collector_t mc;
+                null_handler h;
+                ctx.start();
+                ioutils::text_reader r(ss);
+                json::sax_parser parser(r, mc, h);
+                parser.run();
+                ctx.stop();
+            });
+            runner.run("dom_document_writer", c.name, p.name, bytes, chars, [&](bench::bench_runner::context& ctx)
+            {
+                wostringstream ss;
+                json::dom_document_writer w(doc);
+                ctx.start();
+                w.write(ss);
+                ctx.stop();
+            });
+            return;
+        }
+        const string input = encode(c.text, *p.policy);
+        const uint64_t bytes = input.length();
+        runner.run("dom_document_reader", c.name, p.name, bytes, chars, [&](bench::bench_runner::context& ctx)
+        {
+            istringstream ss(input);
+            json::dom_document d;
+            json::dom_document_reader r(d);
+            ctx.start();
+            r.read(ss, *p.policy);
+            ctx.stop();
+        });
+        runner.run("sax_parser", c.name, p.name, bytes, chars, [&](bench::bench_runner::context& ctx)
+        {
+            istringstream ss(input);
+            json::msg_collector_t mc;
+            null_handler h;
+            ctx.start();
+            ioutils::text_reader r(ss, *p.policy);
+            json::sax_parser parser(r, mc, h);
+            parser.run();
+            ctx.stop();
+        });
+        if (dynamic_cast<const ioutils::text_io_policy_utf8*>(p.policy) != nullptr)
+            run_static_reader_benchmark<ioutils::utf8_decoder>(runner, c, p, input);
+        else if (dynamic_cast<const ioutils::text_io_policy_utf16*>(p.policy) != nullptr)
+            run_static_reader_benchmark<ioutils::utf16_decoder>(runner, c, p, input);
+        runner.run("dom_document_writer", c.name, p.name, bytes, chars, [&](bench::bench_runner::context& ctx)
+        {
+            ostringstream ss;
+            json::dom_document_writer w(doc);
+            ctx.start();
+            {
+                ioutils::text_writer tw(ss, *p.policy);
+                w.write(tw);
+            }
+            ctx.stop();
+        });
+    }
+
+    void run_dom_benchmarks(bench::bench_runner& runner, const corpus& c)
+    {
+        const uint64_t chars = c.text.length();
+        const uint64_t bytes = chars * sizeof(wchar_t);
+        json::dom_document_diff_options options;
+        options.compare_all(true);
+        runner.run("make_diff", c.name, "none", bytes, chars, [&](bench::bench_runner::context& ctx)
+        {
+            json::dom_document ldoc, rdoc;
+            parse(c.text, ldoc);
+            parse(c.text, rdoc);
+            ctx.start();
+            json::make_diff(ldoc, rdoc, options);
+            ctx.stop();
+        });
+        runner.run("make_diff_parallel", c.name, "none", bytes, chars, [&](bench::bench_runner::context& ctx)
+        {
+            json::dom_document ldoc, rdoc;
+            parse(c.text, ldoc);
+            parse(c.text, rdoc);
+            ctx.start();
+            json::make_diff_parallel(ldoc, rdoc, options);
+            ctx.stop();
+        });
+        // Escaping of string values and member names
+        json::dom_document doc;
+        parse(c.text, doc);
+        vector<wstring> strings, escaped;
+        collect_strings(doc, strings);
+        uint64_t str_chars = 0, esc_chars = 0;
+        for (const wstring& s : strings)
+        {
+            str_chars += s.length();
+            escaped.push_back(json::to_escaped(s));
+            esc_chars += escaped.back().length();
+        }
+        runner.run("to_escaped", c.name, "none", str_chars * sizeof(wchar_t), str_chars, [&](bench::bench_runner::context& ctx)
+        {
+            size_t total = 0;
+            ctx.start();
+            for (const wstring& s : strings)
+                total += json::to_escaped(s).length();
+            ctx.stop();
+            if (total == 0 && str_chars > 0)
+                cerr << "to_escaped: empty result" << endl;
+        });
+        runner.run("to_unescaped", c.name, "none", esc_chars * sizeof(wchar_t), esc_chars, [&](bench::bench_runner::context& ctx)
+        {
+            size_t total = 0;
+            ctx.start();
+            for (const wstring& s : escaped)
+                total += json::to_unescaped(s).length();
+            ctx.stop();
+            if (total == 0 && esc_chars > 0)
+                cerr << "to_unescaped: empty result" << endl;
+        });
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    bench_config conf;
+    if (!parse_args(argc, argv, conf))
+        return 1;
+    bench::bench_runner runner;
+    runner.iterations(conf.iterations);
+    runner.filter(conf.filter);
+    runner.verbose(conf.verbose);
+    vector<corpus> corpora;
+    generate_corpora(conf, corpora);
+    load_corpora(conf, corpora);
+    ioutils::text_io_policy_ansi ansi;
+    ioutils::text_io_policy_utf8 utf8;
+    ioutils::text_io_policy_utf16 utf16;
+    vector<policy_item> policies = {
+        { "plain", nullptr },
+        { "ansi", &ansi },
+        { "utf8", &utf8 },
+        { "utf16", &utf16 }
+    };
+    for (const corpus& c : corpora)
+    {
+        for (const policy_item& p : policies)
+        {
+            // Generated unicode texts cannot be encoded with single byte charset
+            if (p.policy == &ansi && !c.is_ascii)
+                continue;
+            run_text_benchmarks(runner, c, p);
+        }
+        run_dom_benchmarks(runner, c);
+    }
+    if (conf.output.empty())
+        runner.write(cout, conf.format);
+    else
+    {
+        ofstream out(conf.output);
+        runner.write(out, conf.format);
+    }
+    return 0;
+}
@@ -0,0 +1,25 @@
+include(../stdext/stdext-common.pri)
+
+TEMPLATE = app
+CONFIG += console
+CONFIG += thread
+
+INCLUDEPATH += \
+    ../stdext/src \
+    ../stdext/src/json
+
+LIBS_DIR = ../stdext/$${DESTDIR_SUBDIR}
+win32: LIBS += -L$$LIBS_DIR/ -lstdext
+unix: LIBS += -L$$LIBS_DIR/ -lstdext
+DEPENDPATH += $$LIBS_DIR
+win32: PRE_TARGETDEPS += $$LIBS_DIR/stdext.lib
+unix: PRE_TARGETDEPS += $$LIBS_DIR/libstdext.a
+
+SOURCES += \
+    src/benchmark.cpp \
+    src/main.cpp
+
+HEADERS += \
+    src/benchmark.h
+
+PostLink_CopyFile(./data/*.*, ./$$DESTDIR/)
@@ -2,7 +2,10 @@
 #include "platforms.h"
 #include "csvtools.h"
 #include "strutils.h"
+#include <cmath>
 #include <fstream>
+#include <map>
+#include <mutex>
 
 using namespace std;
 
@@ -136,6 +139,63 @@ TEST_F(CsvToolsTest, TestStringStream)
     CheckStreamReading(L"String stream LF", policy, ss, expected);
 }
 
+TEST_F(CsvToolsTest, TestLongFields)
+{
+    csv_values_t expected;
+    for (int i = 0; i < 20; i++)
+    {
+        wstring long_text(1000 + i * 37, L'x');
+        long_text[i * 13] = L'\u00fc';
+        expected.push_back(csv_row_values_t({ long_text, L"Quoted, \"" + long_text + L"\"", str::wformat(L"%d", i), L"" }));
+    }
+    ioutils::text_io_policy_plain policy;
+    for (const wstring eol : { L"\r\n", L"\n" })
+    {
+        wstringstream ss = CreateTestStream(expected, L',', eol);
+        CheckStreamReading(L"Long fields", policy, ss, expected);
+    }
+    wstringstream ss = CreateTestStream(expected, L'\t', L"\n");
+    CheckStreamReading(L"Long fields separated by tabs", policy, ss, expected, L'\t');
+    // Text ends with the block
+    policy.max_text_buf_size(4);
+    wstringstream ss2(L"a,b\n");
+    csv::reader rd(ss2, policy);
+    csv::row r;
+    EXPECT_TRUE(rd.next_row(r));
+    EXPECT_FALSE(rd.next_row(r));
+    EXPECT_EQ(1, rd.row_count());
+}
+
+TEST_F(CsvToolsTest, TestRowView)
+{
+    for (const wstring eol : { L"\r\n", L"\n" })
+    {
+        csv_values_t expected = CreateTestStreamValues(eol);
+        expected.push_back(csv_row_values_t({ L"\"\"\"", L"", L"a\"b\"\"c" }));
+        wstringstream ss = CreateTestStream(expected, L',', eol);
+        csv::reader rd(ss);
+        csv::row_view r;
+        long row = 0;
+        while (rd.next_row(r))
+        {
+            row++;
+            const csv_row_values_t& expected_row = expected[row - 1];
+            ASSERT_EQ(expected_row.size(), r.field_count()) << row;
+            for (size_t col = 0; col < r.field_count(); col++)
+            {
+                EXPECT_EQ(expected_row[col], r[col]) << row << L", " << col;
+            }
+            csv::row copy;
+            r.to_row(copy);
+            ASSERT_EQ(r.field_count(), copy.field_count());
+            EXPECT_EQ(r.value(r.field_count() - 1), copy[copy.field_count() - 1].value());
+        }
+        EXPECT_FALSE(rd.has_error());
+        EXPECT_EQ(row, static_cast<long>(expected.size()));
+        EXPECT_THROW(r.field(0), std::out_of_range);
+    }
+}
+
 TEST_F(CsvToolsTest, TestNumberValues)
 {
     csv_values_t expected;
@@ -266,5 +326,551 @@ TEST_F(CsvToolsTest, TestFilesUnicode)
     }
 }
 
+TEST_F(CsvToolsTest, TestParallelReader)
+{
+    csv_values_t values;
+    values.push_back(csv_row_values_t({ L"Id", L"Name", L"Comment" }));
+    for (int i = 1; i <= 500; i++)
+    {
+        wstring comment = i % 7 == 0 ? L"Multi line \"\u00fcber\"\nline 2\r\nline 3" : L"Text " + wstring(i % 13, L'\u4e2d');
+        values.push_back(csv_row_values_t({ str::wformat(L"%d", i), i % 5 == 0 ? L"Quoted, \"name\"" : L"name", comment }));
+    }
+    for (const wstring eol : { L"\r\n", L"\n" })
+    {
+        wstringstream ss = CreateTestStream(values, L',', eol);
+        ioutils::text_io_policy_utf8 policy;
+        {
+            ioutils::text_writer w(L"current.csv", policy);
+            w.write(ss.str());
+        }
+        for (const bool ordered : { true, false })
+        {
+            for (const size_t chunk_size : { 1, 64, 1000, 1000000 })
+            {
+                const wstring title = str::wformat(L"Ordered: %d, chunk size: %d. ", ordered, static_cast<int>(chunk_size));
+                csv::parallel_reader rd(L"current.csv", policy);
+                rd.with_header(true);
+                rd.ordered(ordered);
+                rd.chunk_size(chunk_size);
+                rd.thread_count(4);
+                std::mutex lock;
+                std::map<long, csv_row_values_t> rows;
+                long last_row = 0;
+                bool in_order = true;
+                EXPECT_TRUE(rd.read([&](const csv::row_view& r, const long row_num)
+                {
+                    csv_row_values_t row;
+                    for (size_t i = 0; i < r.field_count(); i++)
+                        row.push_back(r.value(i));
+                    lock_guard<mutex> guard(lock);
+                    in_order = in_order && row_num == last_row + 1;
+                    last_row = row_num;
+                    rows[row_num] = row;
+                    return true;
+                })) << title;
+                EXPECT_FALSE(rd.has_error()) << title << (rd.has_error() ? rd.errors()[0]->to_wstring() : L"");
+                if (ordered)
+                {
+                    EXPECT_TRUE(in_order) << title;
+                }
+                EXPECT_EQ(rd.row_count(), static_cast<long>(values.size() - 1)) << title;
+                ASSERT_EQ(rd.header().field_count(), 3u) << title;
+                EXPECT_EQ(rd.header()[1].value(), L"Name") << title;
+                ASSERT_EQ(rows.size(), values.size() - 1) << title;
+                for (const auto& row : rows)
+                    ASSERT_EQ(row.second, values[row.first]) << title << row.first;
+            }
+        }
+    }
+    // Stops on the first error with the position in the file
+    values[300].push_back(L"Extra");
+    wstringstream ss = CreateTestStream(values, L',', L"\n");
+    ioutils::text_io_policy_utf8 policy;
+    {
+        ioutils::text_writer w(L"current.csv", policy);
+        w.write(ss.str());
+    }
+    csv::reader seq_rd(L"current.csv", policy);
+    csv::row r;
+    seq_rd.read_header();
+    while (seq_rd.next_row(r))
+    { }
+    ASSERT_TRUE(seq_rd.has_error());
+    csv::parallel_reader rd(L"current.csv", policy);
+    rd.with_header(true);
+    rd.chunk_size(100);
+    long count = 0;
+    EXPECT_FALSE(rd.read([&](const csv::row_view&, const long) { count++; return true; }));
+    ASSERT_TRUE(rd.has_error());
+    EXPECT_EQ(count, 299);
+    EXPECT_EQ(rd.errors()[0]->kind(), csv::reader_msg_kind::row_field_count_different_from_header);
+    EXPECT_EQ(rd.errors()[0]->pos(), seq_rd.errors()[0]->pos()) << rd.errors()[0]->pos().to_wstring();
+    // Stopped by handler
+    count = 0;
+    EXPECT_TRUE(rd.read([&](const csv::row_view&, const long row_num) { count++; return row_num < 10; }));
+    EXPECT_EQ(count, 10);
+    EXPECT_EQ(rd.row_count(), 10);
+    // Exception of the handler is passed to the caller when the workers are stopped
+    rd.thread_count(4);
+    for (const bool ordered : { true, false })
+    {
+        rd.ordered(ordered);
+        EXPECT_THROW(rd.read([](const csv::row_view&, const long) -> bool { throw std::runtime_error("Handler"); }),
+                     std::runtime_error) << ordered;
+    }
+}
+
+TEST_F(CsvToolsTest, TestParallelReaderFiles)
+{
+    csv_values_t expected;
+    expected.push_back(csv_row_values_t({ L"1", L"2.345" }));
+    expected.push_back(csv_row_values_t({ L"Non-ASCII текст éèçà", L"ĀĂ" }));
+    expected.push_back(csv_row_values_t({ L"67,89", L"Multi line текст\nстрока 2\ndéjà 3" }));
+    ioutils::text_io_policy_utf8 policy8;
+    ioutils::text_io_policy_utf16 policy16;
+    for (const auto& file : { make_pair(L"test01-utf8-bom.csv", (ioutils::text_io_policy*)&policy8),
+                              make_pair(L"test01-utf16-le.csv", (ioutils::text_io_policy*)&policy16) })
+    {
+        csv::parallel_reader rd(file.first, *file.second);
+        rd.chunk_size(8);
+        csv_values_t rows;
+        EXPECT_TRUE(rd.read([&](const csv::row_view& r, const long)
+        {
+            csv_row_values_t row;
+            for (size_t i = 0; i < r.field_count(); i++)
+                row.push_back(r.value(i));
+            rows.push_back(row);
+            return true;
+        }));
+        EXPECT_EQ(rows, expected) << file.first;
+    }
+    csv::parallel_reader rd(L"not_existing.csv", policy8);
+    EXPECT_FALSE(rd.read([](const csv::row_view&, const long) { return true; }));
+    EXPECT_EQ(rd.row_count(), 0);
+}
+
+TEST_F(CsvToolsTest, TestBatchReader)
+{
+    wstringstream ss;
+    ss << L"Id,Ratio,Date,Flag,Name\n";
+    for (int i = 1; i <= 150; i++)
+    {
+        if (i % 10 == 0)
+            ss << i << L",,,,\n";
+        else
+            ss << i << L"," << i << L".5,2021-03-" << (i % 28 + 1) << L" 10:20:30," << (i % 2 ? L"TRUE" : L"0") << L",\"Name " << i << L"\"\n";
+    }
+    ss << L"x,1e400,date,maybe,Last\n";
+    ss << L"-9223372036854775808,,,,\n";
+    ss << L"12-34,--5,,,Minus\n";
+    csv::reader rd(ss);
+    ASSERT_TRUE(rd.read_header());
+    csv::schema columns;
+    columns.add(L"Id", csv::column_type::ct_int64)
+           .add(L"Ratio", csv::column_type::ct_double)
+           .add(L"Date", csv::column_type::ct_datetime)
+           .add(L"Flag", csv::column_type::ct_bool)
+           .add(L"Name", csv::column_type::ct_string);
+    EXPECT_EQ(columns.find(L"Flag"), 3u);
+    EXPECT_EQ(columns.find(L"None"), 5u);
+    csv::batch_reader br(rd, columns);
+    csv::batch b;
+    size_t rows = 0;
+    while (rows < 150)
+    {
+        ASSERT_TRUE(br.next_batch(b, std::min<size_t>(64, 150 - rows)));
+        ASSERT_EQ(b.column_count(), 5u);
+        EXPECT_EQ(b.first_row(), static_cast<long>(rows + 1));
+        EXPECT_EQ(b.row_count(), std::min<size_t>(64, 150 - rows));
+        size_t null_count = 0;
+        for (size_t i = 0; i < b.row_count(); i++)
+        {
+            const int n = static_cast<int>(rows + i + 1);
+            EXPECT_FALSE(b[0].is_null(i));
+            EXPECT_EQ(b[0].int64_values()[i], n);
+            if (n % 10 == 0)
+            {
+                null_count++;
+                for (size_t col = 1; col < 4; col++)
+                    EXPECT_TRUE(b[col].is_null(i)) << n << L", " << col;
+                EXPECT_FALSE(b[4].is_null(i));
+                EXPECT_EQ(b[4].string_value(i), L"");
+                continue;
+            }
+            EXPECT_EQ(b[1].double_values()[i], n + 0.5);
+            EXPECT_EQ(b[2].datetime_values()[i], datetime(2021, 3, n % 28 + 1, 10, 20, 30, 0));
+            EXPECT_EQ(b[3].bool_values()[i], n % 2);
+            EXPECT_EQ(b[4].string_value(i), L"Name " + std::to_wstring(n));
+        }
+        EXPECT_EQ(b[1].null_count(), null_count);
+        EXPECT_EQ(b[1].null_bitmap().size(), (b.row_count() + 63) / 64);
+        EXPECT_EQ(b[4].string_offsets().size(), b.row_count() + 1);
+        rows += b.row_count();
+    }
+    EXPECT_TRUE(br.messages().warnings().empty());
+    ASSERT_TRUE(br.next_batch(b, 64));
+    ASSERT_EQ(b.row_count(), 3u);
+    EXPECT_EQ(b.first_row(), 151);
+    for (size_t col : { 0, 2, 3 })
+        EXPECT_TRUE(b[col].is_null(0)) << col;
+    EXPECT_EQ(b[4].string_value(0), L"Last");
+    EXPECT_TRUE(std::isinf(b[1].double_values()[0]));
+    EXPECT_EQ(b[0].int64_values()[1], std::numeric_limits<int64_t>::min());
+    EXPECT_TRUE(b[3].is_null(1));
+    EXPECT_FALSE(b[4].is_null(1));
+    // Misplaced minus signs are not ignored
+    EXPECT_TRUE(b[0].is_null(2));
+    EXPECT_TRUE(b[1].is_null(2));
+    ASSERT_EQ(br.messages().warnings().size(), 5u);
+    EXPECT_EQ(br.messages().warnings()[0]->kind(), csv::reader_msg_kind::invalid_column_value);
+    EXPECT_EQ(br.messages().warnings()[0]->pos(), parsers::textpos(152, 1));
+    EXPECT_EQ(br.messages().warnings()[2]->text(), L"Invalid bool value of column 'Flag' in row 151");
+    EXPECT_EQ(br.messages().warnings()[3]->kind(), csv::reader_msg_kind::invalid_column_value);
+    EXPECT_EQ(br.messages().warnings()[3]->text(), L"Invalid int64 value of column 'Id' in row 153");
+    EXPECT_EQ(br.messages().warnings()[4]->text(), L"Invalid double value of column 'Ratio' in row 153");
+    EXPECT_FALSE(br.next_batch(b, 64));
+    EXPECT_EQ(b.row_count(), 0u);
+}
+
+TEST_F(CsvToolsTest, TestWriter)
+{
+    {
+        wstringstream ss;
+        csv::writer w(ss);
+        w.write_row({ L"a", L"b,c", L"say \"hi\"", L"", L"line 1\nline 2", L"\"" });
+        w.write_field(int64_t(-12)).write_field(0.1).write_field(true).write_null().write_field(L"x").end_row();
+        w.write_field(datetime(2021, 3, 4, 5, 6, 7, 8)).write_field(42).end_row();
+        EXPECT_EQ(w.row_count(), 3);
+        EXPECT_EQ(ss.str(), L"");
+        w.flush();
+        EXPECT_EQ(ss.str(), L"a,\"b,c\",\"say \"\"hi\"\"\",,\"line 1\nline 2\",\"\"\"\"\r\n"
+                            L"-12,0.1,true,,x\r\n"
+                            L"2021-03-04 05:06:07.008,42\r\n");
+    }
+    for (const wstring eol : { L"\r\n", L"\n" })
+    {
+        csv_values_t expected = CreateTestStreamValues(eol);
+        expected.push_back(csv_row_values_t({ L"\u00fcber \u4e2d", L"\t", L"a;b|c" }));
+        ioutils::text_io_policy_utf8 policy8;
+        ioutils::text_io_policy_utf16 policy16;
+        for (ioutils::text_io_policy* policy : { (ioutils::text_io_policy*)&policy8, (ioutils::text_io_policy*)&policy16 })
+        {
+            for (const wchar_t separator : { L',', L'\t' })
+            {
+                stringstream bytes;
+                {
+                    csv::writer w(bytes, *policy);
+                    w.separator(separator);
+                    w.eol(eol);
+                    w.buffer_size(16);
+                    for (const csv_row_values_t& values : expected)
+                    {
+                        csv::row r;
+                        for (const wstring& value : values)
+                            r.append_value(value);
+                        w.write_row(r);
+                    }
+                }
+                ioutils::text_reader tr(bytes, *policy);
+                csv::reader rd(&tr);
+                rd.separator(separator);
+                CheckReading(L"Written rows", rd, expected);
+            }
+        }
+    }
+}
+
+TEST_F(CsvToolsTest, TestSniffer)
+{
+    csv::sniffer sn;
+    for (const wchar_t separator : { L',', L';', L'\t', L'|' })
+    {
+        for (const wstring eol : { L"\r\n", L"\n" })
+        {
+            csv_values_t values = CreateTestStreamValues(eol);
+            wstringstream ss = CreateTestStream(values, separator, eol);
+            csv::dialect d = sn.sniff(ss.str());
+            EXPECT_EQ(d.separator(), separator);
+            EXPECT_EQ(d.quote(), L'"');
+            EXPECT_EQ(d.eol(), eol);
+            // Sample is cut in the middle of the last row
+            d = sn.sniff(ss.str().substr(0, ss.str().length() - 10), true);
+            EXPECT_EQ(d.separator(), separator);
+            ss.seekg(0);
+            csv::reader rd(ss);
+            EXPECT_TRUE(d.apply(rd));
+            CheckReading(L"Sniffed", rd, values);
+
+            values.clear();
+            values.push_back(csv_row_values_t({ L"Id", L"Price", L"Name", L"Code" }));
+            for (int i = 0; i < 20; i++)
+                values.push_back(csv_row_values_t({ str::wformat(L"%d", i * 37), str::wformat(L"%d.%d", i, i % 3),
+                                                    L"Name" + wstring(i, L'x'), str::wformat(L"C%03d", i) }));
+            ss = CreateTestStream(values, separator, eol);
+            d = sn.sniff(ss.str());
+            EXPECT_EQ(d.separator(), separator);
+            EXPECT_TRUE(d.has_header());
+            ss.seekg(0);
+            csv::reader rd2(ss);
+            EXPECT_TRUE(d.apply(rd2));
+            EXPECT_EQ(rd2.header().field_count(), 4u);
+            csv::row r;
+            while (rd2.next_row(r))
+            { }
+            EXPECT_FALSE(rd2.has_error());
+            EXPECT_EQ(rd2.row_count(), 20);
+            values.erase(values.begin());
+            ss = CreateTestStream(values, separator, eol);
+            EXPECT_FALSE(sn.sniff(ss.str()).has_header());
+        }
+    }
+    csv::dialect d = sn.sniff(L"'a,b';c\r'e';f\r");
+    EXPECT_EQ(d.separator(), L';');
+    EXPECT_EQ(d.quote(), L'\'');
+    EXPECT_EQ(d.eol(), L"\r");
+    d = sn.sniff(L"single");
+    EXPECT_EQ(d.separator(), L',');
+    EXPECT_FALSE(d.has_header());
+    d = sn.sniff(L"");
+    EXPECT_EQ(d.eol(), L"\r\n");
+    d = sn.sniff_file(L"test01-utf8-bom.csv", ioutils::text_io_policy_utf8());
+    EXPECT_EQ(d.separator(), L',');
+    EXPECT_EQ(d.eol(), L"\n");
+}
+
+TEST_F(CsvToolsTest, TestRowIndex)
+{
+    wstringstream ss;
+    ss << L"Id,Name\r\n";
+    // Line of each row, quoted values contain line ends and separators
+    vector<int> lines = { 0 };
+    int line = 2;
+    for (int i = 1; i <= 100; i++)
+    {
+        lines.push_back(line);
+        if (i % 10 == 0)
+        {
+            ss << i << L",\"Multi\r\nline, \"\"quoted\"\"\nvalue\"\r\n";
+            line += 3;
+        }
+        else
+        {
+            ss << i << L",Name " << i << (i % 3 ? L"\r\n" : L"\n");
+            line++;
+        }
+    }
+    csv::row_index index(8);
+    ASSERT_TRUE(index.build(ss, true));
+    ASSERT_EQ(index.size(), 13u);
+    EXPECT_EQ(index[0].row, 0);
+    EXPECT_EQ(index[0].offset, 9u);
+    EXPECT_EQ(index[12].row, 96);
+    EXPECT_EQ(index[12].line, lines[97]);
+    EXPECT_EQ(index.find(0), index.size());
+    EXPECT_EQ(index.find(8), 0u);
+    EXPECT_EQ(index.find(9), 1u);
+    EXPECT_EQ(index.find(1000), 12u);
+
+    ss.clear();
+    ss.seekg(0);
+    csv::reader rd(ss);
+    ASSERT_TRUE(rd.read_header());
+    csv::row r;
+    for (long row : { 37, 1, 100, 9, 8, 10, 50 })
+    {
+        ASSERT_TRUE(rd.seek_row(row, index)) << row;
+        EXPECT_EQ(rd.row_count(), row - 1);
+        EXPECT_EQ(rd.pos(), parsers::textpos(lines[row], 1)) << row;
+        ASSERT_TRUE(rd.next_row(r)) << row;
+        EXPECT_EQ(r[0].value(), to_wstring(row));
+        EXPECT_EQ(rd.row_count(), row);
+    }
+    EXPECT_EQ(r[1].value(), L"Multi\r\nline, \"quoted\"\nvalue");
+    EXPECT_FALSE(rd.seek_row(101, index));
+    EXPECT_FALSE(rd.seek_row(0, index));
+    EXPECT_FALSE(rd.has_error());
+
+    // Sidecar image
+    stringstream image;
+    index.write(image);
+    EXPECT_LE(image.str().size(), 28u + 13u * 3u);
+    csv::row_index loaded;
+    ASSERT_TRUE(loaded.read(image));
+    ASSERT_EQ(loaded.size(), index.size());
+    EXPECT_EQ(loaded.step(), 8u);
+    for (size_t i = 0; i < index.size(); i++)
+    {
+        EXPECT_EQ(loaded[i].offset, index[i].offset);
+        EXPECT_EQ(loaded[i].row, index[i].row);
+        EXPECT_EQ(loaded[i].line, index[i].line);
+    }
+    string broken = image.str();
+    broken[0] = 'X';
+    stringstream broken_image(broken);
+    EXPECT_FALSE(loaded.read(broken_image));
+    EXPECT_EQ(loaded.size(), 0u);
+    broken = image.str();
+    broken.pop_back();
+    broken_image.str(broken);
+    broken_image.clear();
+    EXPECT_FALSE(loaded.read(broken_image));
+}
+
+TEST_F(CsvToolsTest, TestRowIndexFiles)
+{
+    csv_values_t expected;
+    expected.push_back(csv_row_values_t({ L"1", L"2.345" }));
+    expected.push_back(csv_row_values_t({ L"Non-ASCII текст éèçà", L"ĀĂ" }));
+    expected.push_back(csv_row_values_t({ L"67,89", L"Multi line текст\nстрока 2\ndéjà 3" }));
+    ioutils::text_io_policy_utf8 policy8;
+    ioutils::text_io_policy_utf16 policy16;
+    for (const auto& file : { make_pair(L"test01-utf8.csv", (ioutils::text_io_policy*)&policy8),
+                              make_pair(L"test01-utf8-bom.csv", (ioutils::text_io_policy*)&policy8),
+                              make_pair(L"test01-utf16-le.csv", (ioutils::text_io_policy*)&policy16),
+                              make_pair(L"test01-utf16-be.csv", (ioutils::text_io_policy*)&policy16) })
+    {
+        csv::row_index index(1);
+        ASSERT_TRUE(index.build(file.first, *file.second, false)) << file.first;
+        ASSERT_EQ(index.size(), expected.size()) << file.first;
+        csv::reader rd(file.first, *file.second);
+        csv::row r;
+        for (long row : { 3, 1, 2 })
+        {
+            ASSERT_TRUE(rd.seek_row(row, index)) << file.first << row;
+            ASSERT_TRUE(rd.next_row(r)) << file.first << row;
+            ASSERT_EQ(r.field_count(), 2u) << file.first << row;
+            EXPECT_EQ(r[0].value(), expected[row - 1][0]) << file.first << row;
+            EXPECT_EQ(r[1].value(), expected[row - 1][1]) << file.first << row;
+        }
+        EXPECT_EQ(rd.pos().line(), 3);
+        EXPECT_FALSE(rd.has_error());
+    }
+    csv::row_index index;
+    EXPECT_FALSE(index.build(L"not_existing.csv", policy8, false));
+}
+
+TEST_F(CsvToolsTest, TestBasicTextReader)
+{
+    typedef ioutils::basic_text_reader<ioutils::memory_source<char>, ioutils::utf16_decoder> utf16_reader_t;
+    csv_values_t expected;
+    expected.push_back(csv_row_values_t({ L"1", L"2.345" }));
+    expected.push_back(csv_row_values_t({ L"Non-ASCII текст éèçà", L"ĀĂ" }));
+    expected.push_back(csv_row_values_t({ L"67,89", L"Multi line текст\nстрока 2\ndéjà 3" }));
+    for (const wchar_t* file_name : { L"test01-utf16-le.csv", L"test01-utf16-be.csv" })
+    {
+        ioutils::mapped_file file;
+        ASSERT_TRUE(file.open(file_name));
+        utf16_reader_t tr(ioutils::memory_source<char>(file.data(), file.size()));
+        csv::reader rd(&tr);
+        CheckReading(file_name, rd, expected);
+    }
+}
+
+TEST_F(CsvToolsTest, TestCheckpoint)
+{
+    wstring text = L"Id,Name\r\n";
+    for (int i = 1; i <= 20; i++)
+        text += to_wstring(i) + (i % 5 ? L",Name " + to_wstring(i) + L"\r\n" : L",\"Multi\nline\"\n");
+    wistringstream ss1(text);
+    csv::reader rd1(ss1);
+    ASSERT_TRUE(rd1.read_header());
+    csv::row r;
+    for (int i = 1; i <= 7; i++)
+        ASSERT_TRUE(rd1.next_row(r));
+    csv::checkpoint cp;
+    ASSERT_TRUE(rd1.save_checkpoint(cp));
+    EXPECT_EQ(cp.row_count, 7);
+    EXPECT_EQ(cp.pos, parsers::textpos(10, 1));
+    EXPECT_EQ(cp.header.field_count(), 2u);
+    stringstream image;
+    cp.write(image);
+    csv_values_t expected;
+    while (rd1.next_row(r))
+        expected.push_back(csv_row_values_t({ r[0].value(), r[1].value() }));
+    ASSERT_EQ(expected.size(), 13u);
+
+    // Other process continues from the persisted checkpoint
+    csv::checkpoint loaded;
+    ASSERT_TRUE(loaded.read(image));
+    EXPECT_EQ(loaded.offset, cp.offset);
+    EXPECT_EQ(loaded.header[1].value(), L"Name");
+    wistringstream ss2(text);
+    csv::reader rd2(ss2);
+    ASSERT_TRUE(rd2.restore(loaded));
+    EXPECT_TRUE(rd2.has_header());
+    EXPECT_EQ(rd2.pos(), parsers::textpos(10, 1));
+    csv_values_t rows;
+    while (rd2.next_row(r))
+        rows.push_back(csv_row_values_t({ r[0].value(), r[1].value() }));
+    EXPECT_EQ(rows, expected);
+    EXPECT_EQ(rd2.row_count(), 20);
+    EXPECT_EQ(rd2.pos().line(), 26);
+    EXPECT_FALSE(rd2.has_error());
+    // The same reader goes back
+    ASSERT_TRUE(rd1.restore(cp));
+    ASSERT_TRUE(rd1.next_row(r));
+    EXPECT_EQ(r[0].value(), L"8");
+    EXPECT_EQ(rd1.row_count(), 8);
+
+    string broken = image.str();
+    broken[3] = 'X';
+    stringstream broken_image(broken);
+    EXPECT_FALSE(loaded.read(broken_image));
+    broken = image.str();
+    broken.pop_back();
+    broken_image.str(broken);
+    broken_image.clear();
+    EXPECT_FALSE(loaded.read(broken_image));
+}
+
+TEST_F(CsvToolsTest, TestCheckpointFiles)
+{
+    csv_values_t expected;
+    expected.push_back(csv_row_values_t({ L"Non-ASCII текст éèçà", L"ĀĂ" }));
+    expected.push_back(csv_row_values_t({ L"67,89", L"Multi line текст\nстрока 2\ndéjà 3" }));
+    ioutils::text_io_policy_utf8 policy8;
+    ioutils::text_io_policy_utf16 policy16;
+    for (const auto& file : { make_pair(L"test01-utf8.csv", (ioutils::text_io_policy*)&policy8),
+                              make_pair(L"test01-utf8-bom.csv", (ioutils::text_io_policy*)&policy8),
+                              make_pair(L"test01-utf16-le.csv", (ioutils::text_io_policy*)&policy16),
+                              make_pair(L"test01-utf16-be.csv", (ioutils::text_io_policy*)&policy16) })
+    {
+        const string file_name = str::to_string(file.first);
+        csv::checkpoint cp;
+        {
+            // Byte stream decoded by the policy
+            ifstream stream(file_name, ios::binary);
+            ioutils::text_reader tr(stream, *file.second);
+            csv::reader rd(&tr);
+            csv::row r;
+            ASSERT_TRUE(rd.next_row(r));
+            ASSERT_TRUE(rd.save_checkpoint(cp)) << file_name;
+            EXPECT_EQ(cp.pos, parsers::textpos(2, 1));
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            ifstream stream(file_name, ios::binary);
+            ioutils::text_reader tr(stream, *file.second);
+            csv::reader rd_stream(&tr);
+            csv::reader rd_file(file.first, *file.second);
+            csv::reader& rd = i == 0 ? rd_stream : rd_file;
+            ASSERT_TRUE(rd.restore(cp)) << file_name;
+            csv_values_t rows;
+            csv::row r;
+            while (rd.next_row(r))
+                rows.push_back(csv_row_values_t({ r[0].value(), r[1].value() }));
+            EXPECT_EQ(rows, expected) << file_name << i;
+            EXPECT_EQ(rd.row_count(), 3);
+        }
+        // File stream offset is the same
+        csv::reader rd(file.first, *file.second);
+        csv::row r;
+        ASSERT_TRUE(rd.next_row(r));
+        csv::checkpoint file_cp;
+        ASSERT_TRUE(rd.save_checkpoint(file_cp));
+        EXPECT_EQ(file_cp.offset, cp.offset) << file_name;
+    }
+}
+
 }
 }
@@ -271,6 +271,32 @@ TEST_F(TextReaderTest, TestReadLine)
     EXPECT_EQ(i, lines_count);
 }
 
+TEST_F(TextReaderTest, TestReadUntil)
+{
+    string bytes = "ABCDEFGHIJ,KLMNOPQRSTUVWXYZ\n0123";
+    ioutils::text_io_policy_plain policy;
+    policy.max_text_buf_size(4);
+    stringstream ss(bytes);
+    ioutils::text_reader r1(ss, policy);
+    wstring ws;
+    EXPECT_TRUE(r1.read_until(ws, { L',', L'\n' }));
+    EXPECT_EQ(ws, L"ABCDEFGHIJ");
+    wchar_t c = 0;
+    EXPECT_TRUE(r1.next_char(c));
+    EXPECT_EQ(c, L',');
+    ws.clear();
+    EXPECT_TRUE(r1.read_until(ws, { L',', L'\n' }));
+    EXPECT_EQ(ws, L"KLMNOPQRSTUVWXYZ");
+    EXPECT_TRUE(r1.is_next_char(L'\n'));
+    EXPECT_TRUE(r1.read_until(ws, { L'\n' }));
+    EXPECT_EQ(ws, L"KLMNOPQRSTUVWXYZ");
+    EXPECT_TRUE(r1.next_char(c));
+    ws.clear();
+    EXPECT_FALSE(r1.read_until(ws, { L'a', L'b', L'c', L'd', L'e' }));
+    EXPECT_EQ(ws, L"0123");
+    EXPECT_TRUE(r1.eof());
+}
+
 
 TEST_F(TextReaderTest, TestRead_Ansi)
 {
@@ -395,6 +421,65 @@ TEST_F(TextReaderTest, TestRead_Utf16_Stringstream)
     }
 }
 
+TEST_F(TextReaderTest, TestBasicTextReader)
+{
+    typedef ioutils::memory_source<char> bytes_source;
+    // Sequences are split between blocks of the reader
+    wstring expected;
+    for (int i = 0; i < 3000; i++)
+        expected += locutils_test::string_01_utf16 + L"\n";
+    {
+        const string bytes = locutils::utf16::to_utf8string(expected);
+        ioutils::basic_text_reader<bytes_source, ioutils::utf8_decoder> r(bytes_source(bytes.data(), bytes.size()));
+        CheckRead(r, expected, "UTF-8 memory");
+        EXPECT_TRUE(r.eof());
+        istringstream ss("\xEF\xBB\xBF" + bytes);
+        ioutils::basic_text_reader<ioutils::stream_source<istream>, ioutils::utf8_decoder> rs((ioutils::stream_source<istream>(ss)));
+        CheckRead(rs, expected, "UTF-8 stream BOM");
+    }
+    for (const endianess::byte_order order : { endianess::byte_order::big_endian, endianess::byte_order::little_endian })
+    {
+        string bytes;
+        locutils::utf16::add_bom(bytes, order);
+        for (const wchar_t c : expected)
+        {
+            const char b[2] = { static_cast<char>((c >> 8) & 0xFF), static_cast<char>(c & 0xFF) };
+            bytes += order == endianess::byte_order::big_endian ? string{ b[0], b[1] } : string{ b[1], b[0] };
+        }
+        ioutils::basic_text_reader<bytes_source, ioutils::utf16_decoder> r(bytes_source(bytes.data(), bytes.size()));
+        CheckRead(r, expected, "UTF-16 BOM");
+        EXPECT_EQ(r.decoder().byte_order(), order);
+        ioutils::basic_text_reader<bytes_source, ioutils::utf16_decoder> r2(bytes_source(bytes.data() + 2, bytes.size() - 2),
+                                                                           ioutils::utf16_decoder(order));
+        CheckRead(r2, expected, "UTF-16 NoBOM");
+    }
+    {
+        wistringstream ss(expected);
+        ioutils::basic_text_reader<ioutils::stream_source<wistream>, ioutils::plain_decoder> r((ioutils::stream_source<wistream>(ss)));
+        CheckRead(r, expected, "Plain wide stream");
+        const string bytes = locutils_test::string_01_ansi_cp1252;
+        ioutils::basic_text_reader<bytes_source, ioutils::plain_decoder> r2(bytes_source(bytes.data(), bytes.size()));
+        CheckRead(r2, locutils_test::string_01_utf16_cp1252, "Plain Latin-1");
+    }
+    // Invalid and truncated sequences
+    const string invalid = "A\x80" "B\xC3" "C\xF8\xE2\x82";
+    ioutils::basic_text_reader<bytes_source, ioutils::utf8_decoder> r(bytes_source(invalid.data(), invalid.size()));
+    CheckRead(r, L"A\uFFFDB\uFFFDC\uFFFD\uFFFD\uFFFD", "UTF-8 invalid");
+    // Overlong forms, surrogates and code points above U+10FFFF
+    const string not_scalar = "\xC0\xAF" "A\xE0\x80\xAF" "B\xF0\x80\x80\xAF" "C\xED\xA0\x80" "D\xF4\x90\x80\x80";
+    ioutils::basic_text_reader<bytes_source, ioutils::utf8_decoder> r2(bytes_source(not_scalar.data(), not_scalar.size()));
+    CheckRead(r2, L"\uFFFD\uFFFDA\uFFFD\uFFFD\uFFFDB\uFFFD\uFFFD\uFFFD\uFFFDC\uFFFD\uFFFD\uFFFDD\uFFFD\uFFFD\uFFFD\uFFFD",
+              "UTF-8 not scalar values");
+    const string bounds = "\xC2\x80" "\xE0\xA0\x80" "\xED\x9F\xBF" "\xEE\x80\x80" "\xF0\x90\x80\x80" "\xF4\x8F\xBF\xBF";
+    ioutils::basic_text_reader<bytes_source, ioutils::utf8_decoder> r3(bytes_source(bounds.data(), bounds.size()));
+    CheckRead(r3, L"\u0080\u0800\uD7FF\uE000\U00010000\U0010FFFF", "UTF-8 bounds");
+    ioutils::basic_text_reader<bytes_source, ioutils::utf8_decoder> empty(bytes_source(nullptr, 0));
+    EXPECT_TRUE(empty.eof());
+    wchar_t c = 0;
+    EXPECT_FALSE(empty.next_char(c));
+    EXPECT_FALSE(empty.seek(0));
+}
+
 class TextWriterTest : public testing::Test
 {
 protected:
@@ -409,6 +494,7 @@ protected:
             wstringstream wss;
             ioutils::text_writer w1(wss, policy);
             w1.write(ws);
+            w1.flush();
             wstring ws2 = wss.str();
             EXPECT_EQ(expected.length(), ws2.length()) << title + ": length 1";
             EXPECT_EQ(ws2, wexpected) << title + ": content 1";
@@ -418,6 +504,7 @@ protected:
             stringstream ss;
             ioutils::text_writer w2(ss, policy);
             w2.write(ws);
+            w2.flush();
             string s2 = ss.str();
             EXPECT_EQ(expected.length(), s2.length()) << title + ": length 2";
             EXPECT_EQ(s2, expected) << title + ": content 2";
@@ -481,6 +568,116 @@ TEST_F(TextWriterTest, TestWrite_Utf16)
                     "BOM generate");
 }
 
+TEST_F(TextWriterTest, TestBuffered)
+{
+    wstring ws;
+    for (int i = 0; i < 1000; i++)
+        ws += locutils_test::string_01_utf16;
+    ioutils::text_io_policy_utf8 policy((locutils::codecvt_mode_utf8(locutils::codecvt_headers::generate)));
+    string expected;
+    {
+        ostringstream ss;
+        {
+            ioutils::text_writer w(ss, policy);
+            EXPECT_EQ(w.buffer_size(), ioutils::text_writer::default_buffer_size);
+            w.write(ws);
+        }
+        expected = ss.str();
+        EXPECT_EQ(expected.substr(3), locutils::utf16::to_utf8string(ws));
+    }
+    for (size_t buffer_size : { 0, 1, 7, 100, 100000 })
+    {
+        ostringstream ss;
+        ioutils::text_writer w(ss, policy);
+        w.buffer_size(buffer_size);
+        EXPECT_EQ(w.buffer_size(), max(buffer_size, (size_t)1));
+        // Single characters, small and large strings
+        w.write(ws[0]);
+        w.write(wstring_view(ws).substr(1, 5));
+        w.write(ws.substr(6));
+        w.flush();
+        EXPECT_EQ(ss.str(), expected) << buffer_size;
+    }
+    {
+        // Characters are not written until the buffer is full
+        wostringstream wss;
+        ioutils::text_writer w(wss);
+        w.buffer_size(4);
+        w.write(L"abc").write_endl();
+        EXPECT_TRUE(wss.str().empty());
+        w.write(L'd');
+        EXPECT_EQ(wss.str(), L"abc\n");
+        w.flush();
+        EXPECT_EQ(wss.str(), L"abc\nd");
+    }
+    {
+        // File I/O
+        const wstring file_name = L"current.txt";
+        {
+            ioutils::text_writer w(file_name, policy);
+            w.buffer_size(7);
+            w.write(ws);
+        }
+        ifstream f(locutils::utf16::to_utf8string(file_name), ios::binary);
+        ostringstream ss;
+        ss << f.rdbuf();
+        EXPECT_EQ(ss.str(), expected);
+    }
+}
+
+TEST_F(TextWriterTest, TestBufferedSurrogatePairs)
+{
+    // 'G clef' symbol (U+1D11E) is written as UTF-16 surrogate pair
+    const wstring ws = L"A\xD834\xDD1E" L"BC\xD834\xDD1E\xD834\xDD1E" L"D\xD834\xDD1E";
+    ioutils::text_io_policy_utf8 policy((locutils::codecvt_mode_utf8(locutils::codecvt_headers::consume)));
+    string expected;
+    {
+        ostringstream ss;
+        ioutils::text_writer w(ss, policy);
+        w.write(ws);
+        w.flush();
+        expected = ss.str();
+        EXPECT_EQ(expected, "A\xF0\x9D\x84\x9E" "BC\xF0\x9D\x84\x9E\xF0\x9D\x84\x9E" "D\xF0\x9D\x84\x9E");
+    }
+    for (size_t buffer_size : { 1, 2, 3, 4, 5 })
+    {
+        ostringstream ss1;
+        ostringstream ss2;
+        {
+            // Pairs are not split by full buffers, neither by single characters nor by bulk writes
+            ioutils::text_writer w1(ss1, policy);
+            w1.buffer_size(buffer_size);
+            for (wchar_t c : ws)
+                w1.write(c);
+            ioutils::text_writer w2(ss2, policy);
+            w2.buffer_size(buffer_size);
+            w2.write(ws.substr(0, 2));
+            w2.write(wstring_view(ws).substr(2, 5));
+            w2.write(ws.substr(7));
+        }
+        EXPECT_EQ(ss1.str(), expected) << buffer_size;
+        EXPECT_EQ(ss2.str(), expected) << buffer_size;
+    }
+}
+
+class failing_wbuffer : public std::wstreambuf
+{ };
+
+TEST_F(TextWriterTest, TestDestructorErrors)
+{
+    failing_wbuffer buffer;
+    wostream stream(&buffer);
+    stream.exceptions(ios::badbit);
+    {
+        ioutils::text_writer w(stream);
+        w.write(L"abc");
+        EXPECT_THROW(w.flush(), ios_base::failure);
+        // Error of the flush in destructor is ignored
+        w.write(L"def");
+    }
+    EXPECT_TRUE(stream.bad());
+}
+
 
 }
 }
@@ -0,0 +1,205 @@
+﻿#include <gtest/gtest.h>
+#include "json.h"
+#include <sstream>
+#include <limits>
+#include "strutils.h"
+#include "testutils.h"
+
+using namespace std;
+
+namespace stdext
+{
+namespace json_binding_test
+{
+
+struct point
+{
+    int64_t x = 0;
+    int64_t y = 0;
+    optional<wstring> label;
+};
+
+struct shape
+{
+    wstring name;
+    bool visible = false;
+    double scale = 1.0;
+    uint8_t layer = 0;
+    uint64_t id = 0;
+    vector<point> points;
+    optional<point> center;
+    vector<vector<int32_t>> matrix;
+};
+
+}
+}
+
+STDEXT_JSON_BINDING(stdext::json_binding_test::point,
+    STDEXT_JSON_FIELD(stdext::json_binding_test::point, x),
+    STDEXT_JSON_FIELD(stdext::json_binding_test::point, y),
+    STDEXT_JSON_FIELD(stdext::json_binding_test::point, label))
+
+STDEXT_JSON_BINDING(stdext::json_binding_test::shape,
+    STDEXT_JSON_FIELD(stdext::json_binding_test::shape, name),
+    STDEXT_JSON_FIELD(stdext::json_binding_test::shape, visible),
+    STDEXT_JSON_FIELD(stdext::json_binding_test::shape, scale),
+    STDEXT_JSON_FIELD(stdext::json_binding_test::shape, layer),
+    STDEXT_JSON_FIELD(stdext::json_binding_test::shape, id),
+    STDEXT_JSON_FIELD(stdext::json_binding_test::shape, points),
+    STDEXT_JSON_FIELD(stdext::json_binding_test::shape, center),
+    STDEXT_JSON_FIELD(stdext::json_binding_test::shape, matrix))
+
+namespace stdext
+{
+namespace json_binding_test
+{
+
+class JsonBindingTest : public testing::Test
+{
+protected:
+    template <class T>
+    bool Read(const wstring& text, T& value, vector<json::parser_msg_kind>* kinds = nullptr, vector<wstring>* texts = nullptr,
+              vector<parsers::textpos>* positions = nullptr)
+    {
+        wistringstream ss(text);
+        json::typed_reader<T> r(value);
+        bool result = r.read(ss);
+        for (auto msg : r.messages().errors())
+        {
+            if (kinds != nullptr)
+                kinds->push_back(msg->kind());
+            if (texts != nullptr)
+                texts->push_back(msg->text());
+            if (positions != nullptr)
+                positions->push_back(msg->pos());
+        }
+        return result;
+    }
+};
+
+TEST_F(JsonBindingTest, TestPerfectHashIndex)
+{
+    vector<wstring> names;
+    for (int i = 0; i < 200; i++)
+        names.push_back(str::wformat(L"member%d", i));
+    json::perfect_hash_index index(names);
+    EXPECT_EQ(index.size(), names.size());
+    EXPECT_GE(index.table_size(), names.size());
+    for (size_t i = 0; i < names.size(); i++)
+        EXPECT_EQ(index.find(names[i]), i);
+    EXPECT_EQ(index.find(L"member200"), json::perfect_hash_index::npos);
+    EXPECT_EQ(index.find(L""), json::perfect_hash_index::npos);
+    EXPECT_EQ(json::perfect_hash_index().find(L"x"), json::perfect_hash_index::npos);
+    EXPECT_THROW(json::perfect_hash_index({ L"a", L"b", L"a" }), json::exception);
+}
+
+TEST_F(JsonBindingTest, TestRead)
+{
+    shape s;
+    ASSERT_TRUE(Read(L"{\"name\":\"tri\\u00e4ngle\",\"visible\":true,\"scale\":2,\"layer\":255,\"id\":18446744073709551615,"
+                     L"\"unknown\":{\"x\":[1,{\"y\":2}]},"
+                     L"\"points\":[{\"x\":1,\"y\":2,\"label\":\"a\"},{\"y\":-3,\"label\":null},{}],"
+                     L"\"center\":{\"x\":5},\"matrix\":[[1,2],[],[3]]}", s));
+    EXPECT_EQ(s.name, L"triängle");
+    EXPECT_TRUE(s.visible);
+    EXPECT_EQ(s.scale, 2.0);
+    EXPECT_EQ(s.layer, 255);
+    EXPECT_EQ(s.id, numeric_limits<uint64_t>::max());
+    ASSERT_EQ(s.points.size(), 3u);
+    EXPECT_EQ(s.points[0].x, 1);
+    EXPECT_EQ(s.points[0].y, 2);
+    EXPECT_EQ(s.points[0].label, optional<wstring>(L"a"));
+    EXPECT_EQ(s.points[1].x, 0);
+    EXPECT_EQ(s.points[1].y, -3);
+    EXPECT_FALSE(s.points[1].label.has_value());
+    ASSERT_TRUE(s.center.has_value());
+    EXPECT_EQ(s.center->x, 5);
+    EXPECT_EQ(s.matrix, (vector<vector<int32_t>>{ { 1, 2 }, {}, { 3 } }));
+
+    // Arrays are replaced, missing members are kept, null resets optional values
+    ASSERT_TRUE(Read(L"{\"points\":[{\"x\":9}],\"center\":null}", s));
+    ASSERT_EQ(s.points.size(), 1u);
+    EXPECT_EQ(s.points[0].x, 9);
+    EXPECT_FALSE(s.center.has_value());
+    EXPECT_EQ(s.name, L"triängle");
+
+    vector<point> points;
+    ASSERT_TRUE(Read(L"[{\"x\":1},{\"y\":2}]", points));
+    ASSERT_EQ(points.size(), 2u);
+    EXPECT_EQ(points[1].y, 2);
+}
+
+TEST_F(JsonBindingTest, TestErrors)
+{
+    shape s;
+    vector<json::parser_msg_kind> kinds;
+    vector<wstring> texts;
+    EXPECT_FALSE(Read(L"{\"name\":1,\"visible\":null,\"layer\":256,\"id\":-1,\"points\":{},\"center\":[],"
+                      L"\"matrix\":[[1.5,\"x\",2147483648]],\"scale\":\"big\"}", s, &kinds, &texts));
+    EXPECT_EQ(kinds, (vector<json::parser_msg_kind>{
+        json::parser_msg_kind::err_binding_type_mismatch_fmt,
+        json::parser_msg_kind::err_binding_type_mismatch_fmt,
+        json::parser_msg_kind::err_binding_number_out_of_range_fmt,
+        json::parser_msg_kind::err_binding_number_out_of_range_fmt,
+        json::parser_msg_kind::err_binding_type_mismatch_fmt,
+        json::parser_msg_kind::err_binding_type_mismatch_fmt,
+        json::parser_msg_kind::err_binding_type_mismatch_fmt,
+        json::parser_msg_kind::err_binding_type_mismatch_fmt,
+        json::parser_msg_kind::err_binding_number_out_of_range_fmt,
+        json::parser_msg_kind::err_binding_type_mismatch_fmt }));
+    EXPECT_EQ(texts[0], L"Value does not match the type of 'name'");
+    EXPECT_EQ(texts[2], L"Number is out of range of 'layer'");
+    EXPECT_EQ(texts[6], L"Value does not match the type of 'matrix'");
+    EXPECT_EQ(s.layer, 0);
+    EXPECT_EQ(s.id, 0u);
+
+    // Errors are reported at the position of the value
+    kinds.clear();
+    vector<parsers::textpos> positions;
+    EXPECT_FALSE(Read(L"{\"name\":1,\n \"layer\":256,\n  \"matrix\":[[1.5]]}", s, &kinds, nullptr, &positions));
+    ASSERT_EQ(positions.size(), 3u);
+    EXPECT_EQ(positions[0], parsers::textpos(1, 9));
+    EXPECT_EQ(positions[1], parsers::textpos(2, 10));
+    EXPECT_EQ(positions[2], parsers::textpos(3, 14));
+
+    // Syntax errors are reported by parser
+    kinds.clear();
+    EXPECT_FALSE(Read(L"{\"name\":", s, &kinds));
+    EXPECT_FALSE(kinds.empty());
+}
+
+TEST_F(JsonBindingTest, TestWrite)
+{
+    shape s;
+    s.name = L"a\"b";
+    s.scale = 0.1;
+    s.id = numeric_limits<uint64_t>::max();
+    s.points.push_back(point{ 1, -2, L"p" });
+    s.points.push_back(point{ 3, 4, nullopt });
+    s.matrix = { { 1 }, {} };
+    wstring ws;
+    json::typed_writer<shape> w(s);
+    w.write(ws);
+    EXPECT_EQ(ws, L"{\"name\":\"a\\\"b\",\"visible\":false,\"scale\":0.1,\"layer\":0,\"id\":18446744073709551615,"
+                  L"\"points\":[{\"x\":1,\"y\":-2,\"label\":\"p\"},{\"x\":3,\"y\":4,\"label\":null}],"
+                  L"\"center\":null,\"matrix\":[[1],[]]}");
+
+    shape s2;
+    ASSERT_TRUE(Read(ws, s2));
+    wstring ws2;
+    json::typed_writer<shape>(s2).write(ws2);
+    EXPECT_EQ(ws2, ws);
+
+    s.scale = numeric_limits<double>::quiet_NaN();
+    json::dom_document doc;
+    json::dom_document_reader r(doc);
+    w.write(ws);
+    wistringstream ss(ws);
+    ASSERT_TRUE(r.read(ss));
+    json::dom_object* root = dynamic_cast<json::dom_object*>(doc.root());
+    ASSERT_TRUE(root != nullptr);
+    EXPECT_EQ(root->find_value(L"scale")->type(), json::dom_value_type::vt_literal);
+}
+
+}
+}
@@ -0,0 +1,237 @@
+﻿#include <gtest/gtest.h>
+#include "json.h"
+#include <sstream>
+#include <limits>
+#include "strutils.h"
+#include "testutils.h"
+
+using namespace std;
+
+namespace stdext
+{
+namespace json_cbor_test
+{
+
+class JsonCborTest : public testing::Test
+{
+protected:
+    const wstring default_test_file_name = L"current.cbor";
+
+    void ParseText(const wstring& text, json::dom_document& doc)
+    {
+        wistringstream ss(text);
+        json::dom_document_reader r(doc);
+        ASSERT_TRUE(r.read(ss)) << str::to_string(text);
+    }
+
+    string ToBytes(const wstring& text)
+    {
+        json::dom_document doc;
+        ParseText(text, doc);
+        string bytes;
+        json::cbor_document_writer w(doc);
+        w.write(bytes);
+        return bytes;
+    }
+
+    wstring ToText(const string& bytes)
+    {
+        json::dom_document doc;
+        json::cbor_document_reader r(doc);
+        EXPECT_TRUE(r.read(bytes));
+        wstring ws;
+        json::dom_document_writer w(doc);
+        w.write(ws);
+        return ws;
+    }
+
+    void CheckError(const string& bytes, const json::parser_msg_kind kind, const string& title)
+    {
+        json::dom_document doc;
+        json::cbor_document_reader r(doc);
+        EXPECT_FALSE(r.read(bytes)) << title;
+        ASSERT_TRUE(r.messages().has_errors()) << title;
+        EXPECT_EQ(r.messages().errors()[0]->kind(), kind) << title;
+    }
+
+    // Float texts are not kept in CBOR so their differences are allowed when the values are the same
+    void CheckSameValues(json::dom_document& ldoc, json::dom_document& rdoc, const json::dom_document_shape shape)
+    {
+        json::dom_document_diff_options options;
+        options.compare_all(true);
+        json::dom_document_diff diff = json::make_diff(ldoc, rdoc, options);
+        for (const auto& item : diff.items())
+        {
+            ASSERT_EQ(item.kind(), json::dom_document_diff_kind::value_diff) << json::to_string(shape) << item.to_string();
+            ASSERT_EQ(item.lval()->type(), json::dom_value_type::vt_number) << json::to_string(shape) << item.to_string();
+            auto lnum = dynamic_cast<const json::dom_number*>(item.lval());
+            auto rnum = dynamic_cast<const json::dom_number*>(item.rval());
+            EXPECT_EQ(lnum->value().float_value(), rnum->value().float_value()) << json::to_string(shape) << item.to_string();
+        }
+    }
+};
+
+TEST_F(JsonCborTest, TestEncoding)
+{
+    EXPECT_EQ(ToBytes(L"0"), string("\x00", 1));
+    EXPECT_EQ(ToBytes(L"23"), string("\x17"));
+    EXPECT_EQ(ToBytes(L"24"), string("\x18\x18"));
+    EXPECT_EQ(ToBytes(L"1000"), string("\x19\x03\xe8"));
+    EXPECT_EQ(ToBytes(L"-1"), string("\x20"));
+    EXPECT_EQ(ToBytes(L"-1000"), string("\x39\x03\xe7"));
+    EXPECT_EQ(ToBytes(L"1.5"), string("\xfa\x3f\xc0\x00\x00", 5));
+    EXPECT_EQ(ToBytes(L"0.1"), string("\xfb\x3f\xb9\x99\x99\x99\x99\x99\x9a"));
+    EXPECT_EQ(ToBytes(L"[true,false,null]"), string("\x83\xf5\xf4\xf6"));
+    EXPECT_EQ(ToBytes(L"{\"a\":[1,\"x\"]}"), string("\xa1\x61\x61\x82\x01\x61\x78"));
+    EXPECT_EQ(ToBytes(L"\"ü\""), string("\x62\xc3\xbc"));
+    EXPECT_EQ(ToBytes(L"18446744073709551615"), string("\x1b\xff\xff\xff\xff\xff\xff\xff\xff"));
+    EXPECT_EQ(ToBytes(L"-18446744073709551616"), string("\x3b\xff\xff\xff\xff\xff\xff\xff\xff"));
+}
+
+TEST_F(JsonCborTest, TestDecoding)
+{
+    EXPECT_EQ(ToText(string("\x83\x01\x20\xf9\x3e\x00", 6)), L"[1,-1,1.5]");
+    EXPECT_EQ(ToText(string("\x9f\x01\x9f\xff\xff")), L"[1,[]]");
+    EXPECT_EQ(ToText(string("\xbf\x61\x61\x01\x7f\x61\x62\x62\x63\x64\xff\xf7\xff")), L"{\"a\":1,\"bcd\":null}");
+    // tags are ignored
+    EXPECT_EQ(ToText(string("\xc1\x1a\x51\x4b\x67\xb0")), L"1363896240");
+    EXPECT_EQ(ToText(string("\xfa\x7f\x80\x00\x00", 5)), L"null");
+    EXPECT_EQ(ToText(string("\x3b\x80\x00\x00\x00\x00\x00\x00\x00", 9)), L"-9223372036854775809");
+    EXPECT_EQ(ToText(string("")), L"");
+}
+
+TEST_F(JsonCborTest, TestNumbers)
+{
+    const wstring text = L"[0,9223372036854775807,-9223372036854775808,18446744073709551615,"
+                         L"1.0,0.1,-2.5e-10,1e+300,123.456]";
+    json::dom_document doc1, doc2;
+    ParseText(text, doc1);
+    string bytes;
+    json::cbor_document_writer w(doc1);
+    w.write(bytes);
+    json::cbor_document_reader r(doc2);
+    ASSERT_TRUE(r.read(bytes));
+    json::dom_array* a1 = dynamic_cast<json::dom_array*>(doc1.root());
+    json::dom_array* a2 = dynamic_cast<json::dom_array*>(doc2.root());
+    ASSERT_TRUE(a1 != nullptr && a2 != nullptr);
+    ASSERT_EQ(a1->size(), a2->size());
+    for (size_t i = 0; i < a1->size(); i++)
+    {
+        json::dom_number* n1 = dynamic_cast<json::dom_number*>(a1->at(i));
+        json::dom_number* n2 = dynamic_cast<json::dom_number*>(a2->at(i));
+        ASSERT_TRUE(n2 != nullptr) << i;
+        EXPECT_EQ(n1->numtype(), n2->numtype()) << i;
+        EXPECT_EQ(n1->value().is_int(), n2->value().is_int()) << i;
+        EXPECT_EQ(n1->value().int_value(), n2->value().int_value()) << i;
+        EXPECT_EQ(n1->value().float_value(), n2->value().float_value()) << i;
+    }
+    EXPECT_EQ(a2->at(3)->text(), L"18446744073709551615");
+    EXPECT_EQ(a2->at(4)->text(), L"1.0");
+    EXPECT_EQ(a2->at(5)->text(), L"0.1");
+}
+
+TEST_F(JsonCborTest, TestSaxWriter)
+{
+    const wstring text = L"{\"name\":\"Жук\",\"list\":[1,2.5,{\"x\":[]},{}],\"ok\":true,\"none\":null}";
+    ostringstream ss;
+    json::cbor_writer writer(ss);
+    json::msg_collector_t mc;
+    wistringstream ws(text);
+    ioutils::text_reader reader(ws);
+    json::sax_parser parser(reader, mc, writer);
+    ASSERT_TRUE(parser.run());
+    EXPECT_EQ(ToText(ss.str()), text);
+}
+
+TEST_F(JsonCborTest, TestGeneratedDocs)
+{
+    for (json::dom_document_shape shape : {
+         json::dom_document_shape::mixed,
+         json::dom_document_shape::wide_flat,
+         json::dom_document_shape::deep,
+         json::dom_document_shape::number_heavy,
+         json::dom_document_shape::string_heavy,
+         json::dom_document_shape::unicode_heavy })
+    {
+        // Generated numbers keep the values that are more precise than their texts, so read the text back
+        json::dom_document_generator gen;
+        gen.conf().shape(shape);
+        gen.conf().seed(12345);
+        gen.conf().target_size(50000);
+        wstringstream gs;
+        gen.write(gs);
+        json::dom_document doc1, doc2;
+        ParseText(gs.str(), doc1);
+        json::cbor_document_writer w(doc1);
+        w.write_to_file(default_test_file_name);
+        json::cbor_document_reader r(doc2);
+        ASSERT_TRUE(r.read_file(default_test_file_name)) << json::to_string(shape);
+        CheckSameValues(doc1, doc2, shape);
+        // SAX writer output reads to the same document
+        wstring text;
+        json::dom_document_writer tw(doc1);
+        tw.write(text);
+        ostringstream ss;
+        json::cbor_writer writer(ss);
+        json::msg_collector_t mc;
+        wistringstream ws(text);
+        ioutils::text_reader reader(ws);
+        json::sax_parser parser(reader, mc, writer);
+        ASSERT_TRUE(parser.run());
+        istringstream bs(ss.str());
+        json::dom_document doc3;
+        json::cbor_document_reader r3(doc3);
+        ASSERT_TRUE(r3.read(bs)) << json::to_string(shape);
+        CheckSameValues(doc1, doc3, shape);
+    }
+}
+
+TEST_F(JsonCborTest, TestErrors)
+{
+    CheckError(string("\x83\x01\x02"), json::parser_msg_kind::err_unexpected_text_end, "Short array");
+    CheckError(string("\x19\x01"), json::parser_msg_kind::err_unexpected_text_end, "Short argument");
+    CheckError(string("\x65\x61\x62"), json::parser_msg_kind::err_unexpected_text_end, "Short string");
+    CheckError(string("\x7b\x7f\xff\xff\xff\xff\xff\xff\xff"), json::parser_msg_kind::err_unexpected_text_end, "Huge string");
+    CheckError(string("\x42\x61\x62"), json::parser_msg_kind::err_invalid_cbor_item_fmt, "Byte string");
+    CheckError(string("\x1c"), json::parser_msg_kind::err_invalid_cbor_item_fmt, "Reserved argument");
+    CheckError(string("\xf0"), json::parser_msg_kind::err_invalid_cbor_item_fmt, "Simple value");
+    CheckError(string("\xa1\x01\x02"), json::parser_msg_kind::err_expected_member_name, "Integer key");
+    CheckError(string("\x62\xc3\x28"), json::parser_msg_kind::err_invalid_utf8_string, "Invalid UTF-8");
+    CheckError(string("\x01\x02"), json::parser_msg_kind::err_unexpected_lexeme_fmt, "Trailing data");
+    CheckError(string("\xa2\x61\x61\x01\x61\x61\x02"), json::parser_msg_kind::err_member_name_duplicate_fmt, "Duplicate");
+}
+
+TEST_F(JsonCborTest, TestErrorLimits)
+{
+    // Duplicate member fills the collector, so the trailing data error is dropped
+    const string bytes("\xa2\x61\x61\x01\x61\x61\x02\x01");
+    for (const bool fail_fast : { false, true })
+    {
+        json::msg_collector_t mc;
+        if (fail_fast)
+            mc.fail_fast(true);
+        else
+            mc.limit(1);
+        json::dom_document doc;
+        json::dom_handler handler(doc, mc, L"");
+        json::cbor_reader r(bytes.data(), bytes.size(), mc, handler);
+        EXPECT_FALSE(r.run()) << fail_fast;
+        ASSERT_EQ(mc.errors().size(), 1u) << fail_fast;
+        EXPECT_EQ(mc.errors()[0]->kind(), json::parser_msg_kind::err_member_name_duplicate_fmt) << fail_fast;
+        EXPECT_EQ(mc.dropped_count(), 1u) << fail_fast;
+    }
+    json::msg_collector_t mc;
+    json::dom_document doc;
+    json::dom_handler handler(doc, mc, L"");
+    json::cbor_reader r(bytes.data(), bytes.size(), mc, handler);
+    EXPECT_FALSE(r.run());
+    ASSERT_EQ(mc.errors().size(), 2u);
+    EXPECT_EQ(mc.errors()[1]->text(), L"Unexpected '0x01'");
+    json::cbor_reader r2("\x1c", 1, mc, handler);
+    EXPECT_FALSE(r2.run());
+    ASSERT_EQ(mc.errors().size(), 3u);
+    EXPECT_EQ(mc.errors()[2]->text(), L"Invalid or unsupported CBOR item: 0x1c");
+}
+
+}
+}
@@ -49,12 +49,45 @@ TEST(JsonCommonTest, TestToEscaped)
     EXPECT_EQ(L"\xD834-\xDD1E", json::to_escaped(L"\xD834-\xDD1E")) << "Invalid surrogate pair 2";
 }
 
+TEST(JsonCommonTest, TestAppendEscaped)
+{
+    wstring buf = L"prefix:";
+    json::append_escaped(buf, L"ABC");
+    EXPECT_EQ(L"prefix:ABC", buf) << "1";
+    json::append_escaped(buf, L'\n');
+    EXPECT_EQ(L"prefix:ABC\\n", buf) << "2";
+    buf.clear();
+    json::append_escaped(buf, L"Quick \"brown\"\tfox\x1\xFDD0 jumps");
+    EXPECT_EQ(L"Quick \\\"brown\\\"\\tfox\\u0001\\uFDD0 jumps", buf) << "3";
+    buf.clear();
+    json::append_escaped(buf, L"A\"", true);
+    EXPECT_EQ(L"\\u0041\\\"", buf) << "4";
+    EXPECT_EQ(wstring::npos, json::find_escaping_required(L"ABC"));
+    EXPECT_EQ(1u, json::find_escaping_required(L"A\nBC"));
+    EXPECT_EQ(3u, json::find_escaping_required(L"A\nB\\C", 2));
+    // Table-driven escaping should match the per-character one
+    wstring ws, expected;
+    for (int i = 0x1; i < 0xFFFF; i++)
+    {
+        wchar_t c = static_cast<wchar_t>(i);
+        ws += c;
+        expected += json::to_escaped(c);
+    }
+    buf.clear();
+    json::append_escaped(buf, ws);
+    EXPECT_EQ(expected, buf) << "5";
+}
+
 TEST(JsonCommonTest, TestToUnescaped)
 {
     EXPECT_EQ(L"ABC", json::to_unescaped(L"ABC"));
     EXPECT_EQ(L"ABC", json::to_unescaped(L"\\u0041\\u0042\\u0043"));
     EXPECT_EQ(L"\x0001\x0019\x0022\\", json::to_unescaped(L"\\u0001\\u0019\\u0022\\u005C"));
     EXPECT_EQ(L"\\u123X", json::to_unescaped(L"\\u123X"));
+    EXPECT_EQ(L"a\\b\x00AB" L"c\\u12", json::to_unescaped(L"a\\b\\u00abc\\u12"));
+    wstring buf = L"prefix:";
+    json::append_unescaped(buf, L"\\u0041BC\\u0044");
+    EXPECT_EQ(L"prefix:ABCD", buf);
 }
 
 }
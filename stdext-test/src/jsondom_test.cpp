@@ -3,6 +3,7 @@
 #include <vector>
 #include <algorithm>
 #include <limits>
+#include <thread>
 #include "locutils.h"
 #include "strutils.h"
 #include "testutils.h"
@@ -193,6 +194,20 @@ TEST_F(JsonDomTest, TestDomValues_Number)
                 L"123456.0", json::dom_number_type::nvt_float, L"Float 2.8");
     test_number(doc.create_number(0e+80),
                 L"0.0", json::dom_number_type::nvt_float, L"Float 2.9");
+    //
+    json::dom_number* n = doc.create_number(L"-123456", json::dom_number_type::nvt_int);
+    EXPECT_TRUE(n->value().is_int()) << L"Value 1";
+    EXPECT_EQ(-123456, n->value().int_value()) << L"Value 1";
+    n->text(L"123.5");
+    EXPECT_FALSE(n->value().is_int()) << L"Value 2";
+    EXPECT_EQ(123.5, n->value().float_value()) << L"Value 2";
+    delete n;
+    n = doc.create_number(std::numeric_limits<int64_t>::min());
+    EXPECT_EQ(std::numeric_limits<int64_t>::min(), n->value().int_value()) << L"Value 3";
+    delete n;
+    n = doc.create_number(0.125);
+    EXPECT_EQ(0.125, n->value().float_value()) << L"Value 4";
+    delete n;
 }
 
 TEST_F(JsonDomTest, TestDomValues_Number_Random)
@@ -519,6 +534,199 @@ TEST_F(JsonDomTest, TestDomDocumentComparison)
     ASSERT_TRUE(json::equal(doc1, doc2)) << L"Cmp 6";
 }
 
+TEST_F(JsonDomTest, TestDomDocumentClone)
+{
+    testutils::memchecker chk;
+    {
+        shared_ptr<json::dom_document> source = make_shared<json::dom_document>();
+        FillTestDoc(*source);
+        json::dom_array* a1 = dynamic_cast<json::dom_array*>(source->root());
+        a1->append(source->create_string(L"a\\u005Cu0041"));
+        ASSERT_EQ(a1->at(3)->text(), L"a\\u0041");
+
+        json::dom_document clone;
+        clone.clone_from(source);
+        json::dom_array* c1 = dynamic_cast<json::dom_array*>(clone.root());
+        ASSERT_NE(c1, nullptr);
+        EXPECT_NE(c1, a1);
+        EXPECT_TRUE(c1->is_shared());
+        EXPECT_EQ(c1->size(), 4u);
+        EXPECT_TRUE(c1->is_shared()) << L"Size does not copy";
+        // Only the path to the changed value is copied
+        json::dom_object* co = dynamic_cast<json::dom_object*>(c1->at(2));
+        ASSERT_NE(co, nullptr);
+        EXPECT_FALSE(c1->is_shared());
+        EXPECT_TRUE(co->is_shared());
+        co->append_member(L"New", clone.create_number(1));
+        EXPECT_FALSE(co->is_shared());
+        json::dom_array* ca2 = dynamic_cast<json::dom_array*>(co->find_value(L"Arr 2"));
+        ASSERT_NE(ca2, nullptr);
+        EXPECT_TRUE(ca2->is_shared());
+        EXPECT_EQ(ca2->document(), &clone);
+        EXPECT_EQ(co->size(), 6u);
+        EXPECT_EQ(dynamic_cast<json::dom_object*>(a1->at(2))->size(), 5u);
+        EXPECT_EQ(c1->at(3)->text(), L"a\\u0041");
+        EXPECT_FALSE(json::equal(*source, clone));
+        co->members()->at(5)->value()->text(L"2");
+        dynamic_cast<json::dom_object*>(a1->at(2))->append_member(L"New", source->create_number(2));
+        EXPECT_TRUE(json::equal(*source, clone));
+
+        // Clone of clone does not copy the values of shared clone
+        shared_ptr<json::dom_document> shared_clone = make_shared<json::dom_document>();
+        shared_clone->clone_from(source);
+        json::dom_document clone2;
+        clone2.clone_from(shared_clone);
+        EXPECT_TRUE(json::equal(*source, clone2));
+        EXPECT_TRUE(dynamic_cast<json::dom_array*>(shared_clone->root())->is_shared());
+
+        // Shared values live while clones refer to them
+        json::dom_document clone3;
+        clone3.clone_from(source);
+        source.reset();
+        shared_clone.reset();
+        json::dom_document doc;
+        FillTestDoc(doc);
+        EXPECT_EQ(dynamic_cast<json::dom_array*>(clone3.root())->size(), 4u);
+        dynamic_cast<json::dom_array*>(clone3.root())->at(2);
+        json::dom_array* da = dynamic_cast<json::dom_array*>(doc.root());
+        da->append(doc.create_string(L"a\\u005Cu0041"));
+        dynamic_cast<json::dom_object*>(da->at(2))->append_member(L"New", doc.create_number(2));
+        EXPECT_TRUE(json::equal(doc, clone3));
+        EXPECT_TRUE(json::equal(doc, clone2));
+        clone2.clear();
+        EXPECT_EQ(clone2.root(), nullptr);
+    }
+    chk.checkpoint();
+    ASSERT_FALSE(chk.has_leaks()) << chk.wreport();
+}
+
+TEST_F(JsonDomTest, TestDomDocumentFrozen)
+{
+    shared_ptr<json::dom_document> source = make_shared<json::dom_document>();
+    FillTestDoc(*source);
+    json::dom_document doc;
+    doc.clone_from(source);
+    doc.freeze();
+    ASSERT_TRUE(doc.is_frozen());
+    json::dom_array* a1 = dynamic_cast<json::dom_array*>(doc.root());
+    ASSERT_NE(a1, nullptr);
+    EXPECT_FALSE(a1->is_shared());
+    json::dom_object* o1 = dynamic_cast<json::dom_object*>(a1->at(2));
+    EXPECT_FALSE(dynamic_cast<json::dom_array*>(o1->find_value(L"Arr 2"))->is_shared());
+    EXPECT_TRUE(json::equal(*source, doc));
+    EXPECT_EQ(source->root()->hash(), doc.root()->hash());
+
+    try
+    {
+        a1->append(source->create_number(1));
+        FAIL() << "Append";
+    }
+    catch (const json::dom_exception& e)
+    {
+        EXPECT_EQ(e.error(), json::dom_error::document_is_frozen);
+    }
+    EXPECT_THROW(doc.create_string(L"x"), json::dom_exception);
+    EXPECT_THROW(a1->at(0)->text(L"x"), json::dom_exception);
+    EXPECT_THROW(a1->at(1)->text(L"true"), json::dom_exception);
+    EXPECT_THROW(a1->clear(), json::dom_exception);
+    EXPECT_THROW(o1->clear(), json::dom_exception);
+    EXPECT_THROW(o1->members()->clear(), json::dom_exception);
+    EXPECT_THROW(o1->append_member(L"New", source->create_number(1)), json::dom_exception);
+    EXPECT_THROW(dynamic_cast<json::dom_number*>(o1->find_value(L"Num 1"))->numtype(json::dom_number_type::nvt_float), json::dom_exception);
+    EXPECT_THROW(doc.root(source->create_number(1)), json::dom_exception);
+    EXPECT_THROW(doc.clear(), json::dom_exception);
+    EXPECT_TRUE(json::equal(*source, doc));
+    // Moved document remains frozen
+    json::dom_document doc2(std::move(doc));
+    EXPECT_TRUE(doc2.is_frozen());
+    EXPECT_FALSE(doc.is_frozen());
+}
+
+TEST_F(JsonDomTest, TestDomDocumentFrozenDelete)
+{
+    json::dom_document doc;
+    doc.root(doc.create_string(L"Root"));
+    json::dom_value* str = doc.create_string(L"Detached");
+    json::dom_object* obj = doc.create_object();
+    obj->append_member(L"Num", doc.create_number(1));
+    json::dom_array* arr = doc.create_array();
+    arr->append(doc.create_literal(L"true"));
+    doc.freeze();
+    // Values created before freezing are deleted without the frozen check
+    delete str;
+    delete obj;
+    delete arr;
+    EXPECT_TRUE(doc.is_frozen());
+    EXPECT_NE(doc.root(), nullptr);
+}
+
+TEST_F(JsonDomTest, TestSharedDomDocument)
+{
+    json::shared_dom_document shared;
+    EXPECT_EQ(shared.version(), 0u);
+    ASSERT_NE(shared.get(), nullptr);
+    EXPECT_TRUE(shared.get()->is_frozen());
+    EXPECT_EQ(shared.get()->root(), nullptr);
+
+    shared_ptr<json::dom_document> doc = make_shared<json::dom_document>();
+    json::dom_array* a = doc->create_array();
+    doc->root(a);
+    for (int i = 0; i < 100; i++)
+        a->append(doc->create_number(0));
+    shared.publish(doc);
+    EXPECT_TRUE(doc->is_frozen());
+    EXPECT_EQ(shared.version(), 1u);
+    EXPECT_EQ(shared.get(), doc);
+
+    // Readers see either old or new version of every document, never a mix of them
+    const int version_count = 50;
+    std::atomic<bool> stop(false);
+    std::atomic<int> errors(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++)
+    {
+        readers.emplace_back([&shared, &stop, &errors]()
+        {
+            json::shared_dom_document::reader reader(shared);
+            while (!stop.load())
+            {
+                const json::dom_document& current = reader.doc();
+                const json::dom_array* root = dynamic_cast<const json::dom_array*>(current.root());
+                if (root == nullptr || root->size() != 100)
+                {
+                    errors++;
+                    continue;
+                }
+                const wstring first = (*root->begin())->text();
+                for (const json::dom_value* value : *root)
+                {
+                    if (value->text() != first)
+                        errors++;
+                }
+            }
+        });
+    }
+    for (int v = 1; v <= version_count; v++)
+    {
+        shared.update([v](json::dom_document& next)
+        {
+            json::dom_array* root = dynamic_cast<json::dom_array*>(next.root());
+            for (json::dom_value* value : *root)
+                value->text(std::to_wstring(v));
+        });
+    }
+    stop = true;
+    for (std::thread& t : readers)
+        t.join();
+    EXPECT_EQ(errors.load(), 0);
+    EXPECT_EQ(shared.version(), static_cast<uint64_t>(version_count + 1));
+    json::shared_dom_document::reader reader(shared);
+    EXPECT_EQ(dynamic_cast<const json::dom_array*>(reader.doc().root())->size(), 100u);
+    EXPECT_EQ(reader.version(), shared.version());
+    EXPECT_TRUE(doc->is_frozen()) << L"Old version is not changed";
+    EXPECT_EQ(dynamic_cast<json::dom_array*>(doc->root())->at(0)->text(), L"0");
+}
+
 TEST_F(JsonDomTest, TestDomDocumentMemory)
 {
     testutils::memchecker chk;
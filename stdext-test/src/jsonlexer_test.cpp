@@ -183,6 +183,31 @@ TEST_F(JsonLexerTest, TestNumbers)
     CheckLexeme(L"-0.0e-0", json::lexeme(json::token::number_float, textpos(1, 1), L"-0.0e-0"), L"Num 4.6");
 }
 
+TEST_F(JsonLexerTest, TestNumberValues)
+{
+    auto check = [](const wstring input, const bool is_int, const int64_t int_value, const double float_value)
+    {
+        wstringstream ss(input);
+        ioutils::text_reader r(ss);
+        json::msg_collector_t mc;
+        json::lexer lexer(r, mc);
+        json::lexeme lex;
+        ASSERT_TRUE(lexer.next_lexeme(lex)) << input;
+        EXPECT_EQ(is_int, lex.number().is_int()) << input;
+        if (is_int)
+        {
+            EXPECT_EQ(int_value, lex.number().int_value()) << input;
+        }
+        EXPECT_EQ(float_value, lex.number().float_value()) << input;
+    };
+    check(L"12345", true, 12345, 12345.0);
+    check(L"-12345 ", true, -12345, -12345.0);
+    check(L"123.456,", false, 0, 123.456);
+    check(L"-1.23456e-10]", false, 0, -1.23456e-10);
+    check(L"1e300}", false, 0, 1e300);
+    check(L"12345678901234567890", false, 0, 12345678901234567890.0);
+}
+
 TEST_F(JsonLexerTest, TestTexts)
 {
     lex_vector lv;
@@ -223,6 +248,31 @@ TEST_F(JsonLexerTest, TestTexts)
     CheckText(L"{\t\"abc def\": -4.54557e+18 }", lv, L"Test 5");
 }
 
+TEST_F(JsonLexerTest, TestLexemeCopies)
+{
+    using namespace parsers;
+    // Copies keep their positions after the lexer passed their lines and after it is deleted
+    vector<json::lexeme> copies;
+    {
+        wstringstream ss(L"[\n1,\n\n  true,\n\"a\"\n]");
+        ioutils::text_reader r(ss);
+        json::msg_collector_t mc;
+        json::lexer lexer(r, mc);
+        json::lexeme lex;
+        while (lexer.next_lexeme(lex))
+            copies.push_back(lex);
+        EXPECT_FALSE(lexer.has_errors());
+    }
+    ASSERT_EQ(7u, copies.size());
+    EXPECT_EQ(textpos(1, 1), copies[0].pos());
+    EXPECT_EQ(textpos(2, 1), copies[1].pos());
+    EXPECT_EQ(textpos(2, 2), copies[2].pos());
+    EXPECT_EQ(textpos(4, 3), copies[3].pos());
+    EXPECT_EQ(textpos(4, 7), copies[4].pos());
+    EXPECT_EQ(textpos(5, 1), copies[5].pos());
+    EXPECT_EQ(textpos(6, 1), copies[6].pos());
+}
+
 TEST_F(JsonLexerTest, TestLexerErrors)
 {
     using namespace parsers;
@@ -261,5 +311,39 @@ TEST_F(JsonLexerTest, TestLexerErrors)
     CheckError(L"\"\\x", json::parser_msg_kind::err_unrecognized_escape_seq_fmt, textpos(1, 2), L"E1070.1");
 }
 
+TEST_F(JsonLexerTest, TestLexerErrorLimits)
+{
+    wstring text = L"\"";
+    text.append(10000, L'\x01');
+    text += L"\"";
+    for (int mode = 0; mode < 3; mode++)
+    {
+        wstringstream ss(text);
+        ioutils::text_reader r(ss);
+        r.source_name(L"broken.json");
+        json::msg_collector_t mc;
+        if (mode == 1)
+            mc.limit(10);
+        else if (mode == 2)
+        {
+            mc.fail_fast(true);
+            mc.source_names(false);
+        }
+        json::lexer lexer(r, mc);
+        json::lexeme lex;
+        // Lexer stops when the collector is full
+        EXPECT_EQ(lexer.next_lexeme(lex), mode == 0) << mode;
+        const size_t expected_count = mode == 0 ? 10000 : (mode == 1 ? 10 : 1);
+        ASSERT_EQ(mc.errors().size(), expected_count) << mode;
+        EXPECT_EQ(mc.errors()[0]->text(), L"Unallowed character: \x01 (0x1)");
+        EXPECT_EQ(mc.errors()[0]->source(), mode == 2 ? L"" : L"broken.json");
+        EXPECT_EQ(mc.dropped_count(), 0u) << mode;
+        // Errors of the rest of the text are only counted
+        lexer.next_lexeme(lex);
+        EXPECT_EQ(mc.errors().size(), expected_count) << mode;
+        EXPECT_EQ(mc.dropped_count(), mode == 0 ? 0u : 1u) << mode;
+    }
+}
+
 }
 }
@@ -322,6 +322,26 @@ TEST_F(JsonParserTest, TestObjectErrors)
     CheckError(L"{\"Member1\":", json::parser_msg_kind::err_expected_value, textpos(1, 11), L"4.1");
 }
 
+TEST_F(JsonParserTest, TestErrorLimits)
+{
+    for (const bool fail_fast : { false, true })
+    {
+        wstringstream ss(L"[\"\x01\x01\x01\"");
+        ioutils::text_reader r(ss);
+        json::msg_collector_t mc;
+        if (fail_fast)
+            mc.fail_fast(true);
+        else
+            mc.limit(2);
+        json::dom_document doc;
+        json::dom_parser parser(r, mc, doc);
+        EXPECT_FALSE(parser.run()) << fail_fast;
+        EXPECT_EQ(mc.errors().size(), fail_fast ? 1u : 2u) << fail_fast;
+        // Unclosed array is not reported because the lexer has filled the collector
+        EXPECT_GT(mc.dropped_count(), 0u) << fail_fast;
+    }
+}
+
 TEST_F(JsonParserTest, TestGeneratedDocs)
 {
     const int max_test_count = 100;
@@ -342,5 +362,88 @@ TEST_F(JsonParserTest, TestGeneratedDocs)
     }
 }
 
+/*
+ * Event reader tests
+ */
+class JsonEventReaderTest : public testing::Test
+{
+protected:
+    wstring ReadEvents(const wstring input, bool& has_errors)
+    {
+        wstringstream ss(input);
+        ioutils::text_reader r(ss);
+        json::msg_collector_t mc;
+        json::event_reader reader(r, mc);
+        wstring result;
+        while (reader.next())
+        {
+            result += json::to_wstring(reader.kind());
+            if (reader.kind() == json::event_kind::member_name ||
+                reader.kind() == json::event_kind::literal ||
+                reader.kind() == json::event_kind::number ||
+                reader.kind() == json::event_kind::string)
+                result += L":" + reader.current().text();
+            result += str::wformat(L"(%d) ", static_cast<int>(reader.level()));
+        }
+        has_errors = reader.has_errors();
+        return result;
+    }
+
+    void CheckEvents(const wstring input, const wstring expected, const wstring title)
+    {
+        bool has_errors = false;
+        EXPECT_EQ(expected, ReadEvents(input, has_errors)) << title;
+        EXPECT_FALSE(has_errors) << title;
+    }
+
+    void CheckError(const wstring input, const wstring title)
+    {
+        bool has_errors = false;
+        ReadEvents(input, has_errors);
+        EXPECT_TRUE(has_errors) << title;
+    }
+};
+
+TEST_F(JsonEventReaderTest, TestEvents)
+{
+    CheckEvents(L"", L"", L"1");
+    CheckEvents(L"null", L"literal:null(0) ", L"2");
+    CheckEvents(L"[1, \"a\"]", L"begin_array(1) number:1(1) string:a(1) end_array(0) ", L"3");
+    CheckEvents(L"{\"a\": {\"b\": []}, \"c\": 1.5}",
+                L"begin_object(1) member_name:a(1) begin_object(2) member_name:b(2) begin_array(3) end_array(2) "
+                L"end_object(1) member_name:c(1) number:1.5(1) end_object(0) ",
+                L"4");
+}
+
+TEST_F(JsonEventReaderTest, TestErrors)
+{
+    CheckError(L"[", L"1");
+    CheckError(L"[1,", L"2");
+    CheckError(L"[1 2]", L"3");
+    CheckError(L"{1:2}", L"4");
+    CheckError(L"{\"a\" 2}", L"5");
+    CheckError(L"[}", L"6");
+    CheckError(L"[] []", L"7");
+    CheckError(L"[1,]", L"8");
+}
+
+TEST_F(JsonEventReaderTest, TestSkipValue)
+{
+    wstringstream ss(L"[[1, {\"a\": [2]}], 3]");
+    ioutils::text_reader r(ss);
+    json::msg_collector_t mc;
+    json::event_reader reader(r, mc);
+    ASSERT_TRUE(reader.next());
+    ASSERT_TRUE(reader.next());
+    ASSERT_TRUE(reader.skip_value());
+    EXPECT_TRUE(reader.kind() == json::event_kind::end_array);
+    EXPECT_EQ(1u, reader.level());
+    ASSERT_TRUE(reader.next());
+    EXPECT_EQ(L"3", reader.current().text());
+    ASSERT_TRUE(reader.next());
+    EXPECT_FALSE(reader.next());
+    EXPECT_FALSE(reader.has_errors());
+}
+
 }
 }
@@ -0,0 +1,198 @@
+﻿#include <gtest/gtest.h>
+#include "json.h"
+#include <sstream>
+#include "strutils.h"
+#include "testutils.h"
+
+using namespace std;
+
+namespace stdext
+{
+namespace json_snapshot_test
+{
+
+class JsonSnapshotTest : public testing::Test
+{
+protected:
+    const wstring default_test_file_name = L"current.jsnap";
+
+    void ParseText(const wstring& text, json::dom_document& doc)
+    {
+        wistringstream ss(text);
+        json::dom_document_reader r(doc);
+        ASSERT_TRUE(r.read(ss)) << str::to_string(text);
+    }
+
+    string ToBytes(const wstring& text)
+    {
+        json::dom_document doc;
+        ParseText(text, doc);
+        string bytes;
+        json::dom_snapshot_writer w(doc);
+        w.write(bytes);
+        return bytes;
+    }
+
+    wstring ToText(const json::dom_snapshot& snapshot)
+    {
+        json::dom_document doc;
+        snapshot.to_document(doc);
+        wstring ws;
+        json::dom_document_writer w(doc);
+        w.write(ws);
+        return ws;
+    }
+};
+
+TEST_F(JsonSnapshotTest, TestRoundTrip)
+{
+    for (const wstring text : {
+         L"",
+         L"null",
+         L"123",
+         L"\"\"",
+         L"[]",
+         L"{}",
+         L"[true,false,null,-1,1.5e+10,\"a\\\"b\",\"\u00fc\u4e2d\"]",
+         L"{\"b\":1,\"a\":[{\"b\":2,\"a\":{}}],\"\u00fc\":\"x\"}",
+         L"18446744073709551616" })
+    {
+        string bytes = ToBytes(text);
+        EXPECT_EQ(bytes.size() % 8, 0u) << str::to_string(text);
+        json::dom_snapshot snapshot;
+        snapshot.attach(bytes.data(), bytes.size());
+        EXPECT_EQ(ToText(snapshot), text);
+    }
+}
+
+TEST_F(JsonSnapshotTest, TestValues)
+{
+    string bytes = ToBytes(L"{\"name\":\"\\u00fcber\",\"id\":42,\"ratio\":0.25,\"big\":18446744073709551616,"
+                           L"\"ok\":true,\"list\":[null,\"x\",{\"id\":7}]}");
+    json::dom_snapshot snapshot;
+    snapshot.attach(bytes.data(), bytes.size());
+    json::dom_snapshot_value root = snapshot.root();
+    ASSERT_EQ(root.type(), json::dom_value_type::vt_object);
+    ASSERT_EQ(root.size(), 6u);
+    EXPECT_EQ(root.member_name(0), L"name");
+    EXPECT_EQ(root.utf8_member_name(5), "list");
+    EXPECT_EQ(root[0].text(), L"\u00fcber");
+    EXPECT_EQ(root.find(L"name").utf8_text(), "\xc3\xbc" "ber");
+
+    json::dom_snapshot_value id = root.find("id");
+    ASSERT_EQ(id.type(), json::dom_value_type::vt_number);
+    EXPECT_EQ(id.numtype(), json::dom_number_type::nvt_int);
+    EXPECT_TRUE(id.value().is_int());
+    EXPECT_EQ(id.value().int_value(), 42);
+    EXPECT_EQ(root.find(L"ratio").numtype(), json::dom_number_type::nvt_float);
+    EXPECT_EQ(root.find(L"ratio").value().float_value(), 0.25);
+    EXPECT_EQ(root.find(L"big").text(), L"18446744073709551616");
+    EXPECT_FALSE(root.find(L"big").value().is_int());
+    EXPECT_EQ(root.find(L"ok").literal_type(), json::dom_literal_type::lvt_true);
+    EXPECT_EQ(root.find(L"ok").text(), L"true");
+
+    json::dom_snapshot_value list = root.find(L"list");
+    ASSERT_EQ(list.type(), json::dom_value_type::vt_array);
+    ASSERT_EQ(list.size(), 3u);
+    EXPECT_EQ(list[0].literal_type(), json::dom_literal_type::lvt_null);
+    EXPECT_EQ(list[1].text(), L"x");
+    EXPECT_EQ(list[2].find(L"id").value().int_value(), 7);
+    EXPECT_EQ(list[0].size(), 0u);
+
+    EXPECT_TRUE(root.find(L"missing").is_null());
+    EXPECT_TRUE(root.find(L"").is_null());
+    EXPECT_TRUE(json::dom_snapshot().root().is_null());
+    EXPECT_THROW(list.find(L"id"), json::dom_exception);
+    EXPECT_THROW(id.literal_type(), json::dom_exception);
+    EXPECT_THROW(list.at(3), std::out_of_range);
+}
+
+TEST_F(JsonSnapshotTest, TestSharedNames)
+{
+    wstring text1 = L"[";
+    wstring text2 = L"[";
+    for (int i = 0; i < 100; i++)
+    {
+        if (i > 0)
+        {
+            text1 += L",";
+            text2 += L",";
+        }
+        text1 += L"{\"identifier\":1,\"description\":2}";
+        text2 += str::wformat(L"{\"identifier%03d\":1,\"description%03d\":2}", i, i);
+    }
+    text1 += L"]";
+    text2 += L"]";
+    // Each name node takes 24 bytes
+    EXPECT_EQ(ToBytes(text1).size() + 99 * 2 * 24, ToBytes(text2).size());
+}
+
+TEST_F(JsonSnapshotTest, TestGeneratedDocs)
+{
+    for (json::dom_document_shape shape : {
+         json::dom_document_shape::mixed,
+         json::dom_document_shape::wide_flat,
+         json::dom_document_shape::deep,
+         json::dom_document_shape::number_heavy,
+         json::dom_document_shape::string_heavy,
+         json::dom_document_shape::unicode_heavy })
+    {
+        json::dom_document doc1, doc2;
+        json::dom_document_generator gen(doc1);
+        gen.conf().shape(shape);
+        gen.conf().seed(12345);
+        gen.conf().target_size(50000);
+        gen.run();
+        json::dom_snapshot_writer w(doc1);
+        w.write_to_file(default_test_file_name);
+        json::dom_snapshot snapshot;
+        snapshot.open(default_test_file_name);
+        ASSERT_TRUE(snapshot.is_open());
+        snapshot.to_document(doc2);
+        EXPECT_FALSE(json::make_diff(doc1, doc2).has_differences()) << json::to_string(shape);
+        // Stream and memory images are the same
+        string bytes;
+        w.write(bytes);
+        ASSERT_EQ(bytes.size(), snapshot.size());
+        EXPECT_EQ(memcmp(bytes.data(), snapshot.data(), bytes.size()), 0) << json::to_string(shape);
+        snapshot.close();
+        EXPECT_FALSE(snapshot.is_open());
+    }
+}
+
+TEST_F(JsonSnapshotTest, TestErrors)
+{
+    json::dom_snapshot snapshot;
+    EXPECT_THROW(snapshot.open(L"not_existing.jsnap"), json::dom_exception);
+    string bytes = ToBytes(L"{\"a\":[1,2,3]}");
+    EXPECT_THROW(snapshot.attach(bytes.data(), 16), json::dom_exception);
+    EXPECT_THROW(snapshot.attach(bytes.data(), bytes.size() - 8), json::dom_exception);
+    string broken = bytes;
+    broken[0] = 'X';
+    EXPECT_THROW(snapshot.attach(broken.data(), broken.size()), json::dom_exception);
+    broken = bytes;
+    broken[8] = 2;
+    EXPECT_THROW(snapshot.attach(broken.data(), broken.size()), json::dom_exception);
+    // Root offset points to the trailer
+    broken = bytes;
+    uint64_t offset = broken.size() - 16;
+    memcpy(&broken[broken.size() - 16], &offset, sizeof(offset));
+    snapshot.attach(broken.data(), broken.size());
+    EXPECT_THROW(snapshot.root(), json::dom_exception);
+    // Member value refers to the object itself
+    broken = bytes;
+    memcpy(&offset, &broken[broken.size() - 16], sizeof(offset));
+    memcpy(&broken[offset + 16], &offset, sizeof(offset));
+    snapshot.attach(broken.data(), broken.size());
+    EXPECT_THROW(snapshot.root().at(0), json::dom_exception);
+    json::dom_document doc;
+    EXPECT_THROW(snapshot.to_document(doc), json::dom_exception);
+    // Invalid node type of the member name, which is written first
+    broken = bytes;
+    broken[16] = 9;
+    snapshot.attach(broken.data(), broken.size());
+    EXPECT_THROW(snapshot.root().find(L"a"), json::dom_exception);
+}
+
+}
+}
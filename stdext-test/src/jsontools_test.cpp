@@ -1,6 +1,8 @@
 ﻿#include <gtest/gtest.h>
 #include "jsontools.h"
+#include "csvtools.h"
 #include <fstream>
+#include <sstream>
 #include <vector>
 #include <algorithm>
 #include <limits>
@@ -113,6 +115,28 @@ TEST_F(JsonDocumentReaderTest, TestDocUtf8)
     }
 }
 
+TEST_F(JsonDocumentReaderTest, TestBasicTextReader)
+{
+    typedef ioutils::basic_text_reader<ioutils::memory_source<char>, ioutils::utf8_decoder> utf8_reader_t;
+    json::dom_document doc1;
+    json::dom_document_generator gen(doc1);
+    gen.conf().shape(json::dom_document_shape::unicode_heavy);
+    gen.conf().target_size(100000);
+    gen.run();
+    ioutils::text_io_policy_utf8 policy;
+    ostringstream ss;
+    {
+        ioutils::text_writer w(ss, policy);
+        json::dom_document_writer(doc1).write(w);
+    }
+    const string bytes = ss.str();
+    json::dom_document doc2;
+    json::dom_document_reader reader(doc2);
+    utf8_reader_t r(ioutils::memory_source<char>(bytes.data(), bytes.size()));
+    CheckReader(reader, reader.read(r));
+    EXPECT_FALSE(json::make_diff(doc1, doc2).has_differences());
+}
+
 /*
  * JSON document writer tests
  */
@@ -426,6 +450,132 @@ TEST_F(DomDocumentGeneratorTest, TestGenerationLimits)
     EXPECT_LE(item_count, std::pow(gen.conf().avg_children(), gen.conf().depth())) << "Count max";
 }
 
+TEST_F(DomDocumentGeneratorTest, TestSeed)
+{
+    auto generate = [](const unsigned int seed) -> wstring
+    {
+        json::dom_document doc;
+        json::dom_document_generator gen(doc);
+        gen.conf().depth(4);
+        gen.conf().seed(seed);
+        gen.run();
+        wstring s;
+        json::dom_document_writer w(doc);
+        w.write(s);
+        return s;
+    };
+    wstring s1 = generate(12345);
+    EXPECT_EQ(s1, generate(12345));
+    EXPECT_NE(s1, generate(54321));
+    // Repeated runs with the same seed
+    json::dom_document doc1, doc2;
+    json::dom_document_generator gen(doc1);
+    gen.conf().depth(3);
+    gen.conf().seed(1);
+    gen.run();
+    wstringstream ss1, ss2;
+    gen.write(ss1);
+    json::dom_document_writer(doc1).write(ss2);
+    EXPECT_EQ(ss1.str(), ss2.str());
+}
+
+TEST_F(DomDocumentGeneratorTest, TestStreaming)
+{
+    for (unsigned int seed = 1; seed <= 10; seed++)
+    {
+        json::dom_document_generator gen;
+        gen.conf().depth(5);
+        gen.conf().seed(seed);
+        wstringstream ss;
+        gen.write(ss);
+        json::dom_document doc;
+        json::dom_document_generator dom_gen(doc);
+        dom_gen.conf().depth(5);
+        dom_gen.conf().seed(seed);
+        dom_gen.run();
+        wstring expected;
+        json::dom_document_writer(doc).write(expected);
+        ASSERT_EQ(expected, ss.str()) << seed;
+    }
+    json::dom_document_generator gen;
+    EXPECT_THROW(gen.run(), json::dom_exception);
+}
+
+TEST_F(DomDocumentGeneratorTest, TestShapes)
+{
+    const size_t target_size = 20000;
+    for (json::dom_document_shape shape : {
+         json::dom_document_shape::mixed,
+         json::dom_document_shape::wide_flat,
+         json::dom_document_shape::deep,
+         json::dom_document_shape::number_heavy,
+         json::dom_document_shape::string_heavy,
+         json::dom_document_shape::unicode_heavy })
+    {
+        wstring title = json::to_wstring(shape);
+        json::dom_document_generator gen;
+        gen.conf().shape(shape);
+        gen.conf().seed(7);
+        gen.conf().target_size(target_size);
+        wstringstream ss;
+        gen.write(ss);
+        wstring s = ss.str();
+        EXPECT_GE(s.length(), target_size) << title;
+        json::dom_document doc;
+        json::dom_document_reader r(doc);
+        ss.seekg(0);
+        ASSERT_TRUE(r.read(ss)) << title;
+        ASSERT_TRUE(doc.root() != nullptr && doc.root()->type() == json::dom_value_type::vt_array) << title;
+        json::dom_array* root = dynamic_cast<json::dom_array*>(doc.root());
+        EXPECT_GT(root->size(), 0u) << title;
+        switch (shape)
+        {
+        case json::dom_document_shape::wide_flat:
+            for (json::dom_value* record : *root)
+            {
+                ASSERT_TRUE(record->type() == json::dom_value_type::vt_object) << title;
+                EXPECT_EQ(gen.conf().avg_children(), record->as_container()->count()) << title;
+            }
+            break;
+        case json::dom_document_shape::unicode_heavy:
+            EXPECT_TRUE(std::any_of(s.begin(), s.end(), [](wchar_t c) { return c > 0x3000; })) << title;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+TEST_F(DomDocumentGeneratorTest, TestTargetSize)
+{
+    for (json::dom_document_shape shape : {
+         json::dom_document_shape::mixed,
+         json::dom_document_shape::wide_flat,
+         json::dom_document_shape::deep,
+         json::dom_document_shape::number_heavy,
+         json::dom_document_shape::string_heavy,
+         json::dom_document_shape::unicode_heavy })
+    {
+        for (size_t target_size : { 100, 1000, 20000 })
+        {
+            for (unsigned int seed = 1; seed <= 10; seed++)
+            {
+                wstring title = json::to_wstring(shape) + str::wformat(L" %d %d", (int)target_size, seed);
+                json::dom_document_generator gen;
+                gen.conf().shape(shape);
+                gen.conf().seed(seed);
+                gen.conf().target_size(target_size);
+                wstringstream ss;
+                gen.write(ss);
+                const size_t length = ss.str().length();
+                EXPECT_GE(length, target_size) << title;
+                // Overshoot is limited by one record or scalar value and closing brackets
+                EXPECT_LE(length, target_size * 2 + 2000) << title;
+            }
+        }
+    }
+}
+
 /*
  * Diff tests
  */
@@ -573,5 +723,434 @@ TEST_F(JsonDomDocumentDiffTest, TestValue)
     CheckNoDiff(ldoc, rdoc, options, "Value 2");
 }
 
+TEST_F(JsonDomDocumentDiffTest, TestMemberOrder)
+{
+    json::dom_document ldoc, rdoc;
+    // ldoc is {"a":1,"b":[true],"c":"x"}
+    json::dom_object* lobj = ldoc.create_object();
+    ldoc.root(lobj);
+    lobj->append_member(L"a", ldoc.create_number(1));
+    json::dom_array* larr = ldoc.create_array();
+    larr->append(ldoc.create_literal(L"true"));
+    lobj->append_member(L"b", larr);
+    json::dom_value* lv = ldoc.create_string(L"x");
+    lobj->append_member(L"c", lv);
+    // rdoc is {"c":"x","b":[true],"a":1}
+    json::dom_object* robj = rdoc.create_object();
+    rdoc.root(robj);
+    json::dom_string* rv = rdoc.create_string(L"x");
+    robj->append_member(L"c", rv);
+    json::dom_array* rarr = rdoc.create_array();
+    rarr->append(rdoc.create_literal(L"true"));
+    robj->append_member(L"b", rarr);
+    robj->append_member(L"a", rdoc.create_number(1));
+    EXPECT_EQ(lobj->hash(), robj->hash());
+    json::dom_document_diff_options options;
+    CheckNoDiff(ldoc, rdoc, options, "Order 1");
+    // Cached hashes should be reset after changes
+    rv->text(L"y");
+    EXPECT_NE(lobj->hash(), robj->hash());
+    CheckHasDiffOfKind(json::dom_document_diff_kind::value_diff, ldoc, rdoc, lv, rv, options, "Order 2");
+    rv->text(L"x");
+    CheckNoDiff(ldoc, rdoc, options, "Order 3");
+    json::dom_value* rv2 = rdoc.create_literal(L"null");
+    rarr->append(rv2);
+    CheckHasDiffOfKind(json::dom_document_diff_kind::count_diff, ldoc, rdoc, larr, rarr, options, "Order 4");
+}
+
+TEST_F(JsonDomDocumentDiffTest, TestMemberCaseInsensitive)
+{
+    json::dom_document ldoc, rdoc;
+    // ldoc is {"a":1,"A":2}
+    json::dom_object* lobj = ldoc.create_object();
+    ldoc.root(lobj);
+    lobj->append_member(L"a", ldoc.create_number(1));
+    json::dom_value* lv = ldoc.create_number(2);
+    lobj->append_member(L"A", lv);
+    // rdoc is {"a":1,"b":2}
+    json::dom_object* robj = rdoc.create_object();
+    rdoc.root(robj);
+    robj->append_member(L"a", rdoc.create_number(1));
+    json::dom_value* rv = rdoc.create_number(2);
+    robj->append_member(L"b", rv);
+    json::dom_document_diff_options options;
+    options.case_sensitive(false);
+    options.compare_all(true);
+    // Right member matched once is not matched again
+    CheckHasDiffOfKind(json::dom_document_diff_kind::member_name_diff, ldoc, rdoc, lv, rv, options, "Member 1");
+    json::dom_document_diff diff = json::make_diff(ldoc, rdoc, options);
+    for (const json::dom_document_diff_item& item : diff.items())
+        EXPECT_NE(item.kind(), json::dom_document_diff_kind::value_diff);
+    diff = json::make_diff_parallel(ldoc, rdoc, options, 2);
+    EXPECT_TRUE(diff.has_differences());
+}
+
+TEST_F(JsonDomDocumentDiffTest, TestGeneratedDocs)
+{
+    json::dom_document_diff_options options;
+    for (int i = 1; i <= 20; i++)
+    {
+        json::dom_document ldoc;
+        json::dom_document_generator gen(ldoc);
+        gen.conf().depth(5);
+        gen.conf().avg_children(5);
+        gen.run();
+        json::dom_document_writer w(ldoc);
+        wstring s;
+        w.write(s);
+        json::dom_document rdoc;
+        wstringstream ss(s);
+        json::dom_document_reader r(rdoc);
+        ASSERT_TRUE(r.read(ss));
+        CheckNoDiff(ldoc, rdoc, options, str::to_string(str::wformat(L"Test_%d", i)));
+        if (this->HasFailure())
+            break;
+    }
+}
+
+TEST_F(JsonDomDocumentDiffTest, TestParallel)
+{
+    for (int i = 1; i <= 10; i++)
+    {
+        string title = str::to_string(str::wformat(L"Test_%d", i));
+        json::dom_document ldoc;
+        json::dom_document_generator gen(ldoc);
+        gen.conf().depth(5);
+        gen.conf().avg_children(6);
+        gen.run();
+        json::dom_document_writer w(ldoc);
+        wstring s;
+        w.write(s);
+        wstringstream ss(s);
+        json::dom_document rdoc;
+        json::dom_document_reader r(rdoc);
+        ASSERT_TRUE(r.read(ss)) << title;
+        int n = 0;
+        for (json::dom_document::iterator it = rdoc.begin(); it != rdoc.end(); ++it)
+        {
+            if ((*it)->type() == json::dom_value_type::vt_string && ++n % 7 == 0)
+                (*it)->text(L"changed");
+        }
+        json::dom_document_diff_options options;
+        options.compare_all(true);
+        json::dom_document_diff expected = json::make_diff(ldoc, rdoc, options);
+        json::dom_document_diff diff = json::make_diff_parallel(ldoc, rdoc, options, 4);
+        ASSERT_EQ(expected.items().size(), diff.items().size()) << title;
+        for (size_t j = 0; j < diff.items().size(); j++)
+        {
+            EXPECT_TRUE(expected.items()[j].kind() == diff.items()[j].kind()) << title;
+            EXPECT_EQ(expected.items()[j].lval(), diff.items()[j].lval()) << title;
+            EXPECT_EQ(expected.items()[j].rval(), diff.items()[j].rval()) << title;
+        }
+        options.compare_all(false);
+        expected = json::make_diff(ldoc, rdoc, options);
+        diff = json::make_diff_parallel(ldoc, rdoc, options, 4);
+        ASSERT_EQ(expected.items().size(), diff.items().size()) << title;
+        if (diff.has_differences())
+        {
+            EXPECT_EQ(expected.items()[0].lval(), diff.items()[0].lval()) << title;
+        }
+        if (this->HasFailure())
+            break;
+    }
+}
+
+TEST_F(JsonDomDocumentDiffTest, TestParallelShifted)
+{
+    json::dom_document ldoc, rdoc;
+    wistringstream lss(L"[[1,[2]],[3],\"a\"]");
+    ASSERT_TRUE(json::dom_document_reader(ldoc).read(lss));
+    wistringstream rss(L"[[1,2],[3],\"a\"]");
+    ASSERT_TRUE(json::dom_document_reader(rdoc).read(rss));
+    json::dom_document_diff_options options;
+    options.compare_all(true);
+    // Sequential walk is shifted after the first element
+    json::dom_document_diff expected = json::make_diff(ldoc, rdoc, options);
+    json::dom_document_diff diff = json::make_diff_parallel(ldoc, rdoc, options, 2);
+    ASSERT_TRUE(diff.has_differences());
+    EXPECT_LT(diff.items().size(), expected.items().size());
+    const json::dom_array* larr = dynamic_cast<const json::dom_array*>(ldoc.root());
+    const json::dom_value* lfirst = *larr->begin();
+    for (const json::dom_document_diff_item& item : diff.items())
+    {
+        EXPECT_TRUE(item.lval() == lfirst || item.lval()->parent() == lfirst ||
+                    item.lval()->parent()->parent() == lfirst) << item.to_string();
+    }
+    // Inserted element shifts the following ones in both cases
+    json::dom_document idoc;
+    wistringstream iss(L"[0,[1,[2]],[3],\"a\"]");
+    ASSERT_TRUE(json::dom_document_reader(idoc).read(iss));
+    expected = json::make_diff(idoc, ldoc, options);
+    diff = json::make_diff_parallel(idoc, ldoc, options, 2);
+    EXPECT_TRUE(expected.has_differences());
+    EXPECT_TRUE(diff.has_differences());
+    EXPECT_TRUE(diff.items()[0].kind() == json::dom_document_diff_kind::count_diff);
+}
+
+TEST_F(JsonDomDocumentDiffTest, TestParallelMembers)
+{
+    json::dom_document ldoc, rdoc;
+    json::dom_object* lobj = ldoc.create_object();
+    ldoc.root(lobj);
+    json::dom_object* robj = rdoc.create_object();
+    rdoc.root(robj);
+    for (int i = 0; i < 10; i++)
+    {
+        lobj->append_member(str::wformat(L"m%d", i), ldoc.create_number(i));
+        robj->append_member(str::wformat(L"M%d", 9 - i), rdoc.create_number(9 - i));
+    }
+    json::dom_document_diff_options options;
+    options.compare_all(true);
+    // Unmatched members are paired in order: m0 with M9 etc.
+    json::dom_document_diff diff = json::make_diff_parallel(ldoc, rdoc, options, 3);
+    ASSERT_EQ(20u, diff.items().size());
+    EXPECT_TRUE(json::dom_document_diff_kind::member_name_diff == diff.items()[0].kind());
+    EXPECT_TRUE(json::dom_document_diff_kind::value_diff == diff.items()[1].kind());
+    EXPECT_EQ(json::make_diff(ldoc, rdoc, options).items().size(), diff.items().size());
+    options.case_sensitive(false);
+    CheckNoDiff(ldoc, rdoc, options, "Members 1");
+    diff = json::make_diff_parallel(ldoc, rdoc, options, 3);
+    EXPECT_FALSE(diff.has_differences());
+}
+
+TEST_F(JsonDomDocumentDiffTest, TestClone)
+{
+    const wstring text = L"[{\"a\":[1,2],\"b\":{\"c\":\"x\"}},[3,[4]]]";
+    shared_ptr<json::dom_document> source = make_shared<json::dom_document>();
+    wistringstream ss(text);
+    ASSERT_TRUE(json::dom_document_reader(*source).read(ss));
+    source->freeze();
+    json::dom_document clone;
+    clone.clone_from(source);
+    const json::dom_array* root = dynamic_cast<const json::dom_array*>(clone.root());
+    ASSERT_NE(root, nullptr);
+    // Reading, writing and diffing do not copy the shared values
+    EXPECT_EQ(source->root()->hash(), root->hash());
+    CheckNoDiff(*source, clone, json::dom_document_diff_options(), "Clone 1");
+    EXPECT_FALSE(json::make_diff_parallel(*source, clone, json::dom_document_diff_options(), 2).has_differences());
+    wostringstream os;
+    json::dom_document_writer(clone).write(os);
+    EXPECT_EQ(text, os.str());
+    EXPECT_TRUE(root->is_shared());
+    const json::dom_object* obj = dynamic_cast<const json::dom_object*>(root->at(0));
+    ASSERT_NE(obj, nullptr);
+    EXPECT_EQ(L"x", dynamic_cast<const json::dom_object*>(obj->find_value(L"b"))->find_value(L"c")->text());
+    EXPECT_TRUE(root->is_shared());
+    // Only the path to the changed value is copied
+    json::dom_array* arr = dynamic_cast<json::dom_array*>(dynamic_cast<json::dom_array*>(clone.root())->at(1));
+    arr->append(clone.create_number(5));
+    EXPECT_FALSE(root->is_shared());
+    EXPECT_TRUE(dynamic_cast<const json::dom_object*>(root->at(0))->is_shared());
+    EXPECT_TRUE(dynamic_cast<const json::dom_array*>(arr->at(1))->is_shared());
+    json::dom_document_diff diff = json::make_diff(*source, clone);
+    ASSERT_EQ(1u, diff.items().size());
+    EXPECT_TRUE(json::dom_document_diff_kind::count_diff == diff.items()[0].kind());
+    EXPECT_TRUE(dynamic_cast<const json::dom_object*>(root->at(0))->is_shared());
+    EXPECT_TRUE(dynamic_cast<const json::dom_array*>(arr->at(1))->is_shared());
+    os.str(L"");
+    json::dom_document_writer(clone).write(os);
+    EXPECT_EQ(L"[{\"a\":[1,2],\"b\":{\"c\":\"x\"}},[3,[4],5]]", os.str());
+}
+
+/*
+ * Streaming diff tests
+ */
+class JsonStreamDiffTest : public testing::Test
+{
+protected:
+    class Collector : public json::stream_diff_handler_intf
+    {
+    public:
+        virtual void on_diff(const json::stream_diff_item& item) override { items.push_back(item); }
+        vector<json::stream_diff_item> items;
+    };
+
+    vector<json::stream_diff_item> MakeDiff(const wstring ltext,
+                                            const wstring rtext,
+                                            const json::dom_document_diff_options& options,
+                                            const wstring title)
+    {
+        wstringstream lss(ltext);
+        ioutils::text_reader lr(lss);
+        wstringstream rss(rtext);
+        ioutils::text_reader rr(rss);
+        Collector collector;
+        json::stream_diff diff(lr, rr, collector, options);
+        EXPECT_TRUE(diff.run()) << title;
+        EXPECT_EQ(collector.items.size(), diff.diff_count()) << title;
+        return collector.items;
+    }
+
+    void CheckNoDiff(const wstring ltext, const wstring rtext, const json::dom_document_diff_options& options, const wstring title)
+    {
+        vector<json::stream_diff_item> items = MakeDiff(ltext, rtext, options, title);
+        EXPECT_EQ(0u, items.size()) << title;
+        for (const json::stream_diff_item& item : items)
+            ADD_FAILURE() << title + L": " + item.to_wstring();
+    }
+
+    void CheckDiff(const json::dom_document_diff_kind expected_kind,
+                   const wstring expected_path,
+                   const wstring ltext,
+                   const wstring rtext,
+                   const json::dom_document_diff_options& options,
+                   const wstring title)
+    {
+        vector<json::stream_diff_item> items = MakeDiff(ltext, rtext, options, title);
+        ASSERT_FALSE(items.empty()) << title;
+        EXPECT_TRUE(expected_kind == items[0].kind()) << title + L": " + items[0].to_wstring();
+        EXPECT_EQ(expected_path, items[0].path()) << title;
+    }
+};
+
+TEST_F(JsonStreamDiffTest, TestEquals)
+{
+    json::dom_document_diff_options options;
+    CheckNoDiff(L"", L"", options, L"1");
+    CheckNoDiff(L"[1, 2.5, \"a\", null]", L"[1,2.5,\"a\",null]", options, L"2");
+    CheckNoDiff(L"{\"a\": {\"b\": [true, {}]}}", L"{ \"a\":{\"b\":[ true,{ } ] } }", options, L"3");
+    options.case_sensitive(false);
+    CheckNoDiff(L"{\"Name\": \"VALUE\"}", L"{\"name\": \"value\"}", options, L"4");
+}
+
+TEST_F(JsonStreamDiffTest, TestKinds)
+{
+    json::dom_document_diff_options options;
+    CheckDiff(json::dom_document_diff_kind::type_diff, L"", L"null", L"\"null\"", options, L"1");
+    CheckDiff(json::dom_document_diff_kind::type_diff, L"/1", L"[1, [2]]", L"[1, {}]", options, L"2");
+    CheckDiff(json::dom_document_diff_kind::numtype_diff, L"/0", L"[1]", L"[1.0]", options, L"3");
+    CheckDiff(json::dom_document_diff_kind::value_diff, L"/a/b", L"{\"a\":{\"b\":1}}", L"{\"a\":{\"b\":2}}", options, L"4");
+    CheckDiff(json::dom_document_diff_kind::count_diff, L"", L"[1, 2]", L"[1, 2, 3]", options, L"5");
+    CheckDiff(json::dom_document_diff_kind::count_diff, L"/x", L"{\"x\":{\"a\":1}}", L"{\"x\":{\"a\":1,\"b\":[2]}}", options, L"6");
+    CheckDiff(json::dom_document_diff_kind::member_name_diff, L"/VALUE", L"{\"VALUE\":1}", L"{\"value\":1}", options, L"7");
+    CheckDiff(json::dom_document_diff_kind::value_diff, L"/a~1b~0c", L"{\"a/b~c\":1}", L"{\"a/b~c\":2}", options, L"8");
+}
+
+TEST_F(JsonStreamDiffTest, TestReorderedMembers)
+{
+    // Members are compared by position unlike make_diff which matches them by name
+    const wstring ltext = L"{\"a\":1,\"b\":2}";
+    const wstring rtext = L"{\"b\":2,\"a\":1}";
+    json::dom_document_diff_options options;
+    CheckDiff(json::dom_document_diff_kind::member_name_diff, L"/a", ltext, rtext, options, L"Stream");
+    json::dom_document ldoc;
+    json::dom_document rdoc;
+    wstringstream lss(ltext);
+    wstringstream rss(rtext);
+    EXPECT_TRUE(json::dom_document_reader(ldoc).read(lss));
+    EXPECT_TRUE(json::dom_document_reader(rdoc).read(rss));
+    EXPECT_FALSE(json::make_diff(ldoc, rdoc, options).has_differences());
+}
+
+TEST_F(JsonStreamDiffTest, TestCompareAll)
+{
+    json::dom_document_diff_options options;
+    vector<json::stream_diff_item> items = MakeDiff(L"[1, 2, [3], 4]", L"[0, 2, {}, 5, 6]", options, L"1");
+    ASSERT_EQ(1u, items.size());
+    EXPECT_EQ(L"/0", items[0].path());
+    EXPECT_EQ(parsers::textpos(1, 2), items[0].lpos());
+    options.compare_all(true);
+    items = MakeDiff(L"[1, 2, [3], 4]", L"[0, 2, {}, 5, 6]", options, L"2");
+    ASSERT_EQ(4u, items.size());
+    EXPECT_TRUE(json::dom_document_diff_kind::value_diff == items[0].kind());
+    EXPECT_TRUE(json::dom_document_diff_kind::type_diff == items[1].kind());
+    EXPECT_EQ(L"/2", items[1].path());
+    EXPECT_TRUE(json::dom_document_diff_kind::value_diff == items[2].kind());
+    EXPECT_TRUE(json::dom_document_diff_kind::count_diff == items[3].kind());
+    EXPECT_EQ(L"4", items[3].ltext());
+    EXPECT_EQ(L"5", items[3].rtext());
+}
+
+TEST_F(JsonStreamDiffTest, TestErrors)
+{
+    wstringstream lss(L"[1, 2");
+    ioutils::text_reader lr(lss);
+    wstringstream rss(L"[1, 2]");
+    ioutils::text_reader rr(rss);
+    Collector collector;
+    json::stream_diff diff(lr, rr, collector, json::dom_document_diff_options());
+    EXPECT_FALSE(diff.run());
+    EXPECT_TRUE(diff.lmessages().has_errors());
+    EXPECT_FALSE(diff.rmessages().has_errors());
+}
+
+TEST_F(JsonStreamDiffTest, TestGeneratedDocs)
+{
+    json::dom_document_diff_options options;
+    for (int i = 1; i <= 20; i++)
+    {
+        json::dom_document doc;
+        json::dom_document_generator gen(doc);
+        gen.conf().depth(5);
+        gen.conf().avg_children(5);
+        gen.run();
+        json::dom_document_writer w(doc);
+        wstring s1, s2;
+        w.write(s1);
+        w.conf().pretty_print(true);
+        w.write(s2);
+        CheckNoDiff(s1, s2, options, str::wformat(L"Test_%d", i));
+        if (this->HasFailure())
+            break;
+    }
+}
+
+
+class JsonCsvConverterTest : public testing::Test
+{
+protected:
+    bool Convert(const wstring& csv_text, wstring& json_text, const bool detect_numbers)
+    {
+        wistringstream ss(csv_text);
+        csv::reader rd(ss);
+        json::csv_converter conv(rd);
+        conv.conf().detect_numbers(detect_numbers);
+        return conv.write(json_text);
+    }
+};
+
+TEST_F(JsonCsvConverterTest, TestValues)
+{
+    const wstring text = L"Id,\"Na\"\"me\",Ratio,Note\r\n"
+                         L"1,\"Multi\r\nline, \"\"quoted\"\"\",2.5,\u00fc\\\r\n"
+                         L"-0,,-1.5e+10,01\r\n"
+                         L"2,x,1.,.5\r\n"
+                         L"3,y,1e,-\r\n";
+    wstring ws;
+    ASSERT_TRUE(Convert(text, ws, false));
+    EXPECT_EQ(ws, L"[{\"Id\":\"1\",\"Na\\\"me\":\"Multi\\r\\nline, \\\"quoted\\\"\",\"Ratio\":\"2.5\",\"Note\":\"\u00fc\\\\\"},"
+                  L"{\"Id\":\"-0\",\"Na\\\"me\":\"\",\"Ratio\":\"-1.5e+10\",\"Note\":\"01\"},"
+                  L"{\"Id\":\"2\",\"Na\\\"me\":\"x\",\"Ratio\":\"1.\",\"Note\":\".5\"},"
+                  L"{\"Id\":\"3\",\"Na\\\"me\":\"y\",\"Ratio\":\"1e\",\"Note\":\"-\"}]");
+    ASSERT_TRUE(Convert(text, ws, true));
+    EXPECT_EQ(ws, L"[{\"Id\":1,\"Na\\\"me\":\"Multi\\r\\nline, \\\"quoted\\\"\",\"Ratio\":2.5,\"Note\":\"\u00fc\\\\\"},"
+                  L"{\"Id\":-0,\"Na\\\"me\":\"\",\"Ratio\":-1.5e+10,\"Note\":\"01\"},"
+                  L"{\"Id\":2,\"Na\\\"me\":\"x\",\"Ratio\":\"1.\",\"Note\":\".5\"},"
+                  L"{\"Id\":3,\"Na\\\"me\":\"y\",\"Ratio\":\"1e\",\"Note\":\"-\"}]");
+    ASSERT_TRUE(Convert(L"", ws, true));
+    EXPECT_EQ(ws, L"[]");
+    ASSERT_TRUE(Convert(L"A,B\n", ws, true));
+    EXPECT_EQ(ws, L"[]");
+    // Output is closed when CSV is invalid
+    EXPECT_FALSE(Convert(L"A,B\n1,2\n3\n4,5\n", ws, true));
+    EXPECT_EQ(ws, L"[{\"A\":1,\"B\":2}]");
+}
+
+TEST_F(JsonCsvConverterTest, TestLargeInput)
+{
+    wstring text = L"Id,Name,Value\n";
+    for (int i = 0; i < 20000; i++)
+        text += str::wformat(L"%d,\"Name %d\",%d.25\n", i, i, i);
+    wstring ws;
+    ASSERT_TRUE(Convert(text, ws, true));
+    json::dom_document doc;
+    json::dom_document_reader reader(doc);
+    wistringstream ss(ws);
+    ASSERT_TRUE(reader.read(ss));
+    json::dom_array* rows = dynamic_cast<json::dom_array*>(doc.root());
+    ASSERT_TRUE(rows != nullptr);
+    EXPECT_EQ(rows->size(), 20000u);
+}
+
 }
 }
@@ -2,6 +2,8 @@
 #include "parsers.h"
 #include <fstream>
 #include <limits>
+#include <cmath>
+#include <cstdlib>
 #include "strutils.h"
 #include "testutils.h"
 
@@ -86,6 +88,44 @@ TEST_F(ParsersTest, TestTextPos)
     EXPECT_EQ(1, pos6.col()) << L"Col 6.5";
 }
 
+TEST_F(ParsersTest, TestLineIndex)
+{
+    // Offsets of "ab\ncd\n\ne" characters counted from 1, each line starts after its newline
+    line_index lines(0);
+    EXPECT_EQ(textpos(1, 0), lines.pos(0));
+    EXPECT_EQ(textpos(1, 2), lines.last_line().pos(2));
+    lines.add_line(3);
+    lines.add_line(6);
+    lines.add_line(7);
+    EXPECT_EQ(4u, lines.line_count());
+    EXPECT_EQ(textpos(1, 1), lines.pos(1));
+    EXPECT_EQ(textpos(1, 3), lines.pos(3));
+    EXPECT_EQ(textpos(2, 1), lines.pos(4));
+    EXPECT_EQ(textpos(2, 3), lines.pos(6));
+    EXPECT_EQ(textpos(3, 1), lines.pos(7));
+    EXPECT_EQ(textpos(4, 1), lines.pos(8));
+    EXPECT_EQ(textpos(4, 100), lines.pos(107));
+    // Line snapshot does not depend on the index
+    line_index::line last = lines.last_line();
+    EXPECT_EQ(textpos(4, 1), last.pos(8));
+    // Starts of passed lines are forgotten without changing the following positions
+    lines.forget(4);
+    lines.forget(7);
+    EXPECT_EQ(4u, lines.line_count());
+    EXPECT_EQ(textpos(3, 1), lines.pos(7));
+    EXPECT_EQ(textpos(4, 1), lines.pos(8));
+    lines.forget(100);
+    lines.add_line(200);
+    EXPECT_EQ(5u, lines.line_count());
+    EXPECT_EQ(textpos(4, 100), lines.pos(107));
+    EXPECT_EQ(textpos(5, 1), lines.pos(201));
+    EXPECT_EQ(textpos(5, 1), lines.last_line().pos(201));
+    EXPECT_EQ(textpos(4, 100), last.pos(107));
+    lines.clear();
+    EXPECT_EQ(textpos(1, 8), lines.pos(8));
+    EXPECT_EQ(textpos(1, 9), line_index().pos(8));
+}
+
 TEST_F(ParsersTest, TestMessages)
 {
     textpos pos1(11, 22);
@@ -238,6 +278,58 @@ TEST_F(ParsersTest, TestMessageCollector)
     EXPECT_EQ(2, count) << L"Count 5";
 }
 
+TEST_F(ParsersTest, TestMessageCollectorLimits)
+{
+    test_msg_collector_t collect1;
+    collect1.limit(3);
+    for (int i = 0; i < 10; i++)
+        collect1.add_error(msg_origin::lexer, test_message_kind::e_error1, textpos(1, i + 1), L"", L"Error");
+    EXPECT_EQ(3u, collect1.size());
+    EXPECT_EQ(3u, collect1.errors().size());
+    EXPECT_EQ(7u, collect1.dropped_count());
+    EXPECT_TRUE(collect1.is_full());
+    collect1.add(new test_message_t(msg_origin::other, msg_severity::info, test_message_kind::info1, textpos(), L"", L"Info"));
+    EXPECT_EQ(3u, collect1.size());
+    EXPECT_EQ(8u, collect1.dropped_count());
+    collect1.clear();
+    EXPECT_EQ(0u, collect1.dropped_count());
+    EXPECT_TRUE(collect1.accepts());
+
+    // Fail-fast mode accepts other messages until the first error
+    test_msg_collector_t collect2;
+    collect2.fail_fast(true);
+    collect2.add_warning(msg_origin::lexer, test_message_kind::w_warning1, textpos(), L"", L"Warn 1");
+    collect2.add_error(msg_origin::lexer, test_message_kind::e_error1, textpos(), L"", L"Error 1");
+    EXPECT_FALSE(collect2.accepts());
+    collect2.add_error(msg_origin::lexer, test_message_kind::e_error2, textpos(), L"", L"Error 2");
+    collect2.add_warning(msg_origin::lexer, test_message_kind::w_warning2, textpos(), L"", L"Warn 2");
+    EXPECT_EQ(2u, collect2.size());
+    EXPECT_EQ(L"Error 1", collect2.errors()[0]->text());
+    EXPECT_EQ(2u, collect2.dropped_count());
+}
+
+TEST_F(ParsersTest, TestDeferredMessages)
+{
+    EXPECT_EQ(L"Char A (0x41) in 'abc' 100%", format_message(L"Char %c (0x%x) in '%ls' 100%%", { int64_t(65), int64_t(65), L"abc" }));
+    EXPECT_EQ(L"[007] [  ab] [-5]", format_message(L"[%03d] [%4ls] [%d]", { int64_t(7), L"ab", int64_t(-5) }));
+    EXPECT_EQ(L"Missing %ls", format_message(L"Missing %ls", {}));
+    EXPECT_EQ(L"Text 12", format_message(L"Text %ls", { int64_t(12) }));
+
+    auto format = [](const test_message_kind kind) -> wstring
+    {
+        return kind == test_message_kind::e_error1 ? L"Invalid char %c" : L"Error";
+    };
+    test_msg_collector_t collect1;
+    collect1.add_error(msg_origin::lexer, test_message_kind::e_error1, textpos(1, 2), L"file1.txt", format, { int64_t(L'x') });
+    collect1.add_error(msg_origin::lexer, test_message_kind::e_error2, textpos(1, 3), L"file1.txt", format, {});
+    ASSERT_EQ(2u, collect1.size());
+    EXPECT_EQ(L"Invalid char x", collect1.errors()[0]->text());
+    EXPECT_EQ(L"Invalid char x", collect1.errors()[0]->text());
+    EXPECT_EQ(L"file1.txt(1,3): error 3: Error", collect1.errors()[1]->to_wstring());
+    test_message_t m1(*collect1.errors()[0]);
+    EXPECT_EQ(L"Invalid char x", m1.text());
+}
+
 
 class NumericParserTest : public testing::Test
 {
@@ -289,6 +381,79 @@ TEST_F(NumericParserTest, TestValidNumbers)
     Check(L"-0.0e-0", nt::nt_float);
 }
 
+TEST_F(NumericParserTest, TestBinaryValues)
+{
+    auto check_int = [](const wstring text, const int64_t expected)
+    {
+        numeric_value value = numeric_parser(text).binary_value();
+        EXPECT_TRUE(value.is_int()) << text;
+        EXPECT_EQ(expected, value.int_value()) << text;
+        EXPECT_EQ(static_cast<double>(expected), value.float_value()) << text;
+    };
+    auto check_float = [](const wstring text)
+    {
+        numeric_value value = numeric_parser(text).binary_value();
+        EXPECT_FALSE(value.is_int()) << text;
+        EXPECT_EQ(std::strtod(str::to_string(text).c_str(), nullptr), value.float_value()) << text;
+    };
+    check_int(L"0", 0);
+    check_int(L"-0", 0);
+    check_int(L"12345", 12345);
+    check_int(L"-12345", -12345);
+    check_int(L"9223372036854775807", std::numeric_limits<int64_t>::max());
+    check_int(L"-9223372036854775808", std::numeric_limits<int64_t>::min());
+    check_float(L"9223372036854775808");
+    check_float(L"-9223372036854775809");
+    check_float(L"123456789012345678901234567890");
+    check_float(L"0.0");
+    check_float(L"-0.0");
+    check_float(L"123.456");
+    check_float(L"-123.456");
+    check_float(L"0.000001");
+    check_float(L"1.23456e10");
+    check_float(L"1.23456E-10");
+    check_float(L"-1.23456e+10");
+    check_float(L"1e22");
+    check_float(L"1e23");
+    check_float(L"1e25");
+    check_float(L"9007199254740993e0");
+    check_float(L"9007199254740993.0");
+    check_float(L"0.1234567890123456789012345");
+    check_float(L"2.2250738585072014e-308");
+    check_float(L"4.9e-324");
+    check_float(L"1.7976931348623157e308");
+    check_float(L"1e400");
+    check_float(L"1e-400");
+    check_float(L"-1e400");
+    check_float(L"-1e-400");
+    check_float(L"0." + wstring(400, L'0') + L"1");
+    check_float(L"1" + wstring(400, L'0'));
+    check_float(L"-1" + wstring(400, L'0') + L".5e-100");
+    check_float(L"1.000000000000000000000000000000000000000000000000000000000000000000000001");
+    // Parser which does not keep the text converts the text of the caller
+    for (const wstring& text : { wstring(L"-12345"), wstring(L"123.456"), wstring(L"1e23"), L"1" + wstring(100, L'0') })
+    {
+        numeric_parser parser;
+        parser.keep_text(false);
+        EXPECT_TRUE(parser.read_string(text)) << text;
+        EXPECT_TRUE(parser.cvalue().empty()) << text;
+        EXPECT_EQ(numeric_parser(text).binary_value().float_value(), parser.binary_value(text).float_value()) << text;
+    }
+    EXPECT_TRUE(std::signbit(numeric_parser(L"-0.0").binary_value().float_value()));
+    //
+    testutils::rnd_helper rnd;
+    for (int i = 0; i < 10000; i++)
+    {
+        wstring text = str::wformat(L"%d.%de%d",
+                                    rnd.random_range(-999999, 999999),
+                                    rnd.random_range(0, std::numeric_limits<int>::max()),
+                                    rnd.random_range(-320, 310));
+        check_float(text);
+        if (HasFailure())
+            break;
+    }
+}
+
 TEST_F(NumericParserTest, TestErrors)
 {
     CheckError(L"-");
@@ -303,6 +468,11 @@ TEST_F(NumericParserTest, TestErrors)
     CheckError(L"1e+");
     CheckError(L"00");
     CheckError(L"09");
+    CheckError(L"--5");
+    CheckError(L"12-34");
+    CheckError(L"1.5-");
+    CheckError(L"1e-5-");
+    CheckError(L"1e--5");
 }
 
 }
@@ -1,4 +1,5 @@
 #include <gtest/gtest.h>
+#include <limits>
 #include "strutils.h"
 #include "platforms.h"
 
@@ -97,5 +98,38 @@ TEST(StrUtilsTest, TestQuoted)
     EXPECT_EQ(L"\"123\"", str::double_quoted(L"123")) << L"DQuoted 2.3";
 }
 
+TEST(StrUtilsTest, TestFindFirstOf)
+{
+    wstring s(100, L'a');
+    EXPECT_EQ(s.length(), str::find_first_of(s.data(), s.length(), L',', L'"', L'\r', L'\n'));
+    EXPECT_EQ(0u, str::find_first_of(s.data(), 0, L'a', L'a', L'a', L'a'));
+    for (size_t i : { 0, 1, 3, 4, 7, 8, 15, 16, 17, 50, 98, 99 })
+    {
+        for (wchar_t c : { L',', L'"', L'\r', L'\n' })
+        {
+            wstring s2 = s;
+            s2[i] = c;
+            if (i + 1 < s2.length())
+                s2[i + 1] = L',';
+            EXPECT_EQ(i, str::find_first_of(s2.data(), s2.length(), L',', L'"', L'\r', L'\n')) << i;
+        }
+    }
+    wstring s3 = L"abc\u4e2d\u00fc";
+    EXPECT_EQ(3u, str::find_first_of(s3.data(), s3.length(), L'\u4e2d', L'x', L'x', L'x'));
+    EXPECT_EQ(4u, str::find_first_of(s3.data(), s3.length(), L'\u00fc', L'\u00fc', L'\u00fc', L'\u00fc'));
+}
+
+TEST(StrUtilsTest, TestToShortestString)
+{
+    EXPECT_EQ("0.1", str::to_shortest_string(0.1));
+    EXPECT_EQ("-2.5", str::to_shortest_string(-2.5));
+    EXPECT_EQ("0", str::to_shortest_string(0.0));
+    EXPECT_EQ("1e+300", str::to_shortest_string(1e300));
+    EXPECT_EQ("inf", str::to_shortest_string(numeric_limits<double>::infinity()));
+    EXPECT_EQ("nan", str::to_shortest_string(numeric_limits<double>::quiet_NaN()));
+    for (const double value : { 1.0 / 3, 123456789.125, 2.2250738585072014e-308, numeric_limits<double>::max() })
+        EXPECT_EQ(value, stod(str::to_shortest_string(value))) << value;
+}
+
 }
 }
@@ -23,10 +23,13 @@ SOURCES += \
     src/csvtools_test.cpp \
     src/datetime_test.cpp \
     src/ioutils_test.cpp \
+    src/jsonbinding_test.cpp \
+    src/jsoncbor_test.cpp \
     src/jsoncommon_test.cpp \
     src/jsondom_test.cpp \
     src/jsonlexer_test.cpp \
     src/jsonparser_test.cpp \
+    src/jsonsnapshot_test.cpp \
     src/jsontools_test.cpp \
     src/locutils_test.cpp \
     src/main.cpp \
@@ -3,12 +3,260 @@
  (c) 2001-2021 Serguei Tarassov (see license.txt)
  */
 #include "csvtools.h"
+#include "strutils.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <cstring>
+#include <cwctype>
+#include <exception>
+#include <map>
+#include <sstream>
+#include <mutex>
+#include <thread>
 
 using namespace std;
 
 namespace stdext::csv
 {
 
+namespace
+{
+    const size_t no_boundary = static_cast<size_t>(-1);
+
+    // Read-only stream buffer over the memory range
+    class memory_buf : public std::streambuf
+    {
+    public:
+        memory_buf(const char* data, const std::size_t size)
+        {
+            char* p = const_cast<char*>(data);
+            setg(p, p, p + size);
+        }
+    };
+
+    // CSV reader over the byte range of the mapped file
+    class chunk_reader
+    {
+    public:
+        chunk_reader(const char* data, const std::size_t size, const ioutils::text_io_policy& policy)
+            : m_buf(data, size), m_stream(&m_buf), m_text_reader(m_stream, policy), m_reader(&m_text_reader)
+        {}
+    public:
+        csv::reader& reader() noexcept { return m_reader; }
+        ioutils::text_reader& text_reader() noexcept { return m_text_reader; }
+    private:
+        memory_buf m_buf;
+        std::istream m_stream;
+        ioutils::text_reader m_text_reader;
+        csv::reader m_reader;
+    };
+
+    // Lone CR, LF or LF of CRLF
+    inline bool is_row_end(const char* data, const size_t i, const size_t size)
+    {
+        return data[i] == '\n' || (data[i] == '\r' && (i + 1 == size || data[i + 1] != '\n'));
+    }
+
+    // Row ends outside quotes and the end of the first of them for both quote states at the range start.
+    // Line ends of both states are the all line ends of the range.
+    struct range_scan
+    {
+        bool odd_quotes = false;
+        size_t rows[2] = { 0, 0 };
+        size_t boundary[2] = { no_boundary, no_boundary };
+        // Line ends up to the boundary inclusive
+        size_t boundary_lines[2] = { 0, 0 };
+    };
+
+    range_scan scan_range(const char* data, const size_t begin, const size_t end, const size_t size, const char quote)
+    {
+        range_scan scan;
+        // State for the range started outside quotes, the other state is always opposite.
+        // Doubled quotes toggle it twice, so the parity matches the reader.
+        bool inside = false;
+        for (size_t i = begin; i < end; i++)
+        {
+            if (data[i] == quote)
+                inside = !inside;
+            else if (is_row_end(data, i, size))
+            {
+                const size_t state = inside ? 1 : 0;
+                scan.rows[state]++;
+                if (scan.boundary[state] == no_boundary)
+                {
+                    scan.boundary[state] = i + 1;
+                    scan.boundary_lines[state] = scan.rows[0] + scan.rows[1];
+                }
+            }
+        }
+        scan.odd_quotes = inside;
+        return scan;
+    }
+
+    // Case insensitive "true", "false", "1" or "0"
+    bool to_bool(const std::wstring_view text, uint8_t& value)
+    {
+        if (text == L"1" || text == L"0")
+        {
+            value = text[0] == L'1';
+            return true;
+        }
+        for (const wchar_t* literal : { L"false", L"true" })
+        {
+            const wstring_view lit(literal);
+            bool equal = lit.length() == text.length();
+            for (size_t i = 0; i < text.length() && equal; i++)
+                equal = static_cast<wchar_t>(towlower(text[i])) == lit[i];
+            if (equal)
+            {
+                value = lit[0] == L't';
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Rows of the sample text, returns false on parsing error
+    bool parse_sample(const std::wstring& sample, const bool is_partial, const wchar_t separator, const wchar_t quote,
+                      std::vector<csv::row>& rows)
+    {
+        rows.clear();
+        wistringstream ss(sample);
+        csv::reader rd(ss);
+        rd.separator(separator);
+        rd.quote(quote);
+        csv::row r;
+        while (rd.next_row(r))
+            rows.push_back(r);
+        if (is_partial && rows.size() > 1)
+            rows.pop_back();
+        return !rd.has_error();
+    }
+
+    const char row_index_magic[8] = { 'C', 'S', 'V', 'R', 'O', 'W', 'I', 'X' };
+    const uint32_t row_index_version = 1;
+    const char checkpoint_magic[8] = { 'C', 'S', 'V', 'C', 'H', 'K', 'P', 'T' };
+    const uint32_t checkpoint_version = 1;
+
+    // Records every step-th row start found outside quotes, CR LF is one line end like the reader counts it
+    class row_start_scanner
+    {
+    public:
+        row_start_scanner(csv::row_index::entries_t& entries, const size_t step, const wchar_t quote, const bool with_header,
+                          const uint64_t unit_size, const uint64_t offset)
+            : m_entries(entries), m_step(step), m_quote(static_cast<uint32_t>(quote)), m_row_count(with_header ? -1 : 0),
+              m_unit_size(unit_size), m_offset(offset)
+        {}
+    public:
+        inline void next(const uint32_t unit)
+        {
+            const bool crlf = m_cr && unit == '\n';
+            m_cr = false;
+            if (m_row_end && !crlf)
+            {
+                m_row_end = false;
+                if (m_row_count >= 0 && m_row_count % static_cast<long>(m_step) == 0)
+                    m_entries.push_back({ m_offset, m_row_count, m_line });
+                m_row_count++;
+            }
+            if (crlf)
+                ;
+            else if (unit == m_quote)
+                m_inside = !m_inside;
+            else if (unit == '\r' || unit == '\n')
+            {
+                m_line++;
+                m_row_end = !m_inside;
+                m_cr = unit == '\r';
+            }
+            m_offset += m_unit_size;
+        }
+    private:
+        csv::row_index::entries_t& m_entries;
+        size_t m_step;
+        uint32_t m_quote;
+        long m_row_count;
+        uint64_t m_unit_size;
+        uint64_t m_offset;
+        parsers::textpos::pos_t m_line = 1;
+        bool m_inside = false;
+        bool m_cr = false;
+        bool m_row_end = true;
+    };
+
+    template <class T>
+    inline void write_value(std::ostream& stream, const T value)
+    {
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <class T>
+    inline bool read_value(std::istream& stream, T& value)
+    {
+        return !stream.read(reinterpret_cast<char*>(&value), sizeof(value)).fail();
+    }
+
+    void write_varint(std::ostream& stream, uint64_t value)
+    {
+        for (; value >= 0x80; value >>= 7)
+            stream.put(static_cast<char>((value & 0x7F) | 0x80));
+        stream.put(static_cast<char>(value));
+    }
+
+    bool read_varint(std::istream& stream, uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            const istream::int_type c = stream.get();
+            if (c == istream::traits_type::eof())
+                return false;
+            value |= static_cast<uint64_t>(c & 0x7F) << shift;
+            if ((c & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    // Runs the worker in the calling thread and other threads, the first exception of workers is rethrown
+    // when all of them are finished, so the worker should stop others when it fails
+    void run_workers(const size_t thread_count, const function<void()>& worker)
+    {
+        exception_ptr error;
+        mutex lock;
+        auto guarded_worker = [&]()
+        {
+            try
+            {
+                worker();
+            }
+            catch (...)
+            {
+                lock_guard<mutex> guard(lock);
+                if (error == nullptr)
+                    error = current_exception();
+            }
+        };
+        vector<thread> threads;
+        try
+        {
+            for (size_t i = 1; i < thread_count; i++)
+                threads.push_back(thread(guarded_worker));
+        }
+        catch (const system_error&)
+        {
+            // Started workers do all work
+        }
+        guarded_worker();
+        for (thread& t : threads)
+            t.join();
+        if (error != nullptr)
+            rethrow_exception(error);
+    }
+}
+
 std::wstring to_wstring(const reader_msg_kind value)
 {
     switch(value)
@@ -19,11 +267,24 @@ std::wstring to_wstring(const reader_msg_kind value)
         return L"Separator expected";
     case reader_msg_kind::row_field_count_different_from_header:
         return L"Row field count is defferent from header column count";
+    case reader_msg_kind::invalid_column_value:
+        return L"Invalid column value";
     default:
         return L"Unknown";
     }
 }
 
+/*
+ * row_view class
+ */
+void row_view::to_row(csv::row& r) const
+{
+    r.clear();
+    for (size_type i = 0; i < field_count(); i++)
+        r.append_value(value(i));
+}
+
+
 /*
  * CSV parser and reader
  */
@@ -55,37 +316,67 @@ reader::~reader()
 
 void reader::add_error(const reader_msg_kind kind, const wstring& text)
 {
-    add_error(kind, m_pos, text);
+    add_error(kind, m_offset, text);
 }
 
-void reader::add_error(const reader_msg_kind kind, parsers::textpos pos, const std::wstring& text)
+void reader::add_error(const reader_msg_kind kind, const std::size_t offset, const std::wstring& text)
 {
-    m_messages.add_error(parsers::msg_origin::lexer, kind, pos, m_reader->source_name(), text);
+    if (m_messages.accepts())
+        m_messages.add_error(parsers::msg_origin::lexer, kind, m_lines.pos(offset), m_reader->source_name(), text);
+    else
+        m_messages.drop();
 }
 
 bool reader::next_char(wchar_t& wc)
 {
     if (m_reader->next_char(wc))
     {
-        ++m_pos;
+        m_offset++;
         return true;
     }
     return false;
 }
 
 bool reader::next_row(row& r)
+{
+    bool result = next_row(m_row_view);
+    m_row_view.to_row(r);
+    return result;
+}
+
+bool reader::next_row(row_view& r)
 {
     r.clear();
     if (m_reader->eof())
         return false;
+    // Positions of the previous rows are not requested anymore
+    m_lines.forget(m_offset);
     bool row_accepted = false;
     bool value_accepted = false;
     bool accepting_quoted_value = false;
-    std::wstring value;
-    parsers::textpos lastpos; // last position before accepting row
+    // Values are accumulated directly in the row buffer, doubled quotes are unescaped while copying
+    std::wstring& value = r.m_buffer;
+    size_t value_start = 0;
+    size_t last_offset = 0; // last position before accepting row
     while (!m_reader->eof() && !row_accepted)
     {
-        lastpos = m_pos;
+        // Characters without special meaning are copied by blocks
+        const size_t length = value.length();
+        m_reader->read_until(value, { m_separator, m_quote, L'\r', L'\n' });
+        m_offset += value.length() - length;
+        if (m_reader->eof())
+        {
+            if (value.length() > length)
+            {
+                last_offset = m_offset - 1;
+                r.end_value(value_start);
+            }
+            // End of text is detected only when the last block is read
+            else if (r.field_count() == 0 && value.empty())
+                return false;
+            break;
+        }
+        last_offset = m_offset;
         wchar_t c = 0;
         if (!next_char(c))
         {
@@ -93,9 +384,8 @@ bool reader::next_row(row& r)
                 add_error(reader_msg_kind::io_error, L"I/O error");
             return false;
         }
-        switch (c)
+        if (c == m_quote)
         {
-        case '"':
             if (!accepting_quoted_value)
                 accepting_quoted_value = true;
             else
@@ -115,45 +405,39 @@ bool reader::next_row(row& r)
                     }
                 }
             }
-            break;
-        case L'\r':
-        case L'\n':
+        }
+        else if (c == L'\r' || c == L'\n')
         {
-            wstring nl;
-            nl += c;
+            if (accepting_quoted_value)
+                value += c;
             if (c == L'\r' && m_reader->is_next_char(L'\n'))
             {
                 next_char(c);
-                nl += c;
+                if (accepting_quoted_value)
+                    value += c;
             }
-            if (accepting_quoted_value)
-                value += nl;
-            else
+            if (!accepting_quoted_value)
             {
                 value_accepted = true;
                 row_accepted = true;
             }
-            m_pos.newline();
-            break;
-        }
-        default:
-            if (c != m_separator || accepting_quoted_value)
-                value += c;
-            else
-                value_accepted = true;
-            break;
+            m_lines.add_line(m_offset - 1);
         }
+        else if (c != m_separator || accepting_quoted_value)
+            value += c;
+        else
+            value_accepted = true;
         if (value_accepted || m_reader->eof())
         {
             value_accepted = false;
-            r.append_value(value);
-            value.clear();
+            r.end_value(value_start);
+            value_start = value.length();
         }
     }
     m_row_num++;
     if (has_header() && m_header.field_count() != r.field_count())
     {
-        add_error(reader_msg_kind::row_field_count_different_from_header, lastpos, L"Row field count is different from header one");
+        add_error(reader_msg_kind::row_field_count_different_from_header, last_offset, L"Row field count is different from header one");
         return false;
     }
     return true;
@@ -167,4 +451,996 @@ bool reader::read_header()
     return result;
 }
 
+bool reader::seek_row(const long row, const csv::row_index& index)
+{
+    const size_t i = index.find(row);
+    if (i == index.size())
+        return false;
+    const row_index::entry& e = index[i];
+    // Decoder detects the byte order at the text start
+    wchar_t c;
+    m_reader->peek(c);
+    if (!m_reader->seek(static_cast<streamoff>(e.offset)))
+    {
+        add_error(reader_msg_kind::io_error, L"I/O error");
+        return false;
+    }
+    m_offset = 0;
+    m_lines.reset(e.line);
+    m_row_num = e.row;
+    while (m_row_num < row - 1)
+    {
+        if (!next_row(m_row_view))
+            return false;
+    }
+    return !m_reader->eof();
+}
+
+bool reader::save_checkpoint(csv::checkpoint& value)
+{
+    if (!m_reader->tell(value.offset, value.state))
+        return false;
+    value.pos = pos();
+    value.row_count = m_row_num;
+    value.header = m_header;
+    return true;
+}
+
+bool reader::restore(const csv::checkpoint& value)
+{
+    if (!m_reader->seek(value.offset, value.state))
+    {
+        add_error(reader_msg_kind::io_error, L"I/O error");
+        return false;
+    }
+    m_offset = 0;
+    m_lines.reset(value.pos.line(), value.pos.col());
+    m_row_num = value.row_count;
+    m_header = value.header;
+    return true;
+}
+
+
+/*
+ * checkpoint struct
+ */
+void checkpoint::write(std::ostream& stream) const
+{
+    stream.write(checkpoint_magic, sizeof(checkpoint_magic));
+    write_value(stream, checkpoint_version);
+    write_value(stream, static_cast<int64_t>(offset));
+    write_value(stream, static_cast<int32_t>(pos.line()));
+    write_value(stream, static_cast<int32_t>(pos.col()));
+    write_value(stream, static_cast<int64_t>(row_count));
+    write_value(stream, static_cast<uint32_t>(sizeof(state)));
+    stream.write(reinterpret_cast<const char*>(&state), sizeof(state));
+    write_value(stream, static_cast<uint32_t>(header.field_count()));
+    for (size_t i = 0; i < header.field_count(); i++)
+    {
+        const string bytes = locutils::utf16::to_utf8string(header[i].value());
+        write_value(stream, static_cast<uint32_t>(bytes.length()));
+        stream.write(bytes.data(), bytes.length());
+    }
+}
+
+bool checkpoint::read(std::istream& stream)
+{
+    char magic[sizeof(checkpoint_magic)];
+    uint32_t version = 0;
+    int64_t offset_value = 0;
+    int32_t line = 0;
+    int32_t col = 0;
+    int64_t row_count_value = 0;
+    uint32_t state_size = 0;
+    mbstate_t state_value = {};
+    uint32_t field_count = 0;
+    stream.read(magic, sizeof(magic));
+    if (stream.fail() || memcmp(magic, checkpoint_magic, sizeof(magic)) != 0 || !read_value(stream, version) || version != checkpoint_version)
+        return false;
+    if (!read_value(stream, offset_value) || !read_value(stream, line) || !read_value(stream, col) || !read_value(stream, row_count_value) ||
+        !read_value(stream, state_size) || state_size != sizeof(state_value) || !read_value(stream, state_value) ||
+        !read_value(stream, field_count))
+        return false;
+    csv::header header_value;
+    for (uint32_t i = 0; i < field_count; i++)
+    {
+        uint32_t length = 0;
+        if (!read_value(stream, length))
+            return false;
+        string bytes(length, '\0');
+        if (stream.read(&bytes[0], length).fail())
+            return false;
+        header_value.append_value(locutils::utf8::to_utf16string(bytes));
+    }
+    offset = static_cast<streamoff>(offset_value);
+    pos = parsers::textpos(line, col);
+    row_count = static_cast<long>(row_count_value);
+    state = state_value;
+    header = std::move(header_value);
+    return true;
+}
+
+
+/*
+ * row_index class
+ */
+row_index::row_index(const std::size_t step)
+    : m_step(max(step, static_cast<size_t>(1)))
+{}
+
+bool row_index::build(const std::wstring& file_name, const ioutils::text_io_policy& policy, const bool with_header)
+{
+    m_entries.clear();
+    ioutils::mapped_file file;
+    if (!file.open(file_name))
+        return false;
+    const char* data = file.data();
+    const size_t size = file.size();
+    const ioutils::text_io_policy_utf16* utf16_policy = dynamic_cast<const ioutils::text_io_policy_utf16*>(&policy);
+    if (utf16_policy != nullptr)
+    {
+        endianess::byte_order order = utf16_policy->cvt_mode().byte_order();
+        if (!utf16_policy->cvt_mode().is_byte_order_assigned())
+            locutils::utf16::try_detect_byte_order(data, size, order);
+        const size_t start = size >= 2 && locutils::utf16::is_bom(data[0], data[1], order) ? 2 : 0;
+        const bool is_big_endian = order == endianess::byte_order::big_endian;
+        row_start_scanner scanner(m_entries, m_step, m_quote, with_header, 2, start);
+        for (size_t i = start; i + 1 < size; i += 2)
+        {
+            const uint32_t byte0 = static_cast<unsigned char>(data[i]);
+            const uint32_t byte1 = static_cast<unsigned char>(data[i + 1]);
+            scanner.next(is_big_endian ? (byte0 << 8) | byte1 : (byte1 << 8) | byte0);
+        }
+    }
+    else
+    {
+        // Quotes and line ends are single bytes in ANSI and UTF-8
+        const bool is_utf8 = dynamic_cast<const ioutils::text_io_policy_utf8*>(&policy) != nullptr;
+        const size_t start = is_utf8 && size >= 3 && locutils::utf8::is_bom(data[0], data[1], data[2]) ? 3 : 0;
+        row_start_scanner scanner(m_entries, m_step, m_quote, with_header, 1, start);
+        for (size_t i = start; i < size; i++)
+            scanner.next(static_cast<unsigned char>(data[i]));
+    }
+    return true;
+}
+
+bool row_index::build(std::wistream& stream, const bool with_header)
+{
+    m_entries.clear();
+    row_start_scanner scanner(m_entries, m_step, m_quote, with_header, 1, 0);
+    wchar_t buf[4096];
+    do
+    {
+        stream.read(buf, sizeof(buf) / sizeof(buf[0]));
+        for (streamsize i = 0; i < stream.gcount(); i++)
+            scanner.next(static_cast<uint32_t>(buf[i]));
+    } while (stream.good());
+    return !stream.bad();
+}
+
+std::size_t row_index::find(const long row) const noexcept
+{
+    if (row < 1 || m_entries.empty())
+        return m_entries.size();
+    return min(static_cast<size_t>(row - 1) / m_step, m_entries.size() - 1);
+}
+
+void row_index::write(std::ostream& stream) const
+{
+    const uint64_t step = m_step;
+    const uint64_t count = m_entries.size();
+    stream.write(row_index_magic, sizeof(row_index_magic));
+    write_value(stream, row_index_version);
+    write_value(stream, step);
+    write_value(stream, count);
+    entry prev;
+    for (const entry& e : m_entries)
+    {
+        write_varint(stream, e.offset - prev.offset);
+        write_varint(stream, static_cast<uint64_t>(e.line - prev.line));
+        prev = e;
+    }
+}
+
+bool row_index::read(std::istream& stream)
+{
+    m_entries.clear();
+    char magic[sizeof(row_index_magic)];
+    uint32_t version = 0;
+    uint64_t step = 0;
+    uint64_t count = 0;
+    stream.read(magic, sizeof(magic));
+    if (stream.fail() || memcmp(magic, row_index_magic, sizeof(magic)) != 0 || !read_value(stream, version) ||
+        version != row_index_version || !read_value(stream, step) || step == 0 || !read_value(stream, count))
+        return false;
+    entries_t entries;
+    entry e;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        uint64_t offset_delta, line_delta;
+        if (!read_varint(stream, offset_delta) || !read_varint(stream, line_delta))
+            return false;
+        e.offset += offset_delta;
+        e.row = static_cast<long>(i * step);
+        e.line += static_cast<parsers::textpos::pos_t>(line_delta);
+        entries.push_back(e);
+    }
+    m_step = static_cast<size_t>(step);
+    m_entries = std::move(entries);
+    return true;
+}
+
+
+/*
+ * parallel_reader class
+ */
+parallel_reader::parallel_reader(const std::wstring& file_name, const ioutils::text_io_policy& policy)
+    : m_file_name(file_name), m_policy(policy)
+{}
+
+void parallel_reader::split(const char* data, const std::size_t size, std::vector<chunk>& chunks, const std::size_t thread_count)
+{
+    const size_t range_count = (size + m_chunk_size - 1) / m_chunk_size;
+    vector<range_scan> scans(range_count);
+    atomic<size_t> next_range(0);
+    run_workers(min(thread_count, range_count), [&]()
+    {
+        size_t i;
+        while ((i = next_range++) < range_count)
+            scans[i] = scan_range(data, i * m_chunk_size, min(size, (i + 1) * m_chunk_size), size, static_cast<char>(m_quote));
+    });
+    // Quote states are resolved from the file start, chunks begin after the first row end of each range
+    chunks.clear();
+    chunks.push_back(chunk{ 0, size, 1, 1 });
+    bool inside = false;
+    long rows = 0;
+    size_t lines = 0;
+    for (const range_scan& scan : scans)
+    {
+        const size_t state = inside ? 1 : 0;
+        const size_t boundary = scan.boundary[state];
+        if (boundary != no_boundary && boundary < size)
+        {
+            chunks.back().end = boundary;
+            const parsers::textpos::pos_t first_line = static_cast<parsers::textpos::pos_t>(lines + scan.boundary_lines[state] + 1);
+            chunks.push_back(chunk{ boundary, size, rows + 2, first_line });
+        }
+        rows += static_cast<long>(scan.rows[state]);
+        lines += scan.rows[0] + scan.rows[1];
+        inside = inside != scan.odd_quotes;
+    }
+}
+
+void parallel_reader::add_chunk_error(const chunk& ch, const reader_msg_kind kind,
+                                      const parsers::textpos& pos, const std::wstring& text)
+{
+    if (!m_messages.accepts())
+    {
+        m_messages.drop();
+        return;
+    }
+    // Chunks begin at row starts, so only lines are shifted
+    parsers::textpos file_pos = pos;
+    file_pos.line(file_pos.line() + ch.first_line - 1);
+    m_messages.add_error(parsers::msg_origin::lexer, kind, file_pos, m_file_name, text);
+}
+
+bool parallel_reader::read_sequential(const row_handler_t& handler)
+{
+    csv::reader rd(m_file_name, m_policy);
+    rd.separator(m_separator);
+    rd.quote(m_quote);
+    if (m_with_header && rd.read_header())
+        m_header = rd.header();
+    csv::row_view r;
+    while (!rd.has_error() && rd.next_row(r))
+    {
+        m_row_count = rd.row_count();
+        if (!handler(r, m_row_count))
+            break;
+    }
+    // Collector counts the errors over its limit
+    for (const message_t* err : rd.errors())
+        m_messages.add_error(err->origin(), err->kind(), err->pos(), err->source(), err->text());
+    return !has_error();
+}
+
+bool parallel_reader::read(const row_handler_t& handler)
+{
+    m_row_count = 0;
+    m_header.clear();
+    m_messages.clear();
+    ioutils::mapped_file file;
+    if (dynamic_cast<const ioutils::text_io_policy_utf16*>(&m_policy) != nullptr || !file.open(m_file_name))
+        return read_sequential(handler);
+    const size_t thread_count = m_thread_count > 0 ? m_thread_count : max(1u, thread::hardware_concurrency());
+    const char* data = file.data();
+    vector<chunk> chunks;
+    split(data, file.size(), chunks, thread_count);
+    const size_t chunk_count = chunks.size();
+    size_t first_chunk = 0;
+    if (m_with_header)
+    {
+        // The first chunk contains the first row only
+        first_chunk = 1;
+        chunk_reader cr(data, chunks[0].end, m_policy);
+        cr.text_reader().source_name(m_file_name);
+        cr.reader().separator(m_separator);
+        cr.reader().quote(m_quote);
+        if (cr.reader().read_header())
+            m_header = cr.reader().header();
+        else if (cr.reader().has_error())
+        {
+            const message_t* err = cr.reader().errors()[0];
+            add_chunk_error(chunks[0], err->kind(), err->pos(), err->text());
+            return false;
+        }
+        for (chunk& ch : chunks)
+            ch.first_row--;
+    }
+    auto init_reader = [&](chunk_reader& cr)
+    {
+        cr.text_reader().source_name(m_file_name);
+        cr.reader().separator(m_separator);
+        cr.reader().quote(m_quote);
+        if (has_header())
+            cr.reader().header(m_header);
+    };
+
+    if (!m_ordered)
+    {
+        atomic<size_t> next_chunk(first_chunk);
+        atomic<bool> stopped(false);
+        mutex lock;
+        run_workers(min(thread_count, chunk_count - first_chunk), [&]()
+        {
+            try
+            {
+                csv::row_view r;
+                size_t k;
+                while (!stopped && (k = next_chunk++) < chunk_count)
+                {
+                    const chunk& ch = chunks[k];
+                    chunk_reader cr(data + ch.begin, ch.end - ch.begin, m_policy);
+                    init_reader(cr);
+                    long row_num = ch.first_row;
+                    while (!stopped && cr.reader().next_row(r))
+                    {
+                        if (!handler(r, row_num++))
+                            stopped = true;
+                    }
+                    lock_guard<mutex> guard(lock);
+                    m_row_count = max(m_row_count, row_num - 1);
+                    if (cr.reader().has_error())
+                    {
+                        const message_t* err = cr.reader().errors()[0];
+                        add_chunk_error(ch, err->kind(), err->pos(), err->text());
+                        stopped = true;
+                    }
+                }
+            }
+            catch (...)
+            {
+                // Other workers stop after their current row
+                stopped = true;
+                throw;
+            }
+        });
+        return !has_error();
+    }
+
+    // Workers fill slots ahead of the delivered chunk, the slot of chunk k is reused for chunk k + slot_count
+    struct slot
+    {
+        size_t chunk_index = no_boundary;
+        std::vector<csv::row_view> rows;
+        size_t row_count = 0;
+        bool failed = false;
+        reader_msg_kind kind = reader_msg_kind::io_error;
+        parsers::textpos pos;
+        std::wstring text;
+        // Exception of the worker is rethrown by the calling thread
+        std::exception_ptr error;
+    };
+    const size_t slot_count = thread_count * 2;
+    vector<slot> slots(slot_count);
+    mutex lock;
+    condition_variable cv;
+    size_t next_chunk = first_chunk;
+    size_t delivered = first_chunk;
+    bool stopped = false;
+    auto worker = [&]()
+    {
+        while (true)
+        {
+            size_t k;
+            {
+                unique_lock<mutex> guard(lock);
+                cv.wait(guard, [&]() { return stopped || next_chunk >= chunk_count || next_chunk < delivered + slot_count; });
+                if (stopped || next_chunk >= chunk_count)
+                    return;
+                k = next_chunk++;
+            }
+            slot& s = slots[k % slot_count];
+            const chunk& ch = chunks[k];
+            s.row_count = 0;
+            s.error = nullptr;
+            try
+            {
+                chunk_reader cr(data + ch.begin, ch.end - ch.begin, m_policy);
+                init_reader(cr);
+                while (true)
+                {
+                    if (s.row_count == s.rows.size())
+                        s.rows.emplace_back();
+                    if (!cr.reader().next_row(s.rows[s.row_count]))
+                        break;
+                    s.row_count++;
+                }
+                s.failed = cr.reader().has_error();
+                if (s.failed)
+                {
+                    const message_t* err = cr.reader().errors()[0];
+                    s.kind = err->kind();
+                    s.pos = err->pos();
+                    s.text = err->text();
+                }
+            }
+            catch (...)
+            {
+                s.error = current_exception();
+            }
+            {
+                lock_guard<mutex> guard(lock);
+                s.chunk_index = k;
+            }
+            cv.notify_all();
+        }
+    };
+    vector<thread> threads;
+    auto stop_workers = [&]()
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            stopped = true;
+        }
+        cv.notify_all();
+        for (thread& t : threads)
+            t.join();
+    };
+    try
+    {
+        for (size_t i = 0; i < min(thread_count, chunk_count - first_chunk); i++)
+            threads.push_back(thread(worker));
+        for (size_t k = first_chunk; k < chunk_count; k++)
+        {
+            slot& s = slots[k % slot_count];
+            {
+                unique_lock<mutex> guard(lock);
+                cv.wait(guard, [&]() { return s.chunk_index == k; });
+            }
+            if (s.error != nullptr)
+                rethrow_exception(s.error);
+            bool go_on = true;
+            for (size_t i = 0; i < s.row_count && go_on; i++)
+            {
+                m_row_count = chunks[k].first_row + static_cast<long>(i);
+                go_on = handler(s.rows[i], m_row_count);
+            }
+            if (s.failed && go_on)
+            {
+                add_chunk_error(chunks[k], s.kind, s.pos, s.text);
+                go_on = false;
+            }
+            {
+                lock_guard<mutex> guard(lock);
+                delivered = k + 1;
+                stopped = !go_on;
+            }
+            cv.notify_all();
+            if (!go_on)
+                break;
+        }
+    }
+    catch (...)
+    {
+        // Exception of the handler or of a worker is passed to the caller when all threads are joined
+        stop_workers();
+        throw;
+    }
+    stop_workers();
+    return !has_error();
+}
+
+
+/*
+ * Typed columns
+ */
+std::wstring to_wstring(const column_type value)
+{
+    switch (value)
+    {
+    case column_type::ct_int64:
+        return L"int64";
+    case column_type::ct_double:
+        return L"double";
+    case column_type::ct_datetime:
+        return L"datetime";
+    case column_type::ct_bool:
+        return L"bool";
+    case column_type::ct_string:
+        return L"string";
+    default:
+        return L"Unknown";
+    }
+}
+
+schema::size_type schema::find(const std::wstring& name) const noexcept
+{
+    size_type i = 0;
+    while (i < m_columns.size() && m_columns[i].name() != name)
+        i++;
+    return i;
+}
+
+void column::clear(const std::size_t capacity)
+{
+    m_size = 0;
+    m_null_count = 0;
+    m_nulls.clear();
+    m_nulls.reserve((capacity + 63) / 64);
+    switch (m_type)
+    {
+    case column_type::ct_int64:
+        m_int64_values.clear();
+        m_int64_values.reserve(capacity);
+        break;
+    case column_type::ct_double:
+        m_double_values.clear();
+        m_double_values.reserve(capacity);
+        break;
+    case column_type::ct_datetime:
+        m_datetime_values.clear();
+        m_datetime_values.reserve(capacity);
+        break;
+    case column_type::ct_bool:
+        m_bool_values.clear();
+        m_bool_values.reserve(capacity);
+        break;
+    case column_type::ct_string:
+        m_chars.clear();
+        m_offsets.clear();
+        m_offsets.reserve(capacity + 1);
+        m_offsets.push_back(0);
+        break;
+    }
+}
+
+bool column::append(const std::wstring_view text, parsers::numeric_parser& parser, std::wstring& buf)
+{
+    bool valid = true;
+    switch (m_type)
+    {
+    case column_type::ct_int64:
+    case column_type::ct_double:
+    {
+        parser.reset();
+        valid = parser.read_string(text);
+        const parsers::numeric_value value = valid ? parser.binary_value(text) : parsers::numeric_value();
+        if (m_type == column_type::ct_int64)
+        {
+            valid = valid && value.is_int();
+            m_int64_values.push_back(valid ? value.int_value() : 0);
+        }
+        else
+            m_double_values.push_back(value.float_value());
+        break;
+    }
+    case column_type::ct_datetime:
+        buf.assign(text);
+        try
+        {
+            m_datetime_values.push_back(stdext::datetime(buf));
+        }
+        catch (const datetime_exception&)
+        {
+            valid = false;
+            m_datetime_values.push_back(stdext::datetime());
+        }
+        break;
+    case column_type::ct_bool:
+    {
+        uint8_t value = 0;
+        valid = to_bool(text, value);
+        m_bool_values.push_back(value);
+        break;
+    }
+    case column_type::ct_string:
+        m_chars.append(text);
+        m_offsets.push_back(m_chars.length());
+        break;
+    }
+    if (m_size % 64 == 0)
+        m_nulls.push_back(0);
+    if (!valid)
+    {
+        m_nulls.back() |= uint64_t(1) << (m_size % 64);
+        m_null_count++;
+    }
+    m_size++;
+    return valid;
+}
+
+void column::append_null()
+{
+    switch (m_type)
+    {
+    case column_type::ct_int64:
+        m_int64_values.push_back(0);
+        break;
+    case column_type::ct_double:
+        m_double_values.push_back(0.0);
+        break;
+    case column_type::ct_datetime:
+        m_datetime_values.push_back(stdext::datetime());
+        break;
+    case column_type::ct_bool:
+        m_bool_values.push_back(0);
+        break;
+    case column_type::ct_string:
+        m_offsets.push_back(m_chars.length());
+        break;
+    }
+    if (m_size % 64 == 0)
+        m_nulls.push_back(0);
+    m_nulls.back() |= uint64_t(1) << (m_size % 64);
+    m_null_count++;
+    m_size++;
+}
+
+
+/*
+ * batch_reader class
+ */
+batch_reader::batch_reader(csv::reader& rd, const csv::schema& columns)
+    : m_reader(rd), m_schema(columns)
+{
+    // Numbers are converted from the field views
+    m_parser.keep_text(false);
+}
+
+bool batch_reader::next_batch(csv::batch& b, const std::size_t max_rows)
+{
+    bool same_columns = b.m_columns.size() == m_schema.column_count();
+    for (size_t i = 0; i < b.m_columns.size() && same_columns; i++)
+        same_columns = b.m_columns[i].type() == m_schema[i].type();
+    if (!same_columns)
+    {
+        b.m_columns.clear();
+        for (size_t i = 0; i < m_schema.column_count(); i++)
+            b.m_columns.push_back(csv::column(m_schema[i].type()));
+    }
+    for (csv::column& c : b.m_columns)
+        c.clear(max_rows);
+    b.m_row_count = 0;
+    b.m_first_row = m_reader.row_count() + 1;
+    while (b.m_row_count < max_rows)
+    {
+        // Position of the row start
+        const parsers::textpos pos = m_reader.pos();
+        if (!m_reader.next_row(m_row))
+            break;
+        for (size_t i = 0; i < b.m_columns.size(); i++)
+        {
+            csv::column& c = b.m_columns[i];
+            if (i >= m_row.field_count() || (m_row[i].empty() && c.type() != column_type::ct_string))
+                c.append_null();
+            else if (!c.append(m_row[i], m_parser, m_buf))
+            {
+                if (m_messages.accepts())
+                    m_messages.add_warning(parsers::msg_origin::parser, reader_msg_kind::invalid_column_value, pos,
+                                           m_messages.source_names() ? m_reader.source_name() : wstring(),
+                                           str::wformat(L"Invalid %ls value of column '%ls' in row %ld",
+                                                        to_wstring(c.type()).c_str(), m_schema[i].name().c_str(), m_reader.row_count()));
+                else
+                    m_messages.drop();
+            }
+        }
+        b.m_row_count++;
+    }
+    return b.m_row_count > 0;
+}
+
+
+/*
+ * CSV writer
+ */
+writer::writer(ioutils::text_writer* const wr)
+    : m_writer(wr), m_owns_writer(false)
+{}
+
+writer::writer(std::wostream& stream)
+    : m_writer(new ioutils::text_writer(stream)), m_owns_writer(true)
+{}
+
+writer::writer(std::wostream& stream, const ioutils::text_io_policy& policy)
+    : m_writer(new ioutils::text_writer(stream, policy)), m_owns_writer(true)
+{}
+
+writer::writer(std::ostream& stream, const ioutils::text_io_policy& policy)
+    : m_writer(new ioutils::text_writer(stream, policy)), m_owns_writer(true)
+{}
+
+writer::writer(const std::wstring& file_name, const ioutils::text_io_policy& policy)
+    : m_writer(new ioutils::text_writer(file_name, policy)), m_owns_writer(true)
+{}
+
+writer::writer(std::wofstream& stream, const ioutils::text_io_policy& policy)
+    : m_writer(new ioutils::text_writer(stream, policy)), m_owns_writer(true)
+{}
+
+writer::~writer()
+{
+    // Destructor does not report errors, call flush() to get them
+    try
+    {
+        flush();
+    }
+    catch (...)
+    {
+    }
+    if (m_owns_writer && m_writer != nullptr)
+        delete m_writer;
+}
+
+void writer::flush()
+{
+    write_buffer();
+    m_writer->flush();
+}
+
+void writer::write_buffer()
+{
+    if (m_buffer.empty())
+        return;
+    m_writer->write(m_buffer);
+    m_buffer.clear();
+}
+
+void writer::begin_field()
+{
+    if (m_row_started)
+        m_buffer += m_separator;
+    else
+        m_row_started = true;
+}
+
+writer& writer::write_field(const std::wstring_view value)
+{
+    begin_field();
+    size_t pos = str::find_first_of(value.data(), value.length(), m_separator, m_quote, L'\r', L'\n');
+    if (pos == value.length())
+    {
+        m_buffer.append(value);
+        return *this;
+    }
+    m_buffer += m_quote;
+    size_t start = 0;
+    while ((pos = value.find(m_quote, pos)) != wstring_view::npos)
+    {
+        // Quote is written twice
+        m_buffer.append(value.substr(start, pos + 1 - start));
+        start = pos;
+        pos++;
+    }
+    m_buffer.append(value.substr(start));
+    m_buffer += m_quote;
+    return *this;
+}
+
+void writer::append_ascii(const char* first, const char* last)
+{
+    begin_field();
+    for (; first < last; first++)
+        m_buffer += static_cast<wchar_t>(*first);
+}
+
+writer& writer::write_field(const int64_t value)
+{
+    char buffer[24];
+    to_chars_result result = to_chars(buffer, buffer + sizeof(buffer), value);
+    append_ascii(buffer, result.ptr);
+    return *this;
+}
+
+writer& writer::write_field(const double value)
+{
+    const string text = str::to_shortest_string(value);
+    append_ascii(text.data(), text.data() + text.length());
+    return *this;
+}
+
+writer& writer::write_field(const bool value)
+{
+    begin_field();
+    m_buffer += value ? L"true" : L"false";
+    return *this;
+}
+
+writer& writer::write_field(const stdext::datetime& value)
+{
+    // ISO format without separator and quote characters
+    string text = stdext::datetime(value).to_string();
+    append_ascii(text.data(), text.data() + text.length());
+    return *this;
+}
+
+writer& writer::write_null()
+{
+    begin_field();
+    return *this;
+}
+
+writer& writer::end_row()
+{
+    m_buffer += m_eol;
+    m_row_started = false;
+    m_row_num++;
+    if (m_buffer.length() >= m_buffer_size)
+        write_buffer();
+    return *this;
+}
+
+writer& writer::write_row(const csv::row& r)
+{
+    for (csv::row::size_type i = 0; i < r.field_count(); i++)
+        write_field(r.field(i).value());
+    return end_row();
+}
+
+writer& writer::write_row(const csv::row_view& r)
+{
+    for (csv::row_view::size_type i = 0; i < r.field_count(); i++)
+        write_field(r[i]);
+    return end_row();
+}
+
+writer& writer::write_row(std::initializer_list<std::wstring_view> values)
+{
+    for (const std::wstring_view value : values)
+        write_field(value);
+    return end_row();
+}
+
+
+/*
+ * dialect class
+ */
+bool dialect::apply(csv::reader& rd) const
+{
+    rd.separator(m_separator);
+    rd.quote(m_quote);
+    return m_has_header ? rd.read_header() : true;
+}
+
+void dialect::apply(csv::parallel_reader& rd) const
+{
+    rd.separator(m_separator);
+    rd.quote(m_quote);
+    rd.with_header(m_has_header);
+}
+
+void dialect::apply(csv::writer& wr) const
+{
+    wr.separator(m_separator);
+    wr.quote(m_quote);
+    wr.eol(m_eol);
+}
+
+
+/*
+ * sniffer class
+ */
+csv::dialect sniffer::sniff(const std::wstring& sample, const bool is_partial) const
+{
+    csv::dialect result;
+    if (sample.empty())
+        return result;
+    // Quote which opens the most of fields
+    size_t max_count = 0;
+    for (const wchar_t quote : m_quotes)
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < sample.length(); i++)
+        {
+            if (sample[i] == quote &&
+                (i == 0 || sample[i - 1] == L'\r' || sample[i - 1] == L'\n' || m_separators.find(sample[i - 1]) != wstring::npos))
+                count++;
+        }
+        if (count > max_count)
+        {
+            max_count = count;
+            result.quote(quote);
+        }
+    }
+    // The first line break outside quotes
+    bool inside = false;
+    for (size_t i = 0; i < sample.length(); i++)
+    {
+        const wchar_t c = sample[i];
+        if (c == result.quote())
+            inside = !inside;
+        else if (!inside && (c == L'\r' || c == L'\n'))
+        {
+            result.eol(c == L'\n' ? L"\n" : (i + 1 < sample.length() && sample[i + 1] == L'\n' ? L"\r\n" : L"\r"));
+            break;
+        }
+    }
+    // Share of rows with the most frequent field count
+    vector<csv::row> rows;
+    double max_consistency = 0.0;
+    for (const wchar_t separator : m_separators)
+    {
+        if (!parse_sample(sample, is_partial, separator, result.quote(), rows) || rows.empty())
+            continue;
+        map<size_t, size_t> counts;
+        for (const csv::row& r : rows)
+            counts[r.field_count()]++;
+        auto mode = max_element(counts.begin(), counts.end(),
+                                [](const pair<const size_t, size_t>& a, const pair<const size_t, size_t>& b) { return a.second < b.second; });
+        if (mode->first < 2)
+            continue;
+        const double consistency = static_cast<double>(mode->second) / rows.size();
+        if (consistency > max_consistency)
+        {
+            max_consistency = consistency;
+            result.separator(separator);
+        }
+    }
+    // Columns vote for the header when the first row differs from the other rows
+    parse_sample(sample, is_partial, result.separator(), result.quote(), rows);
+    if (rows.size() < 2)
+        return result;
+    int votes = 0;
+    const csv::row& first = rows[0];
+    for (size_t col = 0; col < first.field_count(); col++)
+    {
+        bool all_numbers = true;
+        bool same_length = true;
+        size_t length = wstring::npos;
+        size_t value_count = 0;
+        for (size_t i = 1; i < rows.size(); i++)
+        {
+            if (col >= rows[i].field_count())
+                continue;
+            const wstring value = rows[i].field(col).value();
+            if (value.empty())
+                continue;
+            value_count++;
+            all_numbers = all_numbers && parsers::is_number(value);
+            same_length = same_length && (length == wstring::npos || length == value.length());
+            length = value.length();
+        }
+        if (value_count == 0)
+            continue;
+        const wstring name = first.field(col).value();
+        if (all_numbers)
+            votes += parsers::is_number(name) ? -1 : 1;
+        else if (same_length)
+            votes += name.length() != length ? 1 : -1;
+    }
+    result.has_header(votes > 0);
+    return result;
+}
+
+csv::dialect sniffer::sniff_file(const std::wstring& file_name, const ioutils::text_io_policy& policy) const
+{
+    ioutils::text_reader rd(file_name, policy);
+    wstring sample;
+    wchar_t c;
+    while (sample.length() < m_sample_size && rd.next_char(c))
+        sample += c;
+    return sniff(sample, sample.length() == m_sample_size && !rd.eof());
+}
+
 }
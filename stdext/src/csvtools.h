@@ -7,9 +7,12 @@
  */
 #pragma once
 
+#include <functional>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
+#include "datetime.h"
 #include "ioutils.h"
 #include "parsers.h"
 
@@ -19,7 +22,7 @@ namespace stdext::csv
     {
     public:
         field(std::wstring value)
-            : m_value(value)
+            : m_value(std::move(value))
         {}
         field(const field& source) = default;
         field& operator=(const field& source) = default;
@@ -50,7 +53,11 @@ namespace stdext::csv
         csv::field& field(const size_type pos) { return m_row.at(pos); }
         void append_value(const std::wstring& value)
         {
-            m_row.push_back(csv::field(value));
+            m_row.emplace_back(value);
+        }
+        void append_value(std::wstring&& value)
+        {
+            m_row.emplace_back(std::move(value));
         }
         void clear() { m_row.clear(); }
         size_type field_count() const { return m_row.size(); }
@@ -63,14 +70,124 @@ namespace stdext::csv
     {};
 
 
+    /*
+     * Row which fields are slices of one character buffer reused between rows
+     * Field views are valid until the next row is read into the same object
+     */
+    class row_view
+    {
+    public:
+        // Offset and length of the field in the buffer
+        typedef std::vector<std::pair<std::size_t, std::size_t>> fields_t;
+        typedef typename fields_t::size_type size_type;
+    public:
+        row_view() {}
+        row_view(const row_view&) = default;
+        row_view& operator=(const row_view&) = default;
+        row_view(row_view&& source) = default;
+        row_view& operator=(row_view&& source) = default;
+    public:
+        std::wstring_view operator[](const size_type pos) const { return field(pos); }
+        std::wstring_view field(const size_type pos) const
+        {
+            const auto& f = m_fields.at(pos);
+            return std::wstring_view(m_buffer.data() + f.first, f.second);
+        }
+        std::wstring value(const size_type pos) const { return std::wstring(field(pos)); }
+        size_type field_count() const noexcept { return m_fields.size(); }
+        void append_value(const std::wstring_view value)
+        {
+            const std::size_t start = m_buffer.length();
+            m_buffer.append(value);
+            end_value(start);
+        }
+        // Allocated memory is kept for the next row
+        void clear() noexcept { m_buffer.clear(); m_fields.clear(); }
+        void to_row(csv::row& r) const;
+    private:
+        friend class reader;
+        void end_value(const std::size_t start) { m_fields.emplace_back(start, m_buffer.length() - start); }
+    private:
+        std::wstring m_buffer;
+        fields_t m_fields;
+    };
+
+
     enum class reader_msg_kind
     {
         io_error = 101,
         expected_separator = 201,
-        row_field_count_different_from_header = 301
+        row_field_count_different_from_header = 301,
+        invalid_column_value = 401
     };
     std::wstring to_wstring(const reader_msg_kind value);
 
+
+    /*
+     * Sidecar index of row starts recorded every step rows, used by reader::seek_row()
+     * Row starts are found outside quotes only, so no quote state is stored. The file is scanned without decoding:
+     * offsets are in bytes for files and in characters for wide streams, UTF-16 byte order is detected from BOM.
+     * Serialized layout: magic "CSVROWIX", uint32 version, uint64 step, uint64 entry count,
+     * then varint deltas of offset and line per entry, row numbers are implied by the step.
+     */
+    class row_index
+    {
+    public:
+        struct entry
+        {
+            uint64_t offset = 0;
+            // Count of data rows before the entry, header is not counted
+            long row = 0;
+            parsers::textpos::pos_t line = 1;
+        };
+        typedef std::vector<entry> entries_t;
+    public:
+        explicit row_index(const std::size_t step = 1024);
+        row_index(const row_index&) = default;
+        row_index& operator =(const row_index&) = default;
+        row_index(row_index&&) = default;
+        row_index& operator =(row_index&&) = default;
+    public:
+        bool build(const std::wstring& file_name, const ioutils::text_io_policy& policy, const bool with_header);
+        // Reads the stream to the end, offsets are counted from the stream start
+        bool build(std::wistream& stream, const bool with_header);
+        void clear() noexcept { m_entries.clear(); }
+        // Entry of the nearest indexed row not after the row (starting from 1), size() if the row is not indexed
+        std::size_t find(const long row) const noexcept;
+        const entry& operator [](const std::size_t i) const { return m_entries[i]; }
+        std::size_t size() const noexcept { return m_entries.size(); }
+        std::size_t step() const noexcept { return m_step; }
+        inline wchar_t quote() const noexcept { return m_quote; }
+        void quote(const wchar_t value) noexcept { m_quote = value; }
+        void write(std::ostream& stream) const;
+        bool read(std::istream& stream);
+    private:
+        std::size_t m_step;
+        wchar_t m_quote = '"';
+        entries_t m_entries;
+    };
+
+
+    /*
+     * Reader state between rows to continue reading the same seekable source later, see reader::save_checkpoint()
+     * Serialized layout: magic "CSVCHKPT", uint32 version, int64 offset, int32 line, int32 col, int64 row count,
+     * uint32 size and bytes of the decoder state, uint32 header field count, then uint32 size and UTF-8 bytes per field.
+     * Values and the decoder state are stored as the platform which wrote them has them.
+     */
+    struct checkpoint
+    {
+        // Stream characters before the next row, i.e. bytes for files and byte streams
+        std::streamoff offset = 0;
+        parsers::textpos pos;
+        long row_count = 0;
+        csv::header header;
+        mbstate_t state = {};
+    public:
+        void write(std::ostream& stream) const;
+        bool read(std::istream& stream);
+    };
+
+
     class reader
     {
     public:
@@ -90,29 +207,416 @@ namespace stdext::csv
         ~reader();
     public:
         bool next_row(csv::row& r);
+        // Does not allocate memory once the row buffer is large enough
+        bool next_row(csv::row_view& r);
         bool read_header();
+        // Moves to the nearest indexed row and skips rows up to the row (starting from 1), so the next row read is the row.
+        // Header should be read before, the index should be built for the same source and the header presence.
+        bool seek_row(const long row, const csv::row_index& index);
+        // Fails when the source is not seekable
+        bool save_checkpoint(csv::checkpoint& value);
+        // Source should be the same as the one of the checkpoint
+        bool restore(const csv::checkpoint& value);
         inline bool eof() const noexcept { return m_reader->eof(); }
         bool has_error() const { return m_messages.has_errors(); }
         const csv::header& header() { return m_header; }
+        // Header read elsewhere, rows are checked against it
+        void header(const csv::header& value) { m_header = value; }
         bool has_header() { return m_header.field_count() > 0; }
-        const parsers::textpos pos() const noexcept { return m_pos; }
+        const parsers::textpos pos() const noexcept { return m_lines.pos(m_offset); }
         long row_count() const { return m_row_num; }
         inline wchar_t separator() const { return m_separator; }
         void separator(const wchar_t value) { m_separator = value; }
+        inline wchar_t quote() const noexcept { return m_quote; }
+        void quote(const wchar_t value) noexcept { m_quote = value; }
         const msg_collector_t& messages() const { return m_messages; }
         const msg_collector_t::errors_t& errors() const { return m_messages.errors(); }
+        const std::wstring& source_name() const noexcept { return m_reader->source_name(); }
     private:
         bool next_char(wchar_t& wc);
         void add_error(const reader_msg_kind kind, const std::wstring& text);
-        void add_error(const reader_msg_kind kind, parsers::textpos pos, const std::wstring& text);
+        void add_error(const reader_msg_kind kind, const std::size_t offset, const std::wstring& text);
     private:
         wchar_t m_separator = ',';
-        parsers::textpos m_pos;
+        wchar_t m_quote = '"';
+        // Count of characters read, position is computed on demand
+        std::size_t m_offset = 0;
+        parsers::line_index m_lines;
         long m_row_num = 0;
         csv::header m_header;
+        csv::row_view m_row_view;
         ioutils::text_reader* m_reader = nullptr;
         bool m_owns_reader = false;
         msg_collector_t m_messages;
     };
 
+
+    /*
+     * Reads the file by chunks parsed in threads
+     * Chunk boundaries are moved to row starts using the quote parity of preceding bytes, so it is
+     * applicable to byte oriented encodings only. UTF-16 files and files which cannot be mapped are read sequentially.
+     */
+    class parallel_reader
+    {
+    public:
+        // Returns false to stop reading. Called from worker threads when rows are not ordered.
+        typedef std::function<bool(const csv::row_view& r, const long row_num)> row_handler_t;
+        typedef reader::msg_collector_t msg_collector_t;
+        typedef typename msg_collector_t::message_t message_t;
+    public:
+        parallel_reader() = delete;
+        parallel_reader(const std::wstring& file_name, const ioutils::text_io_policy& policy);
+        parallel_reader(const parallel_reader&) = delete;
+        parallel_reader& operator =(const parallel_reader&) = delete;
+        parallel_reader(parallel_reader&&) = delete;
+        parallel_reader& operator =(parallel_reader&&) = delete;
+    public:
+        // Returns false on error, rows following the first error in the file are not delivered in ordered mode
+        bool read(const row_handler_t& handler);
+        // The first row is read as header before other rows
+        bool with_header() const noexcept { return m_with_header; }
+        void with_header(const bool value) noexcept { m_with_header = value; }
+        const csv::header& header() const noexcept { return m_header; }
+        bool has_header() const noexcept { return m_header.field_count() > 0; }
+        // Rows are delivered in the file order from the calling thread
+        bool ordered() const noexcept { return m_ordered; }
+        void ordered(const bool value) noexcept { m_ordered = value; }
+        // Approximate size of chunk in bytes
+        std::size_t chunk_size() const noexcept { return m_chunk_size; }
+        void chunk_size(const std::size_t value) noexcept { m_chunk_size = value > 0 ? value : 1; }
+        // 0 means the number of hardware threads
+        std::size_t thread_count() const noexcept { return m_thread_count; }
+        void thread_count(const std::size_t value) noexcept { m_thread_count = value; }
+        inline wchar_t separator() const noexcept { return m_separator; }
+        void separator(const wchar_t value) noexcept { m_separator = value; }
+        // ASCII character because quotes are counted in bytes
+        inline wchar_t quote() const noexcept { return m_quote; }
+        void quote(const wchar_t value) noexcept { m_quote = value; }
+        long row_count() const noexcept { return m_row_count; }
+        bool has_error() const { return m_messages.has_errors(); }
+        const msg_collector_t& messages() const noexcept { return m_messages; }
+        const msg_collector_t::errors_t& errors() const { return m_messages.errors(); }
+    private:
+        struct chunk
+        {
+            std::size_t begin = 0;
+            std::size_t end = 0;
+            // Number of the first row in the chunk
+            long first_row = 1;
+            // Number of the first line in the file
+            parsers::textpos::pos_t first_line = 1;
+        };
+        bool read_sequential(const row_handler_t& handler);
+        void split(const char* data, const std::size_t size, std::vector<chunk>& chunks, const std::size_t thread_count);
+        void add_chunk_error(const chunk& ch, const reader_msg_kind kind,
+                             const parsers::textpos& pos, const std::wstring& text);
+    private:
+        std::wstring m_file_name;
+        const ioutils::text_io_policy& m_policy;
+        wchar_t m_separator = ',';
+        wchar_t m_quote = '"';
+        bool m_with_header = false;
+        bool m_ordered = true;
+        std::size_t m_chunk_size = 4 * 1024 * 1024;
+        std::size_t m_thread_count = 0;
+        long m_row_count = 0;
+        csv::header m_header;
+        msg_collector_t m_messages;
+    };
+
+
+    /*
+     * Typed columns
+     */
+    enum class column_type
+    {
+        ct_int64,
+        ct_double,
+        ct_datetime,
+        ct_bool,
+        ct_string
+    };
+    std::wstring to_wstring(const column_type value);
+
+    class column_def
+    {
+    public:
+        column_def(const std::wstring& name, const column_type type)
+            : m_name(name), m_type(type)
+        {}
+        column_def(const column_def&) = default;
+        column_def& operator=(const column_def&) = default;
+        column_def(column_def&&) = default;
+        column_def& operator=(column_def&&) = default;
+    public:
+        const std::wstring& name() const noexcept { return m_name; }
+        column_type type() const noexcept { return m_type; }
+    private:
+        std::wstring m_name;
+        column_type m_type;
+    };
+
+    // Columns are matched to row fields by position
+    class schema
+    {
+    public:
+        typedef std::vector<csv::column_def> columns_t;
+        typedef typename columns_t::size_type size_type;
+    public:
+        schema() {}
+        schema(std::initializer_list<csv::column_def> columns)
+            : m_columns(columns)
+        {}
+        schema(const schema&) = default;
+        schema& operator=(const schema&) = default;
+        schema(schema&&) = default;
+        schema& operator=(schema&&) = default;
+    public:
+        schema& add(const std::wstring& name, const column_type type)
+        {
+            m_columns.push_back(csv::column_def(name, type));
+            return *this;
+        }
+        const csv::column_def& operator[](const size_type pos) const { return m_columns.at(pos); }
+        size_type column_count() const noexcept { return m_columns.size(); }
+        // Returns column_count() when not found
+        size_type find(const std::wstring& name) const noexcept;
+    private:
+        columns_t m_columns;
+    };
+
+    /*
+     * Values of one column for the rows of the batch
+     * Only the value vector of the column type is filled, values of nulls are default ones.
+     * Strings are stored in the single character buffer, value i is [offsets[i], offsets[i + 1]).
+     */
+    class column
+    {
+    public:
+        explicit column(const column_type type)
+            : m_type(type)
+        {}
+        column(const column&) = default;
+        column& operator=(const column&) = default;
+        column(column&&) = default;
+        column& operator=(column&&) = default;
+    public:
+        column_type type() const noexcept { return m_type; }
+        std::size_t size() const noexcept { return m_size; }
+        bool is_null(const std::size_t i) const noexcept { return (m_nulls[i >> 6] >> (i & 63)) & 1; }
+        std::size_t null_count() const noexcept { return m_null_count; }
+        // Bit i is set for the null value of the row i
+        const std::vector<uint64_t>& null_bitmap() const noexcept { return m_nulls; }
+        const std::vector<int64_t>& int64_values() const noexcept { return m_int64_values; }
+        const std::vector<double>& double_values() const noexcept { return m_double_values; }
+        const std::vector<stdext::datetime>& datetime_values() const noexcept { return m_datetime_values; }
+        // Bytes instead of std::vector<bool> to keep values contiguous
+        const std::vector<uint8_t>& bool_values() const noexcept { return m_bool_values; }
+        const std::wstring& string_chars() const noexcept { return m_chars; }
+        const std::vector<std::size_t>& string_offsets() const noexcept { return m_offsets; }
+        std::wstring_view string_value(const std::size_t i) const
+        {
+            return std::wstring_view(m_chars.data() + m_offsets.at(i), m_offsets.at(i + 1) - m_offsets.at(i));
+        }
+    private:
+        friend class batch_reader;
+        // Memory is kept for the next batch
+        void clear(const std::size_t capacity);
+        // Returns false when the text is not a value of the column type, the value is null then
+        bool append(const std::wstring_view text, parsers::numeric_parser& parser, std::wstring& buf);
+        void append_null();
+    private:
+        column_type m_type;
+        std::size_t m_size = 0;
+        std::size_t m_null_count = 0;
+        std::vector<uint64_t> m_nulls;
+        std::vector<int64_t> m_int64_values;
+        std::vector<double> m_double_values;
+        std::vector<stdext::datetime> m_datetime_values;
+        std::vector<uint8_t> m_bool_values;
+        std::wstring m_chars;
+        std::vector<std::size_t> m_offsets;
+    };
+
+    class batch
+    {
+    public:
+        typedef std::vector<csv::column> columns_t;
+        typedef typename columns_t::size_type size_type;
+    public:
+        batch() {}
+        batch(const batch&) = default;
+        batch& operator=(const batch&) = default;
+        batch(batch&&) = default;
+        batch& operator=(batch&&) = default;
+    public:
+        const csv::column& operator[](const size_type pos) const { return m_columns.at(pos); }
+        size_type column_count() const noexcept { return m_columns.size(); }
+        std::size_t row_count() const noexcept { return m_row_count; }
+        // Number of the first row of the batch in the reader
+        long first_row() const noexcept { return m_first_row; }
+    private:
+        friend class batch_reader;
+        columns_t m_columns;
+        std::size_t m_row_count = 0;
+        long m_first_row = 0;
+    };
+
+    /*
+     * Reads rows to columnar batches
+     * Empty fields and missing trailing fields are nulls, except empty strings.
+     * Values which cannot be converted are nulls and reported as warnings.
+     */
+    class batch_reader
+    {
+    public:
+        typedef reader::msg_collector_t msg_collector_t;
+        typedef typename msg_collector_t::message_t message_t;
+    public:
+        batch_reader() = delete;
+        batch_reader(csv::reader& rd, const csv::schema& columns);
+        batch_reader(const batch_reader&) = delete;
+        batch_reader& operator =(const batch_reader&) = delete;
+        batch_reader(batch_reader&&) = delete;
+        batch_reader& operator =(batch_reader&&) = delete;
+    public:
+        // Reads up to max_rows rows, returns false when there are no more rows or on reader error
+        bool next_batch(csv::batch& b, const std::size_t max_rows);
+        const csv::schema& columns() const noexcept { return m_schema; }
+        bool has_error() const { return m_reader.has_error(); }
+        // Conversion warnings, reader errors are collected by the reader
+        const msg_collector_t& messages() const noexcept { return m_messages; }
+    private:
+        csv::reader& m_reader;
+        csv::schema m_schema;
+        csv::row_view m_row;
+        parsers::numeric_parser m_parser;
+        std::wstring m_buf;
+        msg_collector_t m_messages;
+    };
+
+
+    /*
+     * Writes rows to the text writer through the character buffer
+     * Fields containing separator, quote or line breaks are quoted.
+     */
+    class writer
+    {
+    public:
+        writer() = delete;
+        explicit writer(ioutils::text_writer* const wr);
+        explicit writer(std::wostream& stream);
+        writer(std::wostream& stream, const ioutils::text_io_policy& policy);
+        writer(std::ostream& stream, const ioutils::text_io_policy& policy);
+        writer(const std::wstring& file_name, const ioutils::text_io_policy& policy);
+        writer(std::wofstream& stream, const ioutils::text_io_policy& policy);
+        writer(const writer&) = delete;
+        writer& operator =(const writer&) = delete;
+        writer(writer&&) = delete;
+        writer& operator =(writer&&) = delete;
+        // Flushes the buffer
+        ~writer();
+    public:
+        writer& write_row(const csv::row& r);
+        writer& write_row(const csv::row_view& r);
+        writer& write_row(std::initializer_list<std::wstring_view> values);
+        // Fields of the current row, the row is ended by end_row()
+        writer& write_field(const std::wstring_view value);
+        writer& write_field(const wchar_t* value) { return write_field(std::wstring_view(value)); }
+        writer& write_field(const int64_t value);
+        writer& write_field(const int value) { return write_field(static_cast<int64_t>(value)); }
+        writer& write_field(const double value);
+        writer& write_field(const bool value);
+        writer& write_field(const stdext::datetime& value);
+        // Empty field
+        writer& write_null();
+        writer& end_row();
+        // Writes buffered characters to the text writer and flushes it
+        void flush();
+        inline wchar_t separator() const noexcept { return m_separator; }
+        void separator(const wchar_t value) noexcept { m_separator = value; }
+        inline wchar_t quote() const noexcept { return m_quote; }
+        void quote(const wchar_t value) noexcept { m_quote = value; }
+        // CRLF by default as in RFC 4180
+        const std::wstring& eol() const noexcept { return m_eol; }
+        void eol(const std::wstring& value) { m_eol = value; }
+        // Buffer is flushed when it contains more characters
+        std::size_t buffer_size() const noexcept { return m_buffer_size; }
+        void buffer_size(const std::size_t value) noexcept { m_buffer_size = value; }
+        long row_count() const noexcept { return m_row_num; }
+    private:
+        void begin_field();
+        void write_buffer();
+        void append_ascii(const char* first, const char* last);
+    private:
+        wchar_t m_separator = ',';
+        wchar_t m_quote = '"';
+        std::wstring m_eol = L"\r\n";
+        std::size_t m_buffer_size = 64 * 1024;
+        std::wstring m_buffer;
+        bool m_row_started = false;
+        long m_row_num = 0;
+        ioutils::text_writer* m_writer = nullptr;
+        bool m_owns_writer = false;
+    };
+
+
+    class dialect
+    {
+    public:
+        dialect() {}
+        dialect(const dialect&) = default;
+        dialect& operator=(const dialect&) = default;
+        dialect(dialect&&) = default;
+        dialect& operator=(dialect&&) = default;
+    public:
+        wchar_t separator() const noexcept { return m_separator; }
+        void separator(const wchar_t value) noexcept { m_separator = value; }
+        wchar_t quote() const noexcept { return m_quote; }
+        void quote(const wchar_t value) noexcept { m_quote = value; }
+        bool has_header() const noexcept { return m_has_header; }
+        void has_header(const bool value) noexcept { m_has_header = value; }
+        const std::wstring& eol() const noexcept { return m_eol; }
+        void eol(const std::wstring& value) { m_eol = value; }
+        // Sets separator and quote, reads the header when the dialect has it
+        bool apply(csv::reader& rd) const;
+        void apply(csv::parallel_reader& rd) const;
+        void apply(csv::writer& wr) const;
+    private:
+        wchar_t m_separator = ',';
+        wchar_t m_quote = '"';
+        bool m_has_header = false;
+        std::wstring m_eol = L"\r\n";
+    };
+
+    /*
+     * Detects the dialect from the beginning of the text
+     * Separator is the candidate giving the most consistent field count over sample rows,
+     * header is detected by columns where the first row differs from other rows by type or length.
+     */
+    class sniffer
+    {
+    public:
+        sniffer() {}
+        sniffer(const sniffer&) = delete;
+        sniffer& operator=(const sniffer&) = delete;
+        sniffer(sniffer&&) = delete;
+        sniffer& operator=(sniffer&&) = delete;
+    public:
+        // Count of characters read from files
+        std::size_t sample_size() const noexcept { return m_sample_size; }
+        void sample_size(const std::size_t value) noexcept { m_sample_size = value; }
+        const std::wstring& separators() const noexcept { return m_separators; }
+        void separators(const std::wstring& value) { m_separators = value; }
+        const std::wstring& quotes() const noexcept { return m_quotes; }
+        void quotes(const std::wstring& value) { m_quotes = value; }
+        // The last row of the partial sample is ignored because it may be truncated
+        csv::dialect sniff(const std::wstring& sample, const bool is_partial = false) const;
+        csv::dialect sniff_file(const std::wstring& file_name, const ioutils::text_io_policy& policy) const;
+    private:
+        std::size_t m_sample_size = 64 * 1024;
+        std::wstring m_separators = L",;\t|";
+        std::wstring m_quotes = L"\"'";
+    };
+
 }
@@ -9,6 +9,16 @@
 #include <sstream>
 #include <clocale>
 #include <algorithm>
+#if defined(__STDEXT_WINDOWS)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -42,8 +52,7 @@ void text_io_policy_plain::read_chars(mbstate_t&, text_reader_stream_adapter_bas
 
 void text_io_policy_plain::write_chars(mbstate_t&, text_writer_stream_adapter_base& stream, const std::wstring& ws) const
 {
-    for(const wchar_t& wc : ws)
-        stream.put(wc);
+    stream.write(ws.data(), ws.length());
 }
 
 
@@ -114,10 +123,7 @@ void text_io_policy_ansi::write_chars(mbstate_t& state, text_writer_stream_adapt
 {
     string bytes;
     if (m_cvt->utf16_to_ansi(state, ws, bytes) == m_cvt->ok)
-    {
-        for(const char& c : bytes)
-            stream.put((unsigned char)c);
-    }
+        stream.write(bytes.data(), bytes.length());
 }
 
 
@@ -179,6 +185,24 @@ void text_io_policy_utf8::read_chars(mbstate_t& state, text_reader_stream_adapte
     }
 }
 
+std::size_t text_io_policy_utf8::encoded_size(const wchar_t* chars, const std::size_t count) const
+{
+    size_t size = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint32_t c = static_cast<uint32_t>(chars[i]);
+        if (c < 0x80)
+            size += 1;
+        else if (c < 0x800 || (c >= 0xD800 && c <= 0xDFFF)) // surrogate pair is 4 bytes
+            size += 2;
+        else if (c < 0x10000)
+            size += 3;
+        else
+            size += 4;
+    }
+    return size;
+}
+
 bool text_io_policy_utf8::read_bytes(text_reader_stream_adapter_base& stream, std::string& bytes, const size_t count) const
 {
     size_t i = 0;
@@ -196,10 +220,7 @@ void text_io_policy_utf8::write_chars(mbstate_t& state, text_writer_stream_adapt
 {
     string bytes;
     if (m_cvt->to_utf8(state, ws, bytes) == m_cvt->ok)
-    {
-        for(const char& c : bytes)
-            stream.put((unsigned char)c);
-    }
+        stream.write(bytes.data(), bytes.length());
 }
 
 
@@ -244,6 +265,14 @@ void text_io_policy_utf16::read_chars(mbstate_t& state, text_reader_stream_adapt
     }
 }
 
+std::size_t text_io_policy_utf16::encoded_size(const wchar_t* chars, const std::size_t count) const
+{
+    size_t size = 0;
+    for (size_t i = 0; i < count; i++)
+        size += static_cast<uint32_t>(chars[i]) > 0xFFFF ? 2 * locutils::utf16::bytes_per_character : locutils::utf16::bytes_per_character;
+    return size;
+}
+
 bool text_io_policy_utf16::read_bytes(text_reader_stream_adapter_base& stream, std::string& bytes, const size_t max_len) const
 {
     bytes.clear();
@@ -266,10 +295,7 @@ void text_io_policy_utf16::write_chars(mbstate_t& state, text_writer_stream_adap
 {
     string bytes;
     if (m_cvt->utf16_to_mb(state, ws, bytes) == m_cvt->ok)
-    {
-        for(const char& c : bytes)
-            stream.put((unsigned char)c);
-    }
+        stream.write(bytes.data(), bytes.length());
 }
 
 
@@ -323,19 +349,47 @@ text_reader::~text_reader()
         delete m_stream;
 }
 
-bool text_reader::next_char(wchar_t& wc)
+bool text_reader::read_until(std::wstring& ws, std::initializer_list<wchar_t> stop_chars)
 {
-    if (m_chars.empty())
-        read_chars();
-    if (!m_chars.empty())
+    if (stop_chars.size() == 0 || stop_chars.size() > 4)
+    {
+        wchar_t wc;
+        while (peek(wc))
+        {
+            if (std::find(stop_chars.begin(), stop_chars.end(), wc) != stop_chars.end())
+                return true;
+            ws += wc;
+            m_block_pos++;
+        }
+        return false;
+    }
+    // Missing stop characters are replaced by the first one
+    wchar_t stops[4];
+    for (size_t i = 0; i < 4; i++)
+        stops[i] = i < stop_chars.size() ? *(stop_chars.begin() + i) : *stop_chars.begin();
+    while (m_block_pos < m_block.length() || read_block())
     {
-        wc = m_chars.front();
-        m_chars.pop_front();
-        return true;
+        const wchar_t* begin = m_block.data() + m_block_pos;
+        const size_t count = m_block.length() - m_block_pos;
+        const size_t n = str::find_first_of(begin, count, stops[0], stops[1], stops[2], stops[3]);
+        ws.append(begin, n);
+        m_block_pos += n;
+        if (n < count)
+            return true;
     }
     return false;
 }
 
+bool text_reader::read_block()
+{
+    m_block.clear();
+    m_block_pos = 0;
+    read_chars();
+    m_block.assign(m_chars.begin(), m_chars.end());
+    m_chars.clear();
+    return !m_block.empty();
+}
+
 void text_reader::read_chars()
 {
     if (m_use_file_io) // imbue() codecvt works only with file streams
@@ -352,16 +406,34 @@ void text_reader::read_chars()
         m_policy.read_chars(m_mbstate, *m_stream, m_chars);
 }
 
-bool text_reader::peek(wchar_t& wc)
+bool text_reader::seek(const std::streamoff offset)
 {
-    if (m_chars.empty())
-        read_chars();
-    if (!m_chars.empty())
-    {
-        wc = m_chars.front();
-        return true;
-    }
-    return false;
+    if (m_stream == nullptr)
+        return false;
+    m_chars.clear();
+    m_block.clear();
+    m_block_pos = 0;
+    return m_stream->seek(offset);
+}
+
+bool text_reader::seek(const std::streamoff offset, const mbstate_t& state)
+{
+    m_mbstate = state;
+    return seek(offset);
+}
+
+bool text_reader::tell(std::streamoff& offset, mbstate_t& state)
+{
+    if (m_stream == nullptr)
+        return false;
+    offset = m_stream->tell();
+    if (offset < 0)
+        return false;
+    // Characters decoded ahead are not read yet
+    const size_t pending = m_block.length() - m_block_pos;
+    offset -= static_cast<streamoff>(m_policy.encoded_size(m_block.data() + m_block_pos, pending));
+    state = m_mbstate;
+    return true;
 }
 
 bool text_reader::is_next_char(wchar_t wc)
@@ -413,8 +485,13 @@ std::streamsize text_reader::count() const
 
 bool text_reader::eof() const
 {
-    if (!m_chars.empty())
+    if (m_block_pos < m_block.length() || !m_chars.empty())
         return false;
+    return is_source_eof();
+}
+
+bool text_reader::is_source_eof() const
+{
     if (m_stream != nullptr)
     {
         if (m_stream->gcount() == 0)
@@ -466,33 +543,161 @@ text_writer::text_writer(std::wofstream& stream, const text_io_policy& policy)
 text_writer::~text_writer()
 {
     if (m_stream != nullptr)
+    {
+        // Destructor does not report errors, call flush() to get them
+        try
+        {
+            flush();
+        }
+        catch (...)
+        {
+        }
         delete m_stream;
+    }
 }
 
-text_writer& text_writer::write(const std::wstring& ws)
+text_writer& text_writer::write(const std::wstring_view ws)
 {
-    if (m_use_file_io)
+    if (m_buffer.length() + ws.length() > m_buffer_size)
+        write_buffer();
+    // Buffer may still keep a high surrogate
+    if (m_buffer.length() + ws.length() <= m_buffer_size)
     {
-        for (const wchar_t& wc : ws)
-            m_stream->put(wc);
+        m_buffer.append(ws);
+        return *this;
     }
-    else
-        m_policy.write_chars(m_mbstate, *m_stream, ws);
+    // Large strings are converted by blocks of the buffer size
+    size_t pos = 0;
+    while (m_buffer.length() + ws.length() - pos > m_buffer_size)
+    {
+        const size_t count = m_buffer.length() < m_buffer_size ? m_buffer_size - m_buffer.length() : 1;
+        m_buffer.append(ws.substr(pos, count));
+        write_buffer();
+        pos += count;
+    }
+    m_buffer.append(ws.substr(pos));
     return *this;
 }
 
 text_writer& text_writer::write(const wchar_t wc)
 {
-    if (m_use_file_io)
-        m_stream->put(wc);
-    else
-        m_policy.write_chars(m_mbstate, *m_stream, wstring(1, wc));
+    if (m_buffer.length() >= m_buffer_size)
+        write_buffer();
+    m_buffer += wc;
     return *this;
 }
 
+void text_writer::flush()
+{
+    write_buffer(true);
+    m_stream->flush();
+}
+
+void text_writer::buffer_size(const std::size_t value)
+{
+    m_buffer_size = value > 0 ? value : 1;
+    if (m_buffer.length() >= m_buffer_size)
+        write_buffer();
+}
+
+void text_writer::write_buffer(const bool all)
+{
+    if (m_buffer.empty())
+        return;
+    // Surrogate pair is not split between conversions, the high surrogate waits for the next block
+    wchar_t high_surrogate = 0;
+    if (!all && locutils::utf16::is_high_surrogate(m_buffer.back()))
+    {
+        high_surrogate = m_buffer.back();
+        m_buffer.pop_back();
+    }
+    if (!m_buffer.empty())
+    {
+        if (m_use_file_io)
+            m_stream->write(m_buffer.data(), m_buffer.length());
+        else
+            m_policy.write_chars(m_mbstate, *m_stream, m_buffer);
+        m_buffer.clear();
+    }
+    if (high_surrogate != 0)
+        m_buffer += high_surrogate;
+}
+
 text_writer& text_writer::write_endl()
 {
     return write(L'\n');
 }
 
+/*
+ * mapped_file class
+ */
+bool mapped_file::open(const std::wstring& file_name)
+{
+    close();
+#if defined(__STDEXT_WINDOWS)
+    HANDLE file = CreateFileW(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    m_file = file;
+    m_mapping = mapping;
+    m_data = static_cast<const char*>(data);
+    m_size = static_cast<std::size_t>(size.QuadPart);
+#else
+    int fd = ::open(locutils::utf16::to_utf8string(file_name).c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    m_data = static_cast<const char*>(data);
+    m_size = static_cast<std::size_t>(st.st_size);
+#endif
+    return true;
+}
+
+void mapped_file::close() noexcept
+{
+    if (m_data == nullptr)
+        return;
+#if defined(__STDEXT_WINDOWS)
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+    CloseHandle(m_file);
+    m_mapping = nullptr;
+    m_file = nullptr;
+#else
+    munmap(const_cast<char*>(m_data), m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
 }
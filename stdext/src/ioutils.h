@@ -6,9 +6,14 @@
  */
 #pragma once
 
+#include <algorithm>
 #include <iostream>
 #include <deque>
 #include "locutils.h"
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 
 namespace stdext::ioutils
 {
@@ -50,6 +55,10 @@ namespace stdext::ioutils
         virtual int_type get() = 0;
         virtual bool is_eof(const int_type c) = 0;
         virtual int_type peek() = 0;
+        // Offset is counted in stream characters from the stream start, i.e. in bytes for byte streams
+        virtual bool seek(const std::streamoff offset) = 0;
+        // Offset of the next character to read, -1 if the stream is not seekable
+        virtual std::streamoff tell() = 0;
     };
 
     class text_writer_stream_adapter_base : public text_stream_adapter_base
@@ -60,6 +69,10 @@ namespace stdext::ioutils
         {}
     public:
         virtual void put(const int_type c) = 0;
+        // Bulk writes, each byte or character is one stream character
+        virtual void write(const char* bytes, const std::size_t count) = 0;
+        virtual void write(const wchar_t* chars, const std::size_t count) = 0;
+        virtual void flush() = 0;
     };
 
     template <class StreamT>
@@ -86,6 +99,29 @@ namespace stdext::ioutils
         void imbue(const std::locale& loc) override { m_stream->imbue(std::locale(loc)); }
         bool is_eof(const int_type c) override      { return (c == (int_type)stream_t::traits_type::eof()); }
         int_type peek() override                    { return m_stream->peek(); }
+        bool seek(const std::streamoff offset) override
+        {
+            typename stream_t::pos_type pos(offset);
+            m_stream->clear();
+            if (offset > 0)
+            {
+                // Conversion state of file streams keeps the byte order detected at the text start.
+                // It is available from the position after the first character only.
+                m_stream->seekg(0);
+                m_stream->get();
+                m_stream->clear();
+                const typename stream_t::pos_type current = m_stream->tellg();
+                if (current != typename stream_t::pos_type(-1))
+                    pos.state(current.state());
+            }
+            m_stream->seekg(pos);
+            return !m_stream->fail();
+        }
+        std::streamoff tell() override
+        {
+            m_stream->clear();
+            return static_cast<std::streamoff>(m_stream->tellg());
+        }
     protected:
         stream_t* m_stream = nullptr;
     };
@@ -111,9 +147,33 @@ namespace stdext::ioutils
         }
     public:
         void put(const int_type c) override         { m_stream->put((char_type)c); }
+        void write(const char* bytes, const std::size_t count) override
+        {
+            if constexpr (std::is_same<char_type, char>::value)
+                m_stream->write(bytes, static_cast<std::streamsize>(count));
+            else
+                write_converted(reinterpret_cast<const unsigned char*>(bytes), count);
+        }
+        void write(const wchar_t* chars, const std::size_t count) override
+        {
+            if constexpr (std::is_same<char_type, wchar_t>::value)
+                m_stream->write(chars, static_cast<std::streamsize>(count));
+            else
+                write_converted(chars, count);
+        }
+        void flush() override                       { m_stream->flush(); }
         locale getloc() override                    { return m_stream->getloc(); }
         bool good() override                        { return m_stream->good(); }
         void imbue(const std::locale& loc) override { m_stream->imbue(std::locale(loc)); }
+    protected:
+        template <class CharT>
+        void write_converted(const CharT* chars, const std::size_t count)
+        {
+            std::basic_string<char_type> s(count, char_type());
+            for (std::size_t i = 0; i < count; i++)
+                s[i] = (char_type)chars[i];
+            m_stream->write(s.data(), static_cast<std::streamsize>(s.length()));
+        }
     protected:
         stream_t* m_stream = nullptr;
     };
@@ -142,6 +202,9 @@ namespace stdext::ioutils
         virtual void write_chars(mbstate_t& state, text_writer_stream_adapter_base& stream, const std::wstring& ws) const = 0;
         virtual void set_imbue_read(text_reader_stream_adapter_base&) const = 0;
         virtual void set_imbue_write(text_writer_stream_adapter_base&) const = 0;
+        // Count of stream characters which the characters are decoded from, i.e. bytes for byte streams.
+        // It is exact for valid text, replaced invalid sequences are not taken into account.
+        virtual std::size_t encoded_size(const wchar_t*, const std::size_t count) const { return count; }
     protected:
         void push_back_chars(const std::wstring& ws, text_buffer_t& buf) const;
     protected:
@@ -201,6 +264,7 @@ namespace stdext::ioutils
         void write_chars(mbstate_t& state, text_writer_stream_adapter_base& stream, const std::wstring& ws) const override;
         void set_imbue_read(text_reader_stream_adapter_base& stream) const override;
         void set_imbue_write(text_writer_stream_adapter_base& stream) const override;
+        std::size_t encoded_size(const wchar_t* chars, const std::size_t count) const override;
     private:
         bool read_bytes(text_reader_stream_adapter_base& stream, std::string& bytes, const size_t count) const;
     protected:
@@ -224,6 +288,7 @@ namespace stdext::ioutils
         void write_chars(mbstate_t& state, text_writer_stream_adapter_base& stream, const std::wstring& ws) const override;
         void set_imbue_read(text_reader_stream_adapter_base& stream) const override;
         void set_imbue_write(text_writer_stream_adapter_base& stream) const override;
+        std::size_t encoded_size(const wchar_t* chars, const std::size_t count) const override;
     private:
         bool read_bytes(text_reader_stream_adapter_base& stream, std::string& bytes, const size_t max_len) const;
     protected:
@@ -240,7 +305,6 @@ namespace stdext::ioutils
     class text_reader
     {
     public:
-        text_reader() = delete;
         explicit text_reader(std::wistream& stream);
         text_reader(std::wistream& stream, const text_io_policy& policy);
         explicit text_reader(std::istream& stream);
@@ -253,22 +317,52 @@ namespace stdext::ioutils
         text_reader& operator=(text_reader&&) = delete;
         virtual ~text_reader();
     public:
-        bool next_char(wchar_t& wc);
+        // Characters are taken from the decoded block, so it is inlined in lexers
+        inline bool next_char(wchar_t& wc)
+        {
+            if (m_block_pos >= m_block.length() && !read_block())
+                return false;
+            wc = m_block[m_block_pos++];
+            return true;
+        }
+        // Appends the characters preceding the first of stop characters to ws, the stop character is not read.
+        // Returns false when the text ends before any stop character. Up to 4 stop characters are scanned by blocks.
+        bool read_until(std::wstring& ws, std::initializer_list<wchar_t> stop_chars);
         bool is_next_char(wchar_t wc);
         bool is_next_char(std::initializer_list<wchar_t> wchars);
         std::streamsize count() const;
         bool eof() const;
-        bool peek(wchar_t& wc);
+        inline bool peek(wchar_t& wc)
+        {
+            if (m_block_pos >= m_block.length() && !read_block())
+                return false;
+            wc = m_block[m_block_pos];
+            return true;
+        }
+        // Continues reading from the offset of the seekable stream (see text_reader_stream_adapter_base::seek()).
+        // Offset should be at a character start, the decoder state is kept.
+        bool seek(const std::streamoff offset);
+        bool seek(const std::streamoff offset, const mbstate_t& state);
+        // Stream offset of the next character to read and the decoder state of streams read by the policy, see seek()
+        bool tell(std::streamoff& offset, mbstate_t& state);
         virtual void read_all(std::wstring& ws);
         virtual void read_line(std::wstring& ws);
-        std::wstring source_name() const noexcept { return m_source_name; }
+        const std::wstring& source_name() const noexcept { return m_source_name; }
         void source_name(const std::wstring& value) { m_source_name = value; }
     protected:
+        // Derived readers decode their sources themselves
+        text_reader() {}
         void read_chars();
+        // Moves decoded characters to the contiguous block
+        virtual bool read_block();
+        // Called when all decoded characters are read
+        virtual bool is_source_eof() const;
     protected:
         text_reader_stream_adapter_base* m_stream = nullptr;
         std::wstring m_source_name;
         text_buffer_t m_chars;
+        std::wstring m_block;
+        std::size_t m_block_pos = 0;
         bool m_use_file_io = false;
         text_io_policy_plain m_default_policy;
         const text_io_policy& m_policy = m_default_policy;
@@ -276,9 +370,262 @@ namespace stdext::ioutils
     };
 
 
+    /*
+     * Sources of code units for basic_text_reader
+     * read() copies up to count units and returns 0 at the end of the source
+     */
+    template <class UnitT>
+    class memory_source
+    {
+    public:
+        typedef UnitT unit_type;
+    public:
+        // Data should live while the source is used
+        memory_source(const UnitT* data, const std::size_t size)
+            : m_data(data), m_size(size)
+        {}
+    public:
+        bool eof() const noexcept { return m_pos >= m_size; }
+        std::size_t read(UnitT* buf, const std::size_t count) noexcept
+        {
+            const std::size_t n = std::min(count, m_size - m_pos);
+            std::copy(m_data + m_pos, m_data + m_pos + n, buf);
+            m_pos += n;
+            return n;
+        }
+    private:
+        const UnitT* m_data;
+        std::size_t m_size;
+        std::size_t m_pos = 0;
+    };
+
+    // Reads the stream buffer directly, stream state flags are not changed
+    template <class StreamT>
+    class stream_source
+    {
+    public:
+        typedef typename StreamT::char_type unit_type;
+        typedef typename StreamT::traits_type traits_type;
+    public:
+        explicit stream_source(StreamT& stream)
+            : m_stream(stream)
+        {}
+    public:
+        bool eof() const
+        {
+            return m_stream.rdbuf() == nullptr || traits_type::eq_int_type(m_stream.rdbuf()->sgetc(), traits_type::eof());
+        }
+        std::size_t read(unit_type* buf, const std::size_t count)
+        {
+            return m_stream.rdbuf() == nullptr ? 0 : static_cast<std::size_t>(m_stream.rdbuf()->sgetn(buf, static_cast<std::streamsize>(count)));
+        }
+    private:
+        StreamT& m_stream;
+    };
+
+
+    /*
+     * Decoders for basic_text_reader
+     * decode() appends characters of complete sequences in [first, last) and returns the count of decoded units,
+     * the rest is passed again with the following units. is_final is set when no units follow.
+     * Output never has more characters than input units.
+     */
+
+    // Every unit is a character, i.e. Latin-1 bytes or wide characters
+    class plain_decoder
+    {
+    public:
+        template <class UnitT>
+        std::size_t decode(const UnitT* first, const UnitT* last, std::wstring& ws, const bool)
+        {
+            const std::size_t count = static_cast<std::size_t>(last - first);
+            const std::size_t start = ws.length();
+            ws.resize(start + count);
+            wchar_t* out = &ws[start];
+            for (std::size_t i = 0; i < count; i++)
+                out[i] = static_cast<wchar_t>(static_cast<typename std::make_unsigned<UnitT>::type>(first[i]));
+            return count;
+        }
+    };
+
+    // Invalid sequences are replaced by U+FFFD, BOM is skipped
+    class utf8_decoder
+    {
+    public:
+        std::size_t decode(const char* first, const char* last, std::wstring& ws, const bool is_final)
+        {
+            const unsigned char* p = reinterpret_cast<const unsigned char*>(first);
+            const unsigned char* end = reinterpret_cast<const unsigned char*>(last);
+            if (m_is_first)
+            {
+                if (end - p < 3 && !is_final)
+                    return 0;
+                m_is_first = false;
+                if (end - p >= 3 && locutils::utf8::is_bom(first[0], first[1], first[2]))
+                    p += 3;
+            }
+            const std::size_t start = ws.length();
+            ws.resize(start + static_cast<std::size_t>(end - p));
+            wchar_t* const out_begin = &ws[start];
+            wchar_t* out = out_begin;
+            while (p < end)
+            {
+                const uint32_t c = *p;
+                if (c < 0x80)
+                {
+                    *out++ = static_cast<wchar_t>(c);
+                    p++;
+                    continue;
+                }
+                const std::ptrdiff_t length = c >= 0xF0 ? 4 : (c >= 0xE0 ? 3 : (c >= 0xC0 ? 2 : 0));
+                if (length > 0 && end - p < length && !is_final)
+                    break;
+                uint32_t code = c & (0x7Fu >> length);
+                bool is_valid = length > 0 && c <= 0xF4 && end - p >= length;
+                for (std::ptrdiff_t i = 1; i < length && is_valid; i++)
+                {
+                    is_valid = (p[i] & 0xC0) == 0x80;
+                    code = (code << 6) | (p[i] & 0x3F);
+                }
+                // Overlong forms, surrogates and code points above U+10FFFF are not Unicode scalar values
+                if (is_valid)
+                    is_valid = code >= min_code[length] && code <= 0x10FFFF && (code < 0xD800 || code > 0xDFFF);
+                if (!is_valid)
+                {
+                    *out++ = replacement_char;
+                    p++;
+                }
+                else
+                {
+                    if (sizeof(wchar_t) == 2 && code > 0xFFFF)
+                    {
+                        code -= 0x10000;
+                        *out++ = static_cast<wchar_t>(0xD800 + (code >> 10));
+                        *out++ = static_cast<wchar_t>(0xDC00 + (code & 0x3FF));
+                    }
+                    else
+                        *out++ = static_cast<wchar_t>(code);
+                    p += length;
+                }
+            }
+            ws.resize(start + static_cast<std::size_t>(out - out_begin));
+            return static_cast<std::size_t>(reinterpret_cast<const char*>(p) - first);
+        }
+    private:
+        static const wchar_t replacement_char = 0xFFFD;
+        // Minimal code point of the sequence length
+        static constexpr uint32_t min_code[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+        bool m_is_first = true;
+    };
+
+    // Byte order is detected at the text start like codecvt_utf16_wchar_t does unless it is assigned, BOM is skipped.
+    // Surrogate pairs are kept as they are.
+    class utf16_decoder
+    {
+    public:
+        utf16_decoder() {}
+        explicit utf16_decoder(const endianess::byte_order order)
+            : m_order(order), m_is_order_assigned(true)
+        {}
+    public:
+        endianess::byte_order byte_order() const noexcept { return m_order; }
+        std::size_t decode(const char* first, const char* last, std::wstring& ws, const bool)
+        {
+            const char* p = first;
+            if (m_is_first)
+            {
+                if (last - p < locutils::utf16::bytes_per_character)
+                    return 0;
+                m_is_first = false;
+                if (!m_is_order_assigned)
+                    locutils::utf16::try_detect_byte_order(first, static_cast<std::size_t>(last - first), m_order);
+                if (locutils::utf16::is_bom(p[0], p[1], m_order))
+                    p += locutils::utf16::bytes_per_character;
+            }
+            const std::size_t count = static_cast<std::size_t>(last - p) / locutils::utf16::bytes_per_character;
+            const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+            const std::size_t start = ws.length();
+            ws.resize(start + count);
+            wchar_t* out = &ws[start];
+            if (m_order == endianess::byte_order::big_endian)
+            {
+                for (std::size_t i = 0; i < count; i++)
+                    out[i] = static_cast<wchar_t>((u[2 * i] << 8) | u[2 * i + 1]);
+            }
+            else
+            {
+                for (std::size_t i = 0; i < count; i++)
+                    out[i] = static_cast<wchar_t>((u[2 * i + 1] << 8) | u[2 * i]);
+            }
+            return static_cast<std::size_t>(p - first) + count * locutils::utf16::bytes_per_character;
+        }
+    private:
+        endianess::byte_order m_order = endianess::platform_value();
+        bool m_is_order_assigned = false;
+        bool m_is_first = true;
+    };
+
+
+    /**
+     * @brief The basic_text_reader class
+     * Source and decoder are template parameters, so the decoding loop is inlined.
+     * It is usable everywhere text_reader is expected (lexers, csv::reader): characters are read from the block
+     * without virtual calls, only refilling the block is virtual. Seeking is not supported.
+     */
+    template <class Source, class Decoder>
+    class basic_text_reader : public text_reader
+    {
+    public:
+        typedef typename Source::unit_type unit_type;
+    public:
+        explicit basic_text_reader(const Source& source, const Decoder& decoder = Decoder())
+            : text_reader(), m_source(source), m_decoder(decoder), m_units(block_size)
+        {}
+        basic_text_reader(const basic_text_reader&) = delete;
+        basic_text_reader& operator=(const basic_text_reader&) = delete;
+        basic_text_reader(basic_text_reader&&) = delete;
+        basic_text_reader& operator=(basic_text_reader&&) = delete;
+    public:
+        Source& source() noexcept { return m_source; }
+        Decoder& decoder() noexcept { return m_decoder; }
+    protected:
+        bool read_block() override
+        {
+            m_block.clear();
+            m_block_pos = 0;
+            while (m_block.empty())
+            {
+                const std::size_t n = m_source.read(m_units.data() + m_unit_count, m_units.size() - m_unit_count);
+                m_unit_count += n;
+                if (m_unit_count == 0)
+                    return false;
+                const std::size_t used = m_decoder.decode(m_units.data(), m_units.data() + m_unit_count, m_block, n == 0);
+                // Incomplete sequence is decoded with the following units
+                std::copy(m_units.data() + used, m_units.data() + m_unit_count, m_units.data());
+                m_unit_count -= used;
+                if (n == 0 && used == 0)
+                {
+                    m_unit_count = 0;
+                    break;
+                }
+            }
+            return !m_block.empty();
+        }
+        bool is_source_eof() const override { return m_unit_count == 0 && m_source.eof(); }
+    private:
+        static const std::size_t block_size = 16384;
+        Source m_source;
+        Decoder m_decoder;
+        std::vector<unit_type> m_units;
+        std::size_t m_unit_count = 0;
+    };
+
+
     /**
      * @brief The text_writer class
      * Designed to write wide strings to streams or to text files (both ANSI and Unicode)
+     * Characters are collected in the buffer and converted by blocks,
+     * call flush() to make them available in the stream before the writer is destroyed
      */
     class text_writer
     {
@@ -296,15 +643,56 @@ namespace stdext::ioutils
         text_writer& operator=(text_writer&&) = delete;
         ~text_writer();
     public:
-        text_writer& write(const std::wstring& ws);
+        static constexpr std::size_t default_buffer_size = 16384;
+    public:
+        text_writer& write(const std::wstring_view ws);
         text_writer& write(const wchar_t wc);
         text_writer& write_endl();
+        // Writes buffered characters and flushes the stream
+        void flush();
+        // In characters, 0 is treated as 1
+        std::size_t buffer_size() const noexcept { return m_buffer_size; }
+        void buffer_size(const std::size_t value);
+    protected:
+        // Keeps the trailing high surrogate in the buffer unless all characters are requested
+        void write_buffer(const bool all = false);
     protected:
         text_writer_stream_adapter_base* m_stream = nullptr;
         bool m_use_file_io = false;
         text_io_policy_plain m_default_policy;
         const text_io_policy& m_policy = m_default_policy;
         mbstate_t m_mbstate = {};
+        std::wstring m_buffer;
+        std::size_t m_buffer_size = default_buffer_size;
+    };
+
+
+    /*
+     * Read-only memory mapping of the whole file
+     * Pages are loaded on demand and shared between processes mapping the same file
+     */
+    class mapped_file
+    {
+    public:
+        mapped_file() {}
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+        mapped_file(mapped_file&&) = delete;
+        mapped_file& operator=(mapped_file&&) = delete;
+        ~mapped_file() { close(); }
+    public:
+        bool open(const std::wstring& file_name);
+        void close() noexcept;
+        const char* data() const noexcept { return m_data; }
+        bool is_open() const noexcept { return m_data != nullptr; }
+        std::size_t size() const noexcept { return m_size; }
+    private:
+        const char* m_data = nullptr;
+        std::size_t m_size = 0;
+#if defined(__STDEXT_WINDOWS)
+        void* m_file = nullptr;
+        void* m_mapping = nullptr;
+#endif
     };
 
 }
@@ -12,6 +12,9 @@
 #include "jsondom.h"
 #include "jsonparser.h"
 #include "jsontools.h"
+#include "jsonbinding.h"
+#include "jsoncbor.h"
+#include "jsonsnapshot.h"
 
 namespace stdext
 {
@@ -0,0 +1,236 @@
+/*
+ C++ standard library extensions
+ (c) 2001-2020 Serguei Tarassov (see license.txt)
+ */
+
+#include "jsonbinding.h"
+#include "jsonexceptions.h"
+#include <algorithm>
+#include "../strutils.h"
+
+using namespace std;
+
+namespace stdext
+{
+namespace json
+{
+
+namespace
+{
+    const uint32_t fnv_offset_basis = 2166136261u;
+    const uint32_t fnv_prime = 16777619u;
+    // Seeds tried before the table size is doubled
+    const uint32_t max_seed_count = 256;
+}
+
+/*
+ * perfect_hash_index class
+ */
+perfect_hash_index::perfect_hash_index(const std::vector<std::wstring>& names) noexcept(false)
+    : m_names(names)
+{
+    if (m_names.empty())
+        return;
+    vector<wstring> sorted(m_names);
+    sort(sorted.begin(), sorted.end());
+    auto it = adjacent_find(sorted.begin(), sorted.end());
+    if (it != sorted.end())
+        throw json::exception(L"Duplicate bound member name: " + *it);
+    size_t table_size = 1;
+    while (table_size < m_names.size() * 2)
+        table_size <<= 1;
+    while (true)
+    {
+        m_mask = static_cast<uint32_t>(table_size - 1);
+        for (uint32_t seed = 0; seed < max_seed_count; seed++)
+        {
+            m_slots.assign(table_size, 0);
+            bool collision = false;
+            for (size_t i = 0; i < m_names.size() && !collision; i++)
+            {
+                uint32_t& slot = m_slots[hash(m_names[i], seed) & m_mask];
+                collision = slot != 0;
+                slot = static_cast<uint32_t>(i + 1);
+            }
+            if (!collision)
+            {
+                m_seed = seed;
+                return;
+            }
+        }
+        table_size <<= 1;
+    }
+}
+
+uint32_t perfect_hash_index::hash(const std::wstring& name, const uint32_t seed) noexcept
+{
+    uint32_t h = fnv_offset_basis ^ seed;
+    for (const wchar_t c : name)
+    {
+        h ^= static_cast<uint32_t>(c);
+        h *= fnv_prime;
+    }
+    return h;
+}
+
+std::size_t perfect_hash_index::find(const std::wstring& name) const noexcept
+{
+    if (m_slots.empty())
+        return npos;
+    const uint32_t slot = m_slots[hash(name, m_seed) & m_mask];
+    if (slot == 0 || m_names[slot - 1] != name)
+        return npos;
+    return slot - 1;
+}
+
+
+std::wstring to_number_text(const double value)
+{
+    const string text = str::to_shortest_string(value);
+    return wstring(text.begin(), text.end());
+}
+
+
+/*
+ * binding_handler class
+ */
+binding_handler::binding_handler(const binder_base& binder, void* target, msg_collector_t& msgs, const std::wstring& source_name)
+    : m_binder(binder), m_target(target), m_messages(msgs), m_source_name(source_name)
+{ }
+
+const binder_base* binding_handler::next_value(void*& target, const std::wstring*& name)
+{
+    target = nullptr;
+    name = nullptr;
+    if (m_frames.empty())
+    {
+        if (m_root_done)
+            return nullptr;
+        m_root_done = true;
+        target = m_target;
+        return &m_binder;
+    }
+    frame& f = m_frames.back();
+    if (f.binder == nullptr)
+        return nullptr;
+    if (f.binder->is_array())
+    {
+        const binder_base* element_binder = nullptr;
+        target = f.binder->append_element(f.target, element_binder);
+        name = f.name;
+        return element_binder;
+    }
+    const binder_base* member_binder = f.member_binder;
+    target = f.member_target;
+    name = f.member_name;
+    f.member_binder = nullptr;
+    f.member_target = nullptr;
+    f.member_name = nullptr;
+    return member_binder;
+}
+
+void binding_handler::check_result(const bind_result result, const std::wstring* name)
+{
+    parser_msg_kind kind;
+    switch (result)
+    {
+    case bind_result::ok:
+        return;
+    case bind_result::out_of_range:
+        kind = parser_msg_kind::err_binding_number_out_of_range_fmt;
+        break;
+    default:
+        kind = parser_msg_kind::err_binding_type_mismatch_fmt;
+        break;
+    }
+    if (m_messages.accepts())
+        m_messages.add_error(parsers::msg_origin::parser, kind, m_parser != nullptr ? m_parser->pos() : m_pos, m_source_name, &to_wmessage,
+                             { name == nullptr ? wstring() : *name });
+    else
+        m_messages.drop();
+}
+
+void binding_handler::on_literal(const json::dom_literal_type type, const std::wstring&)
+{
+    void* target;
+    const wstring* name;
+    const binder_base* binder = next_value(target, name);
+    if (binder != nullptr)
+        check_result(binder->set_literal(target, type), name);
+}
+
+void binding_handler::on_number(const json::dom_number_type type, const std::wstring& text)
+{
+    on_number(type, text, parsers::numeric_parser(text).binary_value());
+}
+
+void binding_handler::on_number(const json::dom_number_type type, const std::wstring& text, const parsers::numeric_value& value)
+{
+    void* target;
+    const wstring* name;
+    const binder_base* binder = next_value(target, name);
+    if (binder != nullptr)
+        check_result(binder->set_number(target, type, text, value), name);
+}
+
+void binding_handler::on_string(const std::wstring& text)
+{
+    void* target;
+    const wstring* name;
+    const binder_base* binder = next_value(target, name);
+    if (binder != nullptr)
+        check_result(binder->set_string(target, text), name);
+}
+
+void binding_handler::begin_container(const bool is_array)
+{
+    void* target;
+    const wstring* name;
+    const binder_base* binder = next_value(target, name);
+    if (binder != nullptr)
+    {
+        binder = binder->resolve(target);
+        if (is_array ? !binder->is_array() : !binder->is_object())
+        {
+            check_result(bind_result::type_mismatch, name);
+            binder = nullptr;
+        }
+        else if (is_array)
+            binder->clear(target);
+    }
+    m_frames.push_back(frame{ binder, target, name, nullptr, nullptr, nullptr });
+}
+
+void binding_handler::on_begin_object()
+{
+    begin_container(false);
+}
+
+void binding_handler::on_member_name(const std::wstring& text)
+{
+    if (m_frames.empty())
+        return;
+    frame& f = m_frames.back();
+    if (f.binder != nullptr)
+        f.member_target = f.binder->member(f.target, text, f.member_binder, f.member_name);
+}
+
+void binding_handler::on_end_object(const std::size_t)
+{
+    if (!m_frames.empty())
+        m_frames.pop_back();
+}
+
+void binding_handler::on_begin_array()
+{
+    begin_container(true);
+}
+
+void binding_handler::on_end_array(const std::size_t)
+{
+    if (!m_frames.empty())
+        m_frames.pop_back();
+}
+
+}
+}
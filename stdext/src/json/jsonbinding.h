@@ -0,0 +1,547 @@
+/*
+ C++ standard library extensions
+ (c) 2001-2020 Serguei Tarassov (see license.txt)
+
+ JSON (JavaScript Object Notation) tools
+ Binding of JSON values to C++ types without DOM
+
+ Usage:
+     struct point { int64_t x = 0; int64_t y = 0; std::optional<std::wstring> label; };
+     STDEXT_JSON_BINDING(point,
+         STDEXT_JSON_FIELD(point, x),
+         STDEXT_JSON_FIELD(point, y),
+         STDEXT_JSON_FIELD(point, label))
+     ...
+     point p;
+     json::typed_reader<point> r(p);
+     r.read(stream);
+
+ Supported field types: bool, integral and floating point numbers, std::wstring,
+ std::optional and std::vector of supported types, other bound structs.
+ Unknown members are skipped, missing members keep their values.
+ The macro should be used in the global namespace.
+ */
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <limits>
+#include <cmath>
+#include <type_traits>
+#include "jsoncommon.h"
+#include "jsonparser.h"
+#include "jsontools.h"
+#include "../ioutils.h"
+
+namespace stdext
+{
+    namespace json
+    {
+        /*
+         * Description of the bound struct, specialized by STDEXT_JSON_BINDING
+         * static auto fields() returns the tuple of field_descriptor
+         */
+        template <class T>
+        struct binding_traits;
+
+        template <class T, class M>
+        struct field_descriptor
+        {
+            const wchar_t* name;
+            M T::* member;
+        };
+
+        template <class T, class M>
+        constexpr field_descriptor<T, M> make_field(const wchar_t* name, M T::* member)
+        {
+            return field_descriptor<T, M>{ name, member };
+        }
+
+
+        /*
+         * Maps member names to indexes by perfect hash, the hash seed and the table size
+         * are searched once when the names are set so that every name has its own slot
+         */
+        class perfect_hash_index
+        {
+        public:
+            static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+        public:
+            perfect_hash_index() {}
+            // Names should be unique
+            explicit perfect_hash_index(const std::vector<std::wstring>& names) noexcept(false);
+            perfect_hash_index(const perfect_hash_index&) = default;
+            perfect_hash_index& operator =(const perfect_hash_index&) = default;
+            perfect_hash_index(perfect_hash_index&&) = default;
+            perfect_hash_index& operator =(perfect_hash_index&&) = default;
+        public:
+            std::size_t find(const std::wstring& name) const noexcept;
+            std::size_t size() const noexcept { return m_names.size(); }
+            std::size_t table_size() const noexcept { return m_slots.size(); }
+        private:
+            static uint32_t hash(const std::wstring& name, const uint32_t seed) noexcept;
+        private:
+            std::vector<std::wstring> m_names;
+            std::vector<uint32_t> m_slots;  // index + 1, zero for empty slot
+            uint32_t m_seed = 0;
+            uint32_t m_mask = 0;
+        };
+
+
+        enum class bind_result
+        {
+            ok,
+            type_mismatch,
+            out_of_range
+        };
+
+        /*
+         * Type erased operations on the bound values, one instance per type
+         */
+        class binder_base
+        {
+        public:
+            binder_base() {}
+            binder_base(const binder_base&) = delete;
+            binder_base& operator =(const binder_base&) = delete;
+            binder_base(binder_base&&) = delete;
+            binder_base& operator =(binder_base&&) = delete;
+            virtual ~binder_base() {}
+        public:
+            virtual bind_result set_literal(void*, const json::dom_literal_type) const { return bind_result::type_mismatch; }
+            virtual bind_result set_number(void*, const json::dom_number_type, const std::wstring&, const parsers::numeric_value&) const
+            { return bind_result::type_mismatch; }
+            virtual bind_result set_string(void*, const std::wstring&) const { return bind_result::type_mismatch; }
+            // Binder and target of container values, optional values are emplaced here
+            virtual const binder_base* resolve(void*& target) const { (void)target; return this; }
+            virtual bool is_array() const noexcept { return false; }
+            virtual bool is_object() const noexcept { return false; }
+            // Array operations
+            virtual void clear(void*) const {}
+            virtual void* append_element(void*, const binder_base*& element_binder) const { element_binder = nullptr; return nullptr; }
+            // Object operations, binder is null for unknown members
+            virtual void* member(void*, const std::wstring&, const binder_base*& member_binder, const std::wstring*& member_name) const
+            { member_binder = nullptr; member_name = nullptr; return nullptr; }
+            virtual void write(const void* source, json::sax_handler_intf& handler) const = 0;
+        };
+
+        template <class T>
+        const binder_base& binder_of();
+
+        // Text representation of written numbers, doubles are written in the shortest exact form
+        std::wstring to_number_text(const double value);
+
+
+        template <class T, class Enable = void>
+        class value_binder;
+
+        template <>
+        class value_binder<bool> : public binder_base
+        {
+        public:
+            bind_result set_literal(void* target, const json::dom_literal_type type) const override
+            {
+                if (type == json::dom_literal_type::lvt_null)
+                    return bind_result::type_mismatch;
+                *static_cast<bool*>(target) = (type == json::dom_literal_type::lvt_true);
+                return bind_result::ok;
+            }
+            void write(const void* source, json::sax_handler_intf& handler) const override
+            {
+                if (*static_cast<const bool*>(source))
+                    handler.on_literal(json::dom_literal_type::lvt_true, L"true");
+                else
+                    handler.on_literal(json::dom_literal_type::lvt_false, L"false");
+            }
+        };
+
+        template <class T>
+        class value_binder<T, std::enable_if_t<std::is_integral<T>::value && !std::is_same<T, bool>::value>> : public binder_base
+        {
+        public:
+            bind_result set_number(void* target, const json::dom_number_type type, const std::wstring& text,
+                                   const parsers::numeric_value& value) const override
+            {
+                if (type != json::dom_number_type::nvt_int)
+                    return bind_result::type_mismatch;
+                if (!value.is_int())
+                {
+                    // Only unsigned 64-bit values do not fit into int64_t
+                    if (!std::is_unsigned<T>::value || sizeof(T) < sizeof(uint64_t) || text.empty() || text[0] == L'-')
+                        return bind_result::out_of_range;
+                    try
+                    {
+                        std::size_t pos = 0;
+                        const unsigned long long n = std::stoull(text, &pos);
+                        if (pos != text.length())
+                            return bind_result::out_of_range;
+                        *static_cast<T*>(target) = static_cast<T>(n);
+                        return bind_result::ok;
+                    }
+                    catch (const std::out_of_range&)
+                    {
+                        return bind_result::out_of_range;
+                    }
+                }
+                const int64_t n = value.int_value();
+                if (std::is_unsigned<T>::value)
+                {
+                    if (n < 0 || static_cast<uint64_t>(n) > static_cast<uint64_t>(std::numeric_limits<T>::max()))
+                        return bind_result::out_of_range;
+                }
+                else if (n < static_cast<int64_t>(std::numeric_limits<T>::min()) || n > static_cast<int64_t>(std::numeric_limits<T>::max()))
+                    return bind_result::out_of_range;
+                *static_cast<T*>(target) = static_cast<T>(n);
+                return bind_result::ok;
+            }
+            void write(const void* source, json::sax_handler_intf& handler) const override
+            {
+                const T n = *static_cast<const T*>(source);
+                if (std::is_unsigned<T>::value && static_cast<uint64_t>(n) > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+                    handler.on_number(json::dom_number_type::nvt_int, std::to_wstring(n), parsers::numeric_value(static_cast<double>(n)));
+                else
+                    handler.on_number(json::dom_number_type::nvt_int, std::to_wstring(n), parsers::numeric_value(static_cast<int64_t>(n)));
+            }
+        };
+
+        template <class T>
+        class value_binder<T, std::enable_if_t<std::is_floating_point<T>::value>> : public binder_base
+        {
+        public:
+            bind_result set_number(void* target, const json::dom_number_type, const std::wstring&,
+                                   const parsers::numeric_value& value) const override
+            {
+                *static_cast<T*>(target) = static_cast<T>(value.float_value());
+                return bind_result::ok;
+            }
+            void write(const void* source, json::sax_handler_intf& handler) const override
+            {
+                const double d = static_cast<double>(*static_cast<const T*>(source));
+                // JSON has no NaN and infinities
+                if (!std::isfinite(d))
+                    handler.on_literal(json::dom_literal_type::lvt_null, L"null");
+                else
+                    handler.on_number(json::dom_number_type::nvt_float, to_number_text(d), parsers::numeric_value(d));
+            }
+        };
+
+        template <>
+        class value_binder<std::wstring> : public binder_base
+        {
+        public:
+            bind_result set_string(void* target, const std::wstring& text) const override
+            {
+                *static_cast<std::wstring*>(target) = text;
+                return bind_result::ok;
+            }
+            void write(const void* source, json::sax_handler_intf& handler) const override
+            {
+                handler.on_string(*static_cast<const std::wstring*>(source));
+            }
+        };
+
+        // Null resets the value, other values are bound to the emplaced one
+        template <class T>
+        class value_binder<std::optional<T>> : public binder_base
+        {
+        public:
+            bind_result set_literal(void* target, const json::dom_literal_type type) const override
+            {
+                if (type == json::dom_literal_type::lvt_null)
+                {
+                    value(target).reset();
+                    return bind_result::ok;
+                }
+                return binder_of<T>().set_literal(emplace(target), type);
+            }
+            bind_result set_number(void* target, const json::dom_number_type type, const std::wstring& text,
+                                   const parsers::numeric_value& v) const override
+            {
+                return binder_of<T>().set_number(emplace(target), type, text, v);
+            }
+            bind_result set_string(void* target, const std::wstring& text) const override
+            {
+                return binder_of<T>().set_string(emplace(target), text);
+            }
+            const binder_base* resolve(void*& target) const override
+            {
+                target = emplace(target);
+                return binder_of<T>().resolve(target);
+            }
+            void write(const void* source, json::sax_handler_intf& handler) const override
+            {
+                const std::optional<T>& v = *static_cast<const std::optional<T>*>(source);
+                if (v.has_value())
+                    binder_of<T>().write(&v.value(), handler);
+                else
+                    handler.on_literal(json::dom_literal_type::lvt_null, L"null");
+            }
+        private:
+            static std::optional<T>& value(void* target) { return *static_cast<std::optional<T>*>(target); }
+            static void* emplace(void* target)
+            {
+                std::optional<T>& v = value(target);
+                if (!v.has_value())
+                    v.emplace();
+                return &v.value();
+            }
+        };
+
+        template <class T>
+        class value_binder<std::vector<T>> : public binder_base
+        {
+            static_assert(!std::is_same<T, bool>::value, "std::vector<bool> elements can not be bound, use std::vector<char>");
+        public:
+            bool is_array() const noexcept override { return true; }
+            void clear(void* target) const override { static_cast<std::vector<T>*>(target)->clear(); }
+            void* append_element(void* target, const binder_base*& element_binder) const override
+            {
+                std::vector<T>& v = *static_cast<std::vector<T>*>(target);
+                v.emplace_back();
+                element_binder = &binder_of<T>();
+                return &v.back();
+            }
+            void write(const void* source, json::sax_handler_intf& handler) const override
+            {
+                const std::vector<T>& v = *static_cast<const std::vector<T>*>(source);
+                const binder_base& element_binder = binder_of<T>();
+                handler.on_begin_array();
+                for (const T& element : v)
+                    element_binder.write(&element, handler);
+                handler.on_end_array(v.size());
+            }
+        };
+
+        // Bound struct, its fields are described by binding_traits
+        template <class T>
+        class value_binder<T, std::void_t<decltype(binding_traits<T>::fields())>> : public binder_base
+        {
+        public:
+            value_binder()
+            {
+                std::apply([this](const auto&... descriptors) { (add_field(descriptors), ...); }, binding_traits<T>::fields());
+                std::vector<std::wstring> names;
+                for (const auto& field : m_fields)
+                    names.push_back(field->name);
+                m_index = perfect_hash_index(names);
+            }
+        public:
+            bool is_object() const noexcept override { return true; }
+            void* member(void* target, const std::wstring& name, const binder_base*& member_binder, const std::wstring*& member_name) const override
+            {
+                const std::size_t i = m_index.find(name);
+                if (i == perfect_hash_index::npos)
+                {
+                    member_binder = nullptr;
+                    member_name = nullptr;
+                    return nullptr;
+                }
+                const field_base& field = *m_fields[i];
+                member_binder = field.binder;
+                member_name = &field.name;
+                return field.target(target);
+            }
+            void write(const void* source, json::sax_handler_intf& handler) const override
+            {
+                handler.on_begin_object();
+                for (const auto& field : m_fields)
+                {
+                    handler.on_member_name(field->name);
+                    field->binder->write(field->source(source), handler);
+                }
+                handler.on_end_object(m_fields.size());
+            }
+        private:
+            class field_base
+            {
+            public:
+                field_base(const wchar_t* field_name, const binder_base* field_binder)
+                    : name(field_name), binder(field_binder)
+                {}
+                virtual ~field_base() {}
+                virtual void* target(void* object) const = 0;
+                virtual const void* source(const void* object) const = 0;
+            public:
+                const std::wstring name;
+                const binder_base* const binder;
+            };
+
+            template <class M>
+            class field_impl : public field_base
+            {
+            public:
+                field_impl(const field_descriptor<T, M>& descriptor)
+                    : field_base(descriptor.name, &binder_of<M>()), m_member(descriptor.member)
+                {}
+                void* target(void* object) const override { return &(static_cast<T*>(object)->*m_member); }
+                const void* source(const void* object) const override { return &(static_cast<const T*>(object)->*m_member); }
+            private:
+                M T::* m_member;
+            };
+
+            template <class M>
+            void add_field(const field_descriptor<T, M>& descriptor)
+            {
+                m_fields.emplace_back(new field_impl<M>(descriptor));
+            }
+        private:
+            std::vector<std::unique_ptr<field_base>> m_fields;
+            perfect_hash_index m_index;
+        };
+
+        template <class T>
+        const binder_base& binder_of()
+        {
+            static const value_binder<T> instance;
+            return instance;
+        }
+
+
+        /*
+         * SAX handler which sets the bound value, errors are collected and the value
+         * that caused the error is skipped
+         */
+        class binding_handler : public sax_handler_intf
+        {
+        public:
+            binding_handler(const binder_base& binder, void* target, msg_collector_t& msgs, const std::wstring& source_name);
+            binding_handler() = delete;
+            binding_handler(const binding_handler&) = delete;
+            binding_handler& operator =(const binding_handler&) = delete;
+            binding_handler(binding_handler&&) = delete;
+            binding_handler& operator =(binding_handler&&) = delete;
+        public:
+            virtual void on_literal(const json::dom_literal_type type, const std::wstring& text) override;
+            virtual void on_number(const json::dom_number_type type, const std::wstring& text) override;
+            virtual void on_number(const json::dom_number_type type, const std::wstring& text, const parsers::numeric_value& value) override;
+            virtual void on_string(const std::wstring& text) override;
+            virtual void on_begin_object() override;
+            virtual void on_member_name(const std::wstring& text) override;
+            virtual void on_end_object(const std::size_t member_count) override;
+            virtual void on_begin_array() override;
+            virtual void on_end_array(const std::size_t element_count) override;
+            virtual void textpos_changed(const parsers::textpos& pos) override { m_pos = pos; }
+            // Parser whose current position is taken when an error is reported
+            void parser(const json::sax_parser* value) noexcept { m_parser = value; }
+        private:
+            struct frame
+            {
+                const binder_base* binder;  // null when the value is skipped
+                void* target;
+                const std::wstring* name;
+                const binder_base* member_binder;
+                void* member_target;
+                const std::wstring* member_name;
+            };
+            // Binder, target and name of the next value
+            const binder_base* next_value(void*& target, const std::wstring*& name);
+            void begin_container(const bool is_array);
+            void check_result(const bind_result result, const std::wstring* name);
+        private:
+            const binder_base& m_binder;
+            void* m_target;
+            bool m_root_done = false;
+            std::vector<frame> m_frames;
+            msg_collector_t& m_messages;
+            std::wstring m_source_name;
+            const json::sax_parser* m_parser = nullptr;
+            parsers::textpos m_pos;
+        };
+
+
+        template <class T>
+        class typed_reader
+        {
+        public:
+            typed_reader(T& value) : m_value(value) {}
+            typed_reader() = delete;
+            typed_reader(const typed_reader&) = delete;
+            typed_reader& operator=(const typed_reader&) = delete;
+            typed_reader(typed_reader&&) = delete;
+            typed_reader& operator=(typed_reader&&) = delete;
+        public:
+            bool read(ioutils::text_reader& reader)
+            {
+                m_messages.clear();
+                if (!m_source_name.empty() && reader.source_name().empty())
+                    reader.source_name(m_source_name);
+                binding_handler handler(binder_of<T>(), &m_value, m_messages, reader.source_name());
+                json::sax_parser parser(reader, m_messages, handler);
+                handler.parser(&parser);
+                return parser.run() && !m_messages.has_errors();
+            }
+            bool read(std::wistream& stream)
+            {
+                ioutils::text_reader reader(stream);
+                return read(reader);
+            }
+            bool read(std::istream& stream, const ioutils::text_io_policy& policy)
+            {
+                ioutils::text_reader reader(stream, policy);
+                return read(reader);
+            }
+            bool read_file(const std::wstring file_name, const ioutils::text_io_policy& policy)
+            {
+                ioutils::text_reader reader(file_name, policy);
+                return read(reader);
+            }
+        public:
+            const json::msg_collector_t& messages() const noexcept { return m_messages; }
+            std::wstring source_name() const noexcept { return m_source_name; }
+            void source_name(const std::wstring& value) { m_source_name = value; }
+        private:
+            T& m_value;
+            json::msg_collector_t m_messages;
+            std::wstring m_source_name;
+        };
+
+
+        // Sends the bound value as SAX events, so it can be written by sax_writer, cbor_writer or other handler
+        template <class T>
+        class typed_writer
+        {
+        public:
+            typed_writer(const T& value) : m_value(value) {}
+            typed_writer() = delete;
+            typed_writer(const typed_writer&) = delete;
+            typed_writer& operator=(const typed_writer&) = delete;
+            typed_writer(typed_writer&&) = delete;
+            typed_writer& operator=(typed_writer&&) = delete;
+        public:
+            void write(json::sax_handler_intf& handler) { binder_of<T>().write(&m_value, handler); }
+            void write(ioutils::text_writer& w)
+            {
+                json::sax_writer handler(w);
+                write(handler);
+            }
+            void write(std::wostream& stream)
+            {
+                ioutils::text_writer w(stream);
+                write(w);
+            }
+            void write(std::wstring& ws)
+            {
+                std::wstringstream ss;
+                write(ss);
+                ws = ss.str();
+            }
+        private:
+            const T& m_value;
+        };
+
+    }
+}
+
+#define STDEXT_JSON_FIELD(type, field) stdext::json::make_field(L"" #field, &type::field)
+
+#define STDEXT_JSON_BINDING(type, ...) \
+    namespace stdext { namespace json { \
+        template <> struct binding_traits<type> \
+        { \
+            static auto fields() { return std::make_tuple(__VA_ARGS__); } \
+        }; \
+    } }
@@ -0,0 +1,864 @@
+/*
+ C++ standard library extensions
+ (c) 2001-2020 Serguei Tarassov (see license.txt)
+ */
+
+#include "jsoncbor.h"
+#include "jsonexceptions.h"
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <fstream>
+#include "../strutils.h"
+
+using namespace std;
+
+namespace stdext
+{
+namespace json
+{
+
+namespace
+{
+    // Major types
+    const uint8_t cbor_uint = 0;
+    const uint8_t cbor_negative = 1;
+    const uint8_t cbor_bytes = 2;
+    const uint8_t cbor_text = 3;
+    const uint8_t cbor_array = 4;
+    const uint8_t cbor_map = 5;
+    const uint8_t cbor_tag = 6;
+    const uint8_t cbor_simple = 7;
+    // Additional information
+    const uint8_t cbor_info_uint8 = 24;
+    const uint8_t cbor_info_uint16 = 25;
+    const uint8_t cbor_info_uint32 = 26;
+    const uint8_t cbor_info_uint64 = 27;
+    const uint8_t cbor_info_indefinite = 31;
+    // Simple values and floats
+    const uint8_t cbor_false = 20;
+    const uint8_t cbor_true = 21;
+    const uint8_t cbor_null = 22;
+    const uint8_t cbor_undefined = 23;
+    const uint8_t cbor_half = 25;
+    const uint8_t cbor_single = 26;
+    const uint8_t cbor_double = 27;
+    const uint8_t cbor_break = 0xFF;
+
+    const std::size_t cbor_buffer_size = 65536;
+    // The least negative integer, -1 - 0xFFFFFFFFFFFFFFFF
+    const wchar_t* const cbor_min_int_text = L"-18446744073709551616";
+
+    inline char initial_byte(const uint8_t major, const uint8_t info)
+    {
+        return static_cast<char>((major << 5) | info);
+    }
+
+    bool is_ascii(const std::wstring& ws)
+    {
+        for (const wchar_t c : ws)
+        {
+            if (static_cast<uint32_t>(c) >= 0x80u)
+                return false;
+        }
+        return true;
+    }
+
+    double half_to_double(const uint16_t half)
+    {
+        const int exp = (half >> 10) & 0x1F;
+        const int mant = half & 0x3FF;
+        double value;
+        if (exp == 0)
+            value = std::ldexp(mant, -24);
+        else if (exp != 31)
+            value = std::ldexp(mant + 1024, exp - 25);
+        else
+            value = mant == 0 ? numeric_limits<double>::infinity() : numeric_limits<double>::quiet_NaN();
+        return (half & 0x8000) ? -value : value;
+    }
+
+    // Shortest text that reads back to the same value
+    std::wstring float_to_text(const double value)
+    {
+        const std::string s = str::to_shortest_string(value);
+        std::wstring ws(s.begin(), s.end());
+        if (ws.find_first_of(L".eE") == ws.npos)
+            ws += L".0";
+        return ws;
+    }
+}
+
+
+/*
+ * cbor_encoder class
+ */
+void cbor_encoder::write_head(const uint8_t major, const uint64_t value)
+{
+    char head[9];
+    std::size_t n;
+    if (value < cbor_info_uint8)
+    {
+        m_buffer += initial_byte(major, static_cast<uint8_t>(value));
+        return;
+    }
+    else if (value <= 0xFFu)
+    {
+        head[0] = initial_byte(major, cbor_info_uint8);
+        n = 1;
+    }
+    else if (value <= 0xFFFFu)
+    {
+        head[0] = initial_byte(major, cbor_info_uint16);
+        n = 2;
+    }
+    else if (value <= 0xFFFFFFFFu)
+    {
+        head[0] = initial_byte(major, cbor_info_uint32);
+        n = 4;
+    }
+    else
+    {
+        head[0] = initial_byte(major, cbor_info_uint64);
+        n = 8;
+    }
+    for (std::size_t i = 0; i < n; i++)
+        head[n - i] = static_cast<char>((value >> (i * 8)) & 0xFFu);
+    m_buffer.append(head, n + 1);
+}
+
+void cbor_encoder::write_literal(const dom_literal_type type)
+{
+    switch (type)
+    {
+    case dom_literal_type::lvt_false:
+        m_buffer += initial_byte(cbor_simple, cbor_false);
+        break;
+    case dom_literal_type::lvt_true:
+        m_buffer += initial_byte(cbor_simple, cbor_true);
+        break;
+    case dom_literal_type::lvt_null:
+        m_buffer += initial_byte(cbor_simple, cbor_null);
+        break;
+    }
+}
+
+void cbor_encoder::write_int(const int64_t value)
+{
+    if (value >= 0)
+        write_head(cbor_uint, static_cast<uint64_t>(value));
+    else
+        write_head(cbor_negative, static_cast<uint64_t>(-(value + 1)));
+}
+
+void cbor_encoder::write_float(const double value)
+{
+    const float single = static_cast<float>(value);
+    if (static_cast<double>(single) == value || std::isnan(value))
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &single, sizeof(bits));
+        m_buffer += initial_byte(cbor_simple, cbor_single);
+        for (int i = 3; i >= 0; i--)
+            m_buffer += static_cast<char>((bits >> (i * 8)) & 0xFFu);
+    }
+    else
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        m_buffer += initial_byte(cbor_simple, cbor_double);
+        for (int i = 7; i >= 0; i--)
+            m_buffer += static_cast<char>((bits >> (i * 8)) & 0xFFu);
+    }
+}
+
+bool cbor_encoder::write_big_int(const std::wstring& text)
+{
+    // Integers out of int64_t range keep the exact value if they fit into 64 bits of CBOR argument
+    if (text == cbor_min_int_text)
+    {
+        write_head(cbor_negative, numeric_limits<uint64_t>::max());
+        return true;
+    }
+    std::size_t i = 0;
+    const bool negative = !text.empty() && text[0] == L'-';
+    if (negative)
+        i++;
+    if (i == text.length())
+        return false;
+    uint64_t value = 0;
+    for (; i < text.length(); i++)
+    {
+        if (text[i] < L'0' || text[i] > L'9')
+            return false;
+        const uint64_t digit = static_cast<uint64_t>(text[i] - L'0');
+        if (value > (numeric_limits<uint64_t>::max() - digit) / 10)
+            return false;
+        value = value * 10 + digit;
+    }
+    if (negative)
+    {
+        if (value == 0)
+            return false;
+        write_head(cbor_negative, value - 1);
+    }
+    else
+        write_head(cbor_uint, value);
+    return true;
+}
+
+void cbor_encoder::write_number(const dom_number_type type, const std::wstring& text, const parsers::numeric_value& value)
+{
+    if (type == dom_number_type::nvt_int)
+    {
+        if (value.is_int())
+        {
+            write_int(value.int_value());
+            return;
+        }
+        if (write_big_int(text))
+            return;
+    }
+    write_float(value.float_value());
+}
+
+void cbor_encoder::write_string(const std::wstring& ws)
+{
+    if (is_ascii(ws))
+    {
+        write_head(cbor_text, ws.length());
+        const std::size_t pos = m_buffer.size();
+        m_buffer.resize(pos + ws.length());
+        char* p = &m_buffer[pos];
+        for (const wchar_t c : ws)
+            *p++ = static_cast<char>(c);
+        return;
+    }
+    m_cvt.to_utf8(ws, m_utf8);
+    write_head(cbor_text, m_utf8.length());
+    m_buffer += m_utf8;
+}
+
+void cbor_encoder::write_array_head(const std::size_t size)
+{
+    write_head(cbor_array, size);
+}
+
+void cbor_encoder::write_map_head(const std::size_t size)
+{
+    write_head(cbor_map, size);
+}
+
+std::size_t cbor_encoder::begin_container(const uint8_t major)
+{
+    const std::size_t pos = m_buffer.size();
+    m_buffer += initial_byte(major, cbor_info_uint32);
+    m_buffer.append(4, '\0');
+    return pos;
+}
+
+std::size_t cbor_encoder::begin_array()
+{
+    return begin_container(cbor_array);
+}
+
+std::size_t cbor_encoder::begin_map()
+{
+    return begin_container(cbor_map);
+}
+
+void cbor_encoder::end_container(const std::size_t head_pos, const std::size_t size) noexcept(false)
+{
+    if (static_cast<uint64_t>(size) > 0xFFFFFFFFu)
+        throw json::exception(L"CBOR container size exceeds 32-bit limit");
+    for (std::size_t i = 0; i < 4; i++)
+        m_buffer[head_pos + 4 - i] = static_cast<char>((size >> (i * 8)) & 0xFFu);
+}
+
+void cbor_encoder::flush(std::ostream& stream)
+{
+    stream.write(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+    m_buffer.clear();
+}
+
+
+/*
+ * cbor_writer class
+ */
+cbor_writer::cbor_writer(std::ostream& stream)
+    : m_stream(stream)
+{ }
+
+void cbor_writer::end_value()
+{
+    if (m_heads.empty())
+        m_encoder.flush(m_stream);
+}
+
+void cbor_writer::on_literal(const dom_literal_type type, const std::wstring&)
+{
+    m_encoder.write_literal(type);
+    end_value();
+}
+
+void cbor_writer::on_number(const dom_number_type type, const std::wstring& text)
+{
+    m_encoder.write_number(type, text, parsers::numeric_parser(text).binary_value());
+    end_value();
+}
+
+void cbor_writer::on_number(const dom_number_type type, const std::wstring& text, const parsers::numeric_value& value)
+{
+    m_encoder.write_number(type, text, value);
+    end_value();
+}
+
+void cbor_writer::on_string(const std::wstring& text)
+{
+    m_encoder.write_string(text);
+    end_value();
+}
+
+void cbor_writer::on_begin_object()
+{
+    m_heads.push_back(m_encoder.begin_map());
+}
+
+void cbor_writer::on_member_name(const std::wstring& text)
+{
+    m_encoder.write_string(text);
+}
+
+void cbor_writer::on_end_object(const std::size_t member_count)
+{
+    m_encoder.end_container(m_heads.back(), member_count);
+    m_heads.pop_back();
+    end_value();
+}
+
+void cbor_writer::on_begin_array()
+{
+    m_heads.push_back(m_encoder.begin_array());
+}
+
+void cbor_writer::on_end_array(const std::size_t element_count)
+{
+    m_encoder.end_container(m_heads.back(), element_count);
+    m_heads.pop_back();
+    end_value();
+}
+
+
+/*
+ * cbor_reader class
+ */
+cbor_reader::cbor_reader(std::istream& stream, msg_collector_t& msgs, sax_handler_intf& handler)
+    : m_stream(&stream), m_messages(msgs), m_handler(handler)
+{
+    m_buffer.resize(cbor_buffer_size);
+    m_begin = m_curr = m_end = m_buffer.data();
+}
+
+cbor_reader::cbor_reader(const char* data, const std::size_t size, msg_collector_t& msgs, sax_handler_intf& handler)
+    : m_messages(msgs), m_handler(handler)
+{
+    m_begin = m_curr = data;
+    m_end = data + size;
+}
+
+bool cbor_reader::add_error(const parser_msg_kind kind)
+{
+    return add_error(kind, parsers::msg_args());
+}
+
+bool cbor_reader::add_error(const parser_msg_kind kind, parsers::msg_args&& args)
+{
+    if (!m_messages.accepts())
+    {
+        m_messages.drop();
+        return false;
+    }
+    m_messages.add_error(
+        parsers::msg_origin::parser,
+        kind,
+        pos(),
+        m_source_name,
+        &to_wmessage,
+        std::move(args));
+    return false;
+}
+
+parsers::textpos cbor_reader::pos() const
+{
+    return parsers::textpos(1, static_cast<parsers::textpos::pos_t>(m_offset + (m_curr - m_begin)));
+}
+
+bool cbor_reader::fill()
+{
+    if (m_stream == nullptr || !m_stream->good())
+        return false;
+    m_offset += m_curr - m_begin;
+    const std::size_t rest = m_end - m_curr;
+    char* data = m_buffer.data();
+    std::memmove(data, m_curr, rest);
+    m_stream->read(data + rest, static_cast<std::streamsize>(m_buffer.size() - rest));
+    m_begin = m_curr = data;
+    m_end = data + rest + m_stream->gcount();
+    return m_stream->gcount() > 0;
+}
+
+bool cbor_reader::read_byte(uint8_t& value)
+{
+    if (m_curr == m_end && !fill())
+        return false;
+    value = static_cast<uint8_t>(*m_curr++);
+    return true;
+}
+
+bool cbor_reader::peek_byte(uint8_t& value)
+{
+    if (m_curr == m_end && !fill())
+        return false;
+    value = static_cast<uint8_t>(*m_curr);
+    return true;
+}
+
+bool cbor_reader::read_uint(const std::size_t n, uint64_t& value)
+{
+    if (static_cast<std::size_t>(m_end - m_curr) < n)
+        fill();
+    if (static_cast<std::size_t>(m_end - m_curr) < n)
+        return add_error(parser_msg_kind::err_unexpected_text_end);
+    value = 0;
+    for (std::size_t i = 0; i < n; i++)
+        value = (value << 8) | static_cast<uint8_t>(*m_curr++);
+    return true;
+}
+
+bool cbor_reader::read_argument(const uint8_t info, uint64_t& value)
+{
+    if (info < cbor_info_uint8)
+    {
+        value = info;
+        return true;
+    }
+    switch (info)
+    {
+    case cbor_info_uint8: return read_uint(1, value);
+    case cbor_info_uint16: return read_uint(2, value);
+    case cbor_info_uint32: return read_uint(4, value);
+    case cbor_info_uint64: return read_uint(8, value);
+    default:
+        return add_error(parser_msg_kind::err_invalid_cbor_item_fmt, { static_cast<int64_t>(info) });
+    }
+}
+
+bool cbor_reader::read_break(bool& found)
+{
+    uint8_t b;
+    if (!peek_byte(b))
+        return add_error(parser_msg_kind::err_unexpected_text_end);
+    found = b == cbor_break;
+    if (found)
+        m_curr++;
+    return true;
+}
+
+bool cbor_reader::run()
+{
+    uint8_t b;
+    if (!peek_byte(b))
+        return !has_errors();
+    bool result = read_item();
+    if (result && peek_byte(b))
+    {
+        add_error(parser_msg_kind::err_unexpected_lexeme_fmt, { str::wformat(L"0x%02x", b) });
+        result = false;
+    }
+    return result && !has_errors();
+}
+
+void cbor_reader::send_number(const int64_t value)
+{
+    m_handler.on_number(dom_number_type::nvt_int, std::to_wstring(value), parsers::numeric_value(value));
+}
+
+void cbor_reader::send_number(const double value)
+{
+    if (std::isfinite(value))
+        m_handler.on_number(dom_number_type::nvt_float, float_to_text(value), parsers::numeric_value(value));
+    else
+        m_handler.on_literal(dom_literal_type::lvt_null, L"null");
+}
+
+bool cbor_reader::read_item()
+{
+    uint8_t b;
+    if (!read_byte(b))
+        return add_error(parser_msg_kind::err_unexpected_text_end);
+    m_handler.textpos_changed(pos());
+    const uint8_t major = b >> 5;
+    const uint8_t info = b & 0x1Fu;
+    uint64_t value = 0;
+    switch (major)
+    {
+    case cbor_uint:
+        if (!read_argument(info, value))
+            return false;
+        if (value <= static_cast<uint64_t>(numeric_limits<int64_t>::max()))
+            send_number(static_cast<int64_t>(value));
+        else
+            m_handler.on_number(dom_number_type::nvt_int, std::to_wstring(value),
+                                parsers::numeric_value(static_cast<double>(value)));
+        return true;
+    case cbor_negative:
+        if (!read_argument(info, value))
+            return false;
+        if (value <= static_cast<uint64_t>(numeric_limits<int64_t>::max()))
+            send_number(-1 - static_cast<int64_t>(value));
+        else
+        {
+            // -1 - value does not fit into int64_t, the text is built from the magnitude
+            const std::wstring text = value == numeric_limits<uint64_t>::max()
+                    ? std::wstring(cbor_min_int_text)
+                    : L"-" + std::to_wstring(value + 1);
+            m_handler.on_number(dom_number_type::nvt_int, text,
+                                parsers::numeric_value(-1.0 - static_cast<double>(value)));
+        }
+        return true;
+    case cbor_text:
+        if (!read_text(info, m_text))
+            return false;
+        m_handler.on_string(m_text);
+        return true;
+    case cbor_array:
+        return read_array(info);
+    case cbor_map:
+        return read_map(info);
+    case cbor_tag:
+        return read_argument(info, value) && read_item();
+    case cbor_simple:
+        return read_simple(info);
+    case cbor_bytes:
+    default:
+        m_curr--;
+        return add_error(parser_msg_kind::err_invalid_cbor_item_fmt, { static_cast<int64_t>(b) });
+    }
+}
+
+bool cbor_reader::read_simple(const uint8_t info)
+{
+    uint64_t value = 0;
+    switch (info)
+    {
+    case cbor_false:
+        m_handler.on_literal(dom_literal_type::lvt_false, L"false");
+        return true;
+    case cbor_true:
+        m_handler.on_literal(dom_literal_type::lvt_true, L"true");
+        return true;
+    case cbor_null:
+    case cbor_undefined:
+        m_handler.on_literal(dom_literal_type::lvt_null, L"null");
+        return true;
+    case cbor_half:
+        if (!read_uint(2, value))
+            return false;
+        send_number(half_to_double(static_cast<uint16_t>(value)));
+        return true;
+    case cbor_single:
+    {
+        if (!read_uint(4, value))
+            return false;
+        const uint32_t bits = static_cast<uint32_t>(value);
+        float f;
+        std::memcpy(&f, &bits, sizeof(f));
+        send_number(static_cast<double>(f));
+        return true;
+    }
+    case cbor_double:
+    {
+        if (!read_uint(8, value))
+            return false;
+        double d;
+        std::memcpy(&d, &value, sizeof(d));
+        send_number(d);
+        return true;
+    }
+    default:
+        m_curr--;
+        return add_error(parser_msg_kind::err_invalid_cbor_item_fmt, { static_cast<int64_t>(initial_byte(cbor_simple, info) & 0xFF) });
+    }
+}
+
+bool cbor_reader::read_text_chunk(const uint64_t length)
+{
+    // Appends to m_utf8 while the data is available, so broken lengths do not allocate memory in advance
+    uint64_t rest = length;
+    while (rest > 0)
+    {
+        if (m_curr == m_end && !fill())
+            return add_error(parser_msg_kind::err_unexpected_text_end);
+        const std::size_t n = static_cast<std::size_t>(std::min<uint64_t>(rest, static_cast<uint64_t>(m_end - m_curr)));
+        m_utf8.append(m_curr, n);
+        m_curr += n;
+        rest -= n;
+    }
+    return true;
+}
+
+bool cbor_reader::read_text(const uint8_t info, std::wstring& ws)
+{
+    m_utf8.clear();
+    if (info == cbor_info_indefinite)
+    {
+        bool found = false;
+        while (read_break(found) && !found)
+        {
+            uint8_t b;
+            read_byte(b);
+            uint64_t length = 0;
+            if ((b >> 5) != cbor_text || (b & 0x1Fu) == cbor_info_indefinite)
+            {
+                m_curr--;
+                return add_error(parser_msg_kind::err_invalid_cbor_item_fmt, { static_cast<int64_t>(b) });
+            }
+            if (!read_argument(b & 0x1Fu, length) || !read_text_chunk(length))
+                return false;
+        }
+        if (!found)
+            return false;
+    }
+    else
+    {
+        uint64_t length = 0;
+        if (!read_argument(info, length) || !read_text_chunk(length))
+            return false;
+    }
+    bool ascii = true;
+    for (const char c : m_utf8)
+    {
+        if (static_cast<unsigned char>(c) >= 0x80u)
+        {
+            ascii = false;
+            break;
+        }
+    }
+    if (ascii)
+    {
+        ws.assign(m_utf8.begin(), m_utf8.end());
+        return true;
+    }
+    if (m_cvt.to_utf16(m_utf8, ws) != std::codecvt_base::ok)
+        return add_error(parser_msg_kind::err_invalid_utf8_string);
+    return true;
+}
+
+bool cbor_reader::read_array(const uint8_t info)
+{
+    m_handler.on_begin_array();
+    std::size_t element_count = 0;
+    if (info == cbor_info_indefinite)
+    {
+        bool found = false;
+        while (read_break(found) && !found)
+        {
+            if (!read_item())
+                return false;
+            element_count++;
+        }
+        if (!found)
+            return false;
+    }
+    else
+    {
+        uint64_t size = 0;
+        if (!read_argument(info, size))
+            return false;
+        for (; element_count < size; element_count++)
+        {
+            if (!read_item())
+                return false;
+        }
+    }
+    m_handler.on_end_array(element_count);
+    return true;
+}
+
+bool cbor_reader::read_map(const uint8_t info)
+{
+    m_handler.on_begin_object();
+    const bool indefinite = info == cbor_info_indefinite;
+    uint64_t size = 0;
+    if (!indefinite && !read_argument(info, size))
+        return false;
+    std::size_t member_count = 0;
+    while (indefinite || member_count < size)
+    {
+        if (indefinite)
+        {
+            bool found = false;
+            if (!read_break(found))
+                return false;
+            if (found)
+                break;
+        }
+        uint8_t b;
+        if (!read_byte(b))
+            return add_error(parser_msg_kind::err_unexpected_text_end);
+        if ((b >> 5) != cbor_text)
+        {
+            m_curr--;
+            return add_error(parser_msg_kind::err_expected_member_name);
+        }
+        if (!read_text(b & 0x1Fu, m_text))
+            return false;
+        m_handler.on_member_name(m_text);
+        if (!read_item())
+            return false;
+        member_count++;
+    }
+    m_handler.on_end_object(member_count);
+    return true;
+}
+
+
+/*
+ * cbor_document_reader class
+ */
+cbor_document_reader::cbor_document_reader(json::dom_document& doc)
+    : m_doc(doc)
+{ }
+
+bool cbor_document_reader::read(std::istream& stream)
+{
+    m_messages.clear();
+    m_doc.clear();
+    dom_handler handler(m_doc, m_messages, m_source_name);
+    cbor_reader reader(stream, m_messages, handler);
+    reader.source_name(m_source_name);
+    return reader.run();
+}
+
+bool cbor_document_reader::read(const std::string& bytes)
+{
+    m_messages.clear();
+    m_doc.clear();
+    dom_handler handler(m_doc, m_messages, m_source_name);
+    cbor_reader reader(bytes.data(), bytes.size(), m_messages, handler);
+    reader.source_name(m_source_name);
+    return reader.run();
+}
+
+bool cbor_document_reader::read_file(const std::wstring file_name)
+{
+#if defined(__STDEXT_WINDOWS)
+    ifstream stream(file_name, ios::binary);
+#else
+    ifstream stream(locutils::utf16::to_utf8string(file_name), ios::binary);
+#endif
+    if (m_source_name.empty())
+        m_source_name = file_name;
+    if (!stream.is_open())
+    {
+        m_messages.clear();
+        m_doc.clear();
+        m_messages.add_error(parsers::msg_origin::parser,
+                             parser_msg_kind::err_reader_io,
+                             parsers::textpos(),
+                             m_source_name,
+                             to_wmessage(parser_msg_kind::err_reader_io));
+        return false;
+    }
+    return read(stream);
+}
+
+
+/*
+ * cbor_document_writer class
+ */
+namespace
+{
+    class cbor_writer_visitor : public dom_value_visitor
+    {
+    public:
+        cbor_writer_visitor(cbor_encoder& encoder, std::ostream* stream)
+            : dom_value_visitor(), m_encoder(encoder), m_stream(stream)
+        {}
+    public:
+        void visit(json::dom_literal& value) override { m_encoder.write_literal(value.literal_type()); }
+        void visit(json::dom_number& value) override
+        {
+            m_encoder.write_number(value.numtype(), value.text(), value.value());
+        }
+        void visit(json::dom_string& value) override { m_encoder.write_string(value.text()); }
+        void visit(json::dom_array& value) override
+        {
+            m_encoder.write_array_head(value.size());
+            // Const reading does not copy the shared elements of a clone
+            const dom_array& array = value;
+            for (dom_value* element : array)
+            {
+                element->accept(*this);
+                flush_if_full();
+            }
+        }
+        void visit(json::dom_object& value) override
+        {
+            m_encoder.write_map_head(value.size());
+            for (const dom_object_member* member : *value.cmembers())
+            {
+                m_encoder.write_string(member->name());
+                member->value()->accept(*this);
+                flush_if_full();
+            }
+        }
+    private:
+        void flush_if_full()
+        {
+            if (m_stream != nullptr && m_encoder.size() >= cbor_buffer_size)
+                m_encoder.flush(*m_stream);
+        }
+    private:
+        cbor_encoder& m_encoder;
+        std::ostream* m_stream;
+    };
+}
+
+cbor_document_writer::cbor_document_writer(json::dom_document& doc)
+    : m_doc(doc)
+{ }
+
+void cbor_document_writer::write(std::ostream& stream)
+{
+    if (m_doc.root() == nullptr)
+        return;
+    cbor_encoder encoder;
+    cbor_writer_visitor visitor(encoder, &stream);
+    m_doc.root()->accept(visitor);
+    encoder.flush(stream);
+}
+
+void cbor_document_writer::write(std::string& bytes)
+{
+    bytes.clear();
+    if (m_doc.root() == nullptr)
+        return;
+    cbor_encoder encoder;
+    cbor_writer_visitor visitor(encoder, nullptr);
+    m_doc.root()->accept(visitor);
+    bytes = encoder.buffer();
+}
+
+void cbor_document_writer::write_to_file(const std::wstring file_name)
+{
+#if defined(__STDEXT_WINDOWS)
+    ofstream stream(file_name, ios::binary | ios::trunc);
+#else
+    ofstream stream(locutils::utf16::to_utf8string(file_name), ios::binary | ios::trunc);
+#endif
+    write(stream);
+}
+
+}
+}
@@ -0,0 +1,196 @@
+/*
+ C++ standard library extensions
+ (c) 2001-2020 Serguei Tarassov (see license.txt)
+
+ JSON (JavaScript Object Notation) tools
+ Binary representation in CBOR format
+ Based on RFC 8949 (https://tools.ietf.org/html/rfc8949)
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include "jsoncommon.h"
+#include "jsondom.h"
+#include "jsonparser.h"
+#include "../locutils.h"
+
+namespace stdext
+{
+    namespace json
+    {
+
+        /*
+         * Low level CBOR encoder, items are accumulated in the buffer until flush
+         * Integers are written with the shortest heads, floats as single precision when exact
+         */
+        class cbor_encoder
+        {
+        public:
+            cbor_encoder() {}
+            cbor_encoder(const cbor_encoder&) = delete;
+            cbor_encoder& operator=(const cbor_encoder&) = delete;
+            cbor_encoder(cbor_encoder&&) = delete;
+            cbor_encoder& operator=(cbor_encoder&&) = delete;
+        public:
+            void write_literal(const json::dom_literal_type type);
+            void write_int(const int64_t value);
+            void write_float(const double value);
+            void write_number(const json::dom_number_type type, const std::wstring& text, const parsers::numeric_value& value);
+            void write_string(const std::wstring& ws);
+            void write_array_head(const std::size_t size);
+            void write_map_head(const std::size_t size);
+            // Fixed size container heads are used when the size is known at the end only
+            std::size_t begin_array();
+            std::size_t begin_map();
+            void end_container(const std::size_t head_pos, const std::size_t size) noexcept(false);
+        public:
+            const std::string& buffer() const noexcept { return m_buffer; }
+            std::size_t size() const noexcept { return m_buffer.size(); }
+            void clear() noexcept { m_buffer.clear(); }
+            void flush(std::ostream& stream);
+        private:
+            void write_head(const uint8_t major, const uint64_t value);
+            std::size_t begin_container(const uint8_t major);
+            bool write_big_int(const std::wstring& text);
+        private:
+            std::string m_buffer;
+            std::string m_utf8;
+            locutils::codecvt_utf8_wchar_t m_cvt;
+        };
+
+
+        /*
+         * Writes SAX events in CBOR format
+         * The output of the top level value is buffered until it ends because of container sizes
+         */
+        class cbor_writer : public sax_handler_intf
+        {
+        public:
+            cbor_writer(std::ostream& stream);
+            cbor_writer() = delete;
+            cbor_writer(const cbor_writer&) = delete;
+            cbor_writer& operator=(const cbor_writer&) = delete;
+            cbor_writer(cbor_writer&&) = delete;
+            cbor_writer& operator=(cbor_writer&&) = delete;
+        public:
+            virtual void on_literal(const json::dom_literal_type type, const std::wstring& text) override;
+            virtual void on_number(const json::dom_number_type type, const std::wstring& text) override;
+            virtual void on_number(const json::dom_number_type type, const std::wstring& text, const parsers::numeric_value& value) override;
+            virtual void on_string(const std::wstring& text) override;
+            virtual void on_begin_object() override;
+            virtual void on_member_name(const std::wstring& text) override;
+            virtual void on_end_object(const std::size_t member_count) override;
+            virtual void on_begin_array() override;
+            virtual void on_end_array(const std::size_t element_count) override;
+            virtual void textpos_changed(const parsers::textpos&) override {}
+        private:
+            void end_value();
+        private:
+            std::ostream& m_stream;
+            cbor_encoder m_encoder;
+            std::vector<std::size_t> m_heads;
+        };
+
+
+        /*
+         * Reads single CBOR item and sends its content to SAX handler
+         * Accepts definite and indefinite length strings and containers, map keys must be text strings.
+         * Byte strings and unknown simple values are errors, tags are ignored,
+         * NaN and infinities are reported as null literals.
+         * Message positions contain byte offset in column
+         */
+        class cbor_reader
+        {
+        public:
+            cbor_reader() = delete;
+            cbor_reader(std::istream& stream, msg_collector_t& msgs, json::sax_handler_intf& handler);
+            cbor_reader(const char* data, const std::size_t size, msg_collector_t& msgs, json::sax_handler_intf& handler);
+            cbor_reader(const cbor_reader&) = delete;
+            cbor_reader& operator =(const cbor_reader&) = delete;
+            cbor_reader(cbor_reader&&) = delete;
+            cbor_reader& operator =(cbor_reader&&) = delete;
+        public:
+            bool run();
+            bool has_errors() const { return m_messages.has_errors(); }
+            const msg_collector_t& messages() const { return m_messages; }
+            std::wstring source_name() const noexcept { return m_source_name; }
+            void source_name(const std::wstring& value) { m_source_name = value; }
+        private:
+            bool add_error(const parser_msg_kind kind);
+            bool add_error(const parser_msg_kind kind, parsers::msg_args&& args);
+            parsers::textpos pos() const;
+            bool fill();
+            bool read_byte(uint8_t& value);
+            bool peek_byte(uint8_t& value);
+            bool read_uint(const std::size_t n, uint64_t& value);
+            bool read_argument(const uint8_t info, uint64_t& value);
+            bool read_break(bool& found);
+            bool read_item();
+            bool read_simple(const uint8_t info);
+            bool read_text(const uint8_t info, std::wstring& ws);
+            bool read_text_chunk(const uint64_t length);
+            bool read_array(const uint8_t info);
+            bool read_map(const uint8_t info);
+            void send_number(const int64_t value);
+            void send_number(const double value);
+        private:
+            std::istream* m_stream = nullptr;
+            std::vector<char> m_buffer;
+            const char* m_curr = nullptr;
+            const char* m_end = nullptr;
+            std::size_t m_offset = 0;       // stream offset of m_buffer start
+            const char* m_begin = nullptr;
+            std::string m_utf8;
+            std::wstring m_text;
+            locutils::codecvt_utf8_wchar_t m_cvt;
+            msg_collector_t& m_messages;
+            json::sax_handler_intf& m_handler;
+            std::wstring m_source_name;
+        };
+
+
+        class cbor_document_reader
+        {
+        public:
+            cbor_document_reader(json::dom_document& doc);
+            cbor_document_reader() = delete;
+            cbor_document_reader(const cbor_document_reader&) = delete;
+            cbor_document_reader& operator=(const cbor_document_reader&) = delete;
+            cbor_document_reader(cbor_document_reader&&) = delete;
+            cbor_document_reader& operator=(cbor_document_reader&&) = delete;
+        public:
+            bool read(std::istream& stream);
+            bool read(const std::string& bytes);
+            bool read_file(const std::wstring file_name);
+        public:
+            const json::msg_collector_t& messages() const noexcept { return m_messages; }
+            std::wstring source_name() const noexcept { return m_source_name; }
+            void source_name(const std::wstring& value) { m_source_name = value; }
+        private:
+            json::dom_document& m_doc;
+            json::msg_collector_t m_messages;
+            std::wstring m_source_name;
+        };
+
+
+        class cbor_document_writer
+        {
+        public:
+            cbor_document_writer(json::dom_document& doc);
+            cbor_document_writer() = delete;
+            cbor_document_writer(const cbor_document_writer&) = delete;
+            cbor_document_writer& operator=(const cbor_document_writer&) = delete;
+            cbor_document_writer(cbor_document_writer&&) = delete;
+            cbor_document_writer& operator=(cbor_document_writer&&) = delete;
+        public:
+            void write(std::ostream& stream);
+            void write(std::string& bytes);
+            void write_to_file(const std::wstring file_name);
+        private:
+            json::dom_document& m_doc;
+        };
+
+    }
+}
@@ -25,66 +25,180 @@ bool is_unescaped(const wchar_t c)
         );
 }
 
-std::wstring to_escaped(const wchar_t c, const bool force_to_numeric)
+namespace
 {
-    if (force_to_numeric || !is_unescaped(c))
+    /*
+     * Lookup table of ASCII characters to escape.
+     * Value is the character of short escape sequence ('n' for "\n"), 'u' for "\uXXXX" form or 0 if no escaping required
+     */
+    class escape_table
     {
-        switch (c)
+    public:
+        escape_table()
+        {
+            for (uint32_t c = 0; c < size; c++)
+                m_data[c] = is_unescaped(static_cast<wchar_t>(c)) ? 0 : 'u';
+            m_data[L'\"'] = '"';
+            m_data[L'\\'] = '\\';
+            m_data[L'\b'] = 'b';
+            m_data[L'\f'] = 'f';
+            m_data[L'\n'] = 'n';
+            m_data[L'\r'] = 'r';
+            m_data[L'\t'] = 't';
+        }
+    public:
+        static constexpr uint32_t size = 0x80;
+        static constexpr uint32_t first_noncharacter = 0xFDD0u;
+        inline char operator [](const uint32_t c) const { return m_data[c]; }
+        inline bool requires_escaping(const wchar_t c) const
+        {
+            const uint32_t code = static_cast<uint32_t>(c);
+            if (code < size)
+                return m_data[code] != 0;
+            return code >= first_noncharacter && !is_unescaped(c);
+        }
+    private:
+        char m_data[size];
+    };
+
+    const escape_table g_escape_table;
+
+    const wchar_t* g_hex_digits = L"0123456789ABCDEF";
+
+    inline void append_escaped_char(std::wstring& dest, const wchar_t c)
+    {
+        const uint32_t code = static_cast<uint32_t>(c);
+        const char seq = code < escape_table::size ? g_escape_table[code] : 'u';
+        if (seq != 0 && seq != 'u')
+        {
+            const wchar_t short_seq[2] = { L'\\', static_cast<wchar_t>(seq) };
+            dest.append(short_seq, 2);
+        }
+        else if (code > 0xFFFFu)
+            dest += str::wformat(L"\\u%04X", code);
+        else
         {
-        case L'\"': return L"\\\"";
-        case L'\\': return L"\\\\";
-        case L'\b': return L"\\b";
-        case L'\f': return L"\\f";
-        case L'\n': return L"\\n";
-        case L'\r': return L"\\r";
-        case L'\t': return L"\\t";
-        default:
-            return str::wformat(L"\\u%04X", (unsigned int)c);
+            const wchar_t numeric[6] = {
+                L'\\',
+                L'u',
+                g_hex_digits[(code >> 12) & 0xF],
+                g_hex_digits[(code >> 8) & 0xF],
+                g_hex_digits[(code >> 4) & 0xF],
+                g_hex_digits[code & 0xF] };
+            dest.append(numeric, 6);
         }
     }
+
+    inline int hex_digit_value(const wchar_t c)
+    {
+        if (c >= L'0' && c <= L'9')
+            return c - L'0';
+        if (c >= L'A' && c <= L'F')
+            return c - L'A' + 10;
+        if (c >= L'a' && c <= L'f')
+            return c - L'a' + 10;
+        return -1;
+    }
+}
+
+std::wstring to_escaped(const wchar_t c, const bool force_to_numeric)
+{
+    if (force_to_numeric || g_escape_table.requires_escaping(c))
+    {
+        wstring ws;
+        append_escaped_char(ws, c);
+        return ws;
+    }
     return wstring{c};
 }
 
 std::wstring to_escaped(const std::wstring ws, const bool force_to_numeric)
 {
     wstring ws2;
-    ws2.reserve(ws.length() * (force_to_numeric ? 6 : 2));
-    for (const wchar_t c : ws)
+    append_escaped(ws2, ws, force_to_numeric);
+    return ws2;
+}
+
+void append_escaped(std::wstring& dest, const wchar_t c, const bool force_to_numeric)
+{
+    if (force_to_numeric || g_escape_table.requires_escaping(c))
+        append_escaped_char(dest, c);
+    else
+        dest += c;
+}
+
+void append_escaped(std::wstring& dest, const std::wstring_view ws, const bool force_to_numeric)
+{
+    if (force_to_numeric)
     {
-        if (force_to_numeric || !is_unescaped(c))
-            ws2 += to_escaped(c, force_to_numeric);
-        else
-            ws2 += c;
+        dest.reserve(dest.length() + ws.length() * 6);
+        for (const wchar_t c : ws)
+            append_escaped_char(dest, c);
+        return;
     }
-    return ws2;
+    const wchar_t* const data = ws.data();
+    const size_t length = ws.length();
+    size_t run_start = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (g_escape_table.requires_escaping(data[i]))
+        {
+            dest.append(data + run_start, i - run_start);
+            append_escaped_char(dest, data[i]);
+            run_start = i + 1;
+        }
+    }
+    dest.append(data + run_start, length - run_start);
+}
+
+std::size_t find_escaping_required(const std::wstring& ws, const std::size_t pos)
+{
+    for (size_t i = pos; i < ws.length(); i++)
+    {
+        if (g_escape_table.requires_escaping(ws[i]))
+            return i;
+    }
+    return std::wstring::npos;
 }
 
 std::wstring to_unescaped(const std::wstring ws)
 {
-    std::locale loc;
+    if (ws.find(L'\\') == wstring::npos)
+        return ws;
     wstring ws2;
-    ws2.reserve(ws.length());
-    for (size_t i = 0; i < ws.length(); i++)
+    append_unescaped(ws2, ws);
+    return ws2;
+}
+
+void append_unescaped(std::wstring& dest, const std::wstring& ws)
+{
+    const size_t length = ws.length();
+    size_t run_start = 0;
+    size_t i = ws.find(L'\\');
+    while (i != wstring::npos)
     {
-        wchar_t c = ws[i];
-        if (c == L'\\' && i + 5 < ws.length() && ws[i + 1] == L'u')
+        if (i + 5 < length && ws[i + 1] == L'u')
         {
-            wstring value;
-            for (size_t j = 2; j < 6; j++)
+            int code = 0;
+            size_t j = 2;
+            for (; j < 6; j++)
             {
-                if (!std::isxdigit(ws[i + j], loc))
+                const int digit = hex_digit_value(ws[i + j]);
+                if (digit < 0)
                     break;
-                value += ws[i + j];
+                code = code * 16 + digit;
             }
-            if (value.length() == 4)
+            if (j == 6)
             {
-                c = static_cast<wchar_t>(std::stoi(value, nullptr, 16));
+                dest.append(ws, run_start, i - run_start);
+                dest += static_cast<wchar_t>(code);
                 i += 5;
+                run_start = i + 1;
             }
         }
-        ws2 += c;
+        i = ws.find(L'\\', i + 1);
     }
-    return ws2;
+    dest.append(ws, run_start, length - run_start);
 }
 
 std::wstring to_wmessage(const json::parser_msg_kind kind)
@@ -120,6 +234,12 @@ std::wstring to_wmessage(const json::parser_msg_kind kind)
     case parser_msg_kind::err_unexpected_lexeme_fmt: return L"Unexpected '%ls'";
     case parser_msg_kind::err_unexpected_text_end: return L"Unexpected end of text";
     case parser_msg_kind::err_unsupported_dom_value_type_fmt: return L"Unsupported DOM value type: %ls";
+    // binary formats
+    case parser_msg_kind::err_invalid_cbor_item_fmt: return L"Invalid or unsupported CBOR item: 0x%02x";
+    case parser_msg_kind::err_invalid_utf8_string: return L"Invalid UTF-8 string";
+    // typed binding
+    case parser_msg_kind::err_binding_type_mismatch_fmt: return L"Value does not match the type of '%ls'";
+    case parser_msg_kind::err_binding_number_out_of_range_fmt: return L"Number is out of range of '%ls'";
     default:
         return str::wformat(L"Unsupported message %d", static_cast<int>(kind));
     }
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include "../parsers.h"
 
 namespace stdext
@@ -44,7 +45,13 @@ namespace stdext
             err_unclosed_object = 2295,
             err_unexpected_lexeme_fmt = 2300,
             err_unexpected_text_end = 2310,
-            err_unsupported_dom_value_type_fmt = 2400
+            err_unsupported_dom_value_type_fmt = 2400,
+            // binary formats
+            err_invalid_cbor_item_fmt = 2500,
+            err_invalid_utf8_string = 2510,
+            // typed binding
+            err_binding_type_mismatch_fmt = 2600,
+            err_binding_number_out_of_range_fmt = 2610
         };
         std::wstring to_wmessage(const parser_msg_kind kind);
 
@@ -55,5 +62,10 @@ namespace stdext
         std::wstring to_escaped(const wchar_t c, const bool force_to_numeric = false);
         std::wstring to_escaped(const std::wstring ws, const bool force_to_numeric = false);
         std::wstring to_unescaped(const std::wstring ws);
+        // Append functions write into caller-provided buffer and copy unescaped runs as a whole
+        void append_escaped(std::wstring& dest, const wchar_t c, const bool force_to_numeric = false);
+        void append_escaped(std::wstring& dest, const std::wstring_view ws, const bool force_to_numeric = false);
+        void append_unescaped(std::wstring& dest, const std::wstring& ws);
+        std::size_t find_escaping_required(const std::wstring& ws, const std::size_t pos = 0);
     }
 }
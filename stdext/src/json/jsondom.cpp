@@ -76,6 +76,14 @@ bool equal(const dom_document& doc1, const dom_document& doc2)
     return it1 == it1_end && it2 == it2_end;
 }
 
+namespace
+{
+    inline std::size_t hash_combine(const std::size_t seed, const std::size_t value) noexcept
+    {
+        return seed ^ (value + static_cast<std::size_t>(0x9e3779b97f4a7c15ULL) + (seed << 6) + (seed >> 2));
+    }
+}
+
 /*
  * dom_value class
  */
@@ -84,11 +92,15 @@ dom_value::dom_value(dom_document* const doc, const dom_value_type type)
 {
     if (m_doc == nullptr)
         throw dom_exception(L"Value should be created in document scope", dom_error::document_is_null);
+    m_doc->assert_not_frozen();
 }
 
 dom_value::~dom_value()
+{ }
+
+void dom_value::assert_not_frozen() const noexcept(false)
 {
-    clear();
+    m_doc->assert_not_frozen();
 }
 
 void dom_value::assert_same_doc(dom_document* doc) const noexcept(false)
@@ -115,6 +127,28 @@ void dom_value::parent(dom_value* const value) noexcept (false)
     m_parent = value;
 }
 
+std::size_t dom_value::hash() const
+{
+    if (!m_hash_valid)
+    {
+        m_hash = compute_hash();
+        m_hash_valid = true;
+    }
+    return m_hash;
+}
+
+std::size_t dom_value::compute_hash() const
+{
+    return hash_combine(static_cast<std::size_t>(m_type), std::hash<std::wstring>()(m_text));
+}
+
+void dom_value::reset_hash() noexcept
+{
+    // A valid hash implies valid hashes of all children so the walk stops at the first invalid one
+    for (const dom_value* value = this; value != nullptr && value->m_hash_valid; value = value->m_parent)
+        value->m_hash_valid = false;
+}
+
 std::wstring dom_value::to_wstring() const
 {
     return str::wformat(L"Length: %d\ntext: \"%ls\"\nencoded: \"%ls\"",
@@ -146,6 +180,7 @@ dom_literal::dom_literal(dom_document* const doc, const std::wstring text)
 
 void dom_literal::text(const std::wstring value) noexcept(false)
 {
+    assert_not_frozen();
     m_literal_type = json::to_literal_type(value);
     dom_value::text(value);
 }
@@ -176,27 +211,44 @@ dom_number::dom_number(dom_document* const doc, const std::wstring& text, const
     m_numtype = numtype;
 }
 
-dom_number::dom_number(dom_document* const doc, const int32_t value)
-    : dom_value(doc, dom_value_type::vt_number)
+dom_number::dom_number(dom_document* const doc, const std::wstring& text, const dom_number_type numtype, const parsers::numeric_value& value)
+    : dom_value(doc, dom_value_type::vt_number),
+      m_numtype(numtype),
+      m_value(value)
 {
-    locutils::locale_guard lg(LC_NUMERIC, "C");
-    this->text(std::to_wstring(value));
-    m_numtype = dom_number_type::nvt_int;
+    dom_value::text(text);
 }
 
+dom_number::dom_number(dom_document* const doc, const int32_t value)
+    : dom_number(doc, static_cast<int64_t>(value))
+{ }
+
 dom_number::dom_number(dom_document* const doc, const int64_t value)
-    : dom_value(doc, dom_value_type::vt_number)
+    : dom_value(doc, dom_value_type::vt_number),
+      m_numtype(dom_number_type::nvt_int),
+      m_value(value)
 {
     locutils::locale_guard lg(LC_NUMERIC, "C");
-    this->text(std::to_wstring(value));
-    m_numtype = dom_number_type::nvt_int;
+    dom_value::text(std::to_wstring(value));
 }
 
 dom_number::dom_number(dom_document* const doc, const double value)
-    : dom_value(doc, dom_value_type::vt_number)
+    : dom_value(doc, dom_value_type::vt_number),
+      m_numtype(dom_number_type::nvt_float),
+      m_value(value)
 {
-    this->text(dom_number::to_text(value));
-    m_numtype = dom_number_type::nvt_float;
+    dom_value::text(dom_number::to_text(value));
+}
+
+void dom_number::text(const std::wstring value) noexcept(false)
+{
+    dom_value::text(value);
+    m_value = parsers::numeric_parser(dom_value::text()).binary_value();
+}
+
+std::size_t dom_number::compute_hash() const
+{
+    return hash_combine(dom_value::compute_hash(), static_cast<std::size_t>(m_numtype));
 }
 
 std::wstring dom_number::to_text(const double value)
@@ -257,6 +309,7 @@ dom_object_members::dom_object_members(dom_object* const owner)
 
 void dom_object_members::append(const name_t name, dom_value* const value) noexcept(false)
 {
+    m_owner->assert_not_frozen();
     value->assert_same_doc(m_owner->document());
     check_name(name);
     unique_ptr<dom_object_member> member(new dom_object_member(this, name, value));
@@ -264,6 +317,17 @@ void dom_object_members::append(const name_t name, dom_value* const value) noexc
     value->m_member = member.get();
     m_index[member->name()] = member.get();
     m_data.push_back(member.release());
+    m_owner->reset_hash();
+}
+
+void dom_object_members::append_unescaped(const name_t& name, dom_value* const value)
+{
+    unique_ptr<dom_object_member> member(new dom_object_member(this, name_t(), value));
+    member->m_name = name;
+    value->parent(m_owner);
+    value->m_member = member.get();
+    m_index[name] = member.get();
+    m_data.push_back(member.release());
 }
 
 void dom_object_members::check_name(const name_t name) const noexcept(false)
@@ -272,10 +336,12 @@ void dom_object_members::check_name(const name_t name) const noexcept(false)
         throw dom_exception(str::wformat(L"Duplicate name '%ls'", name.c_str()), dom_error::duplicate_name);
 }
 
-void dom_object_members::clear() noexcept
+void dom_object_members::clear() noexcept(false)
 {
+    m_owner->assert_not_frozen();
     m_index.clear();
     m_data.clear();
+    m_owner->reset_hash();
 }
 
 dom_object_member* dom_object_members::find(const name_t name) const noexcept
@@ -310,11 +376,34 @@ dom_object::~dom_object()
 
 void dom_object::clear()
 {
+    assert_not_frozen();
+    m_source = nullptr;
+    m_source_doc.reset();
     m_members->clear();
     dom_value::clear();
 }
 
-dom_value* dom_object::find_value(const name_t name) const noexcept
+void dom_object::copy_source()
+{
+    const dom_object* source = m_source;
+    shared_ptr<const dom_document> source_doc = std::move(m_source_doc);
+    m_source = nullptr;
+    for (const dom_object_member* member : *source->m_members)
+        m_members->append_unescaped(member->name(), m_doc->create_shared(member->value(), source_doc));
+}
+
+std::size_t dom_object::compute_hash() const
+{
+    // Shared object has the same content as its source
+    if (m_source != nullptr)
+        return m_source->hash();
+    std::size_t result = 0;
+    for (const dom_object_member* member : *m_members)
+        result += hash_combine(std::hash<std::wstring>()(member->name()), member->value()->hash());
+    return hash_combine(hash_combine(static_cast<std::size_t>(m_type), m_members->size()), result);
+}
+
+dom_value* dom_object::find_value(const name_t name)
 {
     dom_object_member* member = this->find(name);
     if (member != nullptr)
@@ -322,6 +411,14 @@ dom_value* dom_object::find_value(const name_t name) const noexcept
     return nullptr;
 }
 
+const dom_value* dom_object::find_value(const name_t name) const noexcept
+{
+    const dom_object_member* member = this->find(name);
+    if (member != nullptr)
+        return member->value();
+    return nullptr;
+}
+
 /*
  * dom_array class
  */
@@ -336,10 +433,45 @@ dom_array::~dom_array()
         delete m_data;
 }
 
-void dom_array::append(dom_value* const value) noexcept
+void dom_array::clear()
+{
+    assert_not_frozen();
+    m_source = nullptr;
+    m_source_doc.reset();
+    m_data->clear();
+    reset_hash();
+}
+
+void dom_array::copy_source()
 {
+    const dom_array* source = m_source;
+    shared_ptr<const dom_document> source_doc = std::move(m_source_doc);
+    m_source = nullptr;
+    for (const dom_value* value : *source->m_data)
+    {
+        dom_value* copy = m_doc->create_shared(value, source_doc);
+        copy->parent(this);
+        m_data->push_back(copy);
+    }
+}
+
+void dom_array::append(dom_value* const value)
+{
+    assert_not_frozen();
+    materialize();
     value->parent(this);
     m_data->push_back(value);
+    reset_hash();
+}
+
+std::size_t dom_array::compute_hash() const
+{
+    if (m_source != nullptr)
+        return m_source->hash();
+    std::size_t result = hash_combine(static_cast<std::size_t>(m_type), m_data->size());
+    for (const dom_value* value : *m_data)
+        result = hash_combine(result, value->hash());
+    return result;
 }
 
 /*
@@ -353,21 +485,22 @@ dom_document::dom_document(dom_document&& source)
 dom_document& dom_document::operator =(dom_document&& source)
 {
     m_root = source.m_root;
+    m_frozen = source.m_frozen;
     source.m_root = nullptr;
+    source.m_frozen = false;
     return *this;
 }
 
 
 dom_document::~dom_document()
 {
-    clear();
+    release();
 }
 
 void dom_document::clear()
 {
-    if (m_root != nullptr)
-        delete m_root;
-    m_root = nullptr;
+    assert_not_frozen();
+    release();
 }
 
 dom_array* dom_document::create_array()
@@ -385,6 +518,11 @@ dom_number* dom_document::create_number(const std::wstring text, const json::dom
     return new dom_number(this, text, numtype);
 }
 
+dom_number* dom_document::create_number(const std::wstring text, const json::dom_number_type numtype, const parsers::numeric_value& value)
+{
+    return new dom_number(this, text, numtype, value);
+}
+
 dom_number* dom_document::create_number(const int32_t value)
 {
     return new dom_number(this, value);
@@ -417,11 +555,85 @@ dom_string* dom_document::create_string(const std::wstring& text)
 
 void dom_document::root(dom_value* const value) noexcept(false)
 {
+    assert_not_frozen();
     value->assert_same_doc_no_parent(this);
     clear();
     m_root = value;
 }
 
+void dom_document::clone_from(const std::shared_ptr<const dom_document>& source)
+{
+    clear();
+    if (source != nullptr && source->root() != nullptr)
+        m_root = create_shared(source->root(), source);
+}
+
+void dom_document::freeze()
+{
+    if (m_frozen)
+        return;
+    if (m_root != nullptr)
+    {
+        // Iteration copies the values shared with other documents, then the hashes of all values are cached
+        for (iterator it = begin(); !it.is_end(); it.next())
+            ;
+        m_root->hash();
+    }
+    m_frozen = true;
+}
+
+void dom_document::assert_not_frozen() const noexcept(false)
+{
+    if (m_frozen)
+        throw dom_exception(L"Document is frozen", dom_error::document_is_frozen);
+}
+
+void dom_document::release() noexcept
+{
+    if (m_root != nullptr)
+        delete m_root;
+    m_root = nullptr;
+}
+
+dom_value* dom_document::create_shared(const dom_value* source, const std::shared_ptr<const dom_document>& source_doc)
+{
+    switch (source->type())
+    {
+    case dom_value_type::vt_array:
+    {
+        const dom_array* array = static_cast<const dom_array*>(source);
+        dom_array* value = create_array();
+        // Not yet copied array refers to the array of the document it was cloned from
+        value->m_source = array->m_source != nullptr ? array->m_source : array;
+        value->m_source_doc = array->m_source != nullptr ? array->m_source_doc : source_doc;
+        return value;
+    }
+    case dom_value_type::vt_object:
+    {
+        const dom_object* object = static_cast<const dom_object*>(source);
+        dom_object* value = create_object();
+        value->m_source = object->m_source != nullptr ? object->m_source : object;
+        value->m_source_doc = object->m_source != nullptr ? object->m_source_doc : source_doc;
+        return value;
+    }
+    case dom_value_type::vt_literal:
+        return create_literal(source->text());
+    case dom_value_type::vt_number:
+    {
+        const dom_number* number = static_cast<const dom_number*>(source);
+        return create_number(number->text(), number->numtype(), number->value());
+    }
+    case dom_value_type::vt_string:
+    {
+        // The text is already unescaped
+        dom_string* value = create_string(L"");
+        value->m_text = source->m_text;
+        return value;
+    }
+    }
+    throw dom_exception(L"Unsupported value type", dom_error::usupported_value_type);
+}
+
 dom_document::iterator dom_document::begin()
 {
     return iterator(this);
@@ -459,6 +671,14 @@ dom_document::const_iterator::const_iterator(const dom_document* doc)
         m_path.push_back(0);
 }
 
+dom_document::const_iterator::const_iterator(const dom_document& doc, const dom_value* value)
+    : m_doc(&doc)
+{
+    m_current = const_cast<dom_value*>(value);
+    if (m_current != nullptr)
+        m_path.push_back(0);
+}
+
 bool dom_document::const_iterator::has_prev_sibling() const noexcept
 {
     return !m_path.empty() && m_path.back() > 0;
@@ -472,30 +692,107 @@ dom_value* dom_document::const_iterator::next()
         if (idx != nullptr && idx->count() > 0)
         {
             m_path.push_back(0);
-            m_current = idx->get_value(0);
+            m_parents.push_back(m_current);
+            m_current = child(m_current, 0);
         }
         else
+            skip();
+    }
+    return m_current;
+}
+
+dom_value* dom_document::const_iterator::skip()
+{
+    while (m_current != nullptr)
+    {
+        // The first path item is the start value of iteration
+        if (m_path.size() <= 1)
         {
-            m_current = m_current->parent();
-            while (m_current != nullptr)
-            {
-                std::size_t next_index = m_path.back() + 1;
-                m_path.pop_back();
-                idx = dynamic_cast<container_intf*>(m_current);
-                if (idx != nullptr && next_index < idx->count())
-                {
-                    m_path.push_back(next_index);
-                    m_current = idx->get_value(next_index);
-                    break;
-                }
-                m_current = m_current->parent();
-            }
+            m_current = nullptr;
+            break;
         }
-        if (m_current == nullptr)
-            m_path.clear();
+        std::size_t next_index = m_path.back() + 1;
+        m_path.pop_back();
+        dom_value* parent = m_parents.back();
+        container_intf* idx = dynamic_cast<container_intf*>(parent);
+        if (idx != nullptr && next_index < idx->count())
+        {
+            m_path.push_back(next_index);
+            m_current = child(parent, next_index);
+            break;
+        }
+        m_parents.pop_back();
+        m_current = parent;
+    }
+    if (m_current == nullptr)
+    {
+        m_path.clear();
+        m_parents.clear();
     }
     return m_current;
 }
 
+dom_value* dom_document::const_iterator::child(dom_value* container, const std::size_t i) const
+{
+    const container_intf* idx = dynamic_cast<const container_intf*>(container);
+    return const_cast<dom_value*>(idx->get_value(i));
+}
+
+dom_value* dom_document::iterator::child(dom_value* container, const std::size_t i) const
+{
+    return dynamic_cast<container_intf*>(container)->get_value(i);
+}
+
+/*
+ * shared_dom_document class
+ */
+shared_dom_document::shared_dom_document()
+{
+    shared_ptr<dom_document> doc = make_shared<dom_document>();
+    doc->freeze();
+    m_doc = doc;
+}
+
+shared_dom_document::document_ptr shared_dom_document::get() const
+{
+    return std::atomic_load(&m_doc);
+}
+
+void shared_dom_document::publish(const std::shared_ptr<dom_document>& doc)
+{
+    doc->freeze();
+    lock_guard<mutex> lock(m_update_lock);
+    std::atomic_store(&m_doc, document_ptr(doc));
+    m_version.fetch_add(1, std::memory_order_release);
+}
+
+shared_dom_document::document_ptr shared_dom_document::update(const update_func_t& func)
+{
+    lock_guard<mutex> lock(m_update_lock);
+    shared_ptr<dom_document> doc = make_shared<dom_document>();
+    doc->clone_from(std::atomic_load(&m_doc));
+    func(*doc);
+    doc->freeze();
+    std::atomic_store(&m_doc, document_ptr(doc));
+    m_version.fetch_add(1, std::memory_order_release);
+    return doc;
+}
+
+shared_dom_document::reader::reader(const shared_dom_document& source)
+    : m_source(source)
+{ }
+
+const dom_document& shared_dom_document::reader::doc()
+{
+    // The document is stored before the version is incremented, so the loaded one is not older than the version
+    const uint64_t version = m_source.version();
+    if (m_doc == nullptr || version != m_version)
+    {
+        m_doc = m_source.get();
+        m_version = version;
+    }
+    return *m_doc;
+}
+
 }
 }
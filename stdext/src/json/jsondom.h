@@ -11,6 +11,9 @@
 #include <memory>
 #include <vector>
 #include <map>
+#include <atomic>
+#include <functional>
+#include <mutex>
 #include <cstdint>
 #include <limits>
 #include "jsoncommon.h"
@@ -52,10 +55,12 @@ namespace stdext
         */
         enum class dom_error
         {
+            document_is_frozen,
             document_is_not_same,
             document_is_null,
             duplicate_name,
             invalid_literal,
+            invalid_snapshot,
             member_not_found,
             owner_is_null,
             parent_is_not_null,
@@ -139,12 +144,14 @@ namespace stdext
         {
         public:
             virtual dom_value* get_value(const std::size_t i) = 0;
+            virtual const dom_value* get_value(const std::size_t i) const = 0;
             virtual std::size_t count() const = 0;
         };
 
         class dom_value
         {
             friend class dom_array;
+            friend class dom_document;
             friend class dom_object_members;
         public:
             dom_value(dom_document* const doc, const dom_value_type type);
@@ -159,19 +166,24 @@ namespace stdext
             virtual bool is_container() const noexcept { return false; }
         public:
             virtual void accept(dom_value_visitor& visitor) = 0;
+            void assert_not_frozen() const noexcept(false);
             void assert_same_doc(dom_document* doc) const noexcept(false);
             void assert_no_parent() const noexcept(false);
             void assert_same_doc_no_parent(dom_document* doc) const noexcept(false);
-            virtual void clear() { m_text.clear(); }
+            virtual void clear() { assert_not_frozen(); m_text.clear(); reset_hash(); }
             dom_document* document() const noexcept { return m_doc; }
+            // Structural hash of the subtree, computed bottom-up on demand and cached until the next change
+            std::size_t hash() const;
             dom_object_member* member() const noexcept { return m_member; }
             dom_value* parent() const noexcept { return m_parent; }
             virtual std::wstring text() const noexcept { return m_text; }
-            virtual void text(const std::wstring value) noexcept(false) { m_text = json::to_unescaped(value); }
+            virtual void text(const std::wstring value) noexcept(false) { assert_not_frozen(); m_text = json::to_unescaped(value); reset_hash(); }
             dom_value_type type() const noexcept { return m_type; }
             virtual std::wstring to_wstring() const;
         protected:
+            virtual std::size_t compute_hash() const;
             void parent(dom_value* const value) noexcept(false);
+            void reset_hash() noexcept;
         protected:
             dom_document* m_doc = nullptr;
             dom_object_member* m_member = nullptr;
@@ -179,6 +191,8 @@ namespace stdext
             dom_value_type m_type;
         private:
             std::wstring m_text;
+            mutable std::size_t m_hash = 0;
+            mutable bool m_hash_valid = false;
         };
 
         enum class dom_literal_type
@@ -215,17 +229,25 @@ namespace stdext
         {
         public:
             dom_number(dom_document* const doc, const std::wstring& text, const dom_number_type numtype);
+            dom_number(dom_document* const doc, const std::wstring& text, const dom_number_type numtype, const parsers::numeric_value& value);
             dom_number(dom_document* const doc, const int32_t value);
             dom_number(dom_document* const doc, const int64_t value);
             dom_number(dom_document* const doc, const double value);
         public:
             void accept(dom_value_visitor& visitor) override { visitor.visit(*this); }
             dom_number_type numtype() const noexcept { return m_numtype; }
-            void numtype(const dom_number_type value) noexcept { m_numtype = value; }
+            void numtype(const dom_number_type value) noexcept(false) { assert_not_frozen(); m_numtype = value; reset_hash(); }
+            virtual std::wstring text() const noexcept override
+            { return dom_value::text(); }
+            void text(const std::wstring value) noexcept(false) override;
+            const parsers::numeric_value& value() const noexcept { return m_value; }
             virtual std::wstring to_wstring() const override;
             static std::wstring to_text(const double value);
+        protected:
+            std::size_t compute_hash() const override;
         protected:
             dom_number_type m_numtype;
+            parsers::numeric_value m_value;
         };
 
         class dom_string : public dom_value
@@ -240,6 +262,7 @@ namespace stdext
 
         class dom_object_member
         {
+            friend class dom_object_members;
         public:
             typedef std::wstring name_t;
         public:
@@ -281,7 +304,7 @@ namespace stdext
             dom_object_members(dom_object* const owner);
         public:
             void append(const name_t name, dom_value* const value) noexcept(false);
-            void clear() noexcept;
+            void clear() noexcept(false);
             dom_object_member* at(const size_type i) { return m_data.at(i); }
             dom_object_member* operator [](const size_type i) { return m_data.at(i); }
             dom_object_member* operator [](const name_t name) { return this->get(name); }
@@ -296,6 +319,9 @@ namespace stdext
             size_type size() const { return m_data.size(); }
         protected:
             void check_name(const name_t name) const noexcept(false);
+        private:
+            // Name is already unescaped and unique
+            void append_unescaped(const name_t& name, dom_value* const value);
         private:
             dom_object* m_owner = nullptr;
             data_t m_data;
@@ -304,6 +330,7 @@ namespace stdext
 
         class dom_object : public dom_value, public container_intf
         {
+            friend class dom_document;
         public:
             typedef dom_object_member::name_t name_t;
             typedef dom_object_members::size_type size_type;
@@ -313,27 +340,42 @@ namespace stdext
         public:
             void accept(dom_value_visitor& visitor) override { visitor.visit(*this); }
             void clear() override;
-            dom_object_members* members() { return m_members; }
-            const dom_object_members* cmembers() const { return m_members; }
+            // Members are not copied from the shared source yet.
+            // Const methods read the source members, non-const ones copy them first
+            bool is_shared() const noexcept { return m_source != nullptr; }
+            dom_object_members* members() { materialize(); return m_members; }
+            const dom_object_members* cmembers() const { return m_source != nullptr ? m_source->m_members : m_members; }
         public: // some facade of members() collection
-            dom_object_member* operator [](const size_type i) { return m_members->at(i); }
-            void append_member(const name_t name, dom_value* const value) noexcept(false) { m_members->append(name, value); }
-            inline bool contains_member(const name_t name) const noexcept { return m_members->contains_name(name); }
-            inline dom_object_member* find(const name_t name) const noexcept { return m_members->find(name); }
-            dom_value* find_value(const name_t name) const noexcept;
-            size_type size() const { return m_members->size(); }
+            dom_object_member* operator [](const size_type i) { return members()->at(i); }
+            void append_member(const name_t name, dom_value* const value) noexcept(false) { members()->append(name, value); }
+            inline bool contains_member(const name_t name) const noexcept { return cmembers()->contains_name(name); }
+            inline dom_object_member* find(const name_t name) { return members()->find(name); }
+            inline const dom_object_member* find(const name_t name) const noexcept { return cmembers()->find(name); }
+            dom_value* find_value(const name_t name);
+            const dom_value* find_value(const name_t name) const noexcept;
+            size_type size() const { return m_source != nullptr ? m_source->m_members->size() : m_members->size(); }
         public: // container_intf implementation
             container_intf* as_container() override { return dynamic_cast<json::container_intf*>(this); }
             bool is_container() const noexcept override { return true; }
-            dom_value* get_value(const std::size_t i) override { return m_members->at(i)->value(); };
-            std::size_t count() const override { return m_members->size(); }
+            dom_value* get_value(const std::size_t i) override { return members()->at(i)->value(); };
+            const dom_value* get_value(const std::size_t i) const override { return cmembers()->m_data.at(i)->value(); };
+            std::size_t count() const override { return size(); }
+        protected:
+            // Does not depend on member order
+            std::size_t compute_hash() const override;
+            inline void materialize() { if (m_source != nullptr) copy_source(); }
+            void copy_source();
         private:
             dom_object_members* m_members = nullptr;
+            // Source object of other document and the reference which keeps that document alive
+            const dom_object* m_source = nullptr;
+            std::shared_ptr<const dom_document> m_source_doc;
         };
 
 
         class dom_array : public dom_value, public container_intf
         {
+            friend class dom_document;
         public:
             typedef stdext::ptr_vector<dom_value> data_t;
             typedef typename data_t::size_type size_type;
@@ -344,28 +386,43 @@ namespace stdext
             ~dom_array() override;
         public:
             void accept(dom_value_visitor& visitor) override { visitor.visit(*this); }
-            void clear() noexcept override { m_data->clear(); }
-            dom_value* at(const size_type i) { return m_data->at(i); }
-            dom_value* operator [](const size_type i) { return m_data->at(i); }
-            iterator begin() noexcept { return m_data->begin(); }
-            const_iterator begin() const noexcept { return m_data->begin(); }
-            iterator end() noexcept { return m_data->end(); }
-            const_iterator end() const noexcept { return m_data->end(); }
-            void append(dom_value* const value) noexcept;
-            bool empty() const noexcept { return m_data->empty(); }
-            size_type size() const { return m_data->size(); }
+            void clear() override;
+            // Elements are not copied from the shared source yet.
+            // Const methods read the source elements, non-const ones copy them first
+            bool is_shared() const noexcept { return m_source != nullptr; }
+            dom_value* at(const size_type i) { materialize(); return m_data->at(i); }
+            const dom_value* at(const size_type i) const { return cdata()->at(i); }
+            dom_value* operator [](const size_type i) { return at(i); }
+            iterator begin() { materialize(); return m_data->begin(); }
+            const_iterator begin() const { return cdata()->begin(); }
+            iterator end() { materialize(); return m_data->end(); }
+            const_iterator end() const { return cdata()->end(); }
+            void append(dom_value* const value);
+            bool empty() const noexcept { return size() == 0; }
+            size_type size() const noexcept { return m_source != nullptr ? m_source->m_data->size() : m_data->size(); }
         public: // container_intf implementation
             container_intf* as_container() override { return dynamic_cast<json::container_intf*>(this); }
             bool is_container() const noexcept override { return true; }
-            dom_value* get_value(const std::size_t i) override { return m_data->at(i); }
-            std::size_t count() const override { return m_data->size(); }
+            dom_value* get_value(const std::size_t i) override { return at(i); }
+            const dom_value* get_value(const std::size_t i) const override { return at(i); }
+            std::size_t count() const override { return size(); }
+        protected:
+            std::size_t compute_hash() const override;
+            inline const data_t* cdata() const noexcept { return m_source != nullptr ? m_source->m_data : m_data; }
+            inline void materialize() { if (m_source != nullptr) copy_source(); }
+            void copy_source();
         private:
             data_t* m_data = nullptr;
+            // Source array of other document and the reference which keeps that document alive
+            const dom_array* m_source = nullptr;
+            std::shared_ptr<const dom_document> m_source_doc;
         };
 
 
         class dom_document
         {
+            friend class dom_array;
+            friend class dom_object;
         public:
             dom_document() { }
             dom_document(const dom_document&) = delete;
@@ -378,6 +435,7 @@ namespace stdext
             dom_array* create_array();
             dom_literal* create_literal(const std::wstring text);
             dom_number* create_number(const std::wstring text, const json::dom_number_type numtype);
+            dom_number* create_number(const std::wstring text, const json::dom_number_type numtype, const parsers::numeric_value& value);
             dom_number* create_number(const int32_t value);
             dom_number* create_number(const int64_t value);
             dom_number* create_number(const double value);
@@ -386,6 +444,17 @@ namespace stdext
             dom_string* create_string(const std::wstring& text);
             dom_value* root() const noexcept { return m_root; }
             void root(dom_value* const value) noexcept(false);
+            // Shares the values of the source document which should not be changed anymore.
+            // Containers copy their children on first non-const access, so the clone takes constant time
+            // and the subtrees which are only read remain shared. Values returned by const methods
+            // of shared containers belong to the source document
+            void clone_from(const std::shared_ptr<const dom_document>& source);
+            // Makes the document immutable: shared values are copied, hashes are computed and
+            // all further changes throw dom_exception. Frozen document may be read by many threads
+            // without locks because its reading methods do not change anything
+            void freeze();
+            bool is_frozen() const noexcept { return m_frozen; }
+            void assert_not_frozen() const noexcept(false);
         public:
             class const_iterator
             {
@@ -395,6 +464,8 @@ namespace stdext
             public:
                 const_iterator(const dom_document& doc);
                 const_iterator(const dom_document* doc);
+                // Iterates the subtree of value only, paths are relative to value
+                const_iterator(const dom_document& doc, const dom_value* value);
                 const_iterator() = delete;
                 const_iterator(const const_iterator&) = default;
                 const_iterator& operator =(const const_iterator&) = default;
@@ -403,6 +474,8 @@ namespace stdext
                 virtual ~const_iterator() {}
             public:
                 dom_value* next();
+                // Moves to the next value after the current subtree
+                dom_value* skip();
                 inline void operator ++() { next(); }
                 inline const_iterator& operator ++(int) { next(); return *this; }
                 inline bool operator ==(const const_iterator& rhs)
@@ -418,10 +491,15 @@ namespace stdext
                 bool has_prev_sibling() const noexcept;
                 inline bool is_end() const noexcept { return m_current == nullptr; }
                 inline const path_t path() const { return m_path; }
+            protected:
+                // Does not copy the children of shared containers
+                virtual dom_value* child(dom_value* container, const std::size_t i) const;
             protected:
                 const dom_document* m_doc;
                 dom_value*          m_current;
                 path_t              m_path;
+                // Containers of the current value, the values of shared containers do not know these parents
+                std::vector<dom_value*> m_parents;
             };
 
             class iterator : public const_iterator
@@ -432,6 +510,9 @@ namespace stdext
             public:
                 inline dom_value* operator *() { return m_current; }
                 inline dom_value* value() noexcept { return m_current; }
+            protected:
+                // Copies the children of shared containers, so they may be changed
+                dom_value* child(dom_value* container, const std::size_t i) const override;
             };
 
         public:
@@ -439,8 +520,70 @@ namespace stdext
             const_iterator begin() const;
             iterator end();
             const_iterator end() const;
+        private:
+            dom_value* create_shared(const dom_value* source, const std::shared_ptr<const dom_document>& source_doc);
+            // Deletes the root without the frozen check, destructors may run on frozen documents
+            void release() noexcept;
         private:
             dom_value* m_root = nullptr;
+            bool m_frozen = false;
+        };
+
+
+        /*
+         * Publishes frozen document versions to reader threads in RCU style.
+         * Readers take the current version and read it without locks, writers prepare the next version
+         * aside and swap it in. The old version is deleted when its last reader releases it.
+         * Atomic operations on std::shared_ptr are not lock-free in common implementations,
+         * so only the reader which reuses the taken version is wait-free while the version is not changed.
+         */
+        class shared_dom_document
+        {
+        public:
+            typedef std::shared_ptr<const dom_document> document_ptr;
+            typedef std::function<void(dom_document&)> update_func_t;
+        public:
+            shared_dom_document();
+            shared_dom_document(const shared_dom_document&) = delete;
+            shared_dom_document& operator =(const shared_dom_document&) = delete;
+            shared_dom_document(shared_dom_document&&) = delete;
+            shared_dom_document& operator =(shared_dom_document&&) = delete;
+        public:
+            // Current version, never null. Takes an internal lock of the standard library,
+            // use reader in hot paths
+            document_ptr get() const;
+            // Counter of published versions
+            uint64_t version() const noexcept { return m_version.load(std::memory_order_acquire); }
+            // Freezes the document and makes it current
+            void publish(const std::shared_ptr<dom_document>& doc);
+            // Applies the changes to the clone of the current version and publishes it, writers are serialized
+            document_ptr update(const update_func_t& func);
+        public:
+            /*
+             * Per-thread reader which reloads the document only when the version changes,
+             * so reading of the same version costs one atomic load of the version counter and does not lock
+             */
+            class reader
+            {
+            public:
+                reader(const shared_dom_document& source);
+                reader() = delete;
+                reader(const reader&) = delete;
+                reader& operator =(const reader&) = delete;
+                reader(reader&&) = delete;
+                reader& operator =(reader&&) = delete;
+            public:
+                const dom_document& doc();
+                uint64_t version() const noexcept { return m_version; }
+            private:
+                const shared_dom_document& m_source;
+                document_ptr m_doc;
+                uint64_t m_version = 0;
+            };
+        private:
+            document_ptr m_doc;
+            std::atomic<uint64_t> m_version{0};
+            std::mutex m_update_lock;
         };
 
 
@@ -74,7 +74,25 @@ void lexeme::reset(const parsers::textpos pos, const json::token tok, const wcha
 
 void lexeme::reset(const parsers::textpos pos, const json::token tok, const std::wstring text)
 {
-    m_pos = pos;
+    m_line = parsers::line_index::line(pos.line(), pos.col(), 0);
+    m_offset = 0;
+    m_token = tok;
+    m_text = text;
+}
+
+void lexeme::reset(const std::size_t offset, const parsers::line_index& lines, const json::token tok, const wchar_t text)
+{
+    // Lexemes do not contain line breaks, so the lexeme starts in the last line
+    m_line = lines.last_line();
+    m_offset = offset;
+    m_token = tok;
+    m_text.assign(1, text);
+}
+
+void lexeme::reset(const std::size_t offset, const parsers::line_index& lines, const json::token tok, const std::wstring text)
+{
+    m_line = lines.last_line();
+    m_offset = offset;
     m_token = tok;
     m_text = text;
 }
@@ -96,30 +114,36 @@ void lexer::accept_char(std::wstring& value)
 
 void lexer::add_error(const parser_msg_kind kind)
 {
-    add_error(kind, m_pos, to_wmessage(kind));
+    add_error(kind, m_offset, parsers::msg_args());
 }
 
-void lexer::add_error(const parser_msg_kind kind, const parsers::textpos pos)
+void lexer::add_error(const parser_msg_kind kind, const std::size_t offset)
 {
-    add_error(kind, pos, to_wmessage(kind));
+    add_error(kind, offset, parsers::msg_args());
 }
 
-void lexer::add_error(const parser_msg_kind kind, const std::wstring text)
+void lexer::add_error(const parser_msg_kind kind, parsers::msg_args&& args)
 {
-    add_error(kind, m_pos, text);
+    add_error(kind, m_offset, std::move(args));
 }
 
-void lexer::add_error(const parser_msg_kind kind, const parsers::textpos pos, const std::wstring text)
+void lexer::add_error(const parser_msg_kind kind, const std::size_t offset, parsers::msg_args&& args)
 {
+    if (!m_messages.accepts())
+    {
+        m_messages.drop();
+        return;
+    }
     m_messages.add_error(
         parsers::msg_origin::lexer,
         kind,
-        pos,
-        m_reader.source_name(),
-        text);
+        m_lines.pos(offset),
+        m_messages.source_names() ? m_reader.source_name() : wstring(),
+        &to_wmessage,
+        std::move(args));
 }
 
-bool lexer::handle_escaped_char(wchar_t& c, const parsers::textpos start)
+bool lexer::handle_escaped_char(wchar_t& c, const std::size_t start)
 {
     std::locale loc;
     wstring value;
@@ -140,7 +164,7 @@ bool lexer::handle_escaped_char(wchar_t& c, const parsers::textpos start)
 
 bool lexer::handle_literal(lexeme& lex)
 {
-    parsers::textpos pos = m_pos;
+    const size_t start = m_offset;
     wstring value;
     accept_char(value);
     while (next_char())
@@ -150,18 +174,14 @@ bool lexer::handle_literal(lexeme& lex)
         accept_char(value);
     }
     if (value == L"false")
-        lex.reset(pos, token::literal_false, value);
+        lex.reset(start, m_lines, token::literal_false, value);
     else if (value == L"null")
-        lex.reset(pos, token::literal_null, value);
+        lex.reset(start, m_lines, token::literal_null, value);
     else if (value == L"true")
-        lex.reset(pos, token::literal_true, value);
+        lex.reset(start, m_lines, token::literal_true, value);
     else
     {
-        add_error(parser_msg_kind::err_invalid_literal_fmt,
-            pos,
-            str::wformat(
-                to_wmessage(parser_msg_kind::err_invalid_literal_fmt),
-                value.c_str()));
+        add_error(parser_msg_kind::err_invalid_literal_fmt, start, { value });
         return false;
     }
     return true;
@@ -169,12 +189,14 @@ bool lexer::handle_literal(lexeme& lex)
 
 bool lexer::handle_number(lexeme& lex)
 {
-    lex.reset(m_pos, token::number_int, m_c);
+    // Characters are collected in the lexeme only, the parser computes the binary value
     parsers::numeric_parser np;
+    np.keep_text(false);
+    lex.reset(m_offset, m_lines, token::unknown, L"");
     do
     {
         if (np.read_char(m_c))
-            accept_char();
+            accept_char(lex);
         else
             break;
     } while (next_char());
@@ -196,7 +218,8 @@ bool lexer::handle_number(lexeme& lex)
     }
     if (char_accepted() || is_whitespace(m_c) || is_structural(m_c))
     {
-        lex.reset(lex.pos(), tok, np.value());
+        lex.token(tok);
+        lex.number(np.binary_value(lex.ctext()));
         return true;
     }
     add_error(parser_msg_kind::err_invalid_number);
@@ -206,7 +229,7 @@ bool lexer::handle_number(lexeme& lex)
 bool lexer::handle_string(lexeme& lex)
 {
     wstring value;
-    lex.reset(m_pos, token::string, L"");
+    lex.reset(m_offset, m_lines, token::string, L"");
     while (next_char())
     {
         if (is_unescaped(m_c))
@@ -219,7 +242,7 @@ bool lexer::handle_string(lexeme& lex)
         }
         else if (is_escape(m_c))
         {
-            parsers::textpos pos = m_pos;
+            const size_t start = m_offset;
             if (!next_char())
                 break;
             switch (m_c)
@@ -251,25 +274,24 @@ bool lexer::handle_string(lexeme& lex)
                 break;
             case  L'u':
                 wchar_t c;
-                if (!handle_escaped_char(c, pos))
+                if (!handle_escaped_char(c, start))
                     return false;
                 value += c;
                 break;
             default:
                 wstring s = L"\\";
                 s += m_c;
-                add_error(parser_msg_kind::err_unrecognized_escape_seq_fmt,
-                    pos,
-                    str::wformat(to_wmessage(parser_msg_kind::err_unrecognized_escape_seq_fmt), s.c_str()));
+                add_error(parser_msg_kind::err_unrecognized_escape_seq_fmt, start, { s });
                 return false;
             }
         }
         else
         {
-            add_error(parser_msg_kind::err_unallowed_char_fmt,
-                str::wformat(
-                    to_wmessage(parser_msg_kind::err_unallowed_char_fmt),
-                    m_c, static_cast<unsigned int>(m_c)));
+            add_error(parser_msg_kind::err_unallowed_char_fmt, m_offset,
+                { static_cast<int64_t>(m_c), static_cast<int64_t>(m_c) });
+            // Stops the flood of errors from the broken text
+            if (m_messages.is_full())
+                return false;
         }
     }
     add_error(parser_msg_kind::err_unclosed_string);
@@ -302,9 +324,9 @@ bool lexer::next_char()
     if (m_reader.next_char(m_c))
     {
         m_c_accepted = false;
-        m_pos++;
         if (prev == L'\n')
-            m_pos.newline();
+            m_lines.add_line(m_offset);
+        m_offset++;
         return true;
     }
     else
@@ -318,6 +340,7 @@ bool lexer::next_char()
 
 bool lexer::next_lexeme(lexeme& lex)
 {
+    m_lines.forget(m_lexeme_offset);
     if (char_accepted() || m_initial)
     {
         if (!next_char())
@@ -325,24 +348,25 @@ bool lexer::next_lexeme(lexeme& lex)
     }
     m_initial = false;
     skip_whitespaces();
+    m_lexeme_offset = m_offset;
     if (!char_accepted())
     {
         switch (m_c)
         {
         case L'[':
-            lex.reset(m_pos, token::begin_array, m_c);
+            lex.reset(m_offset, m_lines, token::begin_array, m_c);
             accept_char();
             return true;
         case L'{':
-            lex.reset(m_pos, token::begin_object, m_c);
+            lex.reset(m_offset, m_lines, token::begin_object, m_c);
             accept_char();
             return true;
         case L']':
-            lex.reset(m_pos, token::end_array, m_c);
+            lex.reset(m_offset, m_lines, token::end_array, m_c);
             accept_char();
             return true;
         case L'}':
-            lex.reset(m_pos, token::end_object, m_c);
+            lex.reset(m_offset, m_lines, token::end_object, m_c);
             accept_char();
             return true;
         case L'"':
@@ -352,11 +376,11 @@ bool lexer::next_lexeme(lexeme& lex)
         case L't':
             return handle_literal(lex);
         case L':':
-            lex.reset(m_pos, token::name_separator, m_c);
+            lex.reset(m_offset, m_lines, token::name_separator, m_c);
             accept_char();
             return true;
         case L',':
-            lex.reset(m_pos, token::value_separator, m_c);
+            lex.reset(m_offset, m_lines, token::value_separator, m_c);
             accept_char();
             return true;
         case L'-':
@@ -372,10 +396,8 @@ bool lexer::next_lexeme(lexeme& lex)
         case L'9':
             return handle_number(lex);
         default:
-            add_error(parser_msg_kind::err_unexpected_char_fmt,
-                str::wformat(
-                    to_wmessage(parser_msg_kind::err_unexpected_char_fmt),
-                    m_c, static_cast<unsigned int>(m_c)));
+            add_error(parser_msg_kind::err_unexpected_char_fmt, m_offset,
+                { static_cast<int64_t>(m_c), static_cast<int64_t>(m_c) });
             break;
         }
     }
@@ -44,7 +44,7 @@ namespace stdext
         public:
             lexeme() { }
             lexeme(const json::token token, const parsers::textpos pos, const std::wstring text)
-                : m_pos(pos), m_token(token), m_text(text)
+                : m_line(pos.line(), pos.col(), 0), m_token(token), m_text(text)
             { }
             lexeme(const lexeme& source) = default;
             lexeme& operator =(const lexeme& source) = default;
@@ -52,19 +52,28 @@ namespace stdext
             lexeme& operator =(lexeme&& source) = default;
             ~lexeme() { }
         public:
-            parsers::textpos pos() const { return m_pos; }
-            void pos(const parsers::textpos& value) { m_pos = value; }
+            // Column of lexemes read by lexer is computed from the snapshot of their line on request
+            parsers::textpos pos() const noexcept { return m_line.pos(m_offset); }
+            void pos(const parsers::textpos& value) { m_line = parsers::line_index::line(value.line(), value.col(), 0); m_offset = 0; }
+            std::size_t offset() const noexcept { return m_offset; }
             void reset(const parsers::textpos pos, const json::token tok, const wchar_t text);
             void reset(const parsers::textpos pos, const json::token tok, const std::wstring text);
+            void reset(const std::size_t offset, const parsers::line_index& lines, const json::token tok, const wchar_t text);
+            void reset(const std::size_t offset, const parsers::line_index& lines, const json::token tok, const std::wstring text);
             json::token token() const noexcept { return m_token; }
             void token(const json::token value) noexcept { m_token = value; }
             std::wstring text() const { return m_text; }
+            const std::wstring& ctext() const noexcept { return m_text; }
             void text(const std::wstring value) { m_text = value; }
             void inc_text(const wchar_t c) { m_text += c; }
+            const parsers::numeric_value& number() const noexcept { return m_number; }
+            void number(const parsers::numeric_value& value) noexcept { m_number = value; }
         private:
-            parsers::textpos m_pos;
+            parsers::line_index::line m_line;
+            std::size_t m_offset = 0;
             json::token m_token = token::unknown;
             std::wstring m_text;
+            parsers::numeric_value m_number;
         };
 
         class lexer
@@ -84,7 +93,9 @@ namespace stdext
             bool next_lexeme(lexeme& lex);
             inline bool has_errors() const noexcept { return m_messages.has_errors(); }
             const msg_collector_t& messages() const { return m_messages; }
-            const parsers::textpos& pos() const { return m_pos; }
+            parsers::textpos pos() const noexcept { return m_lines.pos(m_offset); }
+            // Count of characters read
+            std::size_t offset() const noexcept { return m_offset; }
         public:
             static bool is_digit(const wchar_t c);
             static bool is_escape(const wchar_t c);
@@ -97,10 +108,10 @@ namespace stdext
             void accept_char(std::wstring& value);
             inline bool char_accepted() const noexcept { return m_c_accepted; }
             void add_error(const parser_msg_kind kind);
-            void add_error(const parser_msg_kind kind, const parsers::textpos pos);
-            void add_error(const parser_msg_kind kind, const std::wstring text);
-            void add_error(const parser_msg_kind kind, const parsers::textpos pos, const std::wstring text);
-            bool handle_escaped_char(wchar_t& c, const parsers::textpos start);
+            void add_error(const parser_msg_kind kind, const std::size_t offset);
+            void add_error(const parser_msg_kind kind, parsers::msg_args&& args);
+            void add_error(const parser_msg_kind kind, const std::size_t offset, parsers::msg_args&& args);
+            bool handle_escaped_char(wchar_t& c, const std::size_t start);
             bool handle_literal(lexeme& lex);
             bool handle_number(lexeme& lex);
             bool handle_string(lexeme& lex);
@@ -112,7 +123,10 @@ namespace stdext
             wchar_t m_c = 0;
             bool m_c_accepted = false;
             bool m_initial = true;
-            parsers::textpos m_pos{ 1, 0 };
+            std::size_t m_offset = 0;
+            // Start of the last read lexeme which position may be still requested
+            std::size_t m_lexeme_offset = 0;
+            parsers::line_index m_lines{ 0 };
         };
     }
 }
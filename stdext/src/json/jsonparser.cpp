@@ -47,19 +47,25 @@ sax_parser::~sax_parser()
 {
 }
 
-void sax_parser::add_error(const parser_msg_kind kind, const parsers::textpos pos)
+void sax_parser::add_error(const parser_msg_kind kind, const parsers::textpos& pos)
 {
-    add_error(kind, pos, to_wmessage(kind));
+    add_error(kind, pos, parsers::msg_args());
 }
 
-void sax_parser::add_error(const parser_msg_kind kind, const parsers::textpos pos, const std::wstring text)
+void sax_parser::add_error(const parser_msg_kind kind, const parsers::textpos& pos, parsers::msg_args&& args)
 {
+    if (!m_messages.accepts())
+    {
+        m_messages.drop();
+        return;
+    }
     m_messages.add_error(
         parsers::msg_origin::parser,
         kind,
         pos,
-        m_reader.source_name(),
-        text);
+        m_messages.source_names() ? m_reader.source_name() : wstring(),
+        &to_wmessage,
+        std::move(args));
 
 }
 
@@ -89,10 +95,7 @@ bool sax_parser::parse_doc()
     {
         result = !next_lexeme();
         if (!result)
-            add_error(parser_msg_kind::err_unexpected_lexeme_fmt, pos(),
-                str::wformat(
-                    to_wmessage(parser_msg_kind::err_unexpected_lexeme_fmt).c_str(),
-                    m_curr.text().c_str()));
+            add_error(parser_msg_kind::err_unexpected_lexeme_fmt, pos(), { m_curr.text() });
     }
     return result;
 }
@@ -122,10 +125,7 @@ bool sax_parser::parse_value()
         result = parse_string();
         break;
     default:
-        add_error(parser_msg_kind::err_expected_value_but_found_fmt, pos(),
-            str::wformat(
-                to_wmessage(parser_msg_kind::err_expected_value_but_found_fmt).c_str(),
-                m_curr.text().c_str()));
+        add_error(parser_msg_kind::err_expected_value_but_found_fmt, pos(), { m_curr.text() });
         break;
     }
     return result;
@@ -263,10 +263,10 @@ bool sax_parser::parse_number()
     {
     case token::number_decimal:
     case token::number_float:
-        m_handler.on_number(dom_number_type::nvt_float, m_curr.text());
+        m_handler.on_number(dom_number_type::nvt_float, m_curr.text(), m_curr.number());
         return true;
     case token::number_int:
-        m_handler.on_number(dom_number_type::nvt_int, m_curr.text());
+        m_handler.on_number(dom_number_type::nvt_int, m_curr.text(), m_curr.number());
         return true;
     default:
         add_error(parser_msg_kind::err_expected_number, m_curr.pos());
@@ -285,6 +285,180 @@ bool sax_parser::parse_string()
 }
 
 
+/*
+ * event_reader class
+ */
+std::wstring to_wstring(const event_kind kind)
+{
+    switch (kind)
+    {
+    case event_kind::none: return L"none";
+    case event_kind::begin_array: return L"begin_array";
+    case event_kind::end_array: return L"end_array";
+    case event_kind::begin_object: return L"begin_object";
+    case event_kind::end_object: return L"end_object";
+    case event_kind::member_name: return L"member_name";
+    case event_kind::literal: return L"literal";
+    case event_kind::number: return L"number";
+    case event_kind::string: return L"string";
+    default:
+        return L"unsupported";
+    }
+}
+
+event_reader::event_reader(ioutils::text_reader& reader, msg_collector_t& msgs)
+    : m_reader(reader), m_lexer(reader, msgs), m_messages(msgs)
+{ }
+
+void event_reader::add_error(const parser_msg_kind kind, const parsers::textpos& pos)
+{
+    add_error(kind, pos, parsers::msg_args());
+}
+
+void event_reader::add_error(const parser_msg_kind kind, const parsers::textpos& pos, parsers::msg_args&& args)
+{
+    if (!m_messages.accepts())
+    {
+        m_messages.drop();
+        return;
+    }
+    m_messages.add_error(
+        parsers::msg_origin::parser,
+        kind,
+        pos,
+        m_messages.source_names() ? m_reader.source_name() : wstring(),
+        &to_wmessage,
+        std::move(args));
+}
+
+void event_reader::value_accepted()
+{
+    m_expected = m_containers.empty() ? expected::text_end : expected::value_separator_or_end;
+}
+
+bool event_reader::accept_end(const json::token tok)
+{
+    if (m_containers.empty() ||
+        (tok == token::end_array && m_containers.back() != token::begin_array) ||
+        (tok == token::end_object && m_containers.back() != token::begin_object))
+    {
+        add_error(parser_msg_kind::err_unexpected_lexeme_fmt, m_curr.pos(), { m_curr.text() });
+        return false;
+    }
+    m_containers.pop_back();
+    m_kind = (tok == token::end_array ? event_kind::end_array : event_kind::end_object);
+    value_accepted();
+    return true;
+}
+
+bool event_reader::accept_value()
+{
+    switch (m_curr.token())
+    {
+    case token::begin_array:
+        m_containers.push_back(token::begin_array);
+        m_kind = event_kind::begin_array;
+        m_expected = expected::value_or_end_array;
+        return true;
+    case token::begin_object:
+        m_containers.push_back(token::begin_object);
+        m_kind = event_kind::begin_object;
+        m_expected = expected::member_name_or_end_object;
+        return true;
+    case token::literal_false:
+    case token::literal_null:
+    case token::literal_true:
+        m_kind = event_kind::literal;
+        break;
+    case token::number_decimal:
+    case token::number_float:
+    case token::number_int:
+        m_kind = event_kind::number;
+        break;
+    case token::string:
+        m_kind = event_kind::string;
+        break;
+    default:
+        add_error(parser_msg_kind::err_expected_value_but_found_fmt, m_curr.pos(), { m_curr.text() });
+        return false;
+    }
+    value_accepted();
+    return true;
+}
+
+bool event_reader::next()
+{
+    m_kind = event_kind::none;
+    while (m_lexer.next_lexeme(m_curr))
+    {
+        const json::token tok = m_curr.token();
+        switch (m_expected)
+        {
+        case expected::value_or_end_array:
+            if (tok == token::end_array)
+                return accept_end(tok);
+            return accept_value();
+        case expected::value:
+            return accept_value();
+        case expected::member_name_or_end_object:
+            if (tok == token::end_object)
+                return accept_end(tok);
+            [[fallthrough]];
+        case expected::member_name:
+            if (tok != token::string)
+            {
+                add_error(parser_msg_kind::err_expected_member_name, m_curr.pos());
+                return false;
+            }
+            m_kind = event_kind::member_name;
+            m_expected = expected::name_separator;
+            return true;
+        case expected::name_separator:
+            if (tok != token::name_separator)
+            {
+                add_error(parser_msg_kind::err_expected_name_separator, m_curr.pos());
+                return false;
+            }
+            m_expected = expected::value;
+            break;
+        case expected::value_separator_or_end:
+            if (tok == token::value_separator)
+                m_expected = (m_containers.back() == token::begin_array ? expected::value : expected::member_name);
+            else if (tok == token::end_array || tok == token::end_object)
+                return accept_end(tok);
+            else
+            {
+                add_error(parser_msg_kind::err_unexpected_lexeme_fmt, m_curr.pos(), { m_curr.text() });
+                return false;
+            }
+            break;
+        case expected::text_end:
+        default:
+            add_error(parser_msg_kind::err_unexpected_lexeme_fmt, m_curr.pos(), { m_curr.text() });
+            return false;
+        }
+    }
+    // Empty text is a valid document, same as for sax_parser
+    bool is_complete = m_expected == expected::text_end || (m_expected == expected::value && m_containers.empty());
+    if (!is_complete && !m_lexer.has_errors())
+        add_error(parser_msg_kind::err_unexpected_text_end, m_lexer.pos());
+    return false;
+}
+
+bool event_reader::skip_value()
+{
+    if (m_kind != event_kind::begin_array && m_kind != event_kind::begin_object)
+        return m_kind != event_kind::none && m_kind != event_kind::member_name;
+    const std::size_t level = m_containers.size();
+    while (next())
+    {
+        if ((m_kind == event_kind::end_array || m_kind == event_kind::end_object) && m_containers.size() < level)
+            return true;
+    }
+    return false;
+}
+
+
 /*
  * DOM parser handler
  */
@@ -300,6 +474,12 @@ void dom_handler::on_number(const dom_number_type type, const std::wstring& text
     accept_value(node);
 }
 
+void dom_handler::on_number(const dom_number_type type, const std::wstring& text, const parsers::numeric_value& value)
+{
+    dom_value_ptr node(m_doc.create_number(text, type, value));
+    accept_value(node);
+}
+
 void dom_handler::on_string(const std::wstring& text)
 {
     dom_value_ptr node(m_doc.create_string(text));
@@ -337,12 +517,15 @@ void dom_handler::on_end_array(const std::size_t)
 
 void dom_handler::add_error(const parser_msg_kind kind)
 {
-    add_error(kind, to_wmessage(kind));
+    add_error(kind, parsers::msg_args());
 }
 
-void dom_handler::add_error(const parser_msg_kind kind, const std::wstring text)
+void dom_handler::add_error(const parser_msg_kind kind, parsers::msg_args&& args)
 {
-    m_messages.add_error(parsers::msg_origin::parser, kind, m_pos, m_source_name, text);
+    if (m_messages.accepts())
+        m_messages.add_error(parsers::msg_origin::parser, kind, m_pos, m_source_name, &to_wmessage, std::move(args));
+    else
+        m_messages.drop();
 
 }
 
@@ -391,11 +574,7 @@ bool dom_handler::accept_value(dom_value_ptr& node)
         }
         if (obj->cmembers()->contains_name(m_member_names.top()))
         {
-            add_error(parser_msg_kind::err_member_name_duplicate_fmt,
-                str::wformat(
-                    to_wmessage(parser_msg_kind::err_member_name_duplicate_fmt).c_str(),
-                    m_member_names.top().c_str()));
-
+            add_error(parser_msg_kind::err_member_name_duplicate_fmt, { m_member_names.top() });
             return false;
         }
         obj->append_member(m_member_names.top(), node.value());
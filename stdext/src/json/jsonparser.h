@@ -8,6 +8,7 @@
 #pragma once
 
 #include <stack>
+#include <vector>
 #include "jsonexceptions.h"
 #include "jsonlexer.h"
 #include "jsondom.h"
@@ -41,6 +42,9 @@ namespace stdext
         public:
             virtual void on_literal(const json::dom_literal_type type, const std::wstring& text) = 0;
             virtual void on_number(const json::dom_number_type type, const std::wstring& text) = 0;
+            // Receives the binary value computed by lexer, override it to avoid text conversions
+            virtual void on_number(const json::dom_number_type type, const std::wstring& text, const parsers::numeric_value&)
+            { on_number(type, text); }
             virtual void on_string(const std::wstring& text) = 0;
             virtual void on_begin_object() = 0;
             virtual void on_member_name(const std::wstring& text) = 0;
@@ -65,9 +69,11 @@ namespace stdext
             bool run();
             bool has_errors() const { return m_messages.has_errors(); }
             const msg_collector_t& messages() const { return m_messages; }
+            // Position of the current lexeme, handlers pull it when they report own errors
+            inline const parsers::textpos pos() const { return m_curr.pos(); }
         private:
-            void add_error(const parser_msg_kind kind, const parsers::textpos pos);
-            void add_error(const parser_msg_kind kind, const parsers::textpos pos, const std::wstring text);
+            void add_error(const parser_msg_kind kind, const parsers::textpos& pos);
+            void add_error(const parser_msg_kind kind, const parsers::textpos& pos, parsers::msg_args&& args);
             inline bool eof() const { return m_lexer != nullptr && m_lexer->eof(); }
             bool is_current_token(const json::token tok);
             bool next_lexeme();
@@ -80,7 +86,6 @@ namespace stdext
             bool parse_object_members(std::size_t& member_count);
             bool parse_string();
             bool parse_value();
-            inline const parsers::textpos pos() const { return m_curr.pos(); }
         private:
             ioutils::text_reader& m_reader;
             json::lexer* m_lexer = nullptr;
@@ -90,6 +95,70 @@ namespace stdext
         };
 
 
+        /*
+         * Pull-style counterpart of sax_parser
+         * Every next() call moves to the next structural event so that several documents
+         * can be read in lockstep without building DOM
+         */
+        enum class event_kind
+        {
+            none,
+            begin_array,
+            end_array,
+            begin_object,
+            end_object,
+            member_name,
+            literal,
+            number,
+            string
+        };
+        std::wstring to_wstring(const json::event_kind kind);
+
+        class event_reader
+        {
+        public:
+            event_reader() = delete;
+            event_reader(ioutils::text_reader& reader, msg_collector_t& msgs);
+            event_reader(const event_reader&) = delete;
+            event_reader& operator =(const event_reader&) = delete;
+            event_reader(event_reader&&) = delete;
+            event_reader& operator =(event_reader&&) = delete;
+            ~event_reader() {}
+        public:
+            bool next();
+            bool skip_value();
+            json::event_kind kind() const noexcept { return m_kind; }
+            const json::lexeme& current() const noexcept { return m_curr; }
+            std::size_t level() const noexcept { return m_containers.size(); }
+            bool has_errors() const { return m_messages.has_errors(); }
+            const msg_collector_t& messages() const { return m_messages; }
+        private:
+            enum class expected
+            {
+                value,
+                value_or_end_array,
+                member_name,
+                member_name_or_end_object,
+                name_separator,
+                value_separator_or_end,
+                text_end
+            };
+            void add_error(const parser_msg_kind kind, const parsers::textpos& pos);
+            void add_error(const parser_msg_kind kind, const parsers::textpos& pos, parsers::msg_args&& args);
+            bool accept_end(const json::token tok);
+            bool accept_value();
+            void value_accepted();
+        private:
+            ioutils::text_reader& m_reader;
+            json::lexer m_lexer;
+            json::lexeme m_curr;
+            msg_collector_t& m_messages;
+            std::vector<json::token> m_containers;
+            expected m_expected = expected::value;
+            json::event_kind m_kind = event_kind::none;
+        };
+
+
         class dom_handler : public sax_handler_intf
         {
         public:
@@ -102,6 +171,7 @@ namespace stdext
         public:
             virtual void on_literal(const json::dom_literal_type type, const std::wstring& text) override;
             virtual void on_number(const json::dom_number_type type, const std::wstring& text) override;
+            virtual void on_number(const json::dom_number_type type, const std::wstring& text, const parsers::numeric_value& value) override;
             virtual void on_string(const std::wstring& text) override;
             virtual void on_begin_object() override;
             virtual void on_member_name(const std::wstring& text) override;
@@ -112,7 +182,7 @@ namespace stdext
         private:
             bool accept_value(dom_value_ptr& node);
             void add_error(const parser_msg_kind kind);
-            void add_error(const parser_msg_kind kind, const std::wstring text);
+            void add_error(const parser_msg_kind kind, parsers::msg_args&& args);
         private:
             json::dom_document& m_doc;
             containers_t m_containers;
@@ -0,0 +1,584 @@
+/*
+ C++ standard library extensions
+ (c) 2001-2020 Serguei Tarassov (see license.txt)
+ */
+
+#include "jsonsnapshot.h"
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include <fstream>
+#include <memory>
+
+using namespace std;
+
+namespace stdext
+{
+namespace json
+{
+
+namespace
+{
+    const char snapshot_magic[8] = { 'J', 'S', 'O', 'N', 'S', 'N', 'A', 'P' };
+    const uint32_t snapshot_version = 1;
+    const uint32_t snapshot_byte_order_mark = 0x01020304u;
+    const std::size_t snapshot_header_size = 16;
+    const std::size_t snapshot_trailer_size = 16;
+    const std::size_t snapshot_node_head_size = 8;
+    const std::size_t snapshot_buffer_size = 65536;
+
+    // Node types
+    const uint8_t snapshot_literal = 1;
+    const uint8_t snapshot_number = 2;
+    const uint8_t snapshot_string = 3;
+    const uint8_t snapshot_array = 4;
+    const uint8_t snapshot_object = 5;
+    // Number subtype flag, the value is int64 otherwise double
+    const uint8_t snapshot_int_value = 0x80;
+
+    template <class T>
+    inline T read_at(const char* data, const uint64_t offset)
+    {
+        T value;
+        std::memcpy(&value, data + offset, sizeof(T));
+        return value;
+    }
+
+    inline std::size_t padding(const std::size_t pos)
+    {
+        return (8 - (pos & 7)) & 7;
+    }
+
+    std::wstring utf8_to_wstring(const std::string_view s)
+    {
+        bool ascii = true;
+        for (const char c : s)
+        {
+            if (static_cast<unsigned char>(c) >= 0x80u)
+            {
+                ascii = false;
+                break;
+            }
+        }
+        std::wstring ws;
+        if (ascii)
+        {
+            ws.assign(s.begin(), s.end());
+            return ws;
+        }
+        locutils::codecvt_utf8_wchar_t cvt;
+        if (cvt.to_utf16(std::string(s), ws) != std::codecvt_base::ok)
+            throw dom_exception(L"Invalid UTF-8 string in snapshot", dom_error::invalid_snapshot);
+        return ws;
+    }
+
+    void wstring_to_utf8(const std::wstring& ws, std::string& s, locutils::codecvt_utf8_wchar_t& cvt)
+    {
+        for (const wchar_t c : ws)
+        {
+            if (static_cast<uint32_t>(c) >= 0x80u)
+            {
+                cvt.to_utf8(ws, s);
+                return;
+            }
+        }
+        s.assign(ws.begin(), ws.end());
+    }
+
+    inline void invalid_snapshot(const wchar_t* msg)
+    {
+        throw dom_exception(msg, dom_error::invalid_snapshot);
+    }
+}
+
+/*
+ * dom_snapshot_value class
+ */
+dom_snapshot_value::dom_snapshot_value(const char* data, const std::size_t size, const uint64_t offset)
+    : m_data(data), m_size(size), m_offset(offset)
+{
+    if (size < snapshot_header_size + snapshot_trailer_size + snapshot_node_head_size ||
+        offset < snapshot_header_size || offset > size - snapshot_trailer_size - snapshot_node_head_size)
+        invalid_snapshot(L"Snapshot node offset is out of range");
+    const uint8_t node_type = read_at<uint8_t>(data, offset);
+    m_subtype = read_at<uint8_t>(data, offset + 1);
+    m_length = read_at<uint32_t>(data, offset + 4);
+    uint64_t body = 0;
+    switch (node_type)
+    {
+    case snapshot_literal:
+        m_type = dom_value_type::vt_literal;
+        break;
+    case snapshot_number:
+        m_type = dom_value_type::vt_number;
+        body = 8 + static_cast<uint64_t>(m_length);
+        break;
+    case snapshot_string:
+        m_type = dom_value_type::vt_string;
+        body = m_length;
+        break;
+    case snapshot_array:
+        m_type = dom_value_type::vt_array;
+        body = static_cast<uint64_t>(m_length) * 8;
+        break;
+    case snapshot_object:
+        m_type = dom_value_type::vt_object;
+        body = static_cast<uint64_t>(m_length) * 20;
+        break;
+    default:
+        invalid_snapshot(L"Invalid snapshot node type");
+    }
+    if (body > size - snapshot_trailer_size - snapshot_node_head_size - offset)
+        invalid_snapshot(L"Snapshot node is out of range");
+}
+
+void dom_snapshot_value::assert_type(const dom_value_type type) const
+{
+    if (m_data == nullptr || m_type != type)
+        throw dom_exception(str::wformat(L"Snapshot value is not %ls", str::to_wstring(json::to_string(type)).c_str()),
+                            dom_error::usupported_value_type);
+}
+
+dom_literal_type dom_snapshot_value::literal_type() const
+{
+    assert_type(dom_value_type::vt_literal);
+    return static_cast<dom_literal_type>(m_subtype);
+}
+
+dom_number_type dom_snapshot_value::numtype() const
+{
+    assert_type(dom_value_type::vt_number);
+    return static_cast<dom_number_type>(m_subtype & ~snapshot_int_value);
+}
+
+parsers::numeric_value dom_snapshot_value::value() const
+{
+    assert_type(dom_value_type::vt_number);
+    if (m_subtype & snapshot_int_value)
+        return parsers::numeric_value(read_at<int64_t>(m_data, m_offset + snapshot_node_head_size));
+    return parsers::numeric_value(read_at<double>(m_data, m_offset + snapshot_node_head_size));
+}
+
+std::string_view dom_snapshot_value::utf8_text() const
+{
+    if (m_data == nullptr)
+        return std::string_view();
+    switch (m_type)
+    {
+    case dom_value_type::vt_literal:
+        switch (literal_type())
+        {
+        case dom_literal_type::lvt_false:
+            return "false";
+        case dom_literal_type::lvt_null:
+            return "null";
+        case dom_literal_type::lvt_true:
+            return "true";
+        }
+        return std::string_view();
+    case dom_value_type::vt_number:
+        return std::string_view(m_data + m_offset + snapshot_node_head_size + 8, m_length);
+    case dom_value_type::vt_string:
+        return std::string_view(m_data + m_offset + snapshot_node_head_size, m_length);
+    default:
+        return std::string_view();
+    }
+}
+
+std::wstring dom_snapshot_value::text() const
+{
+    return utf8_to_wstring(utf8_text());
+}
+
+std::size_t dom_snapshot_value::size() const noexcept
+{
+    if (m_data != nullptr && (m_type == dom_value_type::vt_array || m_type == dom_value_type::vt_object))
+        return m_length;
+    return 0;
+}
+
+uint64_t dom_snapshot_value::offset_at(const uint64_t pos) const
+{
+    // Children and member names are always written before the parent, so crafted images can not form cycles
+    const uint64_t offset = read_at<uint64_t>(m_data, m_offset + snapshot_node_head_size + pos);
+    if (offset >= m_offset)
+        invalid_snapshot(L"Snapshot child node should precede its parent");
+    return offset;
+}
+
+std::string_view dom_snapshot_value::string_at(const uint64_t offset) const
+{
+    dom_snapshot_value name(m_data, m_size, offset);
+    name.assert_type(dom_value_type::vt_string);
+    return name.utf8_text();
+}
+
+dom_snapshot_value dom_snapshot_value::at(const std::size_t i) const
+{
+    if (i >= size())
+        throw std::out_of_range("Snapshot value index is out of range");
+    if (m_type == dom_value_type::vt_array)
+        return dom_snapshot_value(m_data, m_size, offset_at(i * 8));
+    return dom_snapshot_value(m_data, m_size, offset_at(i * 16 + 8));
+}
+
+std::string_view dom_snapshot_value::utf8_member_name(const std::size_t i) const
+{
+    assert_type(dom_value_type::vt_object);
+    if (i >= m_length)
+        throw std::out_of_range("Snapshot member index is out of range");
+    return string_at(offset_at(i * 16));
+}
+
+std::wstring dom_snapshot_value::member_name(const std::size_t i) const
+{
+    return utf8_to_wstring(utf8_member_name(i));
+}
+
+dom_snapshot_value dom_snapshot_value::find(const std::string_view utf8_name) const
+{
+    assert_type(dom_value_type::vt_object);
+    const uint64_t index_pos = static_cast<uint64_t>(m_length) * 16;
+    std::size_t lo = 0;
+    std::size_t hi = m_length;
+    while (lo < hi)
+    {
+        const std::size_t mid = lo + (hi - lo) / 2;
+        const uint32_t i = read_at<uint32_t>(m_data, m_offset + snapshot_node_head_size + index_pos + mid * 4);
+        if (i >= m_length)
+            invalid_snapshot(L"Snapshot member index is out of range");
+        const int cmp = string_at(offset_at(static_cast<uint64_t>(i) * 16)).compare(utf8_name);
+        if (cmp == 0)
+            return dom_snapshot_value(m_data, m_size, offset_at(static_cast<uint64_t>(i) * 16 + 8));
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return dom_snapshot_value();
+}
+
+dom_snapshot_value dom_snapshot_value::find(const std::wstring& name) const
+{
+    std::string s;
+    locutils::codecvt_utf8_wchar_t cvt;
+    wstring_to_utf8(name, s, cvt);
+    return find(std::string_view(s));
+}
+
+
+/*
+ * dom_snapshot class
+ */
+void dom_snapshot::check_image(const char* data, const std::size_t size) const
+{
+    if (size < snapshot_header_size + snapshot_trailer_size || std::memcmp(data, snapshot_magic, sizeof(snapshot_magic)) != 0)
+        invalid_snapshot(L"Invalid snapshot header");
+    if (read_at<uint32_t>(data, 8) != snapshot_version)
+        invalid_snapshot(L"Unsupported snapshot version");
+    if (read_at<uint32_t>(data, 12) != snapshot_byte_order_mark)
+        invalid_snapshot(L"Snapshot byte order differs from the platform one");
+    if (read_at<uint64_t>(data, size - 8) != static_cast<uint64_t>(size))
+        invalid_snapshot(L"Snapshot size does not match the image");
+}
+
+void dom_snapshot::open(const std::wstring& file_name)
+{
+    close();
+    if (!m_file.open(file_name))
+        invalid_snapshot(str::wformat(L"Can not map file '%ls'", file_name.c_str()).c_str());
+    try
+    {
+        attach(m_file.data(), m_file.size());
+    }
+    catch (...)
+    {
+        m_file.close();
+        throw;
+    }
+}
+
+void dom_snapshot::attach(const char* data, const std::size_t size)
+{
+    check_image(data, size);
+    m_data = data;
+    m_size = size;
+    m_root_offset = read_at<uint64_t>(data, size - snapshot_trailer_size);
+}
+
+void dom_snapshot::close() noexcept
+{
+    m_file.close();
+    m_data = nullptr;
+    m_size = 0;
+    m_root_offset = 0;
+}
+
+dom_snapshot_value dom_snapshot::root() const
+{
+    if (m_data == nullptr || m_root_offset == 0)
+        return dom_snapshot_value();
+    return dom_snapshot_value(m_data, m_size, m_root_offset);
+}
+
+namespace
+{
+    // Values are owned until they are attached, so nothing leaks when a broken node throws
+    std::unique_ptr<dom_value> create_value(json::dom_document& doc, const dom_snapshot_value& value)
+    {
+        switch (value.type())
+        {
+        case dom_value_type::vt_literal:
+            return std::unique_ptr<dom_value>(doc.create_literal(value.text()));
+        case dom_value_type::vt_number:
+            return std::unique_ptr<dom_value>(doc.create_number(value.text(), value.numtype(), value.value()));
+        case dom_value_type::vt_string:
+            return std::unique_ptr<dom_value>(doc.create_string(value.text()));
+        case dom_value_type::vt_array:
+        {
+            std::unique_ptr<dom_array> a(doc.create_array());
+            for (std::size_t i = 0; i < value.size(); i++)
+            {
+                std::unique_ptr<dom_value> element = create_value(doc, value.at(i));
+                a->append(element.get());
+                element.release();
+            }
+            return a;
+        }
+        case dom_value_type::vt_object:
+        {
+            std::unique_ptr<dom_object> o(doc.create_object());
+            for (std::size_t i = 0; i < value.size(); i++)
+            {
+                std::unique_ptr<dom_value> member_value = create_value(doc, value.at(i));
+                o->append_member(value.member_name(i), member_value.get());
+                member_value.release();
+            }
+            return o;
+        }
+        }
+        return nullptr;
+    }
+}
+
+void dom_snapshot::to_document(json::dom_document& doc) const
+{
+    doc.clear();
+    dom_snapshot_value value = root();
+    if (!value.is_null())
+    {
+        std::unique_ptr<dom_value> root_value = create_value(doc, value);
+        doc.root(root_value.get());
+        root_value.release();
+    }
+}
+
+
+/*
+ * dom_snapshot_writer class
+ */
+namespace
+{
+    // Writes children before parents so the offsets of children are known when the parent is written
+    class snapshot_writer_visitor : public dom_value_visitor
+    {
+    public:
+        snapshot_writer_visitor(std::ostream* stream)
+            : dom_value_visitor(), m_stream(stream)
+        {}
+    public:
+        void visit(json::dom_literal& value) override
+        {
+            m_offset = write_head(snapshot_literal, static_cast<uint8_t>(value.literal_type()), 0);
+        }
+        void visit(json::dom_number& value) override
+        {
+            const std::wstring text = value.text();
+            const parsers::numeric_value& v = value.value();
+            const uint8_t subtype = static_cast<uint8_t>(value.numtype()) | (v.is_int() ? snapshot_int_value : 0);
+            m_offset = write_head(snapshot_number, subtype, check_length(text.length()));
+            if (v.is_int())
+                write_pod(v.int_value());
+            else
+                write_pod(v.float_value());
+            // Number texts are ASCII
+            for (const wchar_t c : text)
+                m_buffer += static_cast<char>(c);
+            pad();
+        }
+        void visit(json::dom_string& value) override
+        {
+            m_offset = write_string(value.text());
+        }
+        void visit(json::dom_array& value) override
+        {
+            std::vector<uint64_t> offsets;
+            offsets.reserve(value.size());
+            // Const reading does not copy the shared elements of a clone
+            const dom_array& array = value;
+            for (dom_value* element : array)
+            {
+                element->accept(*this);
+                offsets.push_back(m_offset);
+            }
+            m_offset = write_head(snapshot_array, 0, check_length(offsets.size()));
+            for (const uint64_t offset : offsets)
+                write_pod(offset);
+            flush_if_full();
+        }
+        void visit(json::dom_object& value) override
+        {
+            std::vector<const name_entry*> names;
+            std::vector<uint64_t> offsets;
+            names.reserve(value.size());
+            offsets.reserve(value.size());
+            for (const dom_object_member* member : *value.cmembers())
+            {
+                names.push_back(&name(member->name()));
+                member->value()->accept(*this);
+                offsets.push_back(m_offset);
+            }
+            std::vector<uint32_t> index(names.size());
+            for (std::size_t i = 0; i < index.size(); i++)
+                index[i] = static_cast<uint32_t>(i);
+            std::sort(index.begin(), index.end(), [&names](const uint32_t a, const uint32_t b)
+            {
+                return names[a]->utf8 < names[b]->utf8;
+            });
+            m_offset = write_head(snapshot_object, 0, check_length(names.size()));
+            for (std::size_t i = 0; i < names.size(); i++)
+            {
+                write_pod(names[i]->offset);
+                write_pod(offsets[i]);
+            }
+            for (const uint32_t i : index)
+                write_pod(i);
+            pad();
+            flush_if_full();
+        }
+    public:
+        void write_header()
+        {
+            m_buffer.append(snapshot_magic, sizeof(snapshot_magic));
+            write_pod(snapshot_version);
+            write_pod(snapshot_byte_order_mark);
+        }
+        void write_trailer(const uint64_t root_offset)
+        {
+            write_pod(root_offset);
+            write_pod(static_cast<uint64_t>(pos() + 8));
+        }
+        void flush()
+        {
+            m_stream->write(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+            m_flushed += m_buffer.size();
+            m_buffer.clear();
+        }
+        const std::string& buffer() const noexcept { return m_buffer; }
+        uint64_t offset() const noexcept { return m_offset; }
+    private:
+        struct name_entry
+        {
+            uint64_t offset;
+            std::string utf8;
+        };
+    private:
+        uint64_t pos() const noexcept { return m_flushed + m_buffer.size(); }
+        uint32_t check_length(const std::size_t length)
+        {
+            if (length > 0xFFFFFFFFu)
+                throw json::exception(L"Value is too long for snapshot");
+            return static_cast<uint32_t>(length);
+        }
+        template <class T>
+        void write_pod(const T value)
+        {
+            m_buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+        uint64_t write_head(const uint8_t type, const uint8_t subtype, const uint32_t length)
+        {
+            const uint64_t offset = pos();
+            m_buffer += static_cast<char>(type);
+            m_buffer += static_cast<char>(subtype);
+            write_pod(static_cast<uint16_t>(0));
+            write_pod(length);
+            return offset;
+        }
+        void pad()
+        {
+            m_buffer.append(padding(static_cast<std::size_t>(pos())), '\0');
+        }
+        uint64_t write_utf8(const std::string& s)
+        {
+            const uint64_t offset = write_head(snapshot_string, 0, check_length(s.length()));
+            m_buffer += s;
+            pad();
+            return offset;
+        }
+        uint64_t write_string(const std::wstring& ws)
+        {
+            wstring_to_utf8(ws, m_utf8, m_cvt);
+            return write_utf8(m_utf8);
+        }
+        const name_entry& name(const std::wstring& ws)
+        {
+            auto it = m_names.find(ws);
+            if (it != m_names.end())
+                return it->second;
+            name_entry entry;
+            wstring_to_utf8(ws, entry.utf8, m_cvt);
+            entry.offset = write_utf8(entry.utf8);
+            return m_names.emplace(ws, std::move(entry)).first->second;
+        }
+        void flush_if_full()
+        {
+            if (m_stream != nullptr && m_buffer.size() >= snapshot_buffer_size)
+                flush();
+        }
+    private:
+        std::ostream* m_stream;
+        std::string m_buffer;
+        uint64_t m_flushed = 0;
+        uint64_t m_offset = 0;
+        std::string m_utf8;
+        locutils::codecvt_utf8_wchar_t m_cvt;
+        std::unordered_map<std::wstring, name_entry> m_names;
+    };
+}
+
+dom_snapshot_writer::dom_snapshot_writer(json::dom_document& doc)
+    : m_doc(doc)
+{ }
+
+void dom_snapshot_writer::write(std::ostream& stream)
+{
+    snapshot_writer_visitor visitor(&stream);
+    visitor.write_header();
+    if (m_doc.root() != nullptr)
+        m_doc.root()->accept(visitor);
+    visitor.write_trailer(m_doc.root() != nullptr ? visitor.offset() : 0);
+    visitor.flush();
+}
+
+void dom_snapshot_writer::write(std::string& bytes)
+{
+    snapshot_writer_visitor visitor(nullptr);
+    visitor.write_header();
+    if (m_doc.root() != nullptr)
+        m_doc.root()->accept(visitor);
+    visitor.write_trailer(m_doc.root() != nullptr ? visitor.offset() : 0);
+    bytes = visitor.buffer();
+}
+
+void dom_snapshot_writer::write_to_file(const std::wstring file_name)
+{
+#if defined(__STDEXT_WINDOWS)
+    ofstream stream(file_name, ios::binary | ios::trunc);
+#else
+    ofstream stream(locutils::utf16::to_utf8string(file_name), ios::binary | ios::trunc);
+#endif
+    write(stream);
+}
+
+}
+}
@@ -0,0 +1,134 @@
+/*
+ C++ standard library extensions
+ (c) 2001-2020 Serguei Tarassov (see license.txt)
+
+ JSON (JavaScript Object Notation) tools
+ Persisted document snapshot usable directly from mapped memory
+ */
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <iostream>
+#include "jsondom.h"
+#include "../ioutils.h"
+
+namespace stdext
+{
+    namespace json
+    {
+        /*
+            Snapshot image layout
+            ---
+            header: magic "JSONSNAP", uint32 version, uint32 byte order mark
+            nodes: written children first, each node is aligned to 8 bytes
+            trailer: uint64 root offset, uint64 image size
+
+            Every node starts from uint8 type, uint8 subtype, uint16 reserved, uint32 length
+            |-- literal: subtype is dom_literal_type
+            |-- number: subtype is dom_number_type with int value flag, length of text,
+            |           int64 or double value, text bytes
+            |-- string: length of UTF-8 bytes, bytes
+            |-- array: length is element count, uint64 element offsets
+            |-- object: length is member count, (uint64 name offset, uint64 value offset) pairs in document order,
+                        uint32 member indexes ordered by name bytes
+            Offsets are counted from the image start, equal member names share the same string node.
+            Values are stored in the byte order of the platform which wrote the image.
+         */
+
+        class dom_snapshot_value
+        {
+        public:
+            dom_snapshot_value() {}
+            dom_snapshot_value(const char* data, const std::size_t size, const uint64_t offset) noexcept(false);
+            dom_snapshot_value(const dom_snapshot_value&) = default;
+            dom_snapshot_value& operator =(const dom_snapshot_value&) = default;
+            dom_snapshot_value(dom_snapshot_value&&) = default;
+            dom_snapshot_value& operator =(dom_snapshot_value&&) = default;
+        public:
+            // Default constructed value and not found members are null
+            bool is_null() const noexcept { return m_data == nullptr; }
+            dom_value_type type() const noexcept { return m_type; }
+            dom_literal_type literal_type() const noexcept(false);
+            dom_number_type numtype() const noexcept(false);
+            parsers::numeric_value value() const noexcept(false);
+            // Text of scalar values in UTF-8 without escapes
+            std::string_view utf8_text() const noexcept(false);
+            std::wstring text() const noexcept(false);
+            // Element or member count of containers, 0 for scalars
+            std::size_t size() const noexcept;
+            // Array element or object member value
+            dom_snapshot_value at(const std::size_t i) const noexcept(false);
+            dom_snapshot_value operator [](const std::size_t i) const noexcept(false) { return at(i); }
+            std::string_view utf8_member_name(const std::size_t i) const noexcept(false);
+            std::wstring member_name(const std::size_t i) const noexcept(false);
+            // Binary search in the object member table
+            dom_snapshot_value find(const std::string_view utf8_name) const noexcept(false);
+            dom_snapshot_value find(const std::wstring& name) const noexcept(false);
+        private:
+            void assert_type(const dom_value_type type) const noexcept(false);
+            std::string_view string_at(const uint64_t offset) const noexcept(false);
+            uint64_t offset_at(const uint64_t pos) const noexcept(false);
+        private:
+            const char* m_data = nullptr;
+            std::size_t m_size = 0;
+            uint64_t m_offset = 0;
+            dom_value_type m_type = dom_value_type::vt_literal;
+            uint8_t m_subtype = 0;
+            uint32_t m_length = 0;
+        };
+
+
+        /*
+         * Read-only view of the snapshot image
+         * Only the header and the trailer are checked when opened, node offsets are checked on access
+         */
+        class dom_snapshot
+        {
+        public:
+            dom_snapshot() {}
+            dom_snapshot(const dom_snapshot&) = delete;
+            dom_snapshot& operator =(const dom_snapshot&) = delete;
+            dom_snapshot(dom_snapshot&&) = delete;
+            dom_snapshot& operator =(dom_snapshot&&) = delete;
+        public:
+            // Maps the file into memory
+            void open(const std::wstring& file_name) noexcept(false);
+            // Uses the image from memory, data should live while the snapshot is used
+            void attach(const char* data, const std::size_t size) noexcept(false);
+            void close() noexcept;
+            const char* data() const noexcept { return m_data; }
+            bool is_open() const noexcept { return m_data != nullptr; }
+            dom_snapshot_value root() const noexcept(false);
+            std::size_t size() const noexcept { return m_size; }
+            // Builds the document from the whole image
+            void to_document(json::dom_document& doc) const;
+        private:
+            void check_image(const char* data, const std::size_t size) const noexcept(false);
+        private:
+            ioutils::mapped_file m_file;
+            const char* m_data = nullptr;
+            std::size_t m_size = 0;
+            uint64_t m_root_offset = 0;
+        };
+
+
+        class dom_snapshot_writer
+        {
+        public:
+            dom_snapshot_writer(json::dom_document& doc);
+            dom_snapshot_writer() = delete;
+            dom_snapshot_writer(const dom_snapshot_writer&) = delete;
+            dom_snapshot_writer& operator=(const dom_snapshot_writer&) = delete;
+            dom_snapshot_writer(dom_snapshot_writer&&) = delete;
+            dom_snapshot_writer& operator=(dom_snapshot_writer&&) = delete;
+        public:
+            void write(std::ostream& stream);
+            void write(std::string& bytes);
+            void write_to_file(const std::wstring file_name);
+        private:
+            json::dom_document& m_doc;
+        };
+
+    }
+}
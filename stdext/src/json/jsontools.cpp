@@ -5,8 +5,14 @@
 
 #include "jsontools.h"
 #include "jsonparser.h"
+#include "../csvtools.h"
 #include <stack>
 #include <sstream>
+#include <unordered_set>
+#include <algorithm>
+#include <atomic>
+#include <locale>
+#include <thread>
 
 using namespace std;
 
@@ -24,17 +30,22 @@ public:
     typedef stack<wstring> endings_t;
 public:
     dom_document_writer_visitor(ioutils::text_writer& text_writer,
-                                endings_t& endings)
+                                endings_t& endings,
+                                wstring& buffer)
         : dom_value_visitor(),
           m_text_writer(text_writer),
-          m_endings(endings)
+          m_endings(endings),
+          m_buffer(buffer)
     {}
 public:
     virtual void visit(json::dom_literal& value) override { m_text_writer.write(value.text()); }
     virtual void visit(json::dom_number& value) override { m_text_writer.write(value.text()); }
     virtual void visit(json::dom_string& value) override
     {
-        m_text_writer.write(L"\"").write(json::to_escaped(value.text())).write(L"\"");
+        m_buffer.assign(1, L'"');
+        json::append_escaped(m_buffer, value.text());
+        m_buffer += L'"';
+        m_text_writer.write(m_buffer);
     }
     void visit(dom_array& value) override
     {
@@ -55,6 +66,7 @@ public:
 private:
     ioutils::text_writer& m_text_writer;
     endings_t& m_endings;
+    wstring& m_buffer;
 };
 
 /*
@@ -123,9 +135,12 @@ void dom_document_writer::write(ioutils::text_writer& w)
         return s;
     };
     stack<wstring> endings;
-    dom_document::iterator doc_begin = m_doc.begin();
-    dom_document::iterator doc_end = m_doc.end();
-    dom_document::iterator it = doc_begin;
+    wstring buffer;
+    // Const iteration does not copy the shared values of a cloned document
+    const dom_document& doc = m_doc;
+    dom_document::const_iterator doc_begin = doc.begin();
+    dom_document::const_iterator doc_end = doc.end();
+    dom_document::const_iterator it = doc_begin;
     while (it != doc_end)
     {
         if (it.has_prev_sibling())
@@ -134,10 +149,16 @@ void dom_document_writer::write(ioutils::text_writer& w)
             w.write_endl();
         if (m_conf.pretty_print())
             w.write(indent(it.level()));
-        dom_value* v = *it;
+        // The visitor only reads the value
+        dom_value* v = const_cast<dom_value*>(*it);
         if (v->member() != nullptr)
-            w.write(L"\"").write(json::to_escaped(v->member()->name())).write(L"\"").write(m_conf.pretty_print() ? L": " : L":");
-        dom_document_writer_visitor visitor(w, endings);
+        {
+            buffer.assign(1, L'"');
+            json::append_escaped(buffer, v->member()->name());
+            buffer += (m_conf.pretty_print() ? L"\": " : L"\":");
+            w.write(buffer);
+        }
+        dom_document_writer_visitor visitor(w, endings, buffer);
         v->accept(visitor);
         dom_document::const_iterator::path_t prev_path = it.path();
         ++it;
@@ -176,90 +197,465 @@ void dom_document_writer::write_to_file(const std::wstring file_name, const iout
 
 
 /*
- * dom_document_generator class
+ * sax_writer class
  */
-dom_document_generator::dom_document_generator(json::dom_document& doc)
-    : m_doc(doc)
+sax_writer::sax_writer(ioutils::text_writer& writer)
+    : m_writer(writer)
 { }
 
-void dom_document_generator::run()
+void sax_writer::begin_value()
 {
-    int level_count = conf().depth();
-    if (level_count == 1)
+    if (m_after_name)
+        m_after_name = false;
+    else if (!m_has_items.empty())
     {
-        m_doc.root(generate_value(random_value_type()));
+        if (m_has_items.back())
+            m_writer.write(L',');
+        m_has_items.back() = true;
     }
+}
+
+void sax_writer::on_literal(const json::dom_literal_type, const std::wstring& text)
+{
+    begin_value();
+    m_writer.write(text);
+}
+
+void sax_writer::on_number(const json::dom_number_type, const std::wstring& text)
+{
+    begin_value();
+    m_writer.write(text);
+}
+
+void sax_writer::on_string(const std::wstring& text)
+{
+    begin_value();
+    m_buffer.assign(1, L'"');
+    json::append_escaped(m_buffer, text);
+    m_buffer += L'"';
+    m_writer.write(m_buffer);
+}
+
+void sax_writer::on_begin_object()
+{
+    begin_value();
+    m_writer.write(L'{');
+    m_has_items.push_back(false);
+}
+
+void sax_writer::on_member_name(const std::wstring& text)
+{
+    if (m_has_items.back())
+        m_buffer.assign(L",\"");
     else
+        m_buffer.assign(1, L'"');
+    m_has_items.back() = true;
+    json::append_escaped(m_buffer, text);
+    m_buffer += L"\":";
+    m_writer.write(m_buffer);
+    m_after_name = true;
+}
+
+void sax_writer::on_end_object(const std::size_t)
+{
+    m_has_items.pop_back();
+    m_writer.write(L'}');
+}
+
+void sax_writer::on_begin_array()
+{
+    begin_value();
+    m_writer.write(L'[');
+    m_has_items.push_back(false);
+}
+
+void sax_writer::on_end_array(const std::size_t)
+{
+    m_has_items.pop_back();
+    m_writer.write(L']');
+}
+
+
+/*
+ * csv_converter class
+ */
+namespace
+{
+    // Output is passed to the text writer by blocks of this size
+    const size_t csv_converter_block_size = 65536;
+
+    // RFC 8259 number: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+    bool is_json_number(const std::wstring_view text)
     {
-        containers_t conts;
-        conts.push_back(generate_value(random_value_container_type()));
-        m_doc.root(conts.back());
-        generate_level(2, level_count, conts);
+        size_t i = 0;
+        auto digits = [&]() -> size_t
+        {
+            const size_t start = i;
+            while (i < text.length() && text[i] >= L'0' && text[i] <= L'9')
+                i++;
+            return i - start;
+        };
+        if (i < text.length() && text[i] == L'-')
+            i++;
+        const size_t int_start = i;
+        const size_t int_digits = digits();
+        if (int_digits == 0 || (int_digits > 1 && text[int_start] == L'0'))
+            return false;
+        if (i < text.length() && text[i] == L'.')
+        {
+            i++;
+            if (digits() == 0)
+                return false;
+        }
+        if (i < text.length() && (text[i] == L'e' || text[i] == L'E'))
+        {
+            i++;
+            if (i < text.length() && (text[i] == L'+' || text[i] == L'-'))
+                i++;
+            if (digits() == 0)
+                return false;
+        }
+        return i == text.length();
     }
 }
 
-void dom_document_generator::generate_level(const int curr_level, const int level_count, const containers_t& parents)
+csv_converter::csv_converter(csv::reader& reader)
+    : m_reader(reader)
+{ }
+
+bool csv_converter::write(ioutils::text_writer& w)
 {
-    bool is_last_level = curr_level == level_count;
-    bool no_more_containers = is_last_level;
-    bool container_required = !is_last_level;
-    for (dom_value* parent : parents)
+    if (!m_reader.has_header() && !m_reader.read_header())
+    {
+        w.write(L"[]");
+        return !m_reader.has_error();
+    }
+    // Escaped member names with preceding separators are prepared once
+    const csv::header& header = m_reader.header();
+    vector<wstring> names;
+    for (size_t i = 0; i < header.field_count(); i++)
     {
-        containers_t conts;
-        int value_count = m_rnd.random_range(1, conf().avg_children() * 2);
-        for (int i = 0; i < value_count; i++)
+        wstring name(i == 0 ? L"{\"" : L",\"");
+        json::append_escaped(name, header[i].value());
+        name += L"\":";
+        names.push_back(name);
+    }
+    wstring buffer(1, L'[');
+    csv::row_view r;
+    bool is_first_row = true;
+    while (m_reader.next_row(r))
+    {
+        if (!is_first_row)
+            buffer += L',';
+        is_first_row = false;
+        for (size_t i = 0; i < r.field_count(); i++)
         {
-            dom_value* child;
-            if (i == value_count - 1 && conts.empty() && container_required)
-                child = generate_value(random_value_container_type());
+            buffer += names[i];
+            const wstring_view value = r[i];
+            if (m_conf.m_detect_numbers && is_json_number(value))
+                buffer.append(value);
             else
             {
-                if (no_more_containers)
-                    child = generate_value(random_value_scalar_type());
-                else
-                    child = generate_value(random_value_type());
+                buffer += L'"';
+                json::append_escaped(buffer, value);
+                buffer += L'"';
+            }
+        }
+        buffer += r.field_count() == 0 ? L"{}" : L"}";
+        if (buffer.length() >= csv_converter_block_size)
+        {
+            w.write(buffer);
+            buffer.clear();
+        }
+    }
+    buffer += L']';
+    w.write(buffer);
+    return !m_reader.has_error();
+}
+
+bool csv_converter::write(std::wostream& stream)
+{
+    ioutils::text_writer w(stream);
+    return write(w);
+}
+
+bool csv_converter::write(std::wstring& ws)
+{
+    wstringstream ss;
+    bool result = write(ss);
+    ws = ss.str();
+    return result;
+}
+
+bool csv_converter::write_to_file(const std::wstring file_name, const ioutils::text_io_policy& policy)
+{
+    ioutils::text_writer w(file_name, policy);
+    return write(w);
+}
+
+
+/*
+ * dom_document_generator class
+ */
+std::string to_string(const dom_document_shape value)
+{
+    switch (value)
+    {
+    case dom_document_shape::mixed: return "mixed";
+    case dom_document_shape::wide_flat: return "wide_flat";
+    case dom_document_shape::deep: return "deep";
+    case dom_document_shape::number_heavy: return "number_heavy";
+    case dom_document_shape::string_heavy: return "string_heavy";
+    case dom_document_shape::unicode_heavy: return "unicode_heavy";
+    default: return "unknown";
+    }
+}
+
+std::wstring to_wstring(const dom_document_shape value)
+{
+    return str::to_wstring(to_string(value));
+}
+
+void dom_document_generator::config::shape(const dom_document_shape value) noexcept
+{
+    m_shape = value;
+    m_name_char_range = locutils::wchar_range(0x21, 0x7E);
+    m_value_char_range = locutils::wchar_range();
+    m_avg_string_length = default_avg_string_length();
+    switch (value)
+    {
+    case dom_document_shape::wide_flat:
+        m_depth = 2;
+        m_avg_children = 50;
+        m_avg_string_length = 20;
+        break;
+    case dom_document_shape::deep:
+        m_depth = 32;
+        m_avg_children = 2;
+        m_avg_string_length = 20;
+        break;
+    case dom_document_shape::string_heavy:
+        m_depth = 4;
+        m_avg_children = 8;
+        m_avg_string_length = 200;
+        m_value_char_range = locutils::wchar_range(0x20, 0x7E);
+        break;
+    case dom_document_shape::unicode_heavy:
+        m_depth = 4;
+        m_avg_children = 8;
+        m_avg_string_length = 200;
+        // Cyrillic to CJK, no surrogates
+        m_name_char_range = locutils::wchar_range(0x0410, 0x044F);
+        m_value_char_range = locutils::wchar_range(0x0400, 0x9FFF);
+        break;
+    case dom_document_shape::number_heavy:
+    case dom_document_shape::mixed:
+    default:
+        m_depth = 4;
+        m_avg_children = default_avg_children();
+    }
+}
+
+dom_document_generator::dom_document_generator()
+{ }
+
+dom_document_generator::dom_document_generator(json::dom_document& doc)
+    : m_doc(&doc)
+{ }
+
+json::dom_document& dom_document_generator::doc() const noexcept(false)
+{
+    if (m_doc == nullptr)
+        throw dom_exception(L"Generator has no document", dom_error::document_is_null);
+    return *m_doc;
+}
+
+void dom_document_generator::run()
+{
+    json::dom_document& target = doc();
+    target.clear();
+    msg_collector_t msgs;
+    dom_handler handler(target, msgs, L"");
+    run(handler);
+}
+
+void dom_document_generator::run(json::sax_handler_intf& handler)
+{
+    if (m_config.has_seed())
+        m_rnd.seed(m_config.seed());
+    m_size = 0;
+    m_record_names.clear();
+    m_record_types.clear();
+    if (m_config.shape() == dom_document_shape::wide_flat)
+    {
+        std::unordered_set<wstring> names;
+        while (m_record_names.size() < m_config.avg_children())
+        {
+            wstring name = random_member_name();
+            if (names.insert(name).second)
+            {
+                m_record_names.push_back(name);
+                m_record_types.push_back(random_value_scalar_type());
             }
-            if (child->is_container())
-                conts.push_back(child);
-            wstring name = m_rnd.random_wstring(3, 32, m_config.name_char_range());
-            dom_append_child_visitor creator(name, child);
-            parent->accept(creator);
         }
-        if (!is_last_level)
-            generate_level(curr_level + 1, level_count, conts);
     }
+    if (m_config.target_size() == 0 && m_config.shape() != dom_document_shape::wide_flat)
+    {
+        if (m_config.depth() == 1)
+            generate_value(handler, random_value_type(), 1);
+        else
+            generate_value(handler, random_value_container_type(), 1);
+        return;
+    }
+    // Root array of subtrees or records
+    handler.on_begin_array();
+    add_size(2);
+    std::size_t count = 0;
+    std::size_t record_count = m_config.target_size() == 0 ?
+        m_rnd.random_range(1, m_config.avg_children() * 2) :
+        numeric_limits<std::size_t>::max();
+    while (count < record_count && !is_size_reached())
+    {
+        if (count > 0)
+            add_size(1);
+        if (m_config.shape() == dom_document_shape::wide_flat)
+            generate_record(handler);
+        else if (m_config.depth() <= 2)
+            generate_scalar(handler, random_value_scalar_type());
+        else
+            generate_value(handler, random_value_type(), 2);
+        count++;
+    }
+    handler.on_end_array(count);
 }
 
-json::dom_value* dom_document_generator::generate_array()
+void dom_document_generator::write(ioutils::text_writer& writer)
 {
-    dom_array* arr = m_doc.create_array();
-    return arr;
+    sax_writer handler(writer);
+    run(handler);
 }
 
-json::dom_value* dom_document_generator::generate_object()
+void dom_document_generator::write(std::wostream& stream)
 {
-    dom_object* obj = m_doc.create_object();
-    return obj;
+    ioutils::text_writer w(stream);
+    write(w);
+}
+
+void dom_document_generator::write_to_file(const std::wstring file_name, const ioutils::text_io_policy& policy)
+{
+    ioutils::text_writer w(file_name, policy);
+    write(w);
 }
 
-json::dom_value* dom_document_generator::generate_value(json::dom_value_type type)
+void dom_document_generator::generate_container(json::sax_handler_intf& handler, const json::dom_value_type type, const unsigned int level)
+{
+    const bool is_object = type == dom_value_type::vt_object;
+    if (is_object)
+        handler.on_begin_object();
+    else
+        handler.on_begin_array();
+    add_size(2);
+    std::size_t value_count = 0;
+    // Only the containers of last level are empty
+    if (level < m_config.depth())
+    {
+        const bool is_last_level = level + 1 == m_config.depth();
+        value_count = m_rnd.random_range(1, m_config.avg_children() * 2);
+        bool has_containers = false;
+        std::unordered_set<wstring> names;
+        for (std::size_t i = 0; i < value_count; i++)
+        {
+            // Sized documents stop growing in depth and in width when the target is reached
+            if (is_size_reached())
+            {
+                value_count = i;
+                break;
+            }
+            dom_value_type child_type;
+            if (i == value_count - 1 && !has_containers && !is_last_level)
+                child_type = random_value_container_type();
+            else if (is_last_level)
+                child_type = random_value_scalar_type();
+            else
+                child_type = random_value_type();
+            has_containers = has_containers || child_type == dom_value_type::vt_array || child_type == dom_value_type::vt_object;
+            if (i > 0)
+                add_size(1);
+            if (is_object)
+            {
+                wstring name = random_member_name();
+                while (!names.insert(name).second)
+                    name = random_member_name();
+                handler.on_member_name(name);
+                add_size(name.length() + 3);
+            }
+            generate_value(handler, child_type, level + 1);
+        }
+    }
+    if (is_object)
+        handler.on_end_object(value_count);
+    else
+        handler.on_end_array(value_count);
+}
+
+void dom_document_generator::generate_record(json::sax_handler_intf& handler)
+{
+    handler.on_begin_object();
+    add_size(2);
+    for (std::size_t i = 0; i < m_record_names.size(); i++)
+    {
+        if (i > 0)
+            add_size(1);
+        handler.on_member_name(m_record_names[i]);
+        add_size(m_record_names[i].length() + 3);
+        generate_scalar(handler, m_record_types[i]);
+    }
+    handler.on_end_object(m_record_names.size());
+}
+
+void dom_document_generator::generate_scalar(json::sax_handler_intf& handler, const json::dom_value_type type)
 {
     switch (type)
     {
-    case dom_value_type::vt_array:
-        return generate_array();
     case dom_value_type::vt_literal:
-        return m_doc.create_literal(random_literal_name());
+    {
+        wstring name = random_literal_name();
+        handler.on_literal(json::to_literal_type(name), name);
+        add_size(name.length());
+        break;
+    }
     case dom_value_type::vt_number:
         if (m_rnd.random_bool())
-            return m_doc.create_number((int32_t)m_rnd.random_range(numeric_limits<int>::min(), numeric_limits<int>::max()));
-        return m_doc.create_number(std::pow(10.0f, m_rnd.random_range(-20, 20)) * (m_rnd.random_float() - 0.5));
-    case dom_value_type::vt_object:
-        return generate_object();
+        {
+            const int64_t value = m_rnd.random_range(numeric_limits<int>::min(), numeric_limits<int>::max());
+            wstring text = std::to_wstring(value);
+            handler.on_number(dom_number_type::nvt_int, text, parsers::numeric_value(value));
+            add_size(text.length());
+        }
+        else
+        {
+            const double value = std::pow(10.0f, m_rnd.random_range(-20, 20)) * (m_rnd.random_float() - 0.5);
+            wstring text = dom_number::to_text(value);
+            handler.on_number(dom_number_type::nvt_float, text, parsers::numeric_value(value));
+            add_size(text.length());
+        }
+        break;
     case dom_value_type::vt_string:
     default:
-        return m_doc.create_string(m_rnd.random_wstring(conf().avg_string_length(), conf().value_char_range()));
+    {
+        wstring text = m_rnd.random_wstring(m_config.avg_string_length(), m_config.value_char_range());
+        handler.on_string(text);
+        add_size(text.length() + 2);
     }
+    }
+}
+
+void dom_document_generator::generate_value(json::sax_handler_intf& handler, const json::dom_value_type type, const unsigned int level)
+{
+    if (type == dom_value_type::vt_array || type == dom_value_type::vt_object)
+        generate_container(handler, type, level);
+    else
+        generate_scalar(handler, type);
 }
 
 std::wstring dom_document_generator::random_literal_name()
@@ -272,25 +668,47 @@ std::wstring dom_document_generator::random_literal_name()
     }
 }
 
+std::wstring dom_document_generator::random_member_name()
+{
+    return m_rnd.random_wstring(3, 32, m_config.name_char_range());
+}
+
 json::dom_value_type dom_document_generator::random_value_type()
 {
     switch (m_rnd.random_range(1, 5))
     {
     case 1: return dom_value_type::vt_array;
-    case 2: return dom_value_type::vt_literal;
-    case 3: return dom_value_type::vt_number;
-    case 4: return dom_value_type::vt_object;
-    default: return dom_value_type::vt_string;
+    case 2: return dom_value_type::vt_object;
+    default: return random_value_scalar_type();
     }
 }
 
 json::dom_value_type dom_document_generator::random_value_scalar_type()
 {
-    switch (m_rnd.random_range(1, 3))
+    switch (m_config.shape())
     {
-    case 1: return dom_value_type::vt_literal;
-    case 2: return dom_value_type::vt_number;
-    default: return dom_value_type::vt_string;
+    case dom_document_shape::number_heavy:
+        switch (m_rnd.random_range(1, 10))
+        {
+        case 1: return dom_value_type::vt_literal;
+        case 2: return dom_value_type::vt_string;
+        default: return dom_value_type::vt_number;
+        }
+    case dom_document_shape::string_heavy:
+    case dom_document_shape::unicode_heavy:
+        switch (m_rnd.random_range(1, 10))
+        {
+        case 1: return dom_value_type::vt_literal;
+        case 2: return dom_value_type::vt_number;
+        default: return dom_value_type::vt_string;
+        }
+    default:
+        switch (m_rnd.random_range(1, 3))
+        {
+        case 1: return dom_value_type::vt_literal;
+        case 2: return dom_value_type::vt_number;
+        default: return dom_value_type::vt_string;
+        }
     }
 }
 
@@ -309,6 +727,7 @@ std::string to_string(const dom_document_diff_kind value)
     switch(value)
     {
     case dom_document_diff_kind::count_diff: return "count";
+    case dom_document_diff_kind::member_name_diff: return "member_name";
     case dom_document_diff_kind::path_diff: return "path";
     case dom_document_diff_kind::type_diff: return "type";
     case dom_document_diff_kind::numtype_diff: return "numtype";
@@ -342,51 +761,601 @@ json::dom_document_diff make_diff(const json::dom_document& ldoc, const json::do
     return json::make_diff(ldoc, rdoc, options);
 }
 
+namespace
+{
+    bool equal_subtrees(const dom_value* lv, const dom_value* rv)
+    {
+        if (lv->type() != rv->type())
+            return false;
+        switch (lv->type())
+        {
+        case dom_value_type::vt_array:
+        {
+            const dom_array* larr = dynamic_cast<const dom_array*>(lv);
+            const dom_array* rarr = dynamic_cast<const dom_array*>(rv);
+            if (larr->size() != rarr->size())
+                return false;
+            dom_array::const_iterator r_it = rarr->begin();
+            for (dom_array::const_iterator l_it = larr->begin(); l_it != larr->end(); ++l_it, ++r_it)
+            {
+                if (!equal_subtrees(*l_it, *r_it))
+                    return false;
+            }
+            return true;
+        }
+        case dom_value_type::vt_object:
+        {
+            // Member order is ignored as in the object hash
+            const dom_object* lobj = dynamic_cast<const dom_object*>(lv);
+            const dom_object* robj = dynamic_cast<const dom_object*>(rv);
+            if (lobj->size() != robj->size())
+                return false;
+            for (const dom_object_member* lmember : *lobj->cmembers())
+            {
+                const dom_object_member* rmember = robj->find(lmember->name());
+                if (rmember == nullptr || !equal_subtrees(lmember->value(), rmember->value()))
+                    return false;
+            }
+            return true;
+        }
+        case dom_value_type::vt_number:
+            if (dynamic_cast<const dom_number*>(lv)->numtype() != dynamic_cast<const dom_number*>(rv)->numtype())
+                return false;
+            [[fallthrough]];
+        default:
+            return lv->text() == rv->text();
+        }
+    }
+
+    // Cached subtree hashes let different subtrees be rejected without walking them,
+    // values are compared when hashes are equal because hashes may collide
+    bool is_same_subtree(const dom_value* lv, const dom_value* rv)
+    {
+        return lv->type() == rv->type() && lv->hash() == rv->hash() && equal_subtrees(lv, rv);
+    }
+
+    class dom_document_differ
+    {
+    public:
+        // Locale should live while the differ is used
+        dom_document_differ(dom_document_diff& diff, const dom_document_diff_options& options, const std::locale& loc)
+            : m_diff(diff), m_options(options), m_ctype(std::use_facet<std::ctype<wchar_t>>(loc))
+        {}
+    public:
+        bool is_stopped() const noexcept { return m_diff.has_differences() && !m_options.compare_all(); }
+        void append(const dom_document_diff_kind kind, const dom_value* lv, const dom_value* rv)
+        {
+            m_diff.append(dom_document_diff_item(kind, lv, rv));
+        }
+        void compare_members(const dom_object* lobj, const dom_object* robj);
+        void compare_values(const dom_value* lv, const dom_value* rv);
+        bool equal_names(const dom_value* lv, const dom_value* rv) const;
+        bool equal_texts(const std::wstring& ltext, const std::wstring& rtext) const;
+        // Members which are already matched are skipped
+        const dom_object_member* find_member(const dom_object* obj, const dom_object_member::name_t& name,
+                                             const std::unordered_set<const dom_object_member*>& matched) const;
+        void walk(dom_document::const_iterator l_it, dom_document::const_iterator r_it);
+    private:
+        dom_document_diff& m_diff;
+        const dom_document_diff_options& m_options;
+        const std::ctype<wchar_t>& m_ctype;
+    };
+
+    // Case insensitive comparison uses the user locale as locutils::utf16::equal_ci but without switching
+    // the global one, so each thread can have own locale object
+    std::locale diff_locale(const dom_document_diff_options& options)
+    {
+        if (options.case_sensitive())
+            return std::locale::classic();
+        try
+        {
+            return std::locale("");
+        }
+        catch (const std::runtime_error&)
+        {
+            return std::locale::classic();
+        }
+    }
+
+    bool dom_document_differ::equal_texts(const std::wstring& ltext, const std::wstring& rtext) const
+    {
+        if (m_options.case_sensitive())
+            return ltext == rtext;
+        if (ltext.length() != rtext.length())
+            return false;
+        for (std::size_t i = 0; i < ltext.length(); i++)
+        {
+            if (ltext[i] != rtext[i] && m_ctype.tolower(ltext[i]) != m_ctype.tolower(rtext[i]))
+                return false;
+        }
+        return true;
+    }
+
+    bool dom_document_differ::equal_names(const dom_value* lv, const dom_value* rv) const
+    {
+        if (lv->member() == nullptr || rv->member() == nullptr)
+            return lv->member() == rv->member();
+        return equal_texts(lv->member()->name(), rv->member()->name());
+    }
+
+    const dom_object_member* dom_document_differ::find_member(const dom_object* obj, const dom_object_member::name_t& name,
+                                                              const std::unordered_set<const dom_object_member*>& matched) const
+    {
+        if (m_options.case_sensitive())
+        {
+            const dom_object_member* member = obj->find(name);
+            return member != nullptr && matched.find(member) == matched.end() ? member : nullptr;
+        }
+        for (const dom_object_member* member : *obj->cmembers())
+        {
+            if (matched.find(member) == matched.end() && equal_texts(member->name(), name))
+                return member;
+        }
+        return nullptr;
+    }
+
+    void dom_document_differ::compare_members(const dom_object* lobj, const dom_object* robj)
+    {
+        // Members are matched by name, the remaining ones are compared in order of appearance
+        std::vector<const dom_object_member*> lrest;
+        std::unordered_set<const dom_object_member*> rmatched;
+        for (const dom_object_member* lmember : *lobj->cmembers())
+        {
+            const dom_object_member* rmember = find_member(robj, lmember->name(), rmatched);
+            if (rmember == nullptr)
+                lrest.push_back(lmember);
+            else
+            {
+                rmatched.insert(rmember);
+                compare_values(lmember->value(), rmember->value());
+            }
+            if (is_stopped())
+                return;
+        }
+        std::size_t i = 0;
+        for (const dom_object_member* rmember : *robj->cmembers())
+        {
+            if (i >= lrest.size() || is_stopped())
+                break;
+            if (rmatched.find(rmember) != rmatched.end())
+                continue;
+            append(dom_document_diff_kind::member_name_diff, lrest[i]->value(), rmember->value());
+            compare_values(lrest[i]->value(), rmember->value());
+            i++;
+        }
+    }
+
+    void dom_document_differ::compare_values(const dom_value* lv, const dom_value* rv)
+    {
+        if (is_stopped() || is_same_subtree(lv, rv))
+            return;
+        if (lv->type() != rv->type())
+        {
+            append(dom_document_diff_kind::type_diff, lv, rv);
+            return;
+        }
+        switch (lv->type())
+        {
+        case dom_value_type::vt_array:
+        {
+            const dom_array* larr = dynamic_cast<const dom_array*>(lv);
+            const dom_array* rarr = dynamic_cast<const dom_array*>(rv);
+            if (larr->size() != rarr->size())
+                append(dom_document_diff_kind::count_diff, lv, rv);
+            dom_array::const_iterator l_it = larr->begin();
+            dom_array::const_iterator r_it = rarr->begin();
+            for (; l_it != larr->end() && r_it != rarr->end() && !is_stopped(); ++l_it, ++r_it)
+                compare_values(*l_it, *r_it);
+            break;
+        }
+        case dom_value_type::vt_object:
+        {
+            const dom_object* lobj = dynamic_cast<const dom_object*>(lv);
+            const dom_object* robj = dynamic_cast<const dom_object*>(rv);
+            if (lobj->size() != robj->size())
+                append(dom_document_diff_kind::count_diff, lv, rv);
+            compare_members(lobj, robj);
+            break;
+        }
+        case dom_value_type::vt_number:
+            if (dynamic_cast<const dom_number*>(lv)->numtype() != dynamic_cast<const dom_number*>(rv)->numtype())
+                append(dom_document_diff_kind::numtype_diff, lv, rv);
+            [[fallthrough]];
+        default:
+            if (!equal_texts(lv->text(), rv->text()))
+                append(dom_document_diff_kind::value_diff, lv, rv);
+        }
+    }
+
+    void dom_document_differ::walk(dom_document::const_iterator l_it, dom_document::const_iterator r_it)
+    {
+        while (!l_it.is_end() && !r_it.is_end() && !is_stopped())
+        {
+            const dom_value* lv = l_it.value();
+            const dom_value* rv = r_it.value();
+            const bool is_same_path = l_it.path() == r_it.path();
+            if (is_same_path && is_same_subtree(lv, rv) && equal_names(lv, rv))
+            {
+                l_it.skip();
+                r_it.skip();
+                continue;
+            }
+            if (lv->type() != rv->type())
+                append(dom_document_diff_kind::type_diff, lv, rv);
+            if (lv->type() == json::dom_value_type::vt_number)
+            {
+                const json::dom_number* ln = dynamic_cast<const json::dom_number*>(lv);
+                const json::dom_number* rn = dynamic_cast<const json::dom_number*>(rv);
+                if (ln != nullptr && rn != nullptr && ln->numtype() != rn->numtype())
+                    append(dom_document_diff_kind::numtype_diff, lv, rv);
+            }
+            if (!is_same_path)
+                append(dom_document_diff_kind::path_diff, lv, rv);
+            if (l_it->is_container() && r_it->is_container())
+            {
+                if (l_it->as_container()->count() != r_it->as_container()->count())
+                    append(dom_document_diff_kind::count_diff, lv, rv);
+            }
+            if (lv->member() != nullptr && rv->member() != nullptr && !equal_names(lv, rv))
+                append(dom_document_diff_kind::member_name_diff, lv, rv);
+            if (!equal_texts(lv->text(), rv->text()))
+                append(dom_document_diff_kind::value_diff, lv, rv);
+            if (is_same_path && lv->type() == dom_value_type::vt_object && rv->type() == dom_value_type::vt_object)
+            {
+                // Objects are compared by member names regardless of their order
+                compare_members(dynamic_cast<const dom_object*>(lv), dynamic_cast<const dom_object*>(rv));
+                l_it.skip();
+                r_it.skip();
+            }
+            else
+            {
+                ++l_it;
+                ++r_it;
+            }
+        }
+    }
+}
+
 json::dom_document_diff make_diff(const json::dom_document& ldoc,
                                   const json::dom_document& rdoc,
                                   const dom_document_diff_options& options)
 {
     json::dom_document_diff diff;
-    dom_document::const_iterator l_it = ldoc.begin();
-    dom_document::const_iterator l_end = ldoc.end();
-    dom_document::const_iterator r_it = rdoc.begin();
-    dom_document::const_iterator r_end = rdoc.end();
-    while (l_it != l_end && r_it != r_end && (!diff.has_differences() || options.compare_all()))
-    {
-        if (l_it->type() != r_it->type())
-            diff.append(dom_document_diff_item(dom_document_diff_kind::type_diff, l_it.value(), r_it.value()));
-        if (l_it->type() == json::dom_value_type::vt_number)
-        {
-            const json::dom_number* ln = dynamic_cast<const json::dom_number*>(l_it.value());
-            const json::dom_number* rn = dynamic_cast<const json::dom_number*>(r_it.value());
-            if (ln != nullptr && rn != nullptr && ln->numtype() != rn->numtype())
-                diff.append(dom_document_diff_item(dom_document_diff_kind::numtype_diff, l_it.value(), r_it.value()));
-        }
-        if (l_it.path() != r_it.path())
-            diff.append(dom_document_diff_item(dom_document_diff_kind::path_diff, l_it.value(), r_it.value()));
-        if (l_it->is_container())
-        {
-            if (l_it->as_container()->count() != r_it->as_container()->count())
-                diff.append(dom_document_diff_item(dom_document_diff_kind::count_diff, l_it.value(), r_it.value()));
-        }
-        if (l_it->member() != nullptr)
-        {
-            bool are_equal = options.case_sensitive() ?
-                (l_it->member()->name() == r_it->member()->name()) :
-                locutils::utf16::equal_ci(l_it->member()->name(), r_it->member()->name());
-            if (!are_equal)
-                diff.append(dom_document_diff_item(dom_document_diff_kind::member_name_diff, l_it.value(), r_it.value()));
-        }
-        bool are_equal = options.case_sensitive() ?
-                    (l_it->text() == r_it->text()) :
-                    locutils::utf16::equal_ci(l_it->text(), r_it->text());
-        if (!are_equal)
-            diff.append(dom_document_diff_item(dom_document_diff_kind::value_diff, l_it.value(), r_it.value()));
-        ++l_it;
-        ++r_it;
+    const std::locale loc = diff_locale(options);
+    dom_document_differ differ(diff, options, loc);
+    differ.walk(ldoc.begin(), rdoc.begin());
+    return diff;
+}
+
+json::dom_document_diff make_diff_parallel(const json::dom_document& ldoc,
+                                           const json::dom_document& rdoc,
+                                           const dom_document_diff_options& options,
+                                           std::size_t thread_count)
+{
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    const dom_value* lroot = ldoc.root();
+    const dom_value* rroot = rdoc.root();
+    if (thread_count < 2 || lroot == nullptr || rroot == nullptr ||
+        lroot->type() != rroot->type() || !lroot->is_container())
+        return make_diff(ldoc, rdoc, options);
+    // Fill hash caches before sharing the documents between threads
+    if (is_same_subtree(lroot, rroot))
+        return json::dom_document_diff();
+    const std::locale loc = diff_locale(options);
+    json::dom_document_diff diff;
+    dom_document_differ differ(diff, options, loc);
+    // Root checks are the same as the first step of make_diff
+    typedef std::pair<const dom_value*, const dom_value*> pair_t;
+    std::vector<pair_t> pairs;
+    std::vector<bool> renamed;
+    if (lroot->type() == dom_value_type::vt_array)
+    {
+        const dom_array* larr = dynamic_cast<const dom_array*>(lroot);
+        const dom_array* rarr = dynamic_cast<const dom_array*>(rroot);
+        if (larr->size() != rarr->size())
+            differ.append(dom_document_diff_kind::count_diff, lroot, rroot);
+        dom_array::const_iterator l_it = larr->begin();
+        dom_array::const_iterator r_it = rarr->begin();
+        for (; l_it != larr->end() && r_it != rarr->end(); ++l_it, ++r_it)
+            pairs.push_back(pair_t(*l_it, *r_it));
+        renamed.resize(pairs.size(), false);
+    }
+    else
+    {
+        const dom_object* lobj = dynamic_cast<const dom_object*>(lroot);
+        const dom_object* robj = dynamic_cast<const dom_object*>(rroot);
+        if (lobj->size() != robj->size())
+            differ.append(dom_document_diff_kind::count_diff, lroot, rroot);
+        // Same member matching as in make_diff
+        std::vector<const dom_object_member*> lrest;
+        std::unordered_set<const dom_object_member*> rmatched;
+        for (const dom_object_member* lmember : *lobj->cmembers())
+        {
+            const dom_object_member* rmember = differ.find_member(robj, lmember->name(), rmatched);
+            if (rmember == nullptr)
+                lrest.push_back(lmember);
+            else
+            {
+                rmatched.insert(rmember);
+                pairs.push_back(pair_t(lmember->value(), rmember->value()));
+            }
+        }
+        renamed.resize(pairs.size(), false);
+        std::size_t i = 0;
+        for (const dom_object_member* rmember : *robj->cmembers())
+        {
+            if (i >= lrest.size())
+                break;
+            if (rmatched.find(rmember) != rmatched.end())
+                continue;
+            pairs.push_back(pair_t(lrest[i]->value(), rmember->value()));
+            renamed.push_back(true);
+            i++;
+        }
+    }
+    if (differ.is_stopped())
+        return diff;
+    // Workers take pairs in order, each pair has own result so the merge order does not depend on scheduling
+    std::vector<json::dom_document_diff> results(pairs.size());
+    std::atomic<std::size_t> next_pair(0);
+    std::atomic<std::size_t> first_found(pairs.size());
+    auto worker = [&]()
+    {
+        const std::locale worker_loc = diff_locale(options);
+        std::size_t i;
+        while ((i = next_pair++) < pairs.size())
+        {
+            // Without compare_all only differences of the first differing pair are reported
+            if (!options.compare_all() && i > first_found)
+                break;
+            dom_document_differ pair_differ(results[i], options, worker_loc);
+            const dom_value* lv = pairs[i].first;
+            const dom_value* rv = pairs[i].second;
+            if (renamed[i])
+                pair_differ.append(dom_document_diff_kind::member_name_diff, lv, rv);
+            if (lroot->type() == dom_value_type::vt_array)
+                pair_differ.walk(dom_document::const_iterator(ldoc, lv), dom_document::const_iterator(rdoc, rv));
+            else
+                pair_differ.compare_values(lv, rv);
+            std::size_t found = first_found;
+            while (results[i].has_differences() && i < found && !first_found.compare_exchange_weak(found, i))
+            { }
+        }
+    };
+    std::vector<std::thread> threads;
+    thread_count = std::min(thread_count, pairs.size());
+    for (std::size_t i = 1; i < thread_count; i++)
+        threads.push_back(std::thread(worker));
+    worker();
+    for (std::thread& t : threads)
+        t.join();
+    for (const json::dom_document_diff& result : results)
+    {
+        for (const json::dom_document_diff_item& item : result.items())
+            diff.append(item);
+        if (differ.is_stopped())
+            break;
     }
     return diff;
 }
 
+/*
+ * stream_diff_item class
+ */
+std::string stream_diff_item::to_string() const
+{
+    return str::to_string(this->to_wstring());
+}
+
+std::wstring stream_diff_item::to_wstring() const
+{
+    return str::wformat(L"Kind: %ls\nPath: %ls\nLeft (%d, %d):\n\t%ls\nRight (%d, %d):\n\t%ls",
+                        json::to_wstring(m_kind).c_str(),
+                        m_path.c_str(),
+                        m_lpos.line(), m_lpos.col(),
+                        m_ltext.c_str(),
+                        m_rpos.line(), m_rpos.col(),
+                        m_rtext.c_str());
+}
+
+/*
+ * stream_diff class
+ */
+namespace
+{
+    dom_value_type to_value_type(const event_reader& reader)
+    {
+        switch (reader.kind())
+        {
+        case event_kind::begin_array: return dom_value_type::vt_array;
+        case event_kind::begin_object: return dom_value_type::vt_object;
+        case event_kind::literal: return dom_value_type::vt_literal;
+        case event_kind::number: return dom_value_type::vt_number;
+        default: return dom_value_type::vt_string;
+        }
+    }
+}
+
+stream_diff::stream_diff(ioutils::text_reader& lreader,
+                         ioutils::text_reader& rreader,
+                         stream_diff_handler_intf& handler,
+                         const dom_document_diff_options& options)
+    : m_lreader(lreader), m_rreader(rreader), m_handler(handler), m_options(options)
+{ }
+
+void stream_diff::add_diff(const dom_document_diff_kind kind,
+                           const parsers::textpos& lpos,
+                           const parsers::textpos& rpos,
+                           const std::wstring& ltext,
+                           const std::wstring& rtext)
+{
+    m_diff_count++;
+    m_handler.on_diff(stream_diff_item(kind, path(), lpos, rpos, ltext, rtext));
+}
+
+std::wstring stream_diff::path() const
+{
+    wstring result;
+    for (const wstring& name : m_path)
+    {
+        result += L'/';
+        for (const wchar_t c : name)
+        {
+            if (c == L'~')
+                result += L"~0";
+            else if (c == L'/')
+                result += L"~1";
+            else
+                result += c;
+        }
+    }
+    return result;
+}
+
+bool stream_diff::compare_text(const std::wstring& ltext, const std::wstring& rtext) const
+{
+    return m_options.case_sensitive() ? ltext == rtext : locutils::utf16::equal_ci(ltext, rtext);
+}
+
+bool stream_diff::run()
+{
+    m_diff_count = 0;
+    m_path.clear();
+    event_reader lreader(m_lreader, m_lmessages);
+    event_reader rreader(m_rreader, m_rmessages);
+    bool lhas_value = lreader.next();
+    bool rhas_value = rreader.next();
+    if (lhas_value && rhas_value)
+    {
+        if (!compare_value(lreader, rreader) || is_stopped())
+            return !lreader.has_errors() && !rreader.has_errors();
+        lhas_value = lreader.next();
+        rhas_value = rreader.next();
+    }
+    if (lhas_value != rhas_value)
+        add_diff(dom_document_diff_kind::count_diff,
+                 lreader.current().pos(), rreader.current().pos(),
+                 lhas_value ? L"1" : L"0",
+                 rhas_value ? L"1" : L"0");
+    return !lreader.has_errors() && !rreader.has_errors();
+}
+
+bool stream_diff::compare_value(event_reader& lreader, event_reader& rreader)
+{
+    const dom_value_type ltype = to_value_type(lreader);
+    if (ltype != to_value_type(rreader))
+    {
+        add_diff(dom_document_diff_kind::type_diff,
+                 lreader.current().pos(), rreader.current().pos(),
+                 json::to_wstring(ltype), json::to_wstring(to_value_type(rreader)));
+        return !is_stopped() && lreader.skip_value() && rreader.skip_value();
+    }
+    switch (ltype)
+    {
+    case dom_value_type::vt_array:
+        return compare_array(lreader, rreader);
+    case dom_value_type::vt_object:
+        return compare_object(lreader, rreader);
+    case dom_value_type::vt_number:
+        if (lreader.current().token() != rreader.current().token())
+            add_diff(dom_document_diff_kind::numtype_diff,
+                     lreader.current().pos(), rreader.current().pos(),
+                     json::to_wstring(lreader.current().token()), json::to_wstring(rreader.current().token()));
+        [[fallthrough]];
+    default:
+        if (!compare_text(lreader.current().text(), rreader.current().text()))
+            add_diff(dom_document_diff_kind::value_diff,
+                     lreader.current().pos(), rreader.current().pos(),
+                     lreader.current().text(), rreader.current().text());
+    }
+    return !is_stopped();
+}
+
+bool stream_diff::count_rest(event_reader& reader, const bool is_object, std::size_t& count)
+{
+    while (reader.kind() != event_kind::end_array && reader.kind() != event_kind::end_object)
+    {
+        if (is_object && !reader.next())
+            return false;
+        if (!reader.skip_value() || !reader.next())
+            return false;
+        count++;
+    }
+    return true;
+}
+
+bool stream_diff::compare_array(event_reader& lreader, event_reader& rreader)
+{
+    const parsers::textpos lpos = lreader.current().pos();
+    const parsers::textpos rpos = rreader.current().pos();
+    std::size_t lcount = 0;
+    std::size_t rcount = 0;
+    while (true)
+    {
+        if (!lreader.next() || !rreader.next())
+            return false;
+        const bool lend = lreader.kind() == event_kind::end_array;
+        const bool rend = rreader.kind() == event_kind::end_array;
+        if (lend || rend)
+        {
+            if (lend && rend)
+                return true;
+            if (!count_rest(lreader, false, lcount) || !count_rest(rreader, false, rcount))
+                return false;
+            add_diff(dom_document_diff_kind::count_diff, lpos, rpos,
+                     std::to_wstring(lcount), std::to_wstring(rcount));
+            return !is_stopped();
+        }
+        m_path.push_back(std::to_wstring(lcount));
+        const bool result = compare_value(lreader, rreader);
+        m_path.pop_back();
+        if (!result)
+            return false;
+        lcount++;
+        rcount++;
+    }
+}
+
+bool stream_diff::compare_object(event_reader& lreader, event_reader& rreader)
+{
+    const parsers::textpos lpos = lreader.current().pos();
+    const parsers::textpos rpos = rreader.current().pos();
+    std::size_t lcount = 0;
+    std::size_t rcount = 0;
+    while (true)
+    {
+        if (!lreader.next() || !rreader.next())
+            return false;
+        const bool lend = lreader.kind() == event_kind::end_object;
+        const bool rend = rreader.kind() == event_kind::end_object;
+        if (lend || rend)
+        {
+            if (lend && rend)
+                return true;
+            if (!count_rest(lreader, true, lcount) || !count_rest(rreader, true, rcount))
+                return false;
+            add_diff(dom_document_diff_kind::count_diff, lpos, rpos,
+                     std::to_wstring(lcount), std::to_wstring(rcount));
+            return !is_stopped();
+        }
+        m_path.push_back(lreader.current().text());
+        bool result = true;
+        if (!compare_text(lreader.current().text(), rreader.current().text()))
+        {
+            add_diff(dom_document_diff_kind::member_name_diff,
+                     lreader.current().pos(), rreader.current().pos(),
+                     lreader.current().text(), rreader.current().text());
+            result = !is_stopped();
+        }
+        result = result && lreader.next() && rreader.next() && compare_value(lreader, rreader);
+        m_path.pop_back();
+        if (!result)
+            return false;
+        lcount++;
+        rcount++;
+    }
+}
+
 }
 }
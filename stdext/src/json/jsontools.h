@@ -13,12 +13,18 @@
 #include <fstream>
 #include "jsoncommon.h"
 #include "jsondom.h"
+#include "jsonparser.h"
 #include "../locutils.h"
 #include "../ioutils.h"
 #include "../testutils.h"
 
 namespace stdext
 {
+    namespace csv
+    {
+        class reader;
+    }
+
     namespace json
     {
 
@@ -82,18 +88,102 @@ namespace stdext
         };
 
 
+        /*
+         * Writes SAX events as JSON text without building DOM
+         */
+        class sax_writer : public sax_handler_intf
+        {
+        public:
+            sax_writer(ioutils::text_writer& writer);
+            sax_writer() = delete;
+            sax_writer(const sax_writer&) = delete;
+            sax_writer& operator=(const sax_writer&) = delete;
+            sax_writer(sax_writer&&) = delete;
+            sax_writer& operator=(sax_writer&&) = delete;
+        public:
+            virtual void on_literal(const json::dom_literal_type type, const std::wstring& text) override;
+            virtual void on_number(const json::dom_number_type type, const std::wstring& text) override;
+            virtual void on_string(const std::wstring& text) override;
+            virtual void on_begin_object() override;
+            virtual void on_member_name(const std::wstring& text) override;
+            virtual void on_end_object(const std::size_t member_count) override;
+            virtual void on_begin_array() override;
+            virtual void on_end_array(const std::size_t element_count) override;
+            virtual void textpos_changed(const parsers::textpos&) override {}
+        private:
+            void begin_value();
+        private:
+            ioutils::text_writer& m_writer;
+            std::wstring m_buffer;
+            std::vector<bool> m_has_items;
+            bool m_after_name = false;
+        };
+
+
+        /*
+         * Writes CSV rows as JSON array of objects which member names are header fields
+         * Rows are written while they are read, so memory use does not depend on the row count
+         */
+        class csv_converter
+        {
+        public:
+            csv_converter(csv::reader& reader);
+            csv_converter() = delete;
+            csv_converter(const csv_converter&) = delete;
+            csv_converter& operator=(const csv_converter&) = delete;
+            csv_converter(csv_converter&&) = delete;
+            csv_converter& operator=(csv_converter&&) = delete;
+        public:
+            class config
+            {
+                friend class csv_converter;
+            public:
+                config() {}
+            public:
+                // Values which are valid JSON numbers are written as numbers instead of strings
+                bool detect_numbers() const noexcept { return m_detect_numbers; }
+                void detect_numbers(const bool value) { m_detect_numbers = value; }
+            private:
+                bool m_detect_numbers = false;
+            };
+        public:
+            config& conf() { return m_conf; }
+            // Reads the header first if the reader has no header, returns false on CSV errors (see reader messages)
+            bool write(ioutils::text_writer& w);
+            bool write(std::wostream& stream);
+            bool write(std::wstring& ws);
+            bool write_to_file(const std::wstring file_name, const ioutils::text_io_policy& policy);
+        private:
+            config m_conf;
+            csv::reader& m_reader;
+        };
+
+
+        /*
+         * Shape presets of generated documents
+         */
+        enum class dom_document_shape
+        {
+            mixed,          // default: random depth-driven tree
+            wide_flat,      // array of records with the same members
+            deep,           // deep nesting with few children
+            number_heavy,
+            string_heavy,
+            unicode_heavy   // long strings and member names outside of ASCII
+        };
+        std::string to_string(const dom_document_shape value);
+        std::wstring to_wstring(const dom_document_shape value);
+
         class dom_document_generator
         {
         public:
+            dom_document_generator();
             dom_document_generator(json::dom_document& doc);
-            dom_document_generator() = delete;
             dom_document_generator(const dom_document_generator&) = delete;
             dom_document_generator& operator=(const dom_document_generator&) = delete;
             dom_document_generator(dom_document_generator&&) = delete;
             dom_document_generator& operator=(dom_document_generator&&) = delete;
         public:
-            typedef std::vector<json::dom_value*> containers_t;
-
             class config
             {
             public:
@@ -107,31 +197,59 @@ namespace stdext
                 void depth(const unsigned int value) { m_depth = value > 0 ? value : 1; }
                 locutils::wchar_range& name_char_range() noexcept { return m_name_char_range; }
                 locutils::wchar_range& value_char_range() noexcept { return m_value_char_range; }
+                // Same seed gives the same document, otherwise the seed is random
+                bool has_seed() const noexcept { return m_has_seed; }
+                unsigned int seed() const noexcept { return m_seed; }
+                void seed(const unsigned int value) noexcept { m_seed = value; m_has_seed = true; }
+                // Sets depth, children count, string length and char ranges of the preset, they can be changed after
+                dom_document_shape shape() const noexcept { return m_shape; }
+                void shape(const dom_document_shape value) noexcept;
+                // Approximate text length in chars, the root becomes an array filled until the length is reached.
+                // Zero means that the size is defined by depth and children count only
+                std::size_t target_size() const noexcept { return m_target_size; }
+                void target_size(const std::size_t value) noexcept { m_target_size = value; }
             private:
                 unsigned int m_avg_children = config::default_avg_children();
                 unsigned int m_avg_string_length = config::default_avg_string_length();
                 unsigned int m_depth = 1;
                 locutils::wchar_range m_name_char_range{0x21, 0x7E};
                 locutils::wchar_range m_value_char_range;
+                bool m_has_seed = false;
+                unsigned int m_seed = 0;
+                dom_document_shape m_shape = dom_document_shape::mixed;
+                std::size_t m_target_size = 0;
             };
 
         public:
             dom_document_generator::config& conf() { return m_config; }
-            json::dom_document& doc() const { return m_doc; }
+            json::dom_document& doc() const noexcept(false);
+            // Builds the document
             void run();
+            // Emits generated values as SAX events, the document is not used
+            void run(json::sax_handler_intf& handler);
+            // Writes generated JSON text, the document is not used
+            void write(ioutils::text_writer& writer);
+            void write(std::wostream& stream);
+            void write_to_file(const std::wstring file_name, const ioutils::text_io_policy& policy);
         private:
-            void generate_level(const int curr_level, const int level_count, const containers_t& parents);
-            json::dom_value* generate_array();
-            json::dom_value* generate_object();
-            json::dom_value* generate_value(json::dom_value_type type);
+            void add_size(const std::size_t value) noexcept { m_size += value; }
+            bool is_size_reached() const noexcept { return m_config.target_size() > 0 && m_size >= m_config.target_size(); }
+            void generate_container(json::sax_handler_intf& handler, const json::dom_value_type type, const unsigned int level);
+            void generate_record(json::sax_handler_intf& handler);
+            void generate_scalar(json::sax_handler_intf& handler, const json::dom_value_type type);
+            void generate_value(json::sax_handler_intf& handler, const json::dom_value_type type, const unsigned int level);
             std::wstring random_literal_name();
+            std::wstring random_member_name();
             json::dom_value_type random_value_type();
             json::dom_value_type random_value_container_type();
             json::dom_value_type random_value_scalar_type();
         private:
             dom_document_generator::config m_config;
-            json::dom_document& m_doc;
+            json::dom_document* m_doc = nullptr;
             testutils::rnd_helper m_rnd;
+            std::size_t m_size = 0;
+            std::vector<std::wstring> m_record_names;
+            std::vector<json::dom_value_type> m_record_types;
         };
 
 
@@ -221,6 +339,112 @@ namespace stdext
                                     const json::dom_document& rdoc,
                                     const dom_document_diff_options& options);
         dom_document_diff make_diff(const json::dom_document& ldoc, const json::dom_document& rdoc);
+        /**
+         * @brief Parallel variant of make_diff, the elements or members of root containers are compared in threads
+         * Each array element is walked independently so the shifted structure in one element does not
+         * produce differences in following ones, in this case the items differ from make_diff ones.
+         * Items are ordered by root children, items of each child are in the order of sequential walk.
+         * @param thread_count 0 means the number of hardware threads
+         */
+        dom_document_diff make_diff_parallel(const json::dom_document& ldoc,
+                                             const json::dom_document& rdoc,
+                                             const dom_document_diff_options& options,
+                                             std::size_t thread_count = 0);
+
+        /*
+         * Streaming diff
+         * Compares two texts in lockstep without building DOM, differences are reported incrementally.
+         * Object members are compared by position: reordered members are reported as member_name_diff
+         * while make_diff matches them by name, so use make_diff when the member order is not significant.
+         */
+        class stream_diff_item
+        {
+        public:
+            stream_diff_item(const dom_document_diff_kind kind,
+                             const std::wstring& path,
+                             const parsers::textpos& lpos,
+                             const parsers::textpos& rpos,
+                             const std::wstring& ltext,
+                             const std::wstring& rtext)
+                : m_kind(kind), m_path(path), m_lpos(lpos), m_rpos(rpos), m_ltext(ltext), m_rtext(rtext)
+            {}
+            stream_diff_item(const stream_diff_item&) = default;
+            stream_diff_item& operator=(const stream_diff_item&) = default;
+            stream_diff_item(stream_diff_item&&) = default;
+            stream_diff_item& operator=(stream_diff_item&&) = default;
+        public:
+            dom_document_diff_kind kind() const noexcept { return m_kind; }
+            // JSON pointer (RFC 6901) of the compared value
+            const std::wstring& path() const noexcept { return m_path; }
+            const parsers::textpos& lpos() const noexcept { return m_lpos; }
+            const parsers::textpos& rpos() const noexcept { return m_rpos; }
+            // Compared texts: values, member names or element counts depending on kind
+            const std::wstring& ltext() const noexcept { return m_ltext; }
+            const std::wstring& rtext() const noexcept { return m_rtext; }
+            std::string to_string() const;
+            std::wstring to_wstring() const;
+        private:
+            dom_document_diff_kind m_kind;
+            std::wstring m_path;
+            parsers::textpos m_lpos;
+            parsers::textpos m_rpos;
+            std::wstring m_ltext;
+            std::wstring m_rtext;
+        };
+
+        class stream_diff_handler_intf
+        {
+        public:
+            virtual ~stream_diff_handler_intf() {}
+            virtual void on_diff(const stream_diff_item& item) = 0;
+        };
+
+        class stream_diff
+        {
+        public:
+            stream_diff() = delete;
+            stream_diff(ioutils::text_reader& lreader,
+                        ioutils::text_reader& rreader,
+                        stream_diff_handler_intf& handler,
+                        const dom_document_diff_options& options);
+            stream_diff(const stream_diff&) = delete;
+            stream_diff& operator =(const stream_diff&) = delete;
+            stream_diff(stream_diff&&) = delete;
+            stream_diff& operator =(stream_diff&&) = delete;
+            ~stream_diff() {}
+        public:
+            /**
+             * @brief Reads both texts until the end or the first difference if compare_all option is off
+             * @return false if one of texts has errors
+             */
+            bool run();
+            std::size_t diff_count() const noexcept { return m_diff_count; }
+            bool has_differences() const noexcept { return m_diff_count > 0; }
+            const msg_collector_t& lmessages() const noexcept { return m_lmessages; }
+            const msg_collector_t& rmessages() const noexcept { return m_rmessages; }
+        private:
+            void add_diff(const dom_document_diff_kind kind,
+                          const parsers::textpos& lpos,
+                          const parsers::textpos& rpos,
+                          const std::wstring& ltext,
+                          const std::wstring& rtext);
+            bool compare_array(event_reader& lreader, event_reader& rreader);
+            bool compare_object(event_reader& lreader, event_reader& rreader);
+            bool compare_text(const std::wstring& ltext, const std::wstring& rtext) const;
+            bool compare_value(event_reader& lreader, event_reader& rreader);
+            bool count_rest(event_reader& reader, const bool is_object, std::size_t& count);
+            bool is_stopped() const noexcept { return m_diff_count > 0 && !m_options.compare_all(); }
+            std::wstring path() const;
+        private:
+            ioutils::text_reader& m_lreader;
+            ioutils::text_reader& m_rreader;
+            stream_diff_handler_intf& m_handler;
+            dom_document_diff_options m_options;
+            msg_collector_t m_lmessages;
+            msg_collector_t m_rmessages;
+            std::vector<std::wstring> m_path;
+            std::size_t m_diff_count = 0;
+        };
 
     }
 }
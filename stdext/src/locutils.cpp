@@ -569,21 +569,21 @@ codecvt_utf8_wchar_t::do_unshift(mbstate_t&, extern_type* first2, extern_type*,
     return codecvt_base_t::ok;
 }
 
-// return min(len2, converted length of bytes [first1, last1))
+// return count of bytes [first1, last1) converted to at most len2 characters
 int codecvt_utf8_wchar_t::do_length(mbstate_t& state, const extern_type* first1, const extern_type* last1, size_t len2) const noexcept
 {
+    const extern_type* start1 = first1;
     size_t curr_length = 0;
-    mbstate_t curr_state = state;
     while (curr_length < len2 && first1 != last1)
     {	// convert another wide character
         const extern_type* next1;
         intern_type* next2;
         intern_type buf2[2];
         // test result of single wide-char conversion
-        switch (do_in(curr_state, first1, last1, next1, buf2, buf2 + 1, next2))
+        switch (do_in(state, first1, last1, next1, buf2, buf2 + 1, next2))
         {
         case codecvt_base_t::noconv:
-            return (int)(curr_length + (last1 - first1));
+            return (int)(last1 - start1);
         case codecvt_base_t::ok:
             if (next2 == buf2 + 1)
             {
@@ -592,10 +592,10 @@ int codecvt_utf8_wchar_t::do_length(mbstate_t& state, const extern_type* first1,
             first1 = next1;
             break;
         default:
-            return (int)curr_length;	// error or partial
+            return (int)(first1 - start1);	// error or partial
         }
     }
-    return (int)curr_length;
+    return (int)(first1 - start1);
 }
 
 
@@ -785,30 +785,31 @@ codecvt_utf16_wchar_t::do_unshift(mbstate_t&, extern_type* first2, extern_type*,
     return codecvt_base_t::ok;
 }
 
-// return min(len2, converted length of bytes [first1, last1))
+// return count of bytes [first1, last1) converted to at most len2 characters
+// State is advanced like do_in() does, so file streams keep the detected byte order in positions
 int codecvt_utf16_wchar_t::do_length(mbstate_t& state, const extern_type* first1, const extern_type* last1, size_t len2) const noexcept
 {
+    const extern_type* start1 = first1;
     size_t curr_length = 0;
-    mbstate_t curr_state = state;
     while (curr_length < len2 && first1 != last1)
     {
         const extern_type* next1;
         intern_type* next2;
         intern_type buf2[2];
-        switch (do_in(curr_state, first1, last1, next1, buf2, buf2 + 1, next2))
+        switch (do_in(state, first1, last1, next1, buf2, buf2 + 1, next2))
         {
         case codecvt_base_t::noconv:
-            return (int)(curr_length + (last1 - first1));
+            return (int)(last1 - start1);
         case codecvt_base_t::ok:
             if (next2 == buf2 + 1)
                 ++curr_length;
             first1 = next1;
             break;
         default:
-            return (int)curr_length;
+            return (int)(first1 - start1);
         }
     }
-    return (int)curr_length;
+    return (int)(first1 - start1);
 }
 
 int codecvt_utf16_wchar_t::do_max_length() const noexcept
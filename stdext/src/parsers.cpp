@@ -4,6 +4,13 @@
  */
 
 #include "parsers.h"
+#include <charconv>
+#include <clocale>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <cwchar>
+#include <algorithm>
 #include "strutils.h"
 
 using namespace std;
@@ -24,6 +31,67 @@ std::wstring to_wstring(const msg_severity value)
     }
 }
 
+std::wstring format_message(const std::wstring& format, const msg_args& args)
+{
+    wstring result;
+    size_t arg_index = 0;
+    size_t i = 0;
+    while (i < format.length())
+    {
+        const wchar_t c = format[i++];
+        if (c != L'%' || i >= format.length())
+        {
+            result += c;
+            continue;
+        }
+        if (format[i] == L'%')
+        {
+            result += L'%';
+            i++;
+            continue;
+        }
+        // Flags and width
+        wstring spec = L"%";
+        while (i < format.length() && wcschr(L"-+ #0123456789", format[i]) != nullptr)
+            spec += format[i++];
+        wstring length;
+        while (i < format.length() && format[i] == L'l')
+            length += format[i++];
+        if (i >= format.length())
+            break;
+        const wchar_t conversion = format[i++];
+        if (arg_index >= args.size())
+        {
+            result += spec + length + conversion;
+            continue;
+        }
+        const msg_arg& arg = args[arg_index++];
+        if (const wstring* text = get_if<wstring>(&arg))
+            result += conversion == L's' ? str::wformat(spec + L"ls", text->c_str()) : *text;
+        else
+        {
+            const int64_t n = get<int64_t>(arg);
+            switch (conversion)
+            {
+            case L'c':
+                result += static_cast<wchar_t>(n);
+                break;
+            case L'd':
+            case L'i':
+            case L'u':
+            case L'x':
+            case L'X':
+                result += str::wformat(spec + L"ll" + conversion, static_cast<long long>(n));
+                break;
+            default:
+                result += std::to_wstring(n);
+                break;
+            }
+        }
+    }
+    return result;
+}
+
 /*
  * textpos class
  */
@@ -63,6 +131,39 @@ std::wstring textpos::to_wstring() const
     return str::to_wstring(to_string());
 }
 
+
+/*
+ * line_index class
+ */
+void line_index::forget(const offset_t offset)
+{
+    // The start of the offset line is kept
+    auto it = lower_bound(m_starts.begin(), m_starts.end(), offset);
+    if (it - m_starts.begin() > 1)
+    {
+        m_forgotten += static_cast<std::size_t>(it - 1 - m_starts.begin());
+        m_starts.erase(m_starts.begin(), it - 1);
+    }
+}
+
+line_index::line line_index::last_line() const noexcept
+{
+    if (m_starts.empty())
+        return line(m_first_line + static_cast<textpos::pos_t>(m_forgotten), m_forgotten == 0 ? m_first_col : 0, 0);
+    return line(m_first_line + static_cast<textpos::pos_t>(line_count() - 1), 0, m_starts.back());
+}
+
+textpos line_index::pos(const offset_t offset) const noexcept
+{
+    // Lines which start before the offset
+    auto it = lower_bound(m_starts.begin(), m_starts.end(), offset);
+    if (it == m_starts.begin() && m_forgotten == 0)
+        return textpos(m_first_line, m_first_col + static_cast<textpos::pos_t>(offset));
+    const offset_t start = it == m_starts.begin() ? 0 : *(it - 1);
+    const std::size_t line = m_forgotten + static_cast<std::size_t>(it - m_starts.begin());
+    return textpos(static_cast<textpos::pos_t>(line) + m_first_line, static_cast<textpos::pos_t>(offset - start));
+}
+
 /*
  * numeric_parser implementation
  */
@@ -71,13 +172,60 @@ numeric_parser::numeric_parser(const std::wstring& s)
     read_string(s);
 }
 
+void numeric_parser::reset()
+{
+    m_type = numeric_type::nt_unknown;
+    m_value.clear();
+    m_char_count = 0;
+    m_digit_count = 0;
+    m_accepting_type = numeric_type::nt_integer;
+    m_mantissa = 0;
+    m_mantissa_digits = 0;
+    m_mantissa_truncated = false;
+    m_negative = false;
+    m_leading_zero = false;
+    m_exponent = 0;
+    m_exp_value = 0;
+    m_exp_negative = false;
+}
+
 void numeric_parser::accept_char(const wchar_t c)
 {
     m_char_count++;
-    m_value += c;
+    if (m_keep_text)
+        m_value += c;
+}
+
+void numeric_parser::accept_digit(const wchar_t c)
+{
+    const int digit = static_cast<int>(c - L'0');
+    if (m_accepting_type == numeric_type::nt_float)
+    {
+        if (m_exp_value < 100000) // saturated, the value is out of double range anyway
+            m_exp_value = m_exp_value * 10 + digit;
+        return;
+    }
+    if (m_accepting_type == numeric_type::nt_integer && m_digit_count == 0)
+        m_leading_zero = (digit == 0);
+    if (m_mantissa_digits < max_mantissa_digits)
+    {
+        if (m_mantissa_digits > 0 || digit != 0) // leading zeros are not significant
+        {
+            m_mantissa = m_mantissa * 10 + static_cast<uint64_t>(digit);
+            m_mantissa_digits++;
+        }
+        if (m_accepting_type == numeric_type::nt_decimal)
+            m_exponent--;
+    }
+    else
+    {
+        m_mantissa_truncated = true;
+        if (m_accepting_type == numeric_type::nt_integer)
+            m_exponent++;
+    }
 }
 
-bool numeric_parser::read_string(const std::wstring& s)
+bool numeric_parser::read_string(const std::wstring_view s)
 {
     for (wchar_t c : s)
     {
@@ -95,8 +243,20 @@ bool numeric_parser::read_char(const wchar_t c)
     switch (c)
     {
     case L'-':
+        // Sign is allowed at the start of the number or of its exponent only
         if (m_char_count == 0)
+        {
             accept_char(c);
+            if (m_accepting_type == numeric_type::nt_float)
+                m_exp_negative = true;
+            else
+                m_negative = true;
+        }
+        else
+        {
+            m_type = numeric_type::nt_unknown;
+            return false;
+        }
         break;
     case L'+':
         if (m_accepting_type == numeric_type::nt_float && m_char_count == 0)
@@ -124,12 +284,13 @@ bool numeric_parser::read_char(const wchar_t c)
     case L'7':
     case L'8':
     case L'9':
-        if (m_accepting_type == numeric_type::nt_integer && m_digit_count == 1 && m_value == L"0")
+        if (m_accepting_type == numeric_type::nt_integer && m_digit_count == 1 && m_leading_zero)
         {
             m_type = numeric_type::nt_unknown;
             return false;
         }
         accept_char(c);
+        accept_digit(c);
         m_digit_count++;
         m_type = m_accepting_type;
         break;
@@ -155,6 +316,87 @@ bool numeric_parser::read_char(const wchar_t c)
     return true;
 }
 
+numeric_value numeric_parser::binary_value(const std::wstring_view text) const
+{
+    if (!is_valid_number())
+        return numeric_value();
+    constexpr uint64_t max_int64 = static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+    if (m_type == numeric_type::nt_integer && !m_mantissa_truncated)
+    {
+        if (!m_negative && m_mantissa <= max_int64)
+            return numeric_value(static_cast<int64_t>(m_mantissa));
+        if (m_negative && m_mantissa <= max_int64 + 1)
+            return numeric_value(m_mantissa == max_int64 + 1 ?
+                                     std::numeric_limits<int64_t>::min() :
+                                     -static_cast<int64_t>(m_mantissa));
+    }
+    // Clinger's fast path: both mantissa and power of ten are exact doubles so the single
+    // multiplication or division is correctly rounded
+    static const double exact_powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    constexpr int max_exact_power = 22;
+    constexpr uint64_t max_exact_mantissa = uint64_t(1) << 53;
+    if (!m_mantissa_truncated)
+    {
+        if (m_mantissa == 0)
+            return numeric_value(m_negative ? -0.0 : 0.0);
+        int exp10 = m_exponent + (m_exp_negative ? -m_exp_value : m_exp_value);
+        uint64_t mantissa = m_mantissa;
+        // move the excess of power into the mantissa while it stays exact, e.g. 1e25
+        while (exp10 > max_exact_power && mantissa <= max_exact_mantissa / 10)
+        {
+            mantissa *= 10;
+            exp10--;
+        }
+        if (mantissa <= max_exact_mantissa && exp10 >= -max_exact_power && exp10 <= max_exact_power)
+        {
+            double value = static_cast<double>(mantissa);
+            if (exp10 < 0)
+                value /= exact_powers[-exp10];
+            else
+                value *= exact_powers[exp10];
+            return numeric_value(m_negative ? -value : value);
+        }
+    }
+    return numeric_value(to_double_fallback(text));
+}
+
+double numeric_parser::to_double_fallback(const std::wstring_view text) const
+{
+    // Characters of a valid number are ASCII, usual numbers are narrowed without allocation
+    char buffer[64];
+    string long_text;
+    char* s = buffer;
+    if (text.length() >= sizeof(buffer))
+    {
+        long_text.resize(text.length() + 1);
+        s = &long_text[0];
+    }
+#if defined(__cpp_lib_to_chars)
+    for (size_t i = 0; i < text.length(); i++)
+        s[i] = static_cast<char>(text[i]);
+    // from_chars() is correctly rounded and does not depend on locale
+    double value = 0;
+    if (from_chars(s, s + text.length(), value).ec == errc::result_out_of_range)
+    {
+        // Decimal exponent of the first significant digit tells overflow from underflow
+        const int magnitude = m_mantissa_digits + m_exponent + (m_exp_negative ? -m_exp_value : m_exp_value);
+        value = magnitude > 0 ? HUGE_VAL : 0.0;
+        if (m_negative)
+            value = -value;
+    }
+    return value;
+#else
+    // strtod() is correctly rounded but uses the decimal point of current C locale
+    const char point = *std::localeconv()->decimal_point;
+    for (size_t i = 0; i < text.length(); i++)
+        s[i] = text[i] == L'.' ? point : static_cast<char>(text[i]);
+    s[text.length()] = 0;
+    return std::strtod(s, nullptr);
+#endif
+}
+
 
 bool is_number(const std::wstring& s)
 {
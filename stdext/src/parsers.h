@@ -8,6 +8,10 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <cstdint>
+#include <vector>
+#include <variant>
 #include "strutils.h"
 #include "ptr_vector.h"
 
@@ -44,6 +48,68 @@ namespace stdext::parsers
         pos_t m_col = 1;
     };
 
+    /*
+     * Offsets of line starts used to compute textpos only when it is requested,
+     * so that readers count characters only. Offset is the count of characters read,
+     * line start is the offset before the first character of the line.
+     * Readers forget the starts of passed lines, so the index keeps only the lines which are still read.
+     */
+    class line_index
+    {
+    public:
+        typedef std::size_t offset_t;
+        // Snapshot of one line, the positions of offsets in it are computed without the index
+        class line
+        {
+        public:
+            line() { }
+            line(const textpos::pos_t number, const textpos::pos_t first_col, const offset_t start)
+                : m_number(number), m_first_col(first_col), m_start(start)
+            { }
+        public:
+            textpos pos(const offset_t offset) const noexcept
+            { return textpos(m_number, m_first_col + static_cast<textpos::pos_t>(offset - m_start)); }
+        private:
+            textpos::pos_t m_number = 1;
+            textpos::pos_t m_first_col = 1;
+            offset_t m_start = 0;
+        };
+    public:
+        // Column of offset 0 in the first line
+        explicit line_index(const textpos::pos_t first_col = 1)
+            : m_first_col(first_col)
+        { }
+        line_index(const line_index&) = default;
+        line_index& operator =(const line_index&) = default;
+        line_index(line_index&&) = default;
+        line_index& operator =(line_index&&) = default;
+        ~line_index() { }
+    public:
+        // Line starts should be added in ascending order
+        void add_line(const offset_t start) { m_starts.push_back(start); }
+        void clear() noexcept { m_starts.clear(); m_forgotten = 0; }
+        // Offset 0 becomes the position, e.g. when the reader continues from a known position
+        void reset(const textpos::pos_t first_line, const textpos::pos_t first_col = 1) noexcept
+        {
+            clear();
+            m_first_line = first_line;
+            m_first_col = first_col;
+        }
+        // Keeps only the line starts needed for positions of offsets which are not less than offset,
+        // positions of the smaller offsets are not available anymore
+        void forget(const offset_t offset);
+        std::size_t line_count() const noexcept { return m_forgotten + m_starts.size() + 1; }
+        // Line which contains the offsets after the last added line start
+        line last_line() const noexcept;
+        textpos pos(const offset_t offset) const noexcept;
+    private:
+        textpos::pos_t m_first_line = 1;
+        textpos::pos_t m_first_col;
+        std::vector<offset_t> m_starts;
+        // Count of line starts removed from m_starts
+        std::size_t m_forgotten = 0;
+    };
+
     /*
      * Parsing messages
      * You need to define a custom enumeration of message kinds in the parser code to use these classes
@@ -65,9 +131,18 @@ namespace stdext::parsers
     };
     std::wstring to_wstring(const msg_severity value);
 
+    // Arguments of the message text formatted on demand
+    typedef std::variant<int64_t, std::wstring> msg_arg;
+    typedef std::vector<msg_arg> msg_args;
+    // Supports %d, %u, %x, %c and %ls conversions with flags and width, arguments are taken in order
+    std::wstring format_message(const std::wstring& format, const msg_args& args);
+
     template <class MsgEnumT>
     class message
     {
+    public:
+        // Returns the format of the message text by its kind
+        typedef std::wstring (*format_func_t)(const MsgEnumT kind);
     public:
         message() = delete;
         message(const msg_origin origin, const msg_severity severity, const MsgEnumT kind, const textpos& pos, const std::wstring& source)
@@ -76,6 +151,12 @@ namespace stdext::parsers
         message(const msg_origin origin, const msg_severity severity, const MsgEnumT kind, const textpos& pos, const std::wstring& source, const std::wstring& text)
             : m_origin(origin), m_severity(severity), m_kind(kind), m_pos(pos), m_source(source), m_text(text)
         { }
+        // Text is formatted when requested first time
+        message(const msg_origin origin, const msg_severity severity, const MsgEnumT kind, const textpos& pos, const std::wstring& source,
+                const format_func_t format_func, msg_args&& args)
+            : m_origin(origin), m_severity(severity), m_kind(kind), m_pos(pos), m_source(source),
+              m_format_func(format_func), m_args(std::move(args))
+        { }
         message(const message&) = default;
         message& operator =(const message&) = default;
         message(message&&) = default;
@@ -88,7 +169,16 @@ namespace stdext::parsers
         msg_severity severity() const noexcept { return m_severity; }
         std::wstring source() const { return m_source; }
         void source(const std::wstring& value) { m_source = value; }
-        std::wstring text() const { return m_text; }
+        std::wstring text() const
+        {
+            if (m_format_func != nullptr)
+            {
+                m_text = format_message(m_format_func(m_kind), m_args);
+                m_format_func = nullptr;
+                m_args.clear();
+            }
+            return m_text;
+        }
         std::wstring to_wstring() const
         {
             return str::wformat(L"%ls%ls: %ls %d: %ls",
@@ -96,7 +186,7 @@ namespace stdext::parsers
                 m_pos.to_wstring().c_str(),
                 parsers::to_wstring(m_severity).c_str(),
                 (int)m_kind,
-                m_text.c_str());
+                text().c_str());
         }
     protected:
         msg_origin m_origin;
@@ -104,10 +194,17 @@ namespace stdext::parsers
         MsgEnumT m_kind;
         textpos m_pos;
         std::wstring m_source;
-        std::wstring m_text;
+        mutable std::wstring m_text;
+        mutable format_func_t m_format_func = nullptr;
+        mutable msg_args m_args;
     };
 
 
+    /*
+     * Collected messages are limited by the count of messages or by the first error in fail-fast mode,
+     * the messages over the limit are only counted. Producers should check accepts() before
+     * building the message, call drop() instead of adding it and may stop when is_full() becomes true.
+     */
     template <class MsgEnumT>
     class msg_collector
     {
@@ -120,6 +217,7 @@ namespace stdext::parsers
         typedef std::vector<message_t*> infos_t;
         typedef std::vector<message_t*> warnings_t;
         typedef typename container_t::const_iterator const_iterator;
+        typedef typename message_t::format_func_t format_func_t;
     public:
         msg_collector() { }
         msg_collector(const msg_collector&) = delete;
@@ -132,8 +230,15 @@ namespace stdext::parsers
         message_t* const& operator [](const size_type i) const { return m_data.at(i); }
         const_iterator begin() const noexcept { return m_data.begin(); }
         const_iterator end() const noexcept { return m_data.end(); }
+        // Takes ownership of the message, the message is deleted when the collector is full
         void add(message_t* const msg)
         {
+            if (is_full())
+            {
+                m_dropped_count++;
+                delete msg;
+                return;
+            }
             m_data.push_back(msg);
             switch (msg->severity())
             {
@@ -153,22 +258,43 @@ namespace stdext::parsers
         }
         void add_error(const msg_origin origin, const MsgEnumT kind, const textpos pos, const std::wstring& source, const std::wstring& text)
         {
-            add(new message_t(origin, msg_severity::error, kind, pos, source, text));
+            if (accepts())
+                add(new message_t(origin, msg_severity::error, kind, pos, source, text));
+            else
+                m_dropped_count++;
         }
         void add_warning(const msg_origin origin, const MsgEnumT kind, const textpos pos, const std::wstring& source, const std::wstring& text)
         {
-            add(new message_t(origin, msg_severity::warning, kind, pos, source, text));
+            if (accepts())
+                add(new message_t(origin, msg_severity::warning, kind, pos, source, text));
+            else
+                m_dropped_count++;
         }
         void add_hint(const msg_origin origin, const MsgEnumT kind, const textpos pos, const std::wstring& source, const std::wstring& text)
         {
-            add(new message_t(origin, msg_severity::hint, kind, pos, source, text));
+            if (accepts())
+                add(new message_t(origin, msg_severity::hint, kind, pos, source, text));
+            else
+                m_dropped_count++;
         }
         void add_info(const msg_origin origin, const MsgEnumT kind, const textpos pos, const std::wstring& source, const std::wstring& text)
         {
-            add(new message_t(origin, msg_severity::info, kind, pos, source, text));
+            if (accepts())
+                add(new message_t(origin, msg_severity::info, kind, pos, source, text));
+            else
+                m_dropped_count++;
+        }
+        void add_error(const msg_origin origin, const MsgEnumT kind, const textpos pos, const std::wstring& source,
+                       const format_func_t format_func, msg_args&& args)
+        {
+            if (accepts())
+                add(new message_t(origin, msg_severity::error, kind, pos, source, format_func, std::move(args)));
+            else
+                m_dropped_count++;
         }
         void clear()
         {
+            m_dropped_count = 0;
             m_infos.clear();
             m_hints.clear();
             m_warnings.clear();
@@ -181,6 +307,24 @@ namespace stdext::parsers
         inline bool has_warnings() const noexcept { return m_warnings.size() > 0; }
         inline bool has_messages() const noexcept { return m_data.size() > 0; }
         size_type size() const noexcept { return m_data.size(); }
+    public:
+        bool accepts() const noexcept { return !is_full(); }
+        bool is_full() const noexcept
+        {
+            return (m_limit > 0 && m_data.size() >= m_limit) || (m_fail_fast && has_errors());
+        }
+        // Count of messages not collected because of the limit
+        size_type dropped_count() const noexcept { return m_dropped_count; }
+        // Counts the message which is not built because the collector does not accept it
+        void drop() noexcept { m_dropped_count++; }
+        bool fail_fast() const noexcept { return m_fail_fast; }
+        void fail_fast(const bool value) noexcept { m_fail_fast = value; }
+        // Maximal count of collected messages, 0 for unlimited
+        size_type limit() const noexcept { return m_limit; }
+        void limit(const size_type value) noexcept { m_limit = value; }
+        // Producers do not pass source names when disabled
+        bool source_names() const noexcept { return m_source_names; }
+        void source_names(const bool value) noexcept { m_source_names = value; }
     public:
         const hints_t& hints() const { return m_hints; }
         const warnings_t& warnings() const { return m_warnings; }
@@ -192,10 +336,43 @@ namespace stdext::parsers
         hints_t m_hints;
         warnings_t m_warnings;
         errors_t m_errors;
+        size_type m_dropped_count = 0;
+        size_type m_limit = 0;
+        bool m_fail_fast = false;
+        bool m_source_names = true;
     };
 
     bool is_number(const std::wstring& s);
 
+    /*
+     * Binary value of a number computed while scanning its text
+     * Integers that fit into int64_t keep the exact value, float_value() is always available
+     */
+    class numeric_value
+    {
+    public:
+        numeric_value() {}
+        explicit numeric_value(const int64_t value)
+            : m_is_int(true), m_int(value), m_float(static_cast<double>(value))
+        {}
+        explicit numeric_value(const double value)
+            : m_float(value)
+        {}
+        numeric_value(const numeric_value&) = default;
+        numeric_value& operator =(const numeric_value&) = default;
+        numeric_value(numeric_value&&) = default;
+        numeric_value& operator =(numeric_value&&) = default;
+        ~numeric_value() {}
+    public:
+        bool is_int() const noexcept { return m_is_int; }
+        int64_t int_value() const noexcept { return m_int; }
+        double float_value() const noexcept { return m_float; }
+    private:
+        bool m_is_int = false;
+        int64_t m_int = 0;
+        double m_float = 0.0;
+    };
+
     class numeric_parser
     {
     public:
@@ -210,20 +387,42 @@ namespace stdext::parsers
         numeric_parser() {}
         explicit numeric_parser(const std::wstring& s);
     public:
+        // Parser which does not keep characters saves their copy when the caller has the text for binary_value(text)
+        bool keep_text() const noexcept { return m_keep_text; }
+        void keep_text(const bool value) noexcept { m_keep_text = value; }
         bool is_valid_number() const { return m_type != numeric_type::nt_unknown; }
-        bool read_string(const std::wstring& s);
+        // Appends characters of s, reset() is required before reading other number
+        bool read_string(const std::wstring_view s);
         bool read_char(const wchar_t c);
         numeric_type type() const { return m_type; }
         std::wstring value() const { return m_value; }
+        const std::wstring& cvalue() const noexcept { return m_value; }
+        numeric_value binary_value() const { return binary_value(m_value); }
+        // Text should contain the characters read since reset()
+        numeric_value binary_value(const std::wstring_view text) const;
+        void reset();
     private:
         numeric_type m_type = numeric_type::nt_unknown;
         std::wstring m_value;
+        bool m_keep_text = true;
     private:
         void accept_char(const wchar_t c);
+        void accept_digit(const wchar_t c);
+        double to_double_fallback(const std::wstring_view text) const;
     private:
         int m_char_count = 0;
         int m_digit_count = 0;
         numeric_type m_accepting_type = numeric_type::nt_integer;
+        // Binary value accumulated while scanning
+        static const int max_mantissa_digits = 19;
+        uint64_t m_mantissa = 0;
+        int m_mantissa_digits = 0;
+        bool m_mantissa_truncated = false;
+        bool m_negative = false;
+        bool m_leading_zero = false;
+        int m_exponent = 0;       // decimal exponent adjustment from fraction and truncated digits
+        int m_exp_value = 0;      // explicit exponent after 'e'/'E'
+        bool m_exp_negative = false;
     };
 }
 
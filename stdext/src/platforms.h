@@ -10,6 +10,10 @@
     #define __STDEXT_X86_X64_OR_I386
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define __STDEXT_USE_SSE2
+#endif
+
 #if defined(WIN32) || defined(WIN64)
     #define __STDEXT_WINDOWS
 #elif defined(__linux__)
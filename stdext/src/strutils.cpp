@@ -2,7 +2,12 @@
 #include <cctype>
 #include <cwctype>
 #include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <iomanip>
+#include <locale>
 #include <memory>
+#include <sstream>
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
@@ -15,6 +20,10 @@
 #include "strutils.h"
 #include "platforms.h"
 
+#if defined(__STDEXT_USE_SSE2)
+#include <emmintrin.h>
+#endif
+
 using namespace std;
 
 namespace stdext::str {
@@ -256,6 +265,78 @@ std::wstring double_quoted(const std::wstring& s)
     return L"\"" + s + L"\"";
 }
 
+std::size_t find_first_of(const wchar_t* s, const std::size_t count, const wchar_t c1, const wchar_t c2, const wchar_t c3, const wchar_t c4) noexcept
+{
+    std::size_t i = 0;
+#if defined(__STDEXT_USE_SSE2)
+    const std::size_t block_chars = sizeof(__m128i) / sizeof(wchar_t);
+    #if __STDEXT_WCHAR_SIZE == 2
+    const __m128i v1 = _mm_set1_epi16(static_cast<short>(c1));
+    const __m128i v2 = _mm_set1_epi16(static_cast<short>(c2));
+    const __m128i v3 = _mm_set1_epi16(static_cast<short>(c3));
+    const __m128i v4 = _mm_set1_epi16(static_cast<short>(c4));
+    #define __STDEXT_CMPEQ _mm_cmpeq_epi16
+    #else
+    const __m128i v1 = _mm_set1_epi32(static_cast<int>(c1));
+    const __m128i v2 = _mm_set1_epi32(static_cast<int>(c2));
+    const __m128i v3 = _mm_set1_epi32(static_cast<int>(c3));
+    const __m128i v4 = _mm_set1_epi32(static_cast<int>(c4));
+    #define __STDEXT_CMPEQ _mm_cmpeq_epi32
+    #endif
+    for (; i + block_chars <= count; i += block_chars)
+    {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        const __m128i eq = _mm_or_si128(_mm_or_si128(__STDEXT_CMPEQ(block, v1), __STDEXT_CMPEQ(block, v2)),
+                                        _mm_or_si128(__STDEXT_CMPEQ(block, v3), __STDEXT_CMPEQ(block, v4)));
+        const int mask = _mm_movemask_epi8(eq);
+        if (mask != 0)
+        {
+            int bit = 0;
+            while ((mask & (1 << bit)) == 0)
+                bit++;
+            return i + static_cast<std::size_t>(bit) / sizeof(wchar_t);
+        }
+    }
+    #undef __STDEXT_CMPEQ
+#endif
+    for (; i < count; i++)
+    {
+        const wchar_t c = s[i];
+        if (c == c1 || c == c2 || c == c3 || c == c4)
+            return i;
+    }
+    return count;
+}
+
+
+string to_shortest_string(const double value)
+{
+#if defined(__cpp_lib_to_chars)
+    char buffer[32];
+    to_chars_result result = to_chars(buffer, buffer + sizeof(buffer), value);
+    return string(buffer, result.ptr);
+#else
+    // MSVC before 2019 and older libraries do not convert floating point values by to_chars
+    if (std::isnan(value))
+        return "nan";
+    if (std::isinf(value))
+        return value < 0 ? "-inf" : "inf";
+    string s;
+    for (int precision = 1; precision <= 17; precision++)
+    {
+        ostringstream os;
+        os.imbue(std::locale::classic());
+        os << setprecision(precision) << value;
+        s = os.str();
+        istringstream is(s);
+        is.imbue(std::locale::classic());
+        double parsed;
+        if (is >> parsed && parsed == value)
+            break;
+    }
+    return s;
+#endif
+}
 
 string to_string(const wstring& ws)
 {
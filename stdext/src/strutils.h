@@ -48,6 +48,13 @@ std::wstring quoted(const std::wstring& s);
 std::string double_quoted(const std::string& s);
 std::wstring double_quoted(const std::wstring& s);
 
+// Position of the first of 4 characters in s or count when not found, uses SSE2 where available
+std::size_t find_first_of(const wchar_t* s, const std::size_t count, const wchar_t c1, const wchar_t c2, const wchar_t c3, const wchar_t c4) noexcept;
+
+// Shortest text which is read back to the same value regardless of the current locale,
+// uses floating point std::to_chars where the standard library provides it
+std::string to_shortest_string(const double value);
+
 std::string to_string(const std::wstring& ws);
 std::wstring to_wstring(const std::string& s);
 
@@ -49,6 +49,10 @@ rnd_helper::rnd_helper()
     m_engine = std::move(rnd_engine);
 }
 
+rnd_helper::rnd_helper(const unsigned int seed)
+    : m_engine(seed)
+{ }
+
 int rnd_helper::random_range(int from, int to) // [from, to]
 {
     std::uniform_int_distribution<int> dist(from, to);
@@ -64,9 +68,8 @@ int64_t rnd_helper::random_range64(int64_t from, int64_t to)
 
 double rnd_helper::random_float() // [0, 1)
 {
-    std::mt19937 gen(m_device());
     std::uniform_real_distribution<double> dist(0, 1);
-    return dist(gen);
+    return dist(m_engine);
 }
 
 std::string rnd_helper::random_string(const int avg_length)
@@ -46,7 +46,9 @@ namespace stdext::testutils
     {
     public:
         rnd_helper();
+        explicit rnd_helper(const unsigned int seed);
     public:
+        void seed(const unsigned int value) { m_engine.seed(value); }
         int random_range(int from, int to); // [from, to]
         int64_t random_range64(int64_t from, int64_t to); // [from, to]
         double random_float(); // [0, 1)
@@ -27,10 +27,13 @@ SOURCES += \
     src/csvtools.cpp \
     src/datetime.cpp \
     src/ioutils.cpp \
+    src/json/jsonbinding.cpp \
+    src/json/jsoncbor.cpp \
     src/json/jsoncommon.cpp \
     src/json/jsondom.cpp \
     src/json/jsonlexer.cpp \
     src/json/jsonparser.cpp \
+    src/json/jsonsnapshot.cpp \
     src/json/jsontools.cpp \
     src/locutils.cpp \
     src/parsers.cpp \
@@ -43,11 +46,14 @@ HEADERS += \
     src/datetime.h \
     src/ioutils.h \
     src/json/json.h \
+    src/json/jsonbinding.h \
+    src/json/jsoncbor.h \
     src/json/jsoncommon.h \
     src/json/jsondom.h \
     src/json/jsonexceptions.h \
     src/json/jsonlexer.h \
     src/json/jsonparser.h \
+    src/json/jsonsnapshot.h \
     src/json/jsontools.h \
     src/locutils.h \
     src/parsers.h \